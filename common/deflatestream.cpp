@@ -0,0 +1,152 @@
+#include "deflatestream.h"
+#include <QtEndian>
+#include <QDebug>
+
+// Отрицательный windowBits - raw deflate: нет заголовка и контрольной суммы,
+// поэтому читать поток можно начинать с любой точки сброса словаря
+static const int RawWindowBits = -15;
+static const int ChunkSize = 16 * 1024;
+
+DeflateStream::DeflateStream()
+{
+    m_stream.zalloc = Z_NULL;
+    m_stream.zfree = Z_NULL;
+    m_stream.opaque = Z_NULL;
+    if (deflateInit2(&m_stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, RawWindowBits,
+                     8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        qDebug() << "deflateInit2 failed";
+        m_failed = true;
+    }
+}
+
+DeflateStream::~DeflateStream()
+{
+    if (!m_failed) {
+        deflateEnd(&m_stream);
+    }
+}
+
+QByteArray DeflateStream::compress(const QByteArray &data)
+{
+    QByteArray out;
+    run(data, Z_SYNC_FLUSH, out);
+    return out;
+}
+
+void DeflateStream::compress(const QByteArray &data, QByteArray &out)
+{
+    run(data, Z_SYNC_FLUSH, out);
+}
+
+QByteArray DeflateStream::resetPoint()
+{
+    QByteArray out;
+    run(QByteArray(), Z_FULL_FLUSH, out);
+    return out;
+}
+
+void DeflateStream::run(const QByteArray &data, int flush, QByteArray &out)
+{
+    if (m_failed) return;
+    const int start = out.size();
+
+    m_stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.constData()));
+    m_stream.avail_in = static_cast<uInt>(data.size());
+
+    // При flush deflate() дописывает вывод, пока не останется свободное место
+    do {
+        const int used = out.size();
+        out.resize(used + ChunkSize);
+        m_stream.next_out = reinterpret_cast<Bytef *>(out.data() + used);
+        m_stream.avail_out = ChunkSize;
+
+        if (deflate(&m_stream, flush) == Z_STREAM_ERROR) {
+            qDebug() << "deflate failed";
+            m_failed = true;
+            out.resize(start);
+            return;
+        }
+        out.resize(used + ChunkSize - static_cast<int>(m_stream.avail_out));
+    } while (m_stream.avail_out == 0);
+}
+
+InflateStream::InflateStream()
+{
+    m_stream.zalloc = Z_NULL;
+    m_stream.zfree = Z_NULL;
+    m_stream.opaque = Z_NULL;
+    m_stream.next_in = Z_NULL;
+    m_stream.avail_in = 0;
+    if (inflateInit2(&m_stream, RawWindowBits) != Z_OK) {
+        qDebug() << "inflateInit2 failed";
+        m_failed = true;
+    }
+}
+
+InflateStream::~InflateStream()
+{
+    if (!m_failed) {
+        inflateEnd(&m_stream);
+    }
+}
+
+bool InflateStream::decompress(const QByteArray &data, QByteArray &out, int maxOutput)
+{
+    if (m_failed) return false;
+
+    m_stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.constData()));
+    m_stream.avail_in = static_cast<uInt>(data.size());
+
+    // Заполненный до конца буфер значит, что у zlib может остаться вывод
+    m_stream.avail_out = 0;
+    while (m_stream.avail_in > 0 || m_stream.avail_out == 0) {
+        if (maxOutput >= 0 && out.size() > maxOutput) {
+            inflateEnd(&m_stream);
+            m_failed = true;
+            return false;
+        }
+        const int used = out.size();
+        out.resize(used + ChunkSize);
+        m_stream.next_out = reinterpret_cast<Bytef *>(out.data() + used);
+        m_stream.avail_out = ChunkSize;
+
+        const int result = inflate(&m_stream, Z_SYNC_FLUSH);
+        out.resize(used + ChunkSize - static_cast<int>(m_stream.avail_out));
+
+        if (result != Z_OK && result != Z_BUF_ERROR) {
+            qDebug() << "inflate failed:" << result;
+            inflateEnd(&m_stream);
+            m_failed = true;
+            return false;
+        }
+        if (result == Z_BUF_ERROR && m_stream.avail_out != 0) break; // вход исчерпан
+    }
+    return true;
+}
+
+QByteArray StreamFrame::encode(Channel channel, const QByteArray &payload)
+{
+    QByteArray frame(HeaderSize, Qt::Uninitialized);
+    writeHeader(channel, payload.size(), frame.data());
+    frame.append(payload);
+    return frame;
+}
+
+void StreamFrame::writeHeader(Channel channel, int payloadSize, char *out)
+{
+    out[0] = static_cast<char>(channel);
+    qToBigEndian<quint32>(static_cast<quint32>(payloadSize), out + 1);
+}
+
+bool StreamFrame::decode(QByteArray &buffer, Channel &channel, QByteArray &payload)
+{
+    if (buffer.size() < HeaderSize) return false;
+
+    const quint32 length = qFromBigEndian<quint32>(buffer.constData() + 1);
+    if (static_cast<quint32>(buffer.size() - HeaderSize) < length) return false;
+
+    channel = static_cast<Channel>(static_cast<quint8>(buffer.at(0)));
+    payload = buffer.mid(HeaderSize, static_cast<int>(length));
+    buffer.remove(0, HeaderSize + static_cast<int>(length));
+    return true;
+}
@@ -0,0 +1,74 @@
+#ifndef DEFLATESTREAM_H
+#define DEFLATESTREAM_H
+
+#include <QByteArray>
+#include <zlib.h>
+
+// Потоковое сжатие raw deflate (без заголовка zlib) с общим словарем на все
+// соединение: повторяющиеся ключи JSON, цвета и толщины линий сжимаются
+// относительно предыдущих сообщений, а не каждого по отдельности.
+class DeflateStream
+{
+public:
+    DeflateStream();
+    ~DeflateStream();
+
+    // Сжимает data и выравнивает вывод по границе блока (Z_SYNC_FLUSH):
+    // получатель может сразу распаковать все, что было передано
+    QByteArray compress(const QByteArray &data);
+    // То же, но дописывает вывод в конец out: буфер вызывающего переиспользуется
+    void compress(const QByteArray &data, QByteArray &out);
+    // Сбрасывает словарь (Z_FULL_FLUSH). Новый распаковщик может начать
+    // читать поток с данных, сжатых после этой точки
+    QByteArray resetPoint();
+
+    bool failed() const { return m_failed; }
+
+private:
+    void run(const QByteArray &data, int flush, QByteArray &out);
+
+    z_stream m_stream;
+    bool m_failed = false;
+
+    DeflateStream(const DeflateStream &) = delete;
+    DeflateStream &operator=(const DeflateStream &) = delete;
+};
+
+class InflateStream
+{
+public:
+    InflateStream();
+    ~InflateStream();
+
+    // Распаковывает очередной кусок потока; false - поток поврежден или
+    // out вырос больше maxOutput (-1 - без ограничения): маленький сжатый
+    // кусок не должен раздуться в гигабайты
+    bool decompress(const QByteArray &data, QByteArray &out, int maxOutput = -1);
+
+    bool failed() const { return m_failed; }
+
+private:
+    z_stream m_stream;
+    bool m_failed = false;
+
+    InflateStream(const InflateStream &) = delete;
+    InflateStream &operator=(const InflateStream &) = delete;
+};
+
+// Кадры сжатого соединения сервер -> клиент: [канал][длина, 4 байта big-endian][данные].
+// Direct - личный поток клиента, Room - общий поток комнаты, сжатый один раз для всех.
+namespace StreamFrame {
+    enum Channel : quint8 {
+        Direct = 0,
+        Room = 1
+    };
+    const int HeaderSize = 5;
+
+    QByteArray encode(Channel channel, const QByteArray &payload);
+    // Заголовок кадра в out[0..HeaderSize), данные пишет вызывающий следом
+    void writeHeader(Channel channel, int payloadSize, char *out);
+    // Достает из начала buffer целый кадр; false - кадр еще не пришел целиком
+    bool decode(QByteArray &buffer, Channel &channel, QByteArray &payload);
+}
+
+#endif // DEFLATESTREAM_H
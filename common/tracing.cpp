@@ -0,0 +1,186 @@
+#include "tracing.h"
+#include <QCoreApplication>
+#include <QRandomGenerator>
+#include <QDebug>
+#include <chrono>
+#include <string.h>
+
+std::atomic<Tracing*> Tracing::s_instance{nullptr};
+
+Tracing::Zone::Zone(const char *name, const QString &arg) :
+    m_name(enabled() ? name : nullptr),
+    m_start(0)
+{
+    if (!m_name) return;
+    const int length = qMin(static_cast<int>(arg.size()), ArgSize - 1);
+    // Аргумент приходит и от клиентов: всё, что пришлось бы экранировать в JSON, заменяется на '?'
+    for (int i = 0; i < length; ++i) {
+        const ushort c = arg[i].unicode();
+        m_arg[i] = (c >= 32 && c < 128 && c != '"' && c != '\\') ? static_cast<char>(c) : '?';
+    }
+    m_arg[length] = '\0';
+    m_start = nowUs();
+}
+
+Tracing::Zone::Zone(const char *name, const char *arg) :
+    m_name(enabled() ? name : nullptr),
+    m_start(0)
+{
+    if (!m_name) return;
+    int length = 0;
+    for (; arg && arg[length] && length < ArgSize - 1; ++length) {
+        const uchar c = static_cast<uchar>(arg[length]);
+        m_arg[length] = (c >= 32 && c < 128 && c != '"' && c != '\\') ? static_cast<char>(c) : '?';
+    }
+    m_arg[length] = '\0';
+    m_start = nowUs();
+}
+
+Tracing::Zone::~Zone()
+{
+    if (!m_name) return;
+    Event event;
+    event.name = m_name;
+    event.phase = 'X';
+    event.ts = m_start;
+    event.duration = nowUs() - m_start;
+    event.id = 0;
+    event.thread = threadId();
+    memcpy(event.arg, m_arg, ArgSize);
+    record(event);
+}
+
+Tracing::Tracing()
+{
+    m_pid = QCoreApplication::applicationPid();
+    m_flowBase = static_cast<quint64>(QRandomGenerator::global()->generate()) << 32;
+    m_pending.reserve(ReserveEvents);
+    m_writing.reserve(ReserveEvents);
+    // resize(0) сохраняет емкость QByteArray только после reserve()
+    m_out.reserve(ReserveEvents * 128);
+}
+
+Tracing::~Tracing()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_stopping = true;
+        m_wake.wakeAll();
+    }
+    wait();
+}
+
+bool Tracing::start(const QString &path, const QString &processName)
+{
+    if (enabled()) return true;
+
+    Tracing *tracing = new Tracing;
+    tracing->m_file.setFileName(path);
+    if (!tracing->m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qDebug() << "Tracing: cannot open" << path;
+        delete tracing;
+        return false;
+    }
+    // Закрывающая скобка не обязательна: просмотрщики читают и оборванный массив
+    const QString metadata = QString("[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%1,\"args\":{\"name\":\"%2\"}},\n")
+            .arg(tracing->m_pid).arg(processName);
+    tracing->m_file.write(metadata.toUtf8());
+
+    tracing->QThread::start(QThread::LowPriority);
+    s_instance.store(tracing, std::memory_order_release);
+    qDebug() << "Tracing to" << path;
+    return true;
+}
+
+void Tracing::stop()
+{
+    // Останавливать из потока, который пишет зоны: другие потоки в этот момент не трассируются
+    Tracing *tracing = s_instance.exchange(nullptr);
+    delete tracing;
+}
+
+quint64 Tracing::newFlowId()
+{
+    Tracing *tracing = s_instance.load(std::memory_order_acquire);
+    if (!tracing) return 0;
+    return tracing->m_flowBase | tracing->m_flowCounter.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Tracing::flow(const char *name, quint64 id, char phase)
+{
+    if (!enabled() || id == 0) return;
+    Event event;
+    event.name = name;
+    event.phase = phase;
+    event.ts = nowUs();
+    event.duration = 0;
+    event.id = id;
+    event.thread = threadId();
+    event.arg[0] = '\0';
+    record(event);
+}
+
+qint64 Tracing::nowUs()
+{
+    using namespace std::chrono;
+    return duration_cast<microseconds>(system_clock::now().time_since_epoch()).count();
+}
+
+quint32 Tracing::threadId()
+{
+    static std::atomic<quint32> next{1};
+    thread_local quint32 id = next.fetch_add(1, std::memory_order_relaxed);
+    return id;
+}
+
+void Tracing::record(const Event &event)
+{
+    Tracing *tracing = s_instance.load(std::memory_order_acquire);
+    if (!tracing) return;
+    QMutexLocker locker(&tracing->m_mutex);
+    tracing->m_pending.append(event);
+}
+
+void Tracing::run()
+{
+    QMutexLocker locker(&m_mutex);
+    forever {
+        const bool stopping = m_stopping;
+        if (!stopping) m_wake.wait(&m_mutex, FlushMs);
+        m_writing.swap(m_pending);
+        locker.unlock();
+        writeEvents(m_writing);
+        m_writing.resize(0);
+        locker.relock();
+        if (stopping || (m_stopping && m_pending.isEmpty())) break;
+    }
+    m_file.flush();
+}
+
+void Tracing::writeEvents(const QVector<Event> &events)
+{
+    QByteArray &out = m_out;
+    for (const Event &event : events) {
+        out += "{\"name\":\"";
+        out += event.name;
+        out += "\",\"ph\":\"";
+        out += event.phase;
+        out += "\",\"ts\":" + QByteArray::number(event.ts);
+        out += ",\"pid\":" + QByteArray::number(m_pid);
+        out += ",\"tid\":" + QByteArray::number(event.thread);
+        if (event.phase == 'X') {
+            out += ",\"dur\":" + QByteArray::number(event.duration);
+            if (event.arg[0]) {
+                out += ",\"args\":{\"type\":\"";
+                out += event.arg;
+                out += "\"}";
+            }
+        } else {
+            // Поток связи привязан к зоне, внутри которой возник
+            out += ",\"cat\":\"flow\",\"id\":\"0x" + QByteArray::number(event.id, 16) + "\",\"bp\":\"e\"";
+        }
+        out += "},\n";
+    }
+    if (!out.isEmpty()) m_file.write(out);
+    out.resize(0);
+}
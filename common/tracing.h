@@ -0,0 +1,91 @@
+#ifndef TRACING_H
+#define TRACING_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QVector>
+#include <QFile>
+#include <QString>
+#include <atomic>
+
+// Трассировка горячих путей клиента и сервера в формате Chrome trace JSON
+// (открывается в chrome://tracing и ui.perfetto.dev). Включается явно; пока
+// выключена, зона стоит одну атомарную загрузку.
+// События копятся в памяти и пишутся в файл фоновым потоком. Время - микросекунды
+// системных часов, поэтому файлы процессов одной машины можно открыть вместе
+// (склеив массивы), а flow-события с одним id свяжут штрих от mouseMoveEvent
+// художника через сервер до перерисовки у угадывающего.
+class Tracing : public QThread
+{
+    Q_OBJECT
+public:
+    static const int ArgSize = 24;
+    static const int FlushMs = 100;
+    // Столько событий помещается в буферы без перевыделения
+    static const int ReserveEvents = 4096;
+
+    // Зона: событие "X" с длительностью от конструктора до деструктора
+    class Zone
+    {
+    public:
+        explicit Zone(const char *name, const QString &arg = QString());
+        // Без временной QString: для аргументов-литералов вроде имени инструмента
+        Zone(const char *name, const char *arg);
+        ~Zone();
+
+    private:
+        const char *m_name;     // nullptr - трассировка выключена
+        qint64 m_start;
+        char m_arg[ArgSize];
+    };
+
+    // processName - подпись процесса в просмотрщике
+    static bool start(const QString &path, const QString &processName);
+    static void stop();
+    static bool enabled() { return s_instance.load(std::memory_order_relaxed) != nullptr; }
+
+    // Уникален между процессами: случайная старшая половина и счетчик
+    static quint64 newFlowId();
+    // phase: 's' - начало, 't' - шаг, 'f' - конец; привязывается к текущей зоне
+    static void flow(const char *name, quint64 id, char phase);
+
+protected:
+    void run() override;
+
+private:
+    struct Event {
+        const char *name;       // только строковые литералы
+        char phase;
+        qint64 ts;
+        qint64 duration;
+        quint64 id;
+        quint32 thread;
+        char arg[ArgSize];
+    };
+
+    Tracing();
+    ~Tracing() override;
+
+    static qint64 nowUs();
+    static quint32 threadId();
+    static void record(const Event &event);
+    void writeEvents(const QVector<Event> &events);
+
+    static std::atomic<Tracing*> s_instance;
+
+    QFile m_file;
+    qint64 m_pid = 0;
+    quint64 m_flowBase = 0;
+    std::atomic<quint32> m_flowCounter{0};
+
+    QMutex m_mutex;
+    QWaitCondition m_wake;
+    // Двойной буфер: run() меняет их местами под мьютексом, емкость обоих сохраняется
+    QVector<Event> m_pending;
+    QVector<Event> m_writing;
+    QByteArray m_out;
+    bool m_stopping = false;
+};
+
+#endif // TRACING_H
@@ -5,14 +5,31 @@
 #include <QPointF>
 #include <QColor>
 #include <QImage>
+#include "layeredcanvas.h"
 #include "doodlearea.h"
 #include <QPainter>
 #include <QUndoCommand>
 
-class DrawLineCommand : public QUndoCommand {
+// Команда, хранящая холст до и после действия. Снимки делят неизмененные
+// плитки с холстом, поэтому их память считается по плиткам (DoodleArea::undoMemoryUsage)
+class SnapshotCommand : public QUndoCommand {
 public:
-    DrawLineCommand(DoodleArea *doodleArea, const QPoint &lastPoint, const QPoint &endPoint, DoodleArea::ShapeType tool, const QColor &penColor, int penWidth, const QImage& oldImage, const QImage& newImage)
-        : doodleArea(doodleArea), lastPoint(lastPoint), endPoint(endPoint), tool(tool), penColor(penColor), penWidth(penWidth), oldImage(oldImage), newImage(newImage) {
+    SnapshotCommand(const LayeredCanvas::Snapshot& oldImage, const LayeredCanvas::Snapshot& newImage)
+        : oldImage(oldImage), newImage(newImage) {}
+
+    qint64 memoryUsage(QSet<const uchar*> &seen) const {
+        return oldImage.memoryUsage(seen) + newImage.memoryUsage(seen);
+    }
+
+protected:
+    LayeredCanvas::Snapshot oldImage;
+    LayeredCanvas::Snapshot newImage;
+};
+
+class DrawLineCommand : public SnapshotCommand {
+public:
+    DrawLineCommand(DoodleArea *doodleArea, const QPoint &lastPoint, const QPoint &endPoint, DoodleArea::ShapeType tool, const QColor &penColor, int penWidth, const LayeredCanvas::Snapshot& oldImage, const LayeredCanvas::Snapshot& newImage)
+        : SnapshotCommand(oldImage, newImage), doodleArea(doodleArea), lastPoint(lastPoint), endPoint(endPoint), tool(tool), penColor(penColor), penWidth(penWidth) {
         setText(QObject::tr("Draw Line")); // User-friendly name in Undo/Redo menu
     }
 
@@ -33,15 +50,13 @@ private:
     DoodleArea::ShapeType tool;
     QColor penColor;
     int penWidth;
-    QImage oldImage;
-    QImage newImage;
 };
 
 // Command to fill an area
-class FillAreaCommand : public QUndoCommand {
+class FillAreaCommand : public SnapshotCommand {
 public:
-    FillAreaCommand(DoodleArea *doodleArea, const QPoint &seedPoint, const QColor &penColor, const QImage& oldImage, const QImage& newImage)
-        : doodleArea(doodleArea), seedPoint(seedPoint), penColor(penColor), oldImage(oldImage), newImage(newImage) {
+    FillAreaCommand(DoodleArea *doodleArea, const QPoint &seedPoint, const QColor &penColor, const LayeredCanvas::Snapshot& oldImage, const LayeredCanvas::Snapshot& newImage)
+        : SnapshotCommand(oldImage, newImage), doodleArea(doodleArea), seedPoint(seedPoint), penColor(penColor) {
         setText(QObject::tr("Fill Area"));
     }
 
@@ -59,15 +74,13 @@ private:
     DoodleArea *doodleArea;
     QPoint seedPoint;
     QColor penColor;
-    QImage oldImage;
-    QImage newImage;
 };
 
 // Command to draw a shape (Line, Rectangle, Ellipse)
-class DrawShapeCommand : public QUndoCommand {
+class DrawShapeCommand : public SnapshotCommand {
 public:
-    DrawShapeCommand(DoodleArea *doodleArea, const QPoint &lastPoint, const QPoint &endPoint, DoodleArea::ShapeType tool, const QColor &penColor, int penWidth, const QImage& oldImage, const QImage& newImage)
-        : doodleArea(doodleArea), lastPoint(lastPoint), endPoint(endPoint), tool(tool), penColor(penColor), penWidth(penWidth), oldImage(oldImage), newImage(newImage) {
+    DrawShapeCommand(DoodleArea *doodleArea, const QPoint &lastPoint, const QPoint &endPoint, DoodleArea::ShapeType tool, const QColor &penColor, int penWidth, const LayeredCanvas::Snapshot& oldImage, const LayeredCanvas::Snapshot& newImage)
+        : SnapshotCommand(oldImage, newImage), doodleArea(doodleArea), lastPoint(lastPoint), endPoint(endPoint), tool(tool), penColor(penColor), penWidth(penWidth) {
         setText(QObject::tr("Draw Shape"));
     }
 
@@ -88,8 +101,6 @@ private:
     DoodleArea::ShapeType tool;
     QColor penColor;
     int penWidth;
-    QImage oldImage;
-    QImage newImage;
 };
 
 #endif // COMMAND_H
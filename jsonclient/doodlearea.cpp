@@ -1,15 +1,20 @@
 #include <QtWidgets>
+#include <cmath>
+#include <functional>
 #include "doodlearea.h"
 #include "command.h"
+#include "tracing.h"
+#include "perfstats.h"
+#include "jsoncodec.h"
 
 DoodleArea::DoodleArea(QWidget *parent) : QWidget(parent) {
-    setAttribute(Qt::WA_StaticContents);
     doodling = false;
     myPenWidth = 1;
     myPenColor = Qt::blue;
     currentTool = Pencil;
     undoStack = new QUndoStack(this);
     setMouseTracking(true);
+    grabGesture(Qt::PinchGesture);
     textInputStartPoint = QPoint(0, 0);
     textFont = QFont("Arial", 12);
     textColor = Qt::black;
@@ -22,16 +27,15 @@ DoodleArea::DoodleArea(QWidget *parent) : QWidget(parent) {
 }
 
 DoodleArea::DoodleArea(const QSize& size, QWidget *parent) : QWidget(parent) {
-    setAttribute(Qt::WA_StaticContents);
     doodling = false;
     myPenWidth = 1;
     myPenColor = Qt::blue;
     currentTool = Pencil;
     undoStack = new QUndoStack(this);
     setMouseTracking(true);
+    grabGesture(Qt::PinchGesture);
 
-    image = QImage(size, QImage::Format_ARGB32_Premultiplied);
-    image.fill(Qt::white);
+    canvas = LayeredCanvas(size, Qt::white);
     setFixedSize(size);
     textInputStartPoint = QPoint(0, 0);
     textFont = QFont("Arial", 12);
@@ -46,10 +50,60 @@ DoodleArea::DoodleArea(const QSize& size, QWidget *parent) : QWidget(parent) {
 }
 
 void DoodleArea::setScaleFactor(double scaleFactor) {
-    m_scaleFactor = scaleFactor;
+    zoomAt(QPointF(width() / 2.0, height() / 2.0), scaleFactor / m_scaleFactor);
+}
+
+void DoodleArea::zoomAt(const QPointF &widgetPos, double factor) {
+    const double newScale = qBound(MinScaleFactor, m_scaleFactor * factor, MaxScaleFactor);
+    if (qFuzzyCompare(newScale, m_scaleFactor)) return;
+
+    // Точка холста под курсором остается на месте
+    const QPointF canvasPos = (widgetPos - QPointF(m_offset)) / m_scaleFactor;
+    m_scaleFactor = newScale;
+    m_offset = (widgetPos - canvasPos * m_scaleFactor).toPoint();
     update();
 }
 
+QPoint DoodleArea::mapToCanvas(const QPoint &widgetPos) const {
+    return (QPointF(widgetPos - m_offset) / m_scaleFactor).toPoint();
+}
+
+QRect DoodleArea::mapFromCanvas(const QRect &canvasRect) const {
+    return QRectF(QPointF(canvasRect.topLeft()) * m_scaleFactor + QPointF(m_offset),
+                  QSizeF(canvasRect.size()) * m_scaleFactor).toAlignedRect();
+}
+
+void DoodleArea::updateCanvasRect(const QRect &canvasRect) {
+    // +1 пиксель на округление при дробном масштабе
+    update(mapFromCanvas(canvasRect).adjusted(-1, -1, 1, 1));
+}
+
+void DoodleArea::wheelEvent(QWheelEvent *event) {
+    // Один щелчок колеса (120) - примерно 20% масштаба
+    const double factor = std::pow(1.2, event->angleDelta().y() / 120.0);
+    zoomAt(event->position(), factor);
+    event->accept();
+}
+
+bool DoodleArea::event(QEvent *event) {
+    if (event->type() == QEvent::Gesture) {
+        QGestureEvent *gestureEvent = static_cast<QGestureEvent *>(event);
+        if (QGesture *gesture = gestureEvent->gesture(Qt::PinchGesture)) {
+            QPinchGesture *pinch = static_cast<QPinchGesture *>(gesture);
+            if (pinch->changeFlags() & QPinchGesture::CenterPointChanged) {
+                m_offset += (pinch->centerPoint() - pinch->lastCenterPoint()).toPoint();
+            }
+            if (pinch->changeFlags() & QPinchGesture::ScaleFactorChanged) {
+                zoomAt(mapFromGlobal(pinch->centerPoint().toPoint()), pinch->scaleFactor());
+            }
+            update();
+            gestureEvent->accept(gesture);
+            return true;
+        }
+    }
+    return QWidget::event(event);
+}
+
 bool DoodleArea::ifModified(){
     return modified;
 }
@@ -59,16 +113,17 @@ bool DoodleArea::openImage(const QString &fileName){
     if(!loadedImage.load(fileName)){
         return false;
     }
-    QSize newSize = loadedImage.size().expandedTo(size());
-    setFixedSize(newSize);
-    image = loadedImage;
+    canvas.loadImage(loadedImage);
+    m_offset = QPoint(0, 0);
+    m_scaleFactor = qBound(MinScaleFactor, qMin(1.0, qMin(double(width()) / canvas.width(),
+                                                          double(height()) / canvas.height())), MaxScaleFactor);
     modified = false;
     update();
     return true;
 }
 
 bool DoodleArea::saveImage(const QString &fileName, const char *fileFormat){
-    QImage visibleImage = image;
+    QImage visibleImage = canvas.toImage();
     resizeImage(&visibleImage, size());
     if(visibleImage.save(fileName, fileFormat)){
         modified = false;
@@ -87,7 +142,7 @@ void DoodleArea::setPenWidth(int newWidth){
 }
 
 void DoodleArea::clearImage(){
-    image.fill(QColor(255,255,255));
+    canvas.clear();
     modified = true;
     update();
 }
@@ -160,49 +215,50 @@ void DoodleArea::clearImage(){
 
 
 void DoodleArea::mousePressEvent(QMouseEvent *event) {
+    if (event->button() == Qt::MiddleButton) {
+        // Средняя кнопка двигает видимую область холста
+        panning = true;
+        m_lastMousePosition = event->pos();
+        setCursor(Qt::ClosedHandCursor);
+        return;
+    }
+
     if(event->button() == Qt::LeftButton) {
-        lastPoint = event->pos();
+        const QPoint pos = mapToCanvas(event->pos());
+        lastPoint = pos;
         doodling = true;
-        oldImage = image.copy(); // Сохраняем состояние для Undo
+        oldImage = canvas.snapshot(); // Сохраняем состояние для Undo (копируются только ссылки на плитки)
+        strokeRect = QRect();
 
         switch(currentTool) {
         case Fill: {
-            fillArea(event->pos(), myPenColor);
+            fillArea(pos, myPenColor);
 
             DrawShapeCommand *fillCommand = new DrawShapeCommand(
                 this,
-                event->pos(),
-                event->pos(),
+                pos,
+                pos,
                 currentTool,
                 myPenColor,
                 myPenWidth,
                 oldImage,
-                image.copy()
+                canvas.snapshot()
                 );
             undoStack->push(fillCommand);
 
-            QJsonObject cmd;
-            cmd["type"] = "draw";
-            cmd["tool"] = "fill";
-            cmd["action"] = "draw";
-            cmd["x"] = event->pos().x();
-            cmd["y"] = event->pos().y();
-            cmd["color"] = myPenColor.name();
-            emit drawingCommandGenerated(cmd);
+            Protocol::DrawCommand cmd = drawCommand(Protocol::DrawAction::Draw);
+            cmd.x1 = pos.x();
+            cmd.y1 = pos.y();
+            emit drawingCommandGenerated(Protocol::Json::encode(cmd));
             break;
         }
 
         case Pencil:
         case Rubber: {
-            QJsonObject cmd;
-            cmd["type"] = "draw";
-            cmd["tool"] = (currentTool == Pencil) ? "pencil" : "rubber";
-            cmd["action"] = "start";
-            cmd["x"] = event->pos().x();
-            cmd["y"] = event->pos().y();
-            cmd["color"] = (currentTool == Pencil) ? myPenColor.name() : "#FFFFFF";
-            cmd["width"] = myPenWidth;
-            emit drawingCommandGenerated(cmd);
+            Protocol::DrawCommand cmd = drawCommand(Protocol::DrawAction::Start);
+            cmd.x1 = pos.x();
+            cmd.y1 = pos.y();
+            emit drawingCommandGenerated(Protocol::Json::encode(cmd));
             break;
         }
 
@@ -214,8 +270,8 @@ void DoodleArea::mousePressEvent(QMouseEvent *event) {
             cmd["tool"] = (currentTool == Line) ? "line" :
                               (currentTool == Rectangle) ? "rectangle" : "ellipse";
             cmd["action"] = "start";
-            cmd["x1"] = event->pos().x();
-            cmd["y1"] = event->pos().y();
+            cmd["x1"] = pos.x();
+            cmd["y1"] = pos.y();
             cmd["color"] = myPenColor.name();
             cmd["width"] = myPenWidth;
             emit drawingCommandGenerated(cmd); */
@@ -226,11 +282,11 @@ void DoodleArea::mousePressEvent(QMouseEvent *event) {
             if (isTextInputActive) {
                 finishTextInput();
             }
-            textInputStartPoint = event->pos();
+            textInputStartPoint = pos;
             isTextInputActive = true;
 
             textInput = new QLineEdit(this);
-            textInput->move(textInputStartPoint);
+            textInput->move(mapFromCanvas(QRect(textInputStartPoint, QSize(1, 1))).topLeft());
             textInput->setFont(textFont);
             textInput->setStyleSheet("QLineEdit { background-color: white; color: black; border: 1px solid black; }");
             textInput->show();
@@ -254,11 +310,13 @@ void DoodleArea::finishTextInput() {
     if (textInput) {
         QString text = textInput->text();
 
-        QPainter painter(&image);
-        painter.setFont(textFont);
-        painter.setPen(textColor);
-        painter.drawText(textInputStartPoint, text);
-        painter.end();
+        const QRect textRect = QFontMetrics(textFont).boundingRect(text)
+                                   .translated(textInputStartPoint).adjusted(-2, -2, 2, 2);
+        canvas.paint(LayeredCanvas::Text, textRect, [&](QPainter &painter) {
+            painter.setFont(textFont);
+            painter.setPen(textColor);
+            painter.drawText(textInputStartPoint, text);
+        });
 
         textInput->deleteLater();
         textInput = nullptr;
@@ -293,9 +351,17 @@ void DoodleArea::finishTextInput() {
     }
 }*/
 void DoodleArea::mouseMoveEvent(QMouseEvent *event) {
+    if (panning) {
+        m_offset += event->pos() - m_lastMousePosition;
+        m_lastMousePosition = event->pos();
+        update();
+        return;
+    }
+
     if (!doodling) return;
+    Tracing::Zone zone("mouseMoveEvent");
 
-    QPoint endPoint = event->pos();
+    QPoint endPoint = mapToCanvas(event->pos());
 
     switch(currentTool) {
     case Pencil:
@@ -304,17 +370,16 @@ void DoodleArea::mouseMoveEvent(QMouseEvent *event) {
         QPoint p1_for_send = lastPoint; // Сохраняем current lastPoint для отправки
         drawLineTo(endPoint); // drawLineTo обновит lastPoint до endPoint
 
-        QJsonObject cmd;
-        cmd["type"] = "draw";
-        cmd["tool"] = (currentTool == Pencil) ? "pencil" : "rubber";
-        cmd["action"] = "move";
-        cmd["x1"] = p1_for_send.x(); // Используем сохраненную lastPoint
-        cmd["y1"] = p1_for_send.y();
-        cmd["x2"] = endPoint.x();
-        cmd["y2"] = endPoint.y();
-        cmd["color"] = (currentTool == Pencil) ? myPenColor.name() : "#FFFFFF";
-        cmd["width"] = myPenWidth;
-        emit drawingCommandGenerated(cmd);
+        Protocol::DrawCommand cmd = drawCommand(Protocol::DrawAction::Move);
+        cmd.x1 = p1_for_send.x(); // Используем сохраненную lastPoint
+        cmd.y1 = p1_for_send.y();
+        cmd.x2 = endPoint.x();
+        cmd.y2 = endPoint.y();
+        if (Tracing::enabled()) {
+            cmd.trace = Tracing::newFlowId();
+            Tracing::flow("stroke", cmd.trace, 's');
+        }
+        emit drawingCommandGenerated(Protocol::Json::encode(cmd));
 
         // lastPoint обновляется после отправки, для следующего mouseMoveEvent
 
@@ -325,10 +390,12 @@ void DoodleArea::mouseMoveEvent(QMouseEvent *event) {
     case Rectangle:
     case Ellipse: {
         // Локальный предварительный просмотр фигур на tempImage
-        tempImage = image.copy(); // Копируем основное изображение
-        drawShape(endPoint, &tempImage); // Рисуем фигуру на временной копии
+        // Предпросмотр живет на отдельном слое: стираем прошлую фигуру и рисуем новую
+        const QRect oldPreview = previewRect;
+        canvas.discard(LayeredCanvas::Preview, previewRect);
+        drawShape(endPoint, LayeredCanvas::Preview);
 
-        update(); // Обновляем виджет, чтобы показать tempImage
+        updateCanvasRect(oldPreview | previewRect); // Перерисовываем только старую и новую рамку фигуры
         break;
     }
 
@@ -360,8 +427,14 @@ void DoodleArea::mouseMoveEvent(QMouseEvent *event) {
 // doodlearea.cpp
 
 void DoodleArea::mouseReleaseEvent(QMouseEvent *event) {
+    if (event->button() == Qt::MiddleButton && panning) {
+        panning = false;
+        unsetCursor();
+        return;
+    }
+
     if (event->button() == Qt::LeftButton && doodling) {
-        QPoint endPoint = event->pos();
+        QPoint endPoint = mapToCanvas(event->pos());
         // oldImage уже сохранена в mousePressEvent
 
         switch(currentTool) {
@@ -369,18 +442,14 @@ void DoodleArea::mouseReleaseEvent(QMouseEvent *event) {
         case Rubber: {
             drawLineTo(endPoint); // Рисуем последний сегмент на основной image
 
-            QJsonObject releaseCmd;
-            releaseCmd["type"] = "draw";
-            releaseCmd["tool"] = (currentTool == Pencil) ? "pencil" : "rubber";
-            releaseCmd["action"] = "release"; // Сигнал о завершении штриха
+            // Сигнал о завершении штриха
+            Protocol::DrawCommand releaseCmd = drawCommand(Protocol::DrawAction::Release);
             // Можно добавить последние точки для надежности, если "move" команды не доходят
-            releaseCmd["x1"] = lastPoint.x(); // Отправляем последнюю связку точек на всякий случай
-            releaseCmd["y1"] = lastPoint.y();
-            releaseCmd["x2"] = endPoint.x();
-            releaseCmd["y2"] = endPoint.y();
-            releaseCmd["color"] = (currentTool == Pencil) ? myPenColor.name() : "#FFFFFF";
-            releaseCmd["width"] = myPenWidth;
-            emit drawingCommandGenerated(releaseCmd);
+            releaseCmd.x1 = lastPoint.x(); // Отправляем последнюю связку точек на всякий случай
+            releaseCmd.y1 = lastPoint.y();
+            releaseCmd.x2 = endPoint.x();
+            releaseCmd.y2 = endPoint.y();
+            emit drawingCommandGenerated(Protocol::Json::encode(releaseCmd));
             break;
         }
 
@@ -388,21 +457,17 @@ void DoodleArea::mouseReleaseEvent(QMouseEvent *event) {
         case Rectangle:
         case Ellipse: {
             // Рисуем окончательную фигуру на основной image
-            drawShape(endPoint, &image);
+            canvas.discard(LayeredCanvas::Preview, previewRect);
+            drawShape(endPoint, LayeredCanvas::Strokes);
 
             // Отправляем окончательную команду для фигуры на сервер
-            QJsonObject cmd;
-            cmd["type"] = "draw";
-            cmd["tool"] = (currentTool == Line) ? "line" :
-                              (currentTool == Rectangle) ? "rectangle" : "ellipse";
-            cmd["action"] = "draw"; // Действие: окончательная отрисовка фигуры
-            cmd["x1"] = lastPoint.x(); // Начальная точка нажатия мыши
-            cmd["y1"] = lastPoint.y();
-            cmd["x2"] = endPoint.x(); // Конечная точка отпускания мыши
-            cmd["y2"] = endPoint.y();
-            cmd["color"] = myPenColor.name();
-            cmd["width"] = myPenWidth;
-            emit drawingCommandGenerated(cmd);
+            // Действие: окончательная отрисовка фигуры
+            Protocol::DrawCommand cmd = drawCommand(Protocol::DrawAction::Draw);
+            cmd.x1 = lastPoint.x(); // Начальная точка нажатия мыши
+            cmd.y1 = lastPoint.y();
+            cmd.x2 = endPoint.x(); // Конечная точка отпускания мыши
+            cmd.y2 = endPoint.y();
+            emit drawingCommandGenerated(Protocol::Json::encode(cmd));
             break;
         }
 
@@ -424,11 +489,11 @@ void DoodleArea::mouseReleaseEvent(QMouseEvent *event) {
         // Для Undo/Redo (этот блок должен быть общим для всех инструментов, кроме текста)
         DrawShapeCommand *command = new DrawShapeCommand(this, lastPoint, endPoint,
                                                          currentTool, myPenColor, myPenWidth,
-                                                         oldImage, image.copy());
+                                                         oldImage, canvas.snapshot());
         undoStack->push(command);
 
         doodling = false;
-        tempImage = QImage(); // Очищаем временное изображение
+        previewRect = QRect();
         update(); // Обновляем виджет, чтобы показать окончательный результат
     }
 }
@@ -447,19 +512,33 @@ void DoodleArea::redo() {
 }
 
 void DoodleArea::paintEvent(QPaintEvent *event) {
+    Tracing::Zone zone("paintEvent");
+    QElapsedTimer frameTimer;
+    frameTimer.start();
+    // Штрихи, дошедшие до экрана в этой перерисовке
+    for (quint64 flowId : qAsConst(m_pendingFlows)) {
+        Tracing::flow("stroke", flowId, 'f');
+    }
+    m_pendingFlows.clear();
+
     QPainter painter(this);
-    painter.setRenderHint(QPainter::Antialiasing, true); // Для более гладкой отрисовки
+    // Без сглаживания: при отдалении берется готовый уменьшенный уровень,
+    // а не масштабирование всего изображения на каждом кадре
+    painter.fillRect(event->rect(), palette().window().color());
 
     painter.save();
 
     painter.translate(m_offset);
     painter.scale(m_scaleFactor, m_scaleFactor);
 
-    if (doodling && currentTool != Pencil && currentTool != Rubber) {
-        painter.drawImage(0, 0, tempImage);
-    } else {
-        painter.drawImage(0, 0, image);
-    }
+    // Перерисовываем только плитки, попавшие в обновляемую область
+    const QRectF exposedF(QPointF(event->rect().topLeft() - m_offset) / m_scaleFactor,
+                          QSizeF(event->rect().size()) / m_scaleFactor);
+    const QRect exposed = exposedF.toAlignedRect().adjusted(-1, -1, 1, 1);
+
+    // Кэш итогового изображения пересобирается только в измененных плитках,
+    // а выводятся только видимые плитки нужного уровня детализации
+    canvas.draw(painter, exposed, m_scaleFactor);
 
     painter.restore();
 
@@ -467,44 +546,108 @@ void DoodleArea::paintEvent(QPaintEvent *event) {
     painter.setPen(framePen);
     painter.setBrush(Qt::NoBrush);
 
-    QRect imageRect(m_offset.x(), m_offset.y(), image.width() * m_scaleFactor, image.height() * m_scaleFactor);
+    QRect imageRect(m_offset.x(), m_offset.y(), canvas.width() * m_scaleFactor, canvas.height() * m_scaleFactor);
     painter.drawRect(imageRect);
+
+    // Время самого HUD в кадр не входит
+    if (m_stats) {
+        m_stats->recordPaint(frameTimer.nsecsElapsed() / 1000);
+        if (m_hudVisible) drawHud(painter);
+    }
 }
 
-void DoodleArea::resizeEvent(QResizeEvent *event) {
-    if (event->size().width() > image.width() || event->size().height() > image.height()) {
-        QImage newImage(event->size(), QImage::Format_ARGB32_Premultiplied);
-        newImage.fill(QColor(255,255,255));
+void DoodleArea::setPerfStats(PerfStats *stats) {
+    m_stats = stats;
+    connect(stats, &PerfStats::secondElapsed, this, [this]() {
+        if (!m_hudVisible) return;
+        samplePerfStats();
+        update(m_hudRect);
+    });
+}
 
-        QPainter painter(&newImage);
-        painter.drawImage(QPoint(0, 0), image);
-        image = newImage;
+void DoodleArea::samplePerfStats() {
+    if (m_stats) {
+        m_stats->setCanvasMemory(canvas.memoryUsage(), undoMemoryUsage());
+    }
+}
+
+void DoodleArea::toggleHud() {
+    m_hudVisible = !m_hudVisible;
+    if (m_hudVisible) samplePerfStats();
+    update(m_hudRect);
+}
+
+qint64 DoodleArea::undoMemoryUsage() const {
+    // Плитки, общие с текущим холстом, холсту и принадлежат
+    QSet<const uchar*> seen;
+    canvas.snapshot().memoryUsage(seen);
+    qint64 total = 0;
+    for (int i = 0; i < undoStack->count(); ++i) {
+        const SnapshotCommand *command = dynamic_cast<const SnapshotCommand*>(undoStack->command(i));
+        if (command) total += command->memoryUsage(seen);
+    }
+    return total;
+}
+
+void DoodleArea::drawHud(QPainter &painter) {
+    const QStringList lines = m_stats->hudLines();
+    const QFontMetrics metrics(painter.font());
+    int width = 0;
+    for (const QString &line : lines) {
+        width = qMax(width, metrics.horizontalAdvance(line));
+    }
+    const int padding = 6;
+    const QRect box(padding, padding, width + 2 * padding, lines.size() * metrics.height() + 2 * padding);
+    // Следующее обновление должно стереть и прошлый, возможно более широкий HUD
+    m_hudRect = box.united(m_hudRect);
+
+    painter.fillRect(box, QColor(0, 0, 0, 170));
+    painter.setPen(Qt::white);
+    int y = box.top() + padding + metrics.ascent();
+    for (const QString &line : lines) {
+        painter.drawText(box.left() + padding, y, line);
+        y += metrics.height();
+    }
+}
+
+void DoodleArea::resizeEvent(QResizeEvent *event) {
+    if (event->size().width() > canvas.width() || event->size().height() > canvas.height()) {
+        // Новые плитки ссылаются на общую плитку фона, старые не копируются
+        canvas.resize(canvas.size().expandedTo(event->size()));
     }
     QWidget::resizeEvent(event);
 }
 
 void DoodleArea::drawLineTo(const QPoint &endPoint){
+    Tracing::Zone zone("drawLineTo");
 
-    QPainter painter(&image);
-    if (currentTool == Pencil) {
-        painter.setPen(QPen(myPenColor, myPenWidth, Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin));
-    } else if (currentTool == Rubber) {
-        painter.setPen(QPen(QColor(255,255,255), myPenWidth, Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin));
-    }
-    painter.drawLine(lastPoint, endPoint);
+    const QPen pen(myPenColor, myPenWidth, Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin);
 
     int rad = (myPenWidth / 2) + 2;
-    update(QRect(lastPoint, endPoint).normalized().adjusted(-rad, -rad, +rad, +rad));
+    QRect dirty = QRect(lastPoint, endPoint).normalized().adjusted(-rad, -rad, +rad, +rad);
+    const QPoint from = lastPoint;
+    auto stroke = [&](QPainter &painter) {
+        painter.setPen(pen);
+        painter.drawLine(from, endPoint);
+    };
+    if (currentTool == Rubber) {
+        canvas.erase(LayeredCanvas::Strokes, dirty, stroke); // Ластик стирает до прозрачности
+    } else {
+        canvas.paint(LayeredCanvas::Strokes, dirty, stroke);
+    }
+    strokeRect |= dirty;
+
+    updateCanvasRect(dirty);
 
     lastPoint = endPoint;
 }
 
-QImage DoodleArea::getImage() const {
-    return image;
+LayeredCanvas::Snapshot DoodleArea::getImage() const {
+    return canvas.snapshot();
 }
 
-void DoodleArea::setImage(const QImage &newImage) {
-    image = newImage;
+void DoodleArea::setImage(const LayeredCanvas::Snapshot &newImage) {
+    canvas.restore(newImage);
 }
 
 void DoodleArea::resizeImage(QImage *image, const QSize &newSize){
@@ -520,8 +663,6 @@ void DoodleArea::resizeImage(QImage *image, const QSize &newSize){
 }
 
 void DoodleArea::resizeCanvas() {
-    QSize currentSize = image.size();
-
     QDialog dialog(this);
     dialog.setWindowTitle(tr("Новый размер изображения"));
 
@@ -552,21 +693,14 @@ void DoodleArea::resizeCanvas() {
         if (okWidth && okHeight) {
             QSize newSize(newWidth, newHeight);
 
-            QImage newImage(newSize, QImage::Format_ARGB32_Premultiplied);
-            newImage.fill(Qt::white);
-
-            QPainter painter(&newImage);
-
-            QRect copyRect(QPoint(0, 0), QSize(qMin(currentSize.width(), newWidth),
-                                               qMin(currentSize.height(), newHeight)));
-
-            painter.drawImage(QPoint(0, 0), image, copyRect);
-
-            image = newImage;
+            // Сохраненные плитки переиспользуются, новая область - общая плитка фона
+            canvas.resize(newSize);
 
 
+            // Размер виджета не меняется: большой холст смотрим через масштаб и сдвиг
+            m_offset = QPoint(0, 0);
+            m_scaleFactor = qBound(MinScaleFactor, qMin(1.0, qMin(double(width()) / newWidth, double(height()) / newHeight)), MaxScaleFactor);
             update();
-            setFixedSize(newSize);
             modified = true;
         } else {
             QMessageBox::warning(this, tr("Ошибка"), tr("Пожалуйста, введите корректные числа от 1 до 2000."));
@@ -576,49 +710,79 @@ void DoodleArea::resizeCanvas() {
 
 void DoodleArea::fillArea(const QPoint &startPoint, const QColor &fillColor)
 {
+    Tracing::Zone zone("fillArea");
 
 
-    if (!image.valid(startPoint) || image.pixelColor(startPoint) == fillColor) {
+    // Заливка работает по слою штрихов: прозрачные пиксели - это фон
+    TiledImage &image = canvas.layer(LayeredCanvas::Strokes);
+    const QRgb fillRgb = qPremultiply(fillColor.rgba());
+    if (!image.valid(startPoint) || image.pixel(startPoint) == fillRgb) {
         return; // Точка вне изображения или уже залита нужным цветом
     }
 
-    QColor targetColor = image.pixelColor(startPoint);
+    const QRgb targetRgb = image.pixel(startPoint);
     QVector<QPoint> stack;
     stack.push_back(startPoint);
+    QRect filled;
 
+    // Построчная заливка: setPixel отсоединяет только плитки, в которые попадает заливка
     while (!stack.isEmpty()) {
         QPoint p = stack.last();
         stack.pop_back();
 
-        if (image.valid(p) && image.pixelColor(p) == targetColor) {
-            image.setPixelColor(p, fillColor); // <-- Здесь используем fillColor
+        if (!image.valid(p) || image.pixel(p) != targetRgb) continue;
+
+        int left = p.x();
+        while (left > 0 && image.pixel(QPoint(left - 1, p.y())) == targetRgb) --left;
+        int right = p.x();
+        while (right < image.width() - 1 && image.pixel(QPoint(right + 1, p.y())) == targetRgb) ++right;
 
+        for (int x = left; x <= right; ++x) {
+            image.setPixel(QPoint(x, p.y()), fillRgb);
             // Добавляем соседние точки в стек
-            stack.push_back(QPoint(p.x() + 1, p.y()));
-            stack.push_back(QPoint(p.x() - 1, p.y()));
-            stack.push_back(QPoint(p.x(), p.y() + 1));
-            stack.push_back(QPoint(p.x(), p.y() - 1));
+            if (p.y() > 0 && image.pixel(QPoint(x, p.y() - 1)) == targetRgb) {
+                stack.push_back(QPoint(x, p.y() - 1));
+            }
+            if (p.y() < image.height() - 1 && image.pixel(QPoint(x, p.y() + 1)) == targetRgb) {
+                stack.push_back(QPoint(x, p.y() + 1));
+            }
         }
+        filled |= QRect(QPoint(left, p.y()), QPoint(right, p.y()));
     }
+    canvas.markDirty(filled);
     modified = true;
-    update();
+    updateCanvasRect(filled);
 }
 
-void DoodleArea::drawShape(const QPoint &endPoint, QImage *targetImage) {
-    QPainter painter(targetImage);
-    painter.setPen(QPen(myPenColor, myPenWidth, Qt::SolidLine));
+void DoodleArea::drawShape(const QPoint &endPoint, LayeredCanvas::Layer target) {
+    const QPen pen(myPenColor, myPenWidth, Qt::SolidLine);
+    const QRect shapeRect = QRect(lastPoint, endPoint).normalized();
+    const int rad = (myPenWidth / 2) + 2;
+    const QRect dirty = shapeRect.adjusted(-rad, -rad, +rad, +rad);
+    if (target == LayeredCanvas::Preview) {
+        previewRect = dirty;
+    }
 
     switch (currentTool) {
     case Line:
-        painter.drawLine(lastPoint, endPoint);
+        canvas.paint(target, dirty, [&](QPainter &painter) {
+            painter.setPen(pen);
+            painter.drawLine(lastPoint, endPoint);
+        });
         modified = true;
         break;
     case Rectangle:
-        painter.drawRect(QRect(lastPoint, endPoint).normalized());
+        canvas.paint(target, dirty, [&](QPainter &painter) {
+            painter.setPen(pen);
+            painter.drawRect(shapeRect);
+        });
         modified = true;
         break;
     case Ellipse:
-        painter.drawEllipse(QRect(lastPoint, endPoint).normalized());
+        canvas.paint(target, dirty, [&](QPainter &painter) {
+            painter.setPen(pen);
+            painter.drawEllipse(shapeRect);
+        });
         modified = true;
         break;
     default:
@@ -632,87 +796,129 @@ QUndoStack* DoodleArea::getUndoStack() const {
 //Работае Киря не прикосаться
 // Новая функция для применения удаленных команд
 void DoodleArea::applyRemoteCommand(const QJsonObject &command) {
+    Protocol::DrawCommand cmd;
+    if (!Protocol::Json::decode(command, cmd)) {
+        qDebug() << "Malformed draw command ignored:" << command;
+        return;
+    }
+    applyRemoteCommand(cmd);
+}
+
+void DoodleArea::applyRemoteCommand(const Protocol::DrawCommand &cmd) {
+    Tracing::Zone zone("applyRemoteCommand", Protocol::name(cmd.tool));
+    if (m_stats) m_stats->recordRemoteCommand();
+    if (Tracing::enabled() && cmd.trace) {
+        Tracing::flow("stroke", cmd.trace, 't');
+        m_pendingFlows.append(cmd.trace);
+    }
 
-    if (command["type"].toString() == "clear") {
-        image.fill(Qt::white);
+    if (cmd.tool == Protocol::Tool::Clear) {
+        canvas.clear();
+        remoteStrokeRect = QRect();
         update();
         return; // Важно выйти после обработки команды clear
     }
 
-    // Если это команда рисования, то она должна быть типа "draw"
-    if (command["type"].toString() == "draw") {
-        QString tool = command["tool"].toString();
-        QString action = command["action"].toString(); // Читаем поле 'action'
-
-        QPainter painter(&image);
-        QColor color = QColor(command["color"].toString());
-        int width = command["width"].toInt();
-
-        // Устанавливаем перо для рисования (для всех, кроме заливки)
-        painter.setPen(QPen(color, width, Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin));
-
-        if (tool == "pencil" || tool == "rubber") {
-            if (tool == "rubber") {
-                painter.setPen(QPen(Qt::white, width, Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin));
-            }
-
-            if (action == "start") { // Инициализируем lastRemotePoint при старте
-                lastRemotePoint = QPoint(command["x"].toInt(), command["y"].toInt());
-                // Можно нарисовать точку для начала линии, если хотите, но drawLineTo дальше сделает это.
-                // painter.drawPoint(lastRemotePoint);
-            } else if (action == "move") {
-                QPoint p1(command["x1"].toInt(), command["y1"].toInt());
-                QPoint p2(command["x2"].toInt(), command["y2"].toInt());
-                painter.drawLine(p1, p2);
-                // Если вы используете lastRemotePoint, то после рисования сегмента обновите ее:
-                // lastRemotePoint = p2; // Это если вы хотите, чтобы удаленный клиент тоже использовал lastRemotePoint
-            } else if (action == "release") {
-                // Для "release" можно просто нарисовать последний сегмент, если он есть
-                QPoint p1(command["x1"].toInt(), command["y1"].toInt());
-                QPoint p2(command["x2"].toInt(), command["y2"].toInt());
-                painter.drawLine(p1, p2);
-                // lastRemotePoint можно сбросить, если он используется для непрерывных линий
-                lastRemotePoint = QPoint(0,0); // Или любое "невалидное" значение
-            }
-        }
-        else if (tool == "line" && action == "draw") { // Окончательная линия
-            painter.drawLine(
-                QPoint(command["x1"].toInt(), command["y1"].toInt()),
-                QPoint(command["x2"].toInt(), command["y2"].toInt())
-                );
-        }
-        else if (tool == "rectangle" && action == "draw") { // Окончательный прямоугольник
-            painter.drawRect(QRect(
-                                 QPoint(command["x1"].toInt(), command["y1"].toInt()),
-                                 QPoint(command["x2"].toInt(), command["y2"].toInt())
-                                 ).normalized()); // .normalized() для правильного построения QRect
-        }
-        else if (tool == "ellipse" && action == "draw") { // Окончательный эллипс
-            painter.drawEllipse(QRect(
-                                    QPoint(command["x1"].toInt(), command["y1"].toInt()),
-                                    QPoint(command["x2"].toInt(), command["y2"].toInt())
-                                    ).normalized()); // .normalized() для правильного построения QRect
+    QColor color = QColor::fromRgb(cmd.color);
+    const int width = cmd.width;
+    const int rad = (width / 2) + 2;
+    const QPoint p1(cmd.x1, cmd.y1);
+    const QPoint p2(cmd.x2, cmd.y2);
+
+    // Перо для рисования (для всех, кроме заливки)
+    QPen pen(color, width, Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin);
+    // Рисуем только на плитках слоя, которые задевает фигура
+    auto drawOnTiles = [&](LayeredCanvas::Layer layer, const QRect &area,
+                           const std::function<void(QPainter &)> &draw) {
+        const QRect dirty = area.normalized().adjusted(-rad, -rad, +rad, +rad);
+        auto withPen = [&](QPainter &painter) {
+            painter.setPen(pen);
+            draw(painter);
+        };
+        if (cmd.tool == Protocol::Tool::Rubber) {
+            canvas.erase(layer, dirty, withPen); // Ластик стирает слой штрихов до прозрачности
+        } else {
+            canvas.paint(layer, dirty, withPen);
         }
-        else if (tool == "fill" && action == "draw")
-        { fillArea(QPoint(command["x"].toInt(), command["y"].toInt()), color);
+        if (layer == LayeredCanvas::RemoteStroke) {
+            remoteStrokeRect |= dirty;
         }
-        else if (tool == "text" && action == "draw") { // Обработка инструмента "Текст"
-            // *** Эту часть реализуем после того, как настроим отправку текста ***
-            // QFont font;
-            // font.setFamily(command["fontFamily"].toString());
-            // font.setPointSize(command["fontSize"].toInt());
-            // if (command["fontWeight"].toString() == "Bold") {
-            //     font.setBold(true);
-            // }
-            // painter.setFont(font);
-            // painter.setPen(QPen(color)); // Для текста цвет устанавливается через QPen
-            // painter.drawText(command["x"].toInt(), command["y"].toInt(), command["text"].toString());
+    };
+
+    switch (cmd.tool) {
+    case Protocol::Tool::Pencil:
+    case Protocol::Tool::Rubber: {
+        // Карандаш копится на слое RemoteStroke до "release", ластик сразу стирает штрихи
+        const LayeredCanvas::Layer strokeLayer = (cmd.tool == Protocol::Tool::Rubber) ? LayeredCanvas::Strokes
+                                                                                     : LayeredCanvas::RemoteStroke;
+        switch (cmd.action) {
+        case Protocol::DrawAction::Start: // Инициализируем lastRemotePoint при старте
+            lastRemotePoint = p1;
+            break;
+        case Protocol::DrawAction::Move:
+            drawOnTiles(strokeLayer, QRect(p1, p2), [&](QPainter &painter) { painter.drawLine(p1, p2); });
+            break;
+        case Protocol::DrawAction::Release:
+            // Для "release" рисуем последний сегмент
+            drawOnTiles(strokeLayer, QRect(p1, p2), [&](QPainter &painter) { painter.drawLine(p1, p2); });
+            // Штрих завершен - переносим его на слой штрихов
+            canvas.merge(LayeredCanvas::RemoteStroke, LayeredCanvas::Strokes, remoteStrokeRect);
+            remoteStrokeRect = QRect();
+            lastRemotePoint = QPoint(0,0); // Или любое "невалидное" значение
+            break;
+        default:
+            break;
         }
+        break;
+    }
+    case Protocol::Tool::Line: // Окончательная линия
+        if (cmd.action != Protocol::DrawAction::Draw) break;
+        drawOnTiles(LayeredCanvas::Strokes, QRect(p1, p2), [&](QPainter &painter) { painter.drawLine(p1, p2); });
+        break;
+    case Protocol::Tool::Rectangle: { // Окончательный прямоугольник
+        if (cmd.action != Protocol::DrawAction::Draw) break;
+        const QRect shape = QRect(p1, p2).normalized(); // .normalized() для правильного построения QRect
+        drawOnTiles(LayeredCanvas::Strokes, shape, [&](QPainter &painter) { painter.drawRect(shape); });
+        break;
+    }
+    case Protocol::Tool::Ellipse: { // Окончательный эллипс
+        if (cmd.action != Protocol::DrawAction::Draw) break;
+        const QRect shape = QRect(p1, p2).normalized();
+        drawOnTiles(LayeredCanvas::Strokes, shape, [&](QPainter &painter) { painter.drawEllipse(shape); });
+        break;
+    }
+    case Protocol::Tool::Fill:
+        if (cmd.action == Protocol::DrawAction::Draw) fillArea(p1, color);
+        break;
+    case Protocol::Tool::Text:
+        // *** Эту часть реализуем после того, как настроим отправку текста ***
+        // Текст уже приходит в cmd.text, шрифт пока не передается
+        break;
+    default:
+        break;
     }
-    // Если тип команды не "draw" и не "clear", можно добавить обработку других типов, если они будут
 
     update(); // Обновляем виджет, чтобы показать изменения
 }
+
+Protocol::DrawCommand DoodleArea::drawCommand(Protocol::DrawAction action) const {
+    Protocol::DrawCommand command;
+    switch (currentTool) {
+    case Pencil: command.tool = Protocol::Tool::Pencil; break;
+    case Rubber: command.tool = Protocol::Tool::Rubber; break;
+    case Fill: command.tool = Protocol::Tool::Fill; break;
+    case Line: command.tool = Protocol::Tool::Line; break;
+    case Rectangle: command.tool = Protocol::Tool::Rectangle; break;
+    case Ellipse: command.tool = Protocol::Tool::Ellipse; break;
+    case Textt: command.tool = Protocol::Tool::Text; break;
+    default: break;
+    }
+    command.action = action;
+    // Ластик рисует белым: так его видят клиенты без слоев
+    command.color = (currentTool == Rubber) ? 0xFFFFFFFF : myPenColor.rgb();
+    command.width = myPenWidth;
+    return command;
+}
 void DoodleArea::setupRemotePainter(QPainter &painter) {
     if (remoteTool == Rubber) {
         painter.setPen(QPen(Qt::white, remotePenWidth, Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin));
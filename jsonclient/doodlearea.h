@@ -9,6 +9,11 @@
 #include <QScrollBar>
 #include <QGraphicsPixmapItem>
 #include <QLineEdit>
+#include <QVector>
+#include "layeredcanvas.h"
+#include "messages.h"
+
+class PerfStats;
 
 
 class DoodleArea : public QWidget
@@ -43,14 +48,19 @@ public:
     int penWidth() const {return myPenWidth;}
     QUndoStack* getUndoStack() const;
     void setTool(ShapeType tool);
-    QImage getImage() const;
-    void setImage(const QImage &newImage);
+    LayeredCanvas::Snapshot getImage() const;
+    void setImage(const LayeredCanvas::Snapshot &newImage);
 
     bool ifModified();
     void setScaleFactor(double scaleFactor);
     double scaleFactor() const { return m_scaleFactor; }
     void drawLineTo(const QPoint &endPoint);
 
+    // Счетчики для HUD: время кадра, примененные команды, память холста
+    void setPerfStats(PerfStats *stats);
+    // Снимает память холста и Undo в stats (обход плиток - только по запросу)
+    void samplePerfStats();
+
     int myPenWidth;
 //Работает Киря, не прикасаться
 signals:
@@ -59,30 +69,43 @@ signals:
 public slots:
     //Работает Киря, не прикасаться
     void applyRemoteCommand(const QJsonObject& command);
+    void applyRemoteCommand(const Protocol::DrawCommand& command);
     //
     void clearImage();
     void resizeCanvas();
 
     void undo();
     void redo();
+    void toggleHud();
 
 private:
+    // Команда протокола для текущего инструмента с цветом и толщиной пера
+    Protocol::DrawCommand drawCommand(Protocol::DrawAction action) const;
+
     DoodleArea *doodleArea;
     void mousePressEvent(QMouseEvent *event) override;
     void finishTextInput();
 
     void mouseMoveEvent(QMouseEvent *event) override;
     void mouseReleaseEvent(QMouseEvent *event) override;
+    void wheelEvent(QWheelEvent *event) override;
+    bool event(QEvent *event) override;
     void paintEvent(QPaintEvent *event) override;
     void resizeEvent(QResizeEvent *event) override;
     void setImageItem(QGraphicsPixmapItem *item);
 
 
-    void drawShape(const QPoint &endPoint, QImage *targetImage);
+    void drawShape(const QPoint &endPoint, LayeredCanvas::Layer target);
     void resizeImage(QImage *image, const QSize &newSize);
 
     void fillArea(const QPoint &seedPoint);
 
+    // Вид: точка холста p выводится в виджете в точке p * m_scaleFactor + m_offset
+    void zoomAt(const QPointF &widgetPos, double factor);
+    QPoint mapToCanvas(const QPoint &widgetPos) const;
+    QRect mapFromCanvas(const QRect &canvasRect) const;
+    void updateCanvasRect(const QRect &canvasRect);
+
     bool modified = false;
     bool doodling;
     bool shaping;
@@ -90,10 +113,12 @@ private:
     QColor myPenColor;
 
 
-    QImage oldImage;
-    QImage tempImage;
+    // Снимки холста дешевы: копируются только указатели на плитки
+    LayeredCanvas::Snapshot oldImage;
 
-    QImage image;
+    LayeredCanvas canvas;
+    QRect strokeRect;        // Область текущего локального штриха
+    QRect previewRect;       // Область предпросмотра фигуры на слое Preview
     QPoint lastPoint;
     ShapeType currentTool;
     QPoint textInputStartPoint;
@@ -106,15 +131,26 @@ private:
     QUndoStack *undoStack;
     QGraphicsPixmapItem *imageItem = nullptr;
 
+    static constexpr double MinScaleFactor = 0.1;
+    static constexpr double MaxScaleFactor = 8.0;
     double m_scaleFactor = 1.0;
     QPoint m_offset;
     QPoint m_lastMousePosition;
+    bool panning = false;    // Сдвиг вида средней кнопкой мыши
     // Работает Киря не прикосаться
     void setupRemotePainter(QPainter &painter);
     QPoint lastRemotePoint;  // Для отслеживания последней точки при удаленном рисовании
     QColor remotePenColor;   // Цвет пера для удаленных команд
     int remotePenWidth;      // Ширина пера для удаленных команд
     ShapeType remoteTool;    // Инструмент для удаленных команд
+    QRect remoteStrokeRect;  // Область штриха на слое RemoteStroke до "release"
+    QVector<quint64> m_pendingFlows;  // Трассируемые штрихи, ждущие перерисовки
+
+    qint64 undoMemoryUsage() const;
+    void drawHud(QPainter &painter);
+    PerfStats *m_stats = nullptr;
+    bool m_hudVisible = false;
+    QRect m_hudRect;         // Где HUD нарисован в прошлый раз, в координатах виджета
     //
 };
 
@@ -14,19 +14,25 @@
 
 // Убедитесь, что DoodleArea.h находится по правильному пути
 #include "doodlearea.h"
+#include "tracing.h"
+#include "perfstats.h"
+#include "jsoncodec.h"
+#include <QFileDialog>
+#include <QMessageBox>
 
 // Конструктор GameWindow
-GameWindow::GameWindow(QTcpSocket* socket, const QString& playerName, QWidget *parent) :
+GameWindow::GameWindow(QTcpSocket* socket, const QString& playerName, PerfStats *stats, QWidget *parent) :
     QMainWindow(parent),
     ui(new Ui::GameWindow),
     m_socket(socket),
     m_playerName(playerName),
     m_isDrawing(false),
-    m_doodleArea(nullptr) // Инициализируем указатель члена класса
+    m_doodleArea(nullptr), // Инициализируем указатель члена класса
+    m_stats(stats)
 {
     ui->setupUi(this); // Загружаем UI из .ui файла
 
-    m_socket->setParent(this); // Устанавливаем GameWindow родителем для сокета
+    // Сокет остается у MainWindow: он переживает обрыв и переподключение
 
     // Изначальная настройка UI (видимость кнопок и полей)
     setupGameUI(false);
@@ -34,6 +40,7 @@ GameWindow::GameWindow(QTcpSocket* socket, const QString& playerName, QWidget *p
     // --- Инициализация и настройка DoodleArea ---
     QSize doodleAreaSize(1121, 711); // Используем явно заданный размер для холста
     m_doodleArea = new DoodleArea(doodleAreaSize, this); // Создаем экземпляр DoodleArea, передавая GameWindow как родителя
+    m_doodleArea->setPerfStats(m_stats);
 
 
     // setActions(m_isDrawing);
@@ -61,9 +68,7 @@ GameWindow::GameWindow(QTcpSocket* socket, const QString& playerName, QWidget *p
     connect(this, &GameWindow::sendDrawingCommand, this, [this](const QJsonObject& cmd) {
         // Отправляем команду только если текущий игрок является художником
         if (m_isDrawing) {
-            QJsonObject message = cmd;
-            message["type"] = "draw"; // Убеждаемся, что тип сообщения "draw"
-            emit sendMessage(message); // Отправляем сообщение через сокет
+            emit sendMessage(cmd); // Тип "draw" команда получила в Protocol::Json::encode
         }
     });
 
@@ -75,6 +80,10 @@ GameWindow::GameWindow(QTcpSocket* socket, const QString& playerName, QWidget *p
     createToolBars();
     setWindowTitle(tr("Крокодил"));
 
+    m_pingClock.start();
+    connect(&m_pingTimer, &QTimer::timeout, this, &GameWindow::sendPing);
+    m_pingTimer.start(PingIntervalMs);
+
     qDebug() << "Player:" << m_playerName << "isDrawing:" << m_isDrawing;
 
 }
@@ -172,64 +181,147 @@ void GameWindow::on_sendGuessButton_clicked()
     QString guess = ui->guessEdit->text().trimmed();
     if (guess.isEmpty()) return;
 
-    QJsonObject message;
-    message["type"] = "guess";
-    message["text"] = guess;
-    emit sendMessage(message); // Отправляем догадку
+    Protocol::Guess message;
+    message.text = guess;
+    emit sendMessage(Protocol::Json::encode(message)); // Отправляем догадку
 
     ui->guessEdit->clear(); // Очищаем поле ввода после отправки
 }
 
 // --- Обновление таблицы очков ---
+// Правит на месте только пришедшие очки, остальные строки не трогаются
 void GameWindow::updateScoresTable(const QJsonObject& scores) {
-    for (int row = 0; row < (ui->scoresTable->rowCount()); ++row) {
-        QTableWidgetItem* nameItem = ui->scoresTable->item(row, 0);
-        if(!nameItem) continue; // Проверяем, что элемент существует
-        QString playerName = nameItem->text();
-
-        if (scores.contains(playerName)) {
-            int score = scores[playerName].toInt();
-            QTableWidgetItem* scoreItem = ui->scoresTable->item(row, 1);
-            if (scoreItem) {
-                scoreItem->setText(QString::number(score)); // Обновляем счет
-            } else {
-                scoreItem = new QTableWidgetItem(QString::number(score));
-                ui->scoresTable->setItem(row, 1, scoreItem);
-            }
+    for (auto it = scores.begin(); it != scores.end(); ++it) {
+        QTableWidgetItem* scoreItem = m_scoreItems.value(it.key().toInt(), nullptr);
+        if (scoreItem) {
+            scoreItem->setText(QString::number(it.value().toInt())); // Обновляем счет
         }
     }
 }
 
+// --- Сообщение "scores": дельта с номером версии или полный снимок ---
+void GameWindow::applyScoresMessage(const QJsonObject& message) {
+    const int seq = message["scoreSeq"].toInt();
+    QJsonObject scores = message["scores"].toObject();
+
+    if (message["full"].toBool()) {
+        updateAllPlayersTable(scores);
+        m_scoreSeq = seq;
+        m_scoresResyncPending = false;
+        return;
+    }
+
+    if (m_scoresResyncPending || seq <= m_scoreSeq) return; // ждем снимок или дельта устарела
+
+    if (seq != m_scoreSeq + 1) {
+        // Пропущена версия - таблица могла разойтись с сервером
+        qDebug() << "CLIENT (" << m_playerName << "): score seq gap" << m_scoreSeq << "->" << seq;
+        requestScoresResync();
+        return;
+    }
+
+    updateScoresTable(scores);
+    m_scoreSeq = seq;
+}
+
+void GameWindow::requestScoresResync() {
+    if (m_scoresResyncPending) return;
+    m_scoresResyncPending = true;
+
+    emit sendMessage(Protocol::Json::encode(Protocol::MessageType::ScoresResync));
+}
+
 // --- Обработка сообщений от сервера ---
 void GameWindow::processServerMessage(const QJsonObject &message) {
     QString type = message["type"].toString();
+    Tracing::Zone zone("processMessage", type);
     // qDebug() << "Processing message type:" << type;
 
-    if (type == "playerJoined") {
-        QString Name = message["name"].toString();
-        QJsonObject scores = message["scores"].toObject();
-        qDebug() << "CLIENT (" << m_playerName << "): Processing 'playerJoined' for:" << Name << ". Full scores received:" << scores;
+    // Номер потока комнаты: с него сервер досылает пропущенное после обрыва
+    if (message.contains("seq")) {
+        m_lastSeq = static_cast<qint64>(message["seq"].toDouble());
+    }
 
-        // Вместо всей предыдущей логики обновления таблицы:
-        updateAllPlayersTable(scores); // Используем новую унифицированную функцию
+    switch (Protocol::messageType(type)) {
+    case Protocol::MessageType::Registered:
+        m_playerId = message["id"].toInt();
+        m_resumeToken = message["token"].toString();
+        m_isSpectator = message["spectator"].toBool();
+        if (m_isSpectator) {
+            setupGameUI(false);
+        }
+        qDebug() << "CLIENT (" << m_playerName << "): registered with id" << m_playerId;
+        break;
+    case Protocol::MessageType::Resumed:
+        m_playerId = message["id"].toInt();
+        // full - разрыв слишком велик, дальше придет ключевой кадр целиком
+        qDebug() << "CLIENT (" << m_playerName << "): session resumed, full ="
+                 << message["full"].toBool() << "from seq" << m_lastSeq;
+        break;
+    case Protocol::MessageType::Pong: {
+        Protocol::Pong pong;
+        if (Protocol::Json::decode(message, pong)) {
+            m_stats->recordRtt(m_pingClock.elapsed() - pong.time);
+        }
+        break;
+    }
+    case Protocol::MessageType::Migrate:
+        // Токен тот же, но сервер вправе его сменить при переносе
+        m_resumeToken = message["token"].toString(m_resumeToken);
+        qDebug() << "CLIENT (" << m_playerName << "): room is moving, reconnecting";
+        break;
+    case Protocol::MessageType::ResumeFailed: {
+        // Сессия истекла на сервере - входим заново под тем же именем
+        qDebug() << "CLIENT (" << m_playerName << "): resume failed, registering again";
+        m_resumeToken.clear();
+        m_lastSeq = 0;
+        emit sessionExpired();
+        break;
+    }
+    case Protocol::MessageType::PlayerJoined: {
+        Protocol::PlayerJoined joined;
+        if (!Protocol::Json::decode(message, joined)) break;
+        m_playerNames[joined.id] = joined.name;
+        qDebug() << "CLIENT (" << m_playerName << "): Processing 'playerJoined' for:" << joined.id << joined.name;
+
+        // Добавляем одну строку, таблица целиком не перестраивается
+        addPlayerRow(joined.id, joined.name, joined.score);
+        break;
     }
     // НОВЫЙ БЛОК: Обработка полного списка игроков при подключении
-    else if (type == "playerList") { // Или "initialState", как решите на сервере
+    case Protocol::MessageType::PlayerList: {
         QJsonArray playersArray = message["players"].toArray();
         qDebug() << "CLIENT (" << m_playerName << "): Processing 'playerList'. Players count:" << playersArray.size();
 
         QJsonObject scoresFromList;
         for (const QJsonValue& value : playersArray) {
             QJsonObject playerObj = value.toObject();
-            scoresFromList[playerObj["name"].toString()] = playerObj["score"].toInt();
+            const int id = playerObj["id"].toInt();
+            m_playerNames[id] = playerObj["name"].toString();
+            scoresFromList[QString::number(id)] = playerObj["score"].toInt();
         }
         updateAllPlayersTable(scoresFromList); // Преобразуем и обновляем
+        m_scoreSeq = message["scoreSeq"].toInt(); // дальше приходят дельты от этой версии
+        m_scoresResyncPending = false;
         qDebug() << "CLIENT (" << m_playerName << "): Получен и обновлен полный список игроков.";
+        break;
+    }
+    case Protocol::MessageType::PlayerLeft: {
+        Protocol::PlayerLeft left;
+        if (!Protocol::Json::decode(message, left)) break;
+        removePlayerRow(left.id);
+        m_playerNames.remove(left.id);
+        break;
     }
-    else if (type == "roundStart") {
-        QString drawer = message["drawer"].toString();
-        m_isDrawing = (drawer == m_playerName); //  Определяем, является ли текущий игрок художником
-        qDebug() << "roundStart: m_isDrawing = " << m_isDrawing << ", drawer = " << drawer << ", m_playerName = " << m_playerName;  // Добавьте отладочный вывод
+    case Protocol::MessageType::Scores:
+        applyScoresMessage(message);
+        break;
+    case Protocol::MessageType::RoundStart: {
+        Protocol::RoundStart roundStart;
+        if (!Protocol::Json::decode(message, roundStart)) break;
+        QString drawer = playerName(roundStart.drawer);
+        m_isDrawing = (roundStart.drawer == m_playerId); //  Определяем, является ли текущий игрок художником
+        qDebug() << "roundStart: m_isDrawing = " << m_isDrawing << ", drawer = " << roundStart.drawer << drawer << ", m_playerId = " << m_playerId;  // Добавьте отладочный вывод
 
         setActions(m_isDrawing);
         //  Очищаем холст и настраиваем UI
@@ -241,48 +333,91 @@ void GameWindow::processServerMessage(const QJsonObject &message) {
             setPencilTool(); // Если художник, по умолчанию карандаш
             ui->toolBar->setVisible(true);
         }
+        break;
     }
-    else if (type == "yourTurn") {
-        QString word = message["word"].toString();
-        ui->wordLabel->setText("Нарисуй-ка мне: " + word);
+    case Protocol::MessageType::YourTurn: {
+        Protocol::YourTurn turn;
+        if (!Protocol::Json::decode(message, turn)) break;
+        ui->wordLabel->setText("Нарисуй-ка мне: " + turn.word);
+        break;
     }
-    else if (type == "draw") {
-        // Принимаем и применяем все команды рисования, кроме тех, что мы сами генерируем (если мы художник)
-        // Исключение: команды очистки всегда применяются, независимо от роли.
-        if (!m_isDrawing || message["tool"].toString() == "clear") {
-            m_doodleArea->applyRemoteCommand(message);
+    case Protocol::MessageType::Draw: {
+        // Сюда доходят только команды, которые не взял быстрый путь parseDraw
+        Protocol::DrawCommand command;
+        if (!Protocol::Json::decode(message, command)) {
+            qDebug() << "Malformed draw command ignored:" << message;
+            break;
         }
+        // seq уже учтен выше, но нужен, чтобы отличить живой кадр от истории
+        processDrawCommand(command, message.contains("seq") ? m_lastSeq : -1);
+        break;
+    }
+    case Protocol::MessageType::Chat: {
+        Protocol::Chat chat;
+        if (!Protocol::Json::decode(message, chat)) break;
+        ui->chatText->append(playerName(chat.player) + ": " + chat.text); // Добавляем сообщение в чат
+        break;
     }
-    else if (type == "chat") {
-        QString player = message["player"].toString();
-        QString text = message["text"].toString();
-        ui->chatText->append(player + ": " + text); // Добавляем сообщение в чат
+    case Protocol::MessageType::Close: {
+        // Видит только этот игрок
+        Protocol::CloseGuess close;
+        if (!Protocol::Json::decode(message, close)) break;
+        ui->chatText->append("≈ \"" + close.text + "\" - почти! Проверьте написание");
+        break;
     }
-    else if (type == "correctGuess") {
-        QJsonObject scores = message["scores"].toObject();
-        updateScoresTable(scores); // Обновляем таблицу очков
-        QString guesser = message["guesser"].toString();
-        QString word = message["word"].toString();
-        ui->chatText->append("✓ " + guesser + " угадал: " + word); // Сообщение об угадывании
+    case Protocol::MessageType::ChatHidden:
+        // Сообщение не ушло остальным: в нем было загаданное слово
+        ui->chatText->append("✗ Сообщение скрыто: оно подсказывает слово");
+        break;
+    case Protocol::MessageType::CorrectGuess: {
+        // Очки пришли отдельной дельтой "scores"
+        Protocol::CorrectGuess correct;
+        if (!Protocol::Json::decode(message, correct)) break;
+        ui->chatText->append("✓ " + playerName(correct.guesser) + " угадал: " + correct.word); // Сообщение об угадывании
 
         ui->guessEdit->clear(); // Очищаем поле ввода догадок
+        break;
     }
-    else if (type == "roundEnd") {
+    case Protocol::MessageType::RoundEnd: {
+        Protocol::RoundEnd roundEnd;
+        Protocol::Json::decode(message, roundEnd);
         setActions(m_isDrawing);
         setNoneTool(); // Если не художник, никаких инструментов
         ui->toolBar->setHidden(true);
 
 
         ui->wordLabel->setText("Приготовились!"); // Сообщение о конце раунда
-        QJsonObject scores = message["scores"].toObject();
-        updateScoresTable(scores); // Обновляем очки
+        if (roundEnd.scoreSeq != m_scoreSeq) {
+            requestScoresResync(); // Таблица отстала от сервера
+        }
+        break;
     }
-    else if (type == "gameOver") {
-        QJsonObject scores = message["scores"].toObject();
-        processGameOver(scores); // Обрабатываем окончание игры
+    case Protocol::MessageType::GameOver: {
+        Protocol::GameOver gameOver;
+        Protocol::Json::decode(message, gameOver);
+        if (gameOver.scoreSeq != m_scoreSeq) {
+            qDebug() << "CLIENT (" << m_playerName << "): final scores may be stale, seq" << m_scoreSeq;
+        }
+        processGameOver(currentScores()); // Обрабатываем окончание игры
+        break;
     }
-    else {
+    default:
         qDebug() << "Unknown message type:" << type;
+        break;
+    }
+}
+
+void GameWindow::processDrawCommand(const Protocol::DrawCommand &command, qint64 seq) {
+    Tracing::Zone zone("processDraw");
+    if (seq >= 0) {
+        m_lastSeq = seq;
+    }
+    // Художнику живые кадры (с seq) возвращают его же штрихи - они уже на холсте.
+    // История раунда из ключевого кадра идет без seq и применяется при любой роли:
+    // иначе художник после resume остался бы с пустым холстом.
+    // Команды очистки всегда применяются, независимо от роли.
+    if (!m_isDrawing || seq < 0 || command.tool == Protocol::Tool::Clear) {
+        m_doodleArea->applyRemoteCommand(command);
     }
 }
 
@@ -290,9 +425,9 @@ void GameWindow::processServerMessage(const QJsonObject &message) {
 void GameWindow::processGameOver(const QJsonObject& scores) {
     QList<QPair<QString, int>> sortedScores;
     for (auto it = scores.begin(); it != scores.end(); ++it) {
-        QString playerName = it.key();
+        QString name = playerName(it.key().toInt());
         int playerScore = it.value().toInt();
-        sortedScores.append(qMakePair(playerName, playerScore));
+        sortedScores.append(qMakePair(name, playerScore));
     }
 
 
@@ -352,8 +487,8 @@ void GameWindow::processGameOver(const QJsonObject& scores) {
 void GameWindow::setupGameUI(bool isDrawer){
 
     // Угадывание для НЕ-художника
-    ui->guessEdit->setEnabled(!isDrawer);
-    ui->sendGuessButton->setEnabled(!isDrawer);
+    ui->guessEdit->setEnabled(!isDrawer && !m_isSpectator);
+    ui->sendGuessButton->setEnabled(!isDrawer && !m_isSpectator);
 
     if (!isDrawer){
         ui->wordLabel->setText("Угадывайте что рисуют!");
@@ -458,6 +593,36 @@ void GameWindow::createActions(){
 
     undoActionBtn->setShortcut(tr("Ctrl+Z"));
     redoActionBtn->setShortcut(tr("Ctrl+Y"));
+
+    // Окно, а не панель инструментов: у угадывающих панель скрыта
+    hudAct = new QAction(tr("Статистика производительности"), this);
+    hudAct->setShortcut(tr("F3"));
+    connect(hudAct, &QAction::triggered, m_doodleArea, &DoodleArea::toggleHud);
+    addAction(hudAct);
+
+    exportStatsAct = new QAction(tr("Сохранить статистику"), this);
+    exportStatsAct->setShortcut(tr("Ctrl+F3"));
+    connect(exportStatsAct, &QAction::triggered, this, &GameWindow::exportPerfStats);
+    addAction(exportStatsAct);
+}
+
+void GameWindow::sendPing() {
+    // Ретранслятор зрителей сообщения клиента не принимает
+    if (m_isSpectator || m_playerId < 0) return;
+    Protocol::Ping ping;
+    ping.id = ++m_pingId;
+    ping.time = m_pingClock.elapsed();
+    emit sendMessage(Protocol::Json::encode(ping));
+}
+
+void GameWindow::exportPerfStats() {
+    const QString path = QFileDialog::getSaveFileName(this, tr("Сохранить статистику"),
+                                                      "croc-stats.json", tr("JSON (*.json)"));
+    if (path.isEmpty()) return;
+    m_doodleArea->samplePerfStats();
+    if (!m_stats->exportTo(path)) {
+        QMessageBox::warning(this, tr("Ошибка"), tr("Не удалось записать %1").arg(path));
+    }
 }
 
 
@@ -560,28 +725,89 @@ void GameWindow::setActions(const bool &drawing){
 
 }
 
+// Полная пересборка - только для playerList и снимка по запросу
 void GameWindow::updateAllPlayersTable(const QJsonObject& scores) {
     ui->scoresTable->setRowCount(0); // Полностью очищаем таблицу
+    m_scoreItems.clear();
 
 
-    QList<QPair<QString, int>> playersData;
+    // id, имя, очки
+    struct Row { int id; QString name; int score; };
+    QList<Row> playersData;
     for (auto it = scores.begin(); it != scores.end(); ++it) {
-        playersData.append({it.key(), it.value().toInt()});
+        const int id = it.key().toInt();
+        playersData.append({id, playerName(id), it.value().toInt()});
     }
 
     // Опционально: отсортировать игроков по очкам или имени
-     std::sort(playersData.begin(), playersData.end(), [](const QPair<QString, int>& a, const QPair<QString, int>& b){
-         return a.first < b.first; // Сортировка по имени
+     std::sort(playersData.begin(), playersData.end(), [](const Row& a, const Row& b){
+         return a.name < b.name; // Сортировка по имени
      });
 
     ui->scoresTable->setRowCount(playersData.size()); // Устанавливаем нужное количество строк
 
     for (int i = 0; i < playersData.size(); ++i) {
-        QTableWidgetItem *nameItem = new QTableWidgetItem(playersData[i].first);
-        QTableWidgetItem *scoreItem = new QTableWidgetItem(QString::number(playersData[i].second));
+        QTableWidgetItem *nameItem = new QTableWidgetItem(playersData[i].name);
+        nameItem->setData(Qt::UserRole, playersData[i].id);
+        QTableWidgetItem *scoreItem = new QTableWidgetItem(QString::number(playersData[i].score));
 
         ui->scoresTable->setItem(i, 0, nameItem);
         ui->scoresTable->setItem(i, 1, scoreItem);
+        m_scoreItems[playersData[i].id] = scoreItem;
     }
     qDebug() << "CLIENT (" << m_playerName << "): Scores table fully updated.";
 }
+
+void GameWindow::addPlayerRow(int id, const QString& name, int score) {
+    if (m_scoreItems.contains(id)) {
+        removePlayerRow(id);
+    }
+
+    // Строки отсортированы по имени - ищем место двоичным поиском
+    int low = 0;
+    int high = ui->scoresTable->rowCount();
+    while (low < high) {
+        const int middle = (low + high) / 2;
+        QTableWidgetItem* item = ui->scoresTable->item(middle, 0);
+        if (item && item->text() < name) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    QTableWidgetItem *nameItem = new QTableWidgetItem(name);
+    nameItem->setData(Qt::UserRole, id);
+    QTableWidgetItem *scoreItem = new QTableWidgetItem(QString::number(score));
+
+    ui->scoresTable->insertRow(low);
+    ui->scoresTable->setItem(low, 0, nameItem);
+    ui->scoresTable->setItem(low, 1, scoreItem);
+    m_scoreItems[id] = scoreItem;
+}
+
+void GameWindow::removePlayerRow(int id) {
+    QTableWidgetItem* scoreItem = m_scoreItems.take(id);
+    if (scoreItem) {
+        ui->scoresTable->removeRow(scoreItem->row());
+    }
+}
+
+QJsonObject GameWindow::currentScores() const {
+    QJsonObject scores;
+    for (auto it = m_scoreItems.begin(); it != m_scoreItems.end(); ++it) {
+        scores[QString::number(it.key())] = it.value()->text().toInt();
+    }
+    return scores;
+}
+
+QJsonObject GameWindow::resumeRequest() const {
+    QJsonObject message = Protocol::Json::encode(Protocol::MessageType::Resume);
+    message["token"] = m_resumeToken;
+    message["lastSeq"] = m_lastSeq;
+    return message;
+}
+
+QString GameWindow::playerName(int id) const {
+    return m_playerNames.value(id, tr("Игрок %1").arg(id));
+}
@@ -6,14 +6,20 @@
 #include <QJsonObject>
 #include <QJsonArray>
 #include <QVector>
+#include <QHash>
 #include <QPoint>
 #include <QToolBar>
 #include <QColorDialog>
 #include <QActionGroup>
 #include <QLabel>
 #include <QPainter>
+#include <QTimer>
+#include <QElapsedTimer>
+#include "messages.h"
 
 class DoodleArea;
+class PerfStats;
+class QTableWidgetItem;
 
 
 namespace Ui {
@@ -36,15 +42,21 @@ public:
         Textt
     };
 
-    explicit GameWindow(QTcpSocket* socket, const QString& playerName, QWidget *parent = nullptr);
+    explicit GameWindow(QTcpSocket* socket, const QString& playerName, PerfStats *stats, QWidget *parent = nullptr);
     ~GameWindow() override;
 
 
 
     void setupGameUI(bool isDrawer);
 
+    // Возобновление сессии после обрыва связи
+    bool canResume() const { return !m_resumeToken.isEmpty(); }
+    QJsonObject resumeRequest() const;
+
 signals:
     void sendMessage(const QJsonObject& message);
+    // Сессия истекла на сервере: нужен новый register с теми же полями, что при входе
+    void sessionExpired();
     //работает Киря не прокосаться
     void sendDrawingCommand(const QJsonObject& command);
     //
@@ -70,10 +82,15 @@ private slots:
 
     void updateBrushPreview(QLabel *label, int width, QColor color);
 
+    void sendPing();
+    void exportPerfStats();
+
 
     //Киря
 public slots:
     void processServerMessage(const QJsonObject &message);
+    // Команда рисования с быстрого пути; seq < 0 - номера потока в строке не было
+    void processDrawCommand(const Protocol::DrawCommand &command, qint64 seq);
     void updateScoresTable(const QJsonObject& scores);
 
 
@@ -81,14 +98,35 @@ public slots:
 private:
     //
     void updateAllPlayersTable(const QJsonObject& scores);
+    void addPlayerRow(int id, const QString& name, int score);
+    void removePlayerRow(int id);
+    void applyScoresMessage(const QJsonObject& message);
+    void requestScoresResync();
+    QJsonObject currentScores() const;
+    QString playerName(int id) const;
     //
     Ui::GameWindow *ui;
     QTcpSocket* m_socket;
     QString m_playerName;
+    int m_playerId = -1;                 // id, выданный сервером в "registered"
+    QString m_resumeToken;               // токен для "resume" после переподключения
+    qint64 m_lastSeq = 0;                // последний номер сообщения потока комнаты
+    bool m_isSpectator = false;          // подключен через ретранслятор: только смотрит
+    QHash<int, QString> m_playerNames;   // имена приходят только в playerJoined/playerList
+    QHash<int, QTableWidgetItem*> m_scoreItems; // id -> ячейка очков, для правки на месте
+    int m_scoreSeq = 0;                  // последняя примененная версия очков
+    bool m_scoresResyncPending = false;  // снимок запрошен, дельты до него бесполезны
     bool m_isDrawing;
 
     DoodleArea *m_doodleArea = nullptr;
 
+    // RTT до сервера: ping несет время отправки, сервер возвращает его в pong
+    static const int PingIntervalMs = 2000;
+    PerfStats *m_stats;
+    QTimer m_pingTimer;
+    QElapsedTimer m_pingClock;
+    int m_pingId = 0;
+
 
     QAction *penColorAct;
     QAction *penWidthAct;
@@ -102,6 +140,8 @@ private:
 
     QAction *undoActionBtn;
     QAction *redoActionBtn;
+    QAction *hudAct;
+    QAction *exportStatsAct;
 
 
     void createActions();
@@ -4,6 +4,23 @@ greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
 CONFIG += c++17
 
+INCLUDEPATH += ../common
+LIBS += -lz
+
+# Общая библиотека протокола (../protocol), собирается первой из summer_practice.pro
+win32:CONFIG(release, debug|release): LIBS += -L$$OUT_PWD/../protocol/release/ -lprotocol
+else:win32:CONFIG(debug, debug|release): LIBS += -L$$OUT_PWD/../protocol/debug/ -lprotocol
+else:unix: LIBS += -L$$OUT_PWD/../protocol/ -lprotocol
+
+INCLUDEPATH += $$PWD/../protocol
+DEPENDPATH += $$PWD/../protocol
+
+win32-g++:CONFIG(release, debug|release): PRE_TARGETDEPS += $$OUT_PWD/../protocol/release/libprotocol.a
+else:win32-g++:CONFIG(debug, debug|release): PRE_TARGETDEPS += $$OUT_PWD/../protocol/debug/libprotocol.a
+else:win32:!win32-g++:CONFIG(release, debug|release): PRE_TARGETDEPS += $$OUT_PWD/../protocol/release/protocol.lib
+else:win32:!win32-g++:CONFIG(debug, debug|release): PRE_TARGETDEPS += $$OUT_PWD/../protocol/debug/protocol.lib
+else:unix: PRE_TARGETDEPS += $$OUT_PWD/../protocol/libprotocol.a
+
 # You can make your code fail to compile if it uses deprecated APIs.
 # In order to do so, uncomment the following line.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
@@ -11,13 +28,23 @@ CONFIG += c++17
 SOURCES += \
     doodlearea.cpp \
     gamewindow.cpp \
+    layeredcanvas.cpp \
     main.cpp \
-    mainwindow.cpp
+    mainwindow.cpp \
+    perfstats.cpp \
+    tiledimage.cpp \
+    ../common/deflatestream.cpp \
+    ../common/tracing.cpp
 
 HEADERS += \
     doodlearea.h \
     gamewindow.h \
-    mainwindow.h
+    layeredcanvas.h \
+    mainwindow.h \
+    perfstats.h \
+    tiledimage.h \
+    ../common/deflatestream.h \
+    ../common/tracing.h
 
 FORMS += \
     gamewindow.ui \
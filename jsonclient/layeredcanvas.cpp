@@ -0,0 +1,242 @@
+#include "layeredcanvas.h"
+#include <QPainter>
+
+LayeredCanvas::LayeredCanvas()
+{
+}
+
+LayeredCanvas::LayeredCanvas(const QSize &size, const QColor &background) :
+    m_background(background),
+    m_composite(size, background)
+{
+    for (TiledImage &l : m_layers) {
+        l = TiledImage(size, Qt::transparent);
+    }
+    m_dirty.fill(false, m_composite.columns() * m_composite.rows());
+    resetMips();
+}
+
+void LayeredCanvas::discard(Layer which, const QRect &area)
+{
+    m_layers[which].resetTiles(area);
+    markDirty(area);
+}
+
+void LayeredCanvas::merge(Layer from, Layer into, const QRect &area)
+{
+    TiledImage &source = m_layers[from];
+    const QRect span = source.tileSpan(area);
+    if (span.isEmpty()) return;
+
+    for (int row = span.top(); row <= span.bottom(); ++row) {
+        for (int column = span.left(); column <= span.right(); ++column) {
+            if (source.isBackgroundTile(column, row)) continue;
+
+            const QRect r = source.tileRect(column, row);
+            const QImage &part = source.tile(column, row);
+            m_layers[into].paint(r, [&](QPainter &painter) {
+                painter.drawImage(r.topLeft(), part);
+            });
+        }
+    }
+    discard(from, area);
+}
+
+void LayeredCanvas::markDirty(const QRect &area)
+{
+    const QRect span = m_composite.tileSpan(area);
+    if (span.isEmpty()) return;
+
+    for (int row = span.top(); row <= span.bottom(); ++row) {
+        for (int column = span.left(); column <= span.right(); ++column) {
+            const int index = row * m_composite.columns() + column;
+            if (!m_dirty[index]) {
+                m_dirty[index] = true;
+                m_dirtyList.append(index);
+            }
+        }
+    }
+}
+
+void LayeredCanvas::clear()
+{
+    for (TiledImage &l : m_layers) {
+        l.fill(Qt::transparent);
+    }
+    // Все слои пусты - итог совпадает с фоном без пересборки
+    m_composite.fill(m_background);
+    m_dirty.fill(false);
+    m_dirtyList.clear();
+    resetMips();
+}
+
+void LayeredCanvas::resize(const QSize &newSize)
+{
+    for (TiledImage &l : m_layers) {
+        l.resize(newSize);
+    }
+    m_composite.resize(newSize);
+    m_dirty.fill(false, m_composite.columns() * m_composite.rows());
+    m_dirtyList.clear();
+    resetMips();
+    markDirty(rect());
+}
+
+LayeredCanvas::Snapshot LayeredCanvas::snapshot() const
+{
+    return Snapshot{m_layers[Strokes], m_layers[Text]};
+}
+
+void LayeredCanvas::restore(const Snapshot &snapshot)
+{
+    if (snapshot.strokes.size() != size()) {
+        resize(snapshot.strokes.size());
+    } else {
+        // Снимок разделяет плитки с текущим состоянием - пересобираем только отличающиеся
+        markChangedTiles(m_layers[Strokes], snapshot.strokes);
+        markChangedTiles(m_layers[Text], snapshot.text);
+    }
+    m_layers[Strokes] = snapshot.strokes;
+    m_layers[Text] = snapshot.text;
+}
+
+const TiledImage &LayeredCanvas::composite()
+{
+    const int columns = m_composite.columns();
+    for (int index : m_dirtyList) {
+        compositeTile(index % columns, index / columns);
+        m_dirty[index] = false;
+        for (int level = 1; level < MipLevels; ++level) {
+            m_mipStale[level][index] = true;
+        }
+    }
+    m_dirtyList.clear();
+    return m_composite;
+}
+
+void LayeredCanvas::draw(QPainter &painter, const QRect &exposed, qreal scale)
+{
+    const TiledImage &full = composite();
+    const int level = mipLevelForScale(scale);
+    if (level == 0) {
+        full.draw(painter, exposed);
+        return;
+    }
+
+    const QRect span = full.tileSpan(exposed);
+    if (span.isEmpty()) return;
+
+    const qreal factor = 1.0 / (1 << level);
+    for (int row = span.top(); row <= span.bottom(); ++row) {
+        for (int column = span.left(); column <= span.right(); ++column) {
+            const QRect target = full.tileRect(column, row).intersected(rect());
+            const QRectF source(QPointF(0, 0), QSizeF(target.size()) * factor);
+            painter.drawImage(QRectF(target), mipTile(level, column, row), source);
+        }
+    }
+}
+
+int LayeredCanvas::mipLevelForScale(qreal scale)
+{
+    // Берем самый мелкий уровень, который еще не меньше экранного размера
+    if (scale > 0.5) return 0;
+    if (scale > 0.25) return 1;
+    return 2;
+}
+
+QImage LayeredCanvas::toImage()
+{
+    return composite().toImage();
+}
+
+void LayeredCanvas::loadImage(const QImage &image)
+{
+    const QSize newSize = image.size().expandedTo(size());
+    resize(newSize);
+    clear();
+    m_layers[Strokes] = TiledImage::fromImage(image, Qt::transparent);
+    m_layers[Strokes].resize(newSize);
+    markDirty(rect());
+}
+
+qint64 LayeredCanvas::memoryUsage() const
+{
+    qint64 total = m_composite.memoryUsage();
+    for (const TiledImage &l : m_layers) {
+        total += l.memoryUsage();
+    }
+    return total;
+}
+
+void LayeredCanvas::markChangedTiles(const TiledImage &current, const TiledImage &next)
+{
+    for (int row = 0; row < current.rows(); ++row) {
+        for (int column = 0; column < current.columns(); ++column) {
+            const bool same = (current.isBackgroundTile(column, row) && next.isBackgroundTile(column, row))
+                              || current.tile(column, row).constBits() == next.tile(column, row).constBits();
+            if (!same) {
+                markDirty(current.tileRect(column, row));
+            }
+        }
+    }
+}
+
+const QImage &LayeredCanvas::mipTile(int level, int column, int row)
+{
+    const int index = row * m_composite.columns() + column;
+    if (!m_mipStale[level][index]) {
+        return m_mips[level][index];
+    }
+
+    if (m_composite.isBackgroundTile(column, row)) {
+        m_mips[level][index] = m_mipBackground[level];
+    } else {
+        // Каждый уровень строится из предыдущего, а не из исходной плитки
+        const QImage &parent = (level == 1) ? m_composite.tile(column, row)
+                                            : mipTile(level - 1, column, row);
+        const int side = TiledImage::TileSize >> level;
+        m_mips[level][index] = parent.scaled(side, side, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    }
+    m_mipStale[level][index] = false;
+    return m_mips[level][index];
+}
+
+void LayeredCanvas::resetMips()
+{
+    const int count = m_composite.columns() * m_composite.rows();
+    for (int level = 1; level < MipLevels; ++level) {
+        const int side = TiledImage::TileSize >> level;
+        m_mipBackground[level] = QImage(side, side, TiledImage::TileFormat);
+        m_mipBackground[level].fill(m_background);
+        m_mips[level].fill(QImage(), count);
+        m_mipStale[level].fill(true, count);
+    }
+}
+
+void LayeredCanvas::compositeTile(int column, int row)
+{
+    bool empty = true;
+    for (const TiledImage &l : m_layers) {
+        if (!l.isBackgroundTile(column, row)) {
+            empty = false;
+            break;
+        }
+    }
+
+    const QRect r = m_composite.tileRect(column, row);
+    if (empty) {
+        m_composite.resetTiles(r);
+        return;
+    }
+
+    m_composite.paint(r, [&](QPainter &painter) {
+        painter.setCompositionMode(QPainter::CompositionMode_Source);
+        painter.fillRect(r, m_background);
+        painter.setCompositionMode(QPainter::CompositionMode_SourceOver);
+        for (const TiledImage &l : m_layers) {
+            if (!l.isBackgroundTile(column, row)) {
+                painter.drawImage(r.topLeft(), l.tile(column, row));
+            }
+        }
+    });
+}
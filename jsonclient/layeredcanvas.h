@@ -0,0 +1,116 @@
+#ifndef LAYEREDCANVAS_H
+#define LAYEREDCANVAS_H
+
+#include <QColor>
+#include <QImage>
+#include <QRect>
+#include <QVector>
+#include "tiledimage.h"
+
+// Холст из нескольких прозрачных слоев поверх сплошного фона.
+// Каждый слой - TiledImage, изменения отмечают грязные плитки, а итоговое
+// изображение (composite) хранится в кэше и пересобирается только по ним.
+// Для отдаления к итогу лениво строятся уменьшенные копии (1/2 и 1/4) по плиткам.
+class LayeredCanvas
+{
+public:
+    enum Layer {
+        Strokes,        // Завершенные штрихи, заливки и фигуры
+        RemoteStroke,   // Штрих художника, который еще рисуется по сети
+        Preview,        // Локальный предпросмотр фигуры
+        Text,           // Текст
+        LayerCount
+    };
+
+    // Уровень 0 - исходный масштаб, 1 - половина, 2 - четверть
+    static const int MipLevels = 3;
+
+    // Состояние для Undo/Redo: только слои с постоянным содержимым
+    struct Snapshot {
+        TiledImage strokes;
+        TiledImage text;
+
+        qint64 memoryUsage(QSet<const uchar*> &seen) const {
+            return strokes.memoryUsage(seen) + text.memoryUsage(seen);
+        }
+    };
+
+    LayeredCanvas();
+    LayeredCanvas(const QSize &size, const QColor &background);
+
+    QSize size() const { return m_composite.size(); }
+    int width() const { return m_composite.width(); }
+    int height() const { return m_composite.height(); }
+    QRect rect() const { return m_composite.rect(); }
+    bool valid(const QPoint &p) const { return m_composite.valid(p); }
+    QColor background() const { return m_background; }
+
+    TiledImage &layer(Layer which) { return m_layers[which]; }
+    const TiledImage &layer(Layer which) const { return m_layers[which]; }
+
+    // Рисует на слое и помечает area как измененную
+    template <typename DrawFn>
+    void paint(Layer which, const QRect &area, DrawFn draw);
+    // Стирает до прозрачности на слое (настоящий ластик, а не белая краска)
+    template <typename DrawFn>
+    void erase(Layer which, const QRect &area, DrawFn draw);
+    // Выбрасывает плитки слоя, задевающие area (для временных слоев)
+    void discard(Layer which, const QRect &area);
+    // Переносит содержимое from в into в пределах area и очищает from
+    void merge(Layer from, Layer into, const QRect &area);
+    void markDirty(const QRect &area);
+
+    void clear();
+    void resize(const QSize &newSize);
+
+    Snapshot snapshot() const;
+    void restore(const Snapshot &snapshot);
+
+    // Итоговое изображение: пересобираются только грязные плитки
+    const TiledImage &composite();
+    // Выводит видимые плитки с уровня, ближайшего к масштабу scale (но не грубее)
+    void draw(QPainter &painter, const QRect &exposed, qreal scale = 1.0);
+    static int mipLevelForScale(qreal scale);
+
+    QImage toImage();
+    void loadImage(const QImage &image);
+
+    qint64 memoryUsage() const;
+
+private:
+    void markChangedTiles(const TiledImage &current, const TiledImage &next);
+    void compositeTile(int column, int row);
+    const QImage &mipTile(int level, int column, int row);
+    void resetMips();
+
+    QColor m_background;
+    TiledImage m_layers[LayerCount];
+    TiledImage m_composite;
+    QVector<bool> m_dirty;       // флаг на каждую плитку
+    QVector<int> m_dirtyList;    // номера грязных плиток, без повторов
+
+    // Уменьшенные копии итоговых плиток; m_mipStale - плитка устарела после пересборки
+    QVector<QImage> m_mips[MipLevels];
+    QVector<bool> m_mipStale[MipLevels];
+    QImage m_mipBackground[MipLevels];
+};
+
+template <typename DrawFn>
+void LayeredCanvas::paint(Layer which, const QRect &area, DrawFn draw)
+{
+    m_layers[which].paint(area, draw);
+    markDirty(area);
+}
+
+template <typename DrawFn>
+void LayeredCanvas::erase(Layer which, const QRect &area, DrawFn draw)
+{
+    m_layers[which].paint(area, [&](QPainter &painter) {
+        painter.setCompositionMode(QPainter::CompositionMode_Clear);
+        draw(painter);
+    });
+    m_layers[which].squeeze(area);
+    markDirty(area);
+}
+
+#endif // LAYEREDCANVAS_H
@@ -1,10 +1,18 @@
 #include "mainwindow.h"
 #include <QApplication>
+#include "tracing.h"
 
 int main(int argc, char *argv[])
 {
     QApplication a(argc, argv);
 
+    // CROC_TRACE=client.json - зоны горячих путей для chrome://tracing
+    const QString tracePath = qEnvironmentVariable("CROC_TRACE");
+    if (!tracePath.isEmpty()) {
+        Tracing::start(tracePath, "jsonclient " + QString::number(a.applicationPid()));
+        QObject::connect(&a, &QCoreApplication::aboutToQuit, &Tracing::stop);
+    }
+
     qApp->setWindowIcon(QIcon(":/images/crocIco.png"));
     MainWindow w;
     w.show();
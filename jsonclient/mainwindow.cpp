@@ -1,6 +1,10 @@
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
 #include <QJsonDocument>
+#include <QRandomGenerator>
+#include "tracing.h"
+#include "jsoncodec.h"
+#include "drawparser.h"
 
 MainWindow::MainWindow(QWidget *parent) :
     QMainWindow(parent),
@@ -15,6 +19,12 @@ MainWindow::MainWindow(QWidget *parent) :
     connect(m_socket, &QTcpSocket::disconnected, this, &MainWindow::onDisconnected);
     connect(m_socket, &QTcpSocket::errorOccurred, this, &MainWindow::onError);
     connect(m_socket, &QTcpSocket::connected, this, &MainWindow::onConnected);
+    connect(m_socket, &QTcpSocket::bytesWritten, this, [this]() {
+        m_stats.setOutboundBacklog(m_socket->bytesToWrite());
+    });
+
+    m_reconnectTimer.setSingleShot(true);
+    connect(&m_reconnectTimer, &QTimer::timeout, this, &MainWindow::reconnect);
 }
 
 MainWindow::~MainWindow()
@@ -59,6 +69,9 @@ void MainWindow::on_connectButton_clicked(){
 
 
     m_playerName = name;
+    m_room = ui->roomEdit->text().trimmed();
+    m_host = IP;
+    m_port = port;
     m_socket->connectToHost(IP, port);
 }
 
@@ -68,60 +81,234 @@ void MainWindow::sendJsonMessage(const QJsonObject &message){
 
         QJsonDocument doc(message);
         QByteArray jsonData = doc.toJson(QJsonDocument::Compact);
-        m_socket->write(jsonData + "\n");
+        if (m_deflate) {
+            m_socket->write(m_deflate->compress(jsonData + "\n"));
+        } else {
+            m_socket->write(jsonData + "\n");
+        }
         m_socket->flush();
+        m_stats.setOutboundBacklog(m_socket->bytesToWrite());
     }
 }
 
 void MainWindow::onConnected(){
+    m_migrating = false;
+    m_readBuffer.clear(); // Недочитанный хвост старого соединения не нужен
+    resetCompression();   // Сжатие договаривается заново на каждом соединении
+
+    if (m_gameWindow && m_gameWindow->canResume()) {
+        // Окно игры живо - просим сервер дослать пропущенное
+        m_reconnectAttempts = 0;
+        ui->statusLabel->setText("Переподключено к серверу");
+        QJsonObject resume = m_gameWindow->resumeRequest();
+        addSessionFields(resume);
+        sendJsonMessage(resume);
+        return;
+    }
+
     ui->statusLabel->setText("Подключено к серверу");
     ui->connectButton->setEnabled(false);
 
-    m_gameWindow = new GameWindow(m_socket, m_playerName, this); 
+    m_gameWindow = new GameWindow(m_socket, m_playerName, &m_stats, this); 
     m_gameWindow->show();
 
-    QJsonObject message;
-    message["type"] = "register";
-    message["name"] = m_playerName;
-    sendJsonMessage(message); 
+    sendJsonMessage(registerRequest());
     connect(m_gameWindow, &GameWindow::sendMessage, this, &MainWindow::sendJsonMessage);
+    connect(m_gameWindow, &GameWindow::sessionExpired, this, &MainWindow::registerAgain);
 
 }
 
-void MainWindow::onReadyRead()
+void MainWindow::addSessionFields(QJsonObject &request) const
 {
-    static QByteArray buffer;
-
-    buffer += m_socket->readAll();
+    // Какое сжатие умеет клиент; сервер выбирает в ответе
+    request["compression"] = QJsonArray{QString("deflate")};
+    // Сервер из нескольких процессов находит по комнате тот, где живет сессия
+    if (!m_room.isEmpty()) request["room"] = m_room;
+}
 
-    while (buffer.contains('\n')) {
-        int pos = buffer.indexOf('\n');
-        QByteArray messageData = buffer.left(pos);
-        buffer.remove(0, pos + 1);
+QJsonObject MainWindow::registerRequest() const
+{
+    QJsonObject message = Protocol::Json::encode(Protocol::MessageType::Register);
+    message["name"] = m_playerName;
+    addSessionFields(message);
+    return message;
+}
 
-        QJsonParseError error;
-        QJsonDocument doc = QJsonDocument::fromJson(messageData, &error);
+void MainWindow::registerAgain()
+{
+    sendJsonMessage(registerRequest());
+}
 
-        if (error.error != QJsonParseError::NoError) {
-            qDebug() << "JSON parse error:" << error.errorString();
+void MainWindow::onReadyRead()
+{
+    Tracing::Zone zone("onReadyRead");
+    QByteArray &buffer = m_readBuffer;
+
+    const QByteArray data = m_socket->readAll();
+    m_stats.recordWireBytes(data.size());
+    buffer += data;
+
+    while (true) {
+        if (!m_framed) {
+            int pos = buffer.indexOf('\n');
+            if (pos < 0) break;
+            if (handleDrawLine(buffer.constData(), pos)) {
+                buffer.remove(0, pos + 1);
+                continue;
+            }
+            QByteArray messageData = buffer.left(pos);
+            buffer.remove(0, pos + 1);
+            handleLine(messageData); // может включить сжатие для остатка буфера
             continue;
         }
 
-        //
-
-        if (doc.isObject()) {
-            qDebug() << "Client received:" << doc.toJson(QJsonDocument::Compact);
-            if (m_gameWindow) {
-                m_gameWindow->processServerMessage(doc.object());
+        StreamFrame::Channel channel;
+        QByteArray payload;
+        if (!StreamFrame::decode(buffer, channel, payload)) break;
+
+        InflateStream *inflater = (channel == StreamFrame::Room) ? m_roomInflate.data()
+                                                                 : m_directInflate.data();
+        QByteArray lines;
+        if (!inflater->decompress(payload, lines)) {
+            qDebug() << "Broken compressed stream, channel" << channel;
+            m_socket->abort();
+            return;
+        }
+        // Сервер сжимает только целые сообщения, кадр кончается на '\n'
+        for (const QByteArray &line : lines.split('\n')) {
+            if (!line.isEmpty()) {
+                handleLine(line);
             }
         }
     }
+    m_stats.setInboundBacklog(buffer.size());
+}
+
+bool MainWindow::handleDrawLine(const char *data, int size)
+{
+    static const QString DrawType = QStringLiteral("draw");
+    if (!m_gameWindow) return false;
+
+    Protocol::DrawCommand command;
+    qint64 seq;
+    {
+        Tracing::Zone zone("parseDraw");
+        if (!Protocol::parseDraw(data, size, command, seq)) return false;
+    }
+    m_stats.recordInbound(DrawType, size);
+    m_gameWindow->processDrawCommand(command, seq);
+    return true;
+}
+
+void MainWindow::handleLine(const QByteArray &messageData)
+{
+    if (handleDrawLine(messageData.constData(), messageData.size())) return;
+
+    QJsonParseError error;
+    QJsonDocument doc;
+    {
+        Tracing::Zone zone("parseJson");
+        doc = QJsonDocument::fromJson(messageData, &error);
+    }
+
+    if (error.error != QJsonParseError::NoError) {
+        qDebug() << "JSON parse error:" << error.errorString();
+        return;
+    }
+
+    if (doc.isObject()) {
+        qDebug() << "Client received:" << doc.toJson(QJsonDocument::Compact);
+        const QJsonObject message = doc.object();
+        const QString type = message["type"].toString();
+        const Protocol::MessageType kind = Protocol::messageType(type);
+        m_stats.recordInbound(type, messageData.size());
+        if ((kind == Protocol::MessageType::Registered || kind == Protocol::MessageType::Resumed)
+                && message["compression"].toString() == "deflate") {
+            startCompression();
+        }
+        if (m_gameWindow) {
+            m_gameWindow->processServerMessage(message);
+        }
+        if (kind == Protocol::MessageType::Migrate && m_gameWindow && m_gameWindow->canResume()) {
+            // Комната переехала в другой процесс сервера: сразу переподключаемся,
+            // маршрутизатор сервера приведет resume к новому владельцу
+            m_migrating = true;
+            QTimer::singleShot(0, this, &MainWindow::reconnect);
+        }
+    }
+}
+
+void MainWindow::startCompression()
+{
+    m_framed = true;
+    m_directInflate.reset(new InflateStream);
+    m_roomInflate.reset(new InflateStream);
+
+    // Последняя несжатая строка: сервер переключит распаковку после нее
+    sendJsonMessage(Protocol::Json::encode(Protocol::MessageType::CompressStart));
+    m_deflate.reset(new DeflateStream);
+}
+
+void MainWindow::resetCompression()
+{
+    m_framed = false;
+    m_directInflate.reset();
+    m_roomInflate.reset();
+    m_deflate.reset();
 }
 
 
 
 void MainWindow::onDisconnected()
 {
+    // Старое соединение закрыли мы сами, новое уже устанавливается
+    if (m_migrating) return;
+
+    // Короткий обрыв не должен стоить игроку очков - пробуем вернуться в сессию
+    if (m_gameWindow && m_gameWindow->canResume() && m_reconnectAttempts < MaxReconnectAttempts) {
+        scheduleReconnect();
+        return;
+    }
+
+    closeGameWindow();
+}
+
+void MainWindow::onError(QAbstractSocket::SocketError error){
+    m_migrating = false;
+    if (m_gameWindow && m_gameWindow->canResume() && m_reconnectAttempts < MaxReconnectAttempts) {
+        scheduleReconnect();
+        return;
+    }
+
+    QMessageBox::warning(this, "Ошибка подключения", m_socket->errorString());
+    closeGameWindow();
+}
+
+void MainWindow::scheduleReconnect()
+{
+    // disconnected и errorOccurred приходят парой - второй раз не планируем
+    if (m_reconnectTimer.isActive()) return;
+
+    const int delay = qMin(MaxReconnectDelayMs, InitialReconnectDelayMs << m_reconnectAttempts);
+    // Случайный разброс, чтобы после падения сервера клиенты не шли все разом
+    const int jittered = delay / 2 + QRandomGenerator::global()->bounded(delay / 2 + 1);
+    ++m_reconnectAttempts;
+
+    ui->statusLabel->setText(QString("Связь потеряна, попытка %1 из %2...")
+                                 .arg(m_reconnectAttempts).arg(MaxReconnectAttempts));
+    m_reconnectTimer.start(jittered);
+}
+
+void MainWindow::reconnect()
+{
+    m_socket->abort();
+    m_socket->connectToHost(m_host, m_port);
+}
+
+void MainWindow::closeGameWindow()
+{
+    m_reconnectTimer.stop();
+    m_reconnectAttempts = 0;
     ui->statusLabel->setText("Отключено от сервера");
     ui->connectButton->setEnabled(true);
 
@@ -131,8 +318,3 @@ void MainWindow::onDisconnected()
         m_gameWindow = nullptr;
     }
 }
-
-void MainWindow::onError(QAbstractSocket::SocketError error){
-    QMessageBox::warning(this, "Ошибка подключения", m_socket->errorString());
-    onDisconnected();
-}
@@ -6,7 +6,11 @@
 #include <QMessageBox>
 #include <QRegularExpression>
 #include <QHostAddress>
+#include <QTimer>
+#include <QScopedPointer>
 #include "gamewindow.h"
+#include "deflatestream.h"
+#include "perfstats.h"
 
 namespace Ui {
 class MainWindow;
@@ -21,6 +25,8 @@ public:
     ~MainWindow() override;
 
     void sendJsonMessage(const QJsonObject &message);
+    // Новый вход под тем же именем, в ту же комнату и с тем же предложением сжатия
+    void registerAgain();
 
 private slots:
     void on_connectButton_clicked();
@@ -28,12 +34,43 @@ private slots:
     void onConnected();
     void onDisconnected();
     void onError(QAbstractSocket::SocketError error);
+    void reconnect();
 
 private:
+    void scheduleReconnect();
+    void closeGameWindow();
+    void handleLine(const QByteArray &line);
+    // Быстрый путь для "draw" прямо из байтов строки; false - строку разбирает handleLine
+    bool handleDrawLine(const char *data, int size);
+    void addSessionFields(QJsonObject &request) const;
+    QJsonObject registerRequest() const;
+    void startCompression();
+    void resetCompression();
+
     Ui::MainWindow *ui;
     QTcpSocket* m_socket;
     QString m_playerName;
+    QString m_room;         // пусто - комната сервера по умолчанию
     GameWindow* m_gameWindow = nullptr;
+    QByteArray m_readBuffer;
+    PerfStats m_stats;      // Живет дольше окна игры: переподключение не сбрасывает счетчики
+
+    // Сжатие, согласованное в register/resume: после него сервер шлет кадры
+    // двух каналов (личный и общий поток комнаты), у каждого свой распаковщик
+    bool m_framed = false;
+    QScopedPointer<InflateStream> m_directInflate;
+    QScopedPointer<InflateStream> m_roomInflate;
+    QScopedPointer<DeflateStream> m_deflate;
+
+    // Автоматическое переподключение с экспоненциальной задержкой
+    static const int MaxReconnectAttempts = 8;
+    static const int InitialReconnectDelayMs = 500;
+    static const int MaxReconnectDelayMs = 10000;
+    QString m_host;
+    quint16 m_port = 0;
+    QTimer m_reconnectTimer;
+    int m_reconnectAttempts = 0;
+    bool m_migrating = false;   // сервер перенес комнату, переподключаемся без паузы
 
 
 };
@@ -0,0 +1,197 @@
+#include "perfstats.h"
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QDateTime>
+#include <QVector>
+#include <algorithm>
+
+namespace {
+
+QString formatBytes(qint64 bytes)
+{
+    if (bytes < 1024) return QString("%1 Б").arg(bytes);
+    if (bytes < 1024 * 1024) return QString("%1 КБ").arg(bytes / 1024.0, 0, 'f', 1);
+    return QString("%1 МБ").arg(bytes / (1024.0 * 1024.0), 0, 'f', 1);
+}
+
+}
+
+void Histogram::add(qint64 value)
+{
+    int bucket = 0;
+    while (bucket < Buckets - 1 && value > (m_first << bucket)) {
+        ++bucket;
+    }
+    ++m_counts[bucket];
+    ++m_count;
+    m_sum += value;
+    m_max = qMax(m_max, value);
+}
+
+qint64 Histogram::percentile(int p) const
+{
+    if (m_count == 0) return 0;
+    const qint64 target = (m_count * p + 99) / 100;
+    qint64 seen = 0;
+    for (int bucket = 0; bucket < Buckets - 1; ++bucket) {
+        seen += m_counts[bucket];
+        if (seen >= target) return qMin(m_first << bucket, m_max);
+    }
+    return m_max;
+}
+
+QJsonObject Histogram::toJson() const
+{
+    QJsonArray buckets;
+    for (int bucket = 0; bucket < Buckets; ++bucket) {
+        QJsonObject entry;
+        // У последней корзины верхней границы нет
+        if (bucket < Buckets - 1) entry["le"] = m_first << bucket;
+        entry["count"] = m_counts[bucket];
+        buckets.append(entry);
+    }
+    QJsonObject result;
+    result["count"] = m_count;
+    result["mean"] = mean();
+    result["p50"] = percentile(50);
+    result["p95"] = percentile(95);
+    result["p99"] = percentile(99);
+    result["max"] = m_max;
+    result["buckets"] = buckets;
+    return result;
+}
+
+PerfStats::PerfStats(QObject *parent) : QObject(parent)
+{
+    m_uptime.start();
+    m_secondTimer.setInterval(1000);
+    connect(&m_secondTimer, &QTimer::timeout, this, &PerfStats::rollOver);
+    m_secondTimer.start();
+}
+
+void PerfStats::recordPaint(qint64 us)
+{
+    m_paintUs.add(us);
+    m_lastPaintUs = us;
+    ++m_current.frames;
+}
+
+void PerfStats::recordInbound(const QString &type, int bytes)
+{
+    TypeCounter &current = m_current.inbound[type];
+    ++current.messages;
+    current.bytes += bytes;
+    TypeCounter &total = m_inboundTotal[type];
+    ++total.messages;
+    total.bytes += bytes;
+}
+
+void PerfStats::recordRtt(qint64 ms)
+{
+    m_rttMs.add(ms);
+    m_lastRttMs = ms;
+}
+
+void PerfStats::setCanvasMemory(qint64 canvasBytes, qint64 undoBytes)
+{
+    m_canvasBytes = canvasBytes;
+    m_undoBytes = undoBytes;
+}
+
+QJsonObject PerfStats::countersToJson(const QHash<QString, TypeCounter> &counters)
+{
+    QJsonObject result;
+    for (auto it = counters.begin(); it != counters.end(); ++it) {
+        QJsonObject counter;
+        counter["messages"] = it->messages;
+        counter["bytes"] = it->bytes;
+        result[it.key()] = counter;
+    }
+    return result;
+}
+
+void PerfStats::rollOver()
+{
+    m_lastSecond = m_current;
+    m_current = Window();
+    emit secondElapsed();
+}
+
+QStringList PerfStats::hudLines() const
+{
+    QStringList lines;
+    lines << QString("Кадр: %1 мс, p50 %2 / p95 %3 / max %4 мс, %5 кадр/с")
+             .arg(m_lastPaintUs / 1000.0, 0, 'f', 1)
+             .arg(m_paintUs.percentile(50) / 1000.0, 0, 'f', 1)
+             .arg(m_paintUs.percentile(95) / 1000.0, 0, 'f', 1)
+             .arg(m_paintUs.max() / 1000.0, 0, 'f', 1)
+             .arg(m_lastSecond.frames);
+    lines << QString("Команды рисования: %1/с").arg(m_lastSecond.remoteCommands);
+
+    qint64 messages = 0;
+    qint64 bytes = 0;
+    QVector<QPair<qint64, QString>> byType;
+    for (auto it = m_lastSecond.inbound.begin(); it != m_lastSecond.inbound.end(); ++it) {
+        messages += it->messages;
+        bytes += it->bytes;
+        byType.append(qMakePair(it->bytes, it.key()));
+    }
+    lines << QString("Входящие: %1 сообщ/с, %2/с (из сети %3/с)")
+             .arg(messages).arg(formatBytes(bytes)).arg(formatBytes(m_lastSecond.wireBytes));
+    // Самые тяжелые типы за секунду
+    std::sort(byType.begin(), byType.end(), [](const QPair<qint64, QString> &a, const QPair<qint64, QString> &b) {
+        return a.first > b.first;
+    });
+    for (int i = 0; i < byType.size() && i < 4; ++i) {
+        const TypeCounter counter = m_lastSecond.inbound.value(byType[i].second);
+        lines << QString("  %1: %2/с, %3/с").arg(byType[i].second).arg(counter.messages)
+                 .arg(formatBytes(counter.bytes));
+    }
+
+    lines << QString("Очереди: прием %1, отправка %2")
+             .arg(formatBytes(m_inboundBacklog)).arg(formatBytes(m_outboundBacklog));
+    lines << QString("Память: холст %1, undo %2")
+             .arg(formatBytes(m_canvasBytes)).arg(formatBytes(m_undoBytes));
+    if (m_lastRttMs < 0) {
+        lines << QString("RTT: нет данных");
+    } else {
+        lines << QString("RTT: %1 мс, p50 %2 / p95 %3 / max %4 мс")
+                 .arg(m_lastRttMs).arg(m_rttMs.percentile(50))
+                 .arg(m_rttMs.percentile(95)).arg(m_rttMs.max());
+    }
+    return lines;
+}
+
+QJsonObject PerfStats::toJson() const
+{
+    QJsonObject lastSecond;
+    lastSecond["frames"] = m_lastSecond.frames;
+    lastSecond["remoteCommands"] = m_lastSecond.remoteCommands;
+    lastSecond["wireBytes"] = m_lastSecond.wireBytes;
+    lastSecond["inbound"] = countersToJson(m_lastSecond.inbound);
+
+    QJsonObject result;
+    result["time"] = QDateTime::currentDateTime().toString(Qt::ISODate);
+    result["uptimeMs"] = m_uptime.elapsed();
+    result["paintUs"] = m_paintUs.toJson();
+    result["rttMs"] = m_rttMs.toJson();
+    result["lastSecond"] = lastSecond;
+    result["inboundTotal"] = countersToJson(m_inboundTotal);
+    result["remoteCommandsTotal"] = m_remoteCommandsTotal;
+    result["inboundBacklogBytes"] = m_inboundBacklog;
+    result["outboundBacklogBytes"] = m_outboundBacklog;
+    result["canvasBytes"] = m_canvasBytes;
+    result["undoBytes"] = m_undoBytes;
+    return result;
+}
+
+bool PerfStats::exportTo(const QString &path) const
+{
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        return false;
+    }
+    file.write(QJsonDocument(toJson()).toJson(QJsonDocument::Indented));
+    return true;
+}
@@ -0,0 +1,100 @@
+#ifndef PERFSTATS_H
+#define PERFSTATS_H
+
+#include <QObject>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include <QJsonObject>
+
+// Гистограмма с фиксированными корзинами: корзина i - значения до first << i,
+// последняя - все, что больше. Запись без выделения памяти.
+class Histogram
+{
+public:
+    static const int Buckets = 14;
+
+    explicit Histogram(qint64 first) : m_first(first) {}
+
+    void add(qint64 value);
+    qint64 count() const { return m_count; }
+    qint64 max() const { return m_max; }
+    qint64 mean() const { return m_count ? m_sum / m_count : 0; }
+    // Верхняя граница корзины, куда попал процентиль p (0..100)
+    qint64 percentile(int p) const;
+    QJsonObject toJson() const;
+
+private:
+    qint64 m_first;
+    qint64 m_counts[Buckets] = {};
+    qint64 m_count = 0;
+    qint64 m_sum = 0;
+    qint64 m_max = 0;
+};
+
+// Счетчики клиента для HUD и для отчета об ошибке: время кадра, входящий поток
+// по типам сообщений, очереди сокета, память холста и RTT до сервера.
+// Раз в секунду счетчики текущей секунды становятся "за последнюю секунду" -
+// по ним HUD показывает скорости. Сеть, сервер и отрисовку так можно разделить:
+// растет RTT - сеть или сервер, растет время кадра - отрисовка.
+class PerfStats : public QObject
+{
+    Q_OBJECT
+public:
+    explicit PerfStats(QObject *parent = nullptr);
+
+    void recordPaint(qint64 us);
+    void recordRemoteCommand() { ++m_current.remoteCommands; ++m_remoteCommandsTotal; }
+    void recordInbound(const QString &type, int bytes);
+    void recordWireBytes(qint64 bytes) { m_current.wireBytes += bytes; }
+    void recordRtt(qint64 ms);
+
+    void setInboundBacklog(qint64 bytes) { m_inboundBacklog = bytes; }
+    void setOutboundBacklog(qint64 bytes) { m_outboundBacklog = bytes; }
+    void setCanvasMemory(qint64 canvasBytes, qint64 undoBytes);
+
+    QStringList hudLines() const;
+    QJsonObject toJson() const;
+    bool exportTo(const QString &path) const;
+
+signals:
+    // Скорости обновились: пора перерисовать HUD
+    void secondElapsed();
+
+private:
+    struct TypeCounter {
+        qint64 messages = 0;
+        qint64 bytes = 0;
+    };
+    struct Window {
+        qint64 frames = 0;
+        qint64 remoteCommands = 0;
+        qint64 wireBytes = 0;           // байты из сокета, до распаковки
+        QHash<QString, TypeCounter> inbound;
+    };
+
+    void rollOver();
+    static QJsonObject countersToJson(const QHash<QString, TypeCounter> &counters);
+
+    Window m_current;
+    Window m_lastSecond;
+    QHash<QString, TypeCounter> m_inboundTotal;
+    qint64 m_remoteCommandsTotal = 0;
+
+    Histogram m_paintUs{125};   // 125 мкс ... 1 с
+    Histogram m_rttMs{1};       // 1 мс ... 8 с
+    qint64 m_lastPaintUs = 0;
+    qint64 m_lastRttMs = -1;
+
+    qint64 m_inboundBacklog = 0;    // принято, но еще не разобрано
+    qint64 m_outboundBacklog = 0;   // ждет отправки в сокете
+    qint64 m_canvasBytes = 0;
+    qint64 m_undoBytes = 0;
+
+    QTimer m_secondTimer;
+    QElapsedTimer m_uptime;
+};
+
+#endif // PERFSTATS_H
@@ -0,0 +1,214 @@
+#include "tiledimage.h"
+#include <QRegion>
+
+TiledImage::TiledImage()
+{
+}
+
+TiledImage::TiledImage(const QSize &size, const QColor &background)
+{
+    resetBackgroundTile(background);
+    resize(size);
+}
+
+TiledImage TiledImage::fromImage(const QImage &image, const QColor &background)
+{
+    TiledImage result(image.size(), background);
+    const QImage source = image.convertToFormat(TileFormat);
+
+    for (int row = 0; row < result.m_rows; ++row) {
+        for (int column = 0; column < result.m_columns; ++column) {
+            QImage &target = result.tileForWrite(column, row);
+            QPainter painter(&target);
+            painter.setCompositionMode(QPainter::CompositionMode_Source);
+            painter.drawImage(QPoint(0, 0), source, result.tileRect(column, row));
+        }
+    }
+    result.squeeze(result.rect());
+    return result;
+}
+
+QImage TiledImage::toImage() const
+{
+    QImage result(m_size, TileFormat);
+    result.fill(m_background);
+
+    QPainter painter(&result);
+    draw(painter, rect());
+    return result;
+}
+
+QRgb TiledImage::pixel(const QPoint &p) const
+{
+    const QImage &t = tile(p.x() / TileSize, p.y() / TileSize);
+    return t.pixel(p.x() % TileSize, p.y() % TileSize);
+}
+
+void TiledImage::setPixel(const QPoint &p, QRgb color)
+{
+    QImage &t = tileForWrite(p.x() / TileSize, p.y() / TileSize);
+    t.setPixel(p.x() % TileSize, p.y() % TileSize, color);
+}
+
+void TiledImage::fill(const QColor &color)
+{
+    resetBackgroundTile(color);
+    m_tiles.fill(m_backgroundTile);
+}
+
+void TiledImage::resize(const QSize &newSize)
+{
+    if (m_backgroundTile.isNull()) {
+        resetBackgroundTile(Qt::white);
+    }
+
+    const int newColumns = (newSize.width() + TileSize - 1) / TileSize;
+    const int newRows = (newSize.height() + TileSize - 1) / TileSize;
+
+    QVector<QImage> tiles(newColumns * newRows, m_backgroundTile);
+    for (int row = 0; row < qMin(m_rows, newRows); ++row) {
+        for (int column = 0; column < qMin(m_columns, newColumns); ++column) {
+            tiles[row * newColumns + column] = tile(column, row);
+        }
+    }
+
+    // Пиксели за новой границей не должны всплыть при следующем увеличении
+    const QRect kept(QPoint(0, 0), m_size.boundedTo(newSize));
+    m_tiles = tiles;
+    m_columns = newColumns;
+    m_rows = newRows;
+    m_size = newSize;
+
+    for (int row = 0; row < m_rows; ++row) {
+        for (int column = 0; column < m_columns; ++column) {
+            const QRect r = tileRect(column, row);
+            if (isBackgroundTile(column, row) || kept.contains(r)) continue;
+
+            QImage &target = tileForWrite(column, row);
+            QPainter painter(&target);
+            painter.setCompositionMode(QPainter::CompositionMode_Source);
+            QRegion stale = QRegion(r) - QRegion(kept);
+            painter.translate(-r.topLeft());
+            for (const QRect &part : stale) {
+                painter.fillRect(part, m_background);
+            }
+        }
+    }
+    squeeze(rect());
+}
+
+void TiledImage::squeeze(const QRect &area)
+{
+    const QRect span = tileSpan(area);
+    if (span.isEmpty()) return;
+
+    const QRgb bg = m_backgroundTile.pixel(0, 0);
+    for (int row = span.top(); row <= span.bottom(); ++row) {
+        for (int column = span.left(); column <= span.right(); ++column) {
+            if (isBackgroundTile(column, row)) continue;
+
+            const QImage &t = tile(column, row);
+            bool blank = true;
+            for (int y = 0; y < TileSize && blank; ++y) {
+                const QRgb *line = reinterpret_cast<const QRgb *>(t.constScanLine(y));
+                for (int x = 0; x < TileSize; ++x) {
+                    if (line[x] != bg) {
+                        blank = false;
+                        break;
+                    }
+                }
+            }
+            if (blank) {
+                m_tiles[row * m_columns + column] = m_backgroundTile;
+            }
+        }
+    }
+}
+
+void TiledImage::resetTiles(const QRect &area)
+{
+    const QRect span = tileSpan(area);
+    if (span.isEmpty()) return;
+
+    for (int row = span.top(); row <= span.bottom(); ++row) {
+        for (int column = span.left(); column <= span.right(); ++column) {
+            m_tiles[row * m_columns + column] = m_backgroundTile;
+        }
+    }
+}
+
+void TiledImage::draw(QPainter &painter, const QRect &exposed) const
+{
+    const QRect area = exposed.intersected(rect());
+    const QRect span = tileSpan(area);
+    if (span.isEmpty()) return;
+
+    for (int row = span.top(); row <= span.bottom(); ++row) {
+        for (int column = span.left(); column <= span.right(); ++column) {
+            const QRect r = tileRect(column, row).intersected(rect());
+            painter.drawImage(r.topLeft(), tile(column, row), QRect(QPoint(0, 0), r.size()));
+        }
+    }
+}
+
+QRect TiledImage::tileRect(int column, int row) const
+{
+    return QRect(column * TileSize, row * TileSize, TileSize, TileSize);
+}
+
+QRect TiledImage::tileSpan(const QRect &area) const
+{
+    const QRect clipped = area.normalized().intersected(rect());
+    if (clipped.isEmpty()) return QRect();
+
+    return QRect(QPoint(clipped.left() / TileSize, clipped.top() / TileSize),
+                 QPoint(clipped.right() / TileSize, clipped.bottom() / TileSize));
+}
+
+bool TiledImage::isBackgroundTile(int column, int row) const
+{
+    // constBits() не отсоединяет данные, совпадение указателей = общая плитка
+    return tile(column, row).constBits() == m_backgroundTile.constBits();
+}
+
+qint64 TiledImage::memoryUsage() const
+{
+    qint64 total = 0;
+    for (int row = 0; row < m_rows; ++row) {
+        for (int column = 0; column < m_columns; ++column) {
+            if (!isBackgroundTile(column, row)) {
+                total += tile(column, row).sizeInBytes();
+            }
+        }
+    }
+    return total;
+}
+
+qint64 TiledImage::memoryUsage(QSet<const uchar*> &seen) const
+{
+    qint64 total = 0;
+    for (int row = 0; row < m_rows; ++row) {
+        for (int column = 0; column < m_columns; ++column) {
+            if (isBackgroundTile(column, row)) continue;
+            const QImage &t = tile(column, row);
+            if (!seen.contains(t.constBits())) {
+                seen.insert(t.constBits());
+                total += t.sizeInBytes();
+            }
+        }
+    }
+    return total;
+}
+
+QImage &TiledImage::tileForWrite(int column, int row)
+{
+    // Неконстантный доступ к QImage отсоединит плитку при первой записи
+    return m_tiles[row * m_columns + column];
+}
+
+void TiledImage::resetBackgroundTile(const QColor &color)
+{
+    m_background = color;
+    m_backgroundTile = QImage(TileSize, TileSize, TileFormat);
+    m_backgroundTile.fill(color);
+}
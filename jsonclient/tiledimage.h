@@ -0,0 +1,96 @@
+#ifndef TILEDIMAGE_H
+#define TILEDIMAGE_H
+
+#include <QColor>
+#include <QImage>
+#include <QPainter>
+#include <QRect>
+#include <QSize>
+#include <QVector>
+#include <QSet>
+
+// Холст, разбитый на плитки TileSize x TileSize.
+// Каждая плитка - неявно разделяемый QImage, поэтому копия TiledImage стоит
+// O(число плиток) копирований указателей, а при записи дублируются только
+// затронутые плитки. Все плитки цвета фона ссылаются на одну общую плитку.
+class TiledImage
+{
+public:
+    static const int TileSize = 64;
+    static const QImage::Format TileFormat = QImage::Format_ARGB32_Premultiplied;
+
+    TiledImage();
+    TiledImage(const QSize &size, const QColor &background);
+
+    static TiledImage fromImage(const QImage &image, const QColor &background);
+    QImage toImage() const;
+
+    bool isNull() const { return m_size.isEmpty(); }
+    QSize size() const { return m_size; }
+    int width() const { return m_size.width(); }
+    int height() const { return m_size.height(); }
+    QRect rect() const { return QRect(QPoint(0, 0), m_size); }
+    QColor background() const { return m_background; }
+
+    bool valid(const QPoint &p) const { return rect().contains(p); }
+    QRgb pixel(const QPoint &p) const;
+    void setPixel(const QPoint &p, QRgb color);
+
+    // Сбрасывает все плитки на общую плитку нового цвета фона
+    void fill(const QColor &color);
+    // Меняет размер, сохраняя содержимое в левом верхнем углу
+    void resize(const QSize &newSize);
+    // Возвращает на общую плитку те плитки из area, что снова стали цвета фона
+    void squeeze(const QRect &area);
+    // Сбрасывает на общую плитку фона все плитки, задевающие area, целиком
+    void resetTiles(const QRect &area);
+
+    // Рисует draw(QPainter&) в координатах холста только на плитках, пересекающих area
+    template <typename DrawFn>
+    void paint(const QRect &area, DrawFn draw);
+
+    // Выводит плитки, попадающие в exposed (координаты холста)
+    void draw(QPainter &painter, const QRect &exposed) const;
+
+    int columns() const { return m_columns; }
+    int rows() const { return m_rows; }
+    QRect tileRect(int column, int row) const;
+    QRect tileSpan(const QRect &area) const; // диапазон колонок/строк плиток для area
+    const QImage &tile(int column, int row) const { return m_tiles.at(row * m_columns + column); }
+    bool isBackgroundTile(int column, int row) const;
+
+    // Байты пикселей, принадлежащих только этому холсту (без общей плитки фона)
+    qint64 memoryUsage() const;
+    // То же, но без плиток из seen; посчитанные плитки добавляются в seen.
+    // Для копий, которые делят плитки друг с другом (снимки Undo)
+    qint64 memoryUsage(QSet<const uchar*> &seen) const;
+
+private:
+    QImage &tileForWrite(int column, int row);
+    void resetBackgroundTile(const QColor &color);
+
+    QSize m_size;
+    QColor m_background;
+    QImage m_backgroundTile;
+    QVector<QImage> m_tiles;
+    int m_columns = 0;
+    int m_rows = 0;
+};
+
+template <typename DrawFn>
+void TiledImage::paint(const QRect &area, DrawFn draw)
+{
+    const QRect span = tileSpan(area);
+    if (span.isEmpty()) return;
+
+    for (int row = span.top(); row <= span.bottom(); ++row) {
+        for (int column = span.left(); column <= span.right(); ++column) {
+            QImage &target = tileForWrite(column, row);
+            QPainter painter(&target);
+            painter.translate(-column * TileSize, -row * TileSize);
+            draw(painter);
+        }
+    }
+}
+
+#endif // TILEDIMAGE_H
@@ -0,0 +1,238 @@
+#include "chatfilter.h"
+#include "guessmatcher.h"
+#include <QDebug>
+
+namespace {
+
+// Окно последних символов сообщения: хватает на самый длинный образец
+const int WindowSize = 128;
+const int MaxSpans = 16;
+
+bool isEnding(ushort c)
+{
+    switch (c) {
+    case 0x0430: case 0x0435: case 0x0438: case 0x0439: case 0x043E:   // а е и й о
+    case 0x0443: case 0x044B: case 0x044C: case 0x044E: case 0x044F:   // у ы ь ю я
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Образец засчитывается только с начала слова: "кот" не ловится в "скоту"
+bool startsWord(const ushort *symbols, int start)
+{
+    return start == 0 || symbols[(start - 1) % WindowSize] == ' ';
+}
+
+}
+
+ChatFilter::ChatFilter()
+{
+    rebuild();
+}
+
+QVector<ushort> ChatFilter::normalize(const QString &text)
+{
+    // Так же, как GuessMatcher::normalize, но всегда в кириллическом режиме:
+    // у фильтра одно сообщение на все образцы, и "kot" должен ловиться как "кот"
+    QVector<ushort> out;
+    bool pendingSpace = false;
+    for (QChar c : text) {
+        if (c.category() == QChar::Mark_NonSpacing) continue;
+        if (!c.isLetterOrNumber()) {
+            pendingSpace = !out.isEmpty();
+            continue;
+        }
+        if (pendingSpace) {
+            out.append(' ');
+            pendingSpace = false;
+        }
+        out.append(GuessMatcher::fold(c, true));
+    }
+    return out;
+}
+
+QVector<ushort> ChatFilter::stem(QVector<ushort> symbols)
+{
+    // Грубая основа: до двух гласных (и ь) с конца, но не короче трех букв
+    for (int i = 0; i < 2 && symbols.size() > 3 && isEnding(symbols.last()); ++i) {
+        symbols.removeLast();
+    }
+    return symbols;
+}
+
+void ChatFilter::setBlocklist(const QStringList &words)
+{
+    m_blockPatterns.clear();
+    for (const QString &word : words) {
+        Pattern pattern{normalize(word), Blocked};
+        if (!pattern.symbols.isEmpty()) m_blockPatterns.append(pattern);
+    }
+    rebuild();
+}
+
+void ChatFilter::setAnswer(const QString &word, const QStringList &aliases)
+{
+    m_answerPatterns.clear();
+    QStringList variants = aliases;
+    variants.prepend(word);
+    for (const QString &variant : variants) {
+        Pattern pattern{stem(normalize(variant)), Answer};
+        if (!pattern.symbols.isEmpty()) m_answerPatterns.append(pattern);
+    }
+    rebuild();
+}
+
+void ChatFilter::clearAnswer()
+{
+    if (m_answerPatterns.isEmpty()) return;
+    m_answerPatterns.clear();
+    rebuild();
+}
+
+void ChatFilter::rebuild()
+{
+    // Сжатый алфавит: номера получают только символы образцов, все прочее - 0
+    m_alphabet.fill(0, 0x10000);
+    m_alphabetSize = 1;
+    QVector<const Pattern *> patterns;
+    for (const QVector<Pattern> *list : {&m_answerPatterns, &m_blockPatterns}) {
+        for (const Pattern &pattern : *list) {
+            if (pattern.symbols.size() > MaxPatternLength) {
+                qDebug() << "Chat filter: pattern is longer than" << MaxPatternLength << "characters, skipped";
+                continue;
+            }
+            int added = 0;
+            for (ushort c : pattern.symbols) {
+                if (m_alphabet[c] == 0) ++added;
+            }
+            if (m_alphabetSize + added > 256) {
+                qDebug() << "Chat filter: too many different characters, pattern skipped";
+                continue;
+            }
+            for (ushort c : pattern.symbols) {
+                if (m_alphabet[c] == 0) m_alphabet[c] = static_cast<quint8>(m_alphabetSize++);
+            }
+            patterns.append(&pattern);
+        }
+    }
+
+    // Бор образцов; -1 - перехода нет
+    const int k = m_alphabetSize;
+    m_delta.fill(-1, k);
+    m_answerLength.fill(0, 1);
+    m_blockLength.fill(0, 1);
+    for (const Pattern *pattern : patterns) {
+        int state = 0;
+        for (ushort c : pattern->symbols) {
+            const int symbol = m_alphabet[c];
+            if (m_delta[state * k + symbol] < 0) {
+                m_delta[state * k + symbol] = m_answerLength.size();
+                m_delta.insert(m_delta.size(), k, -1);
+                m_answerLength.append(0);
+                m_blockLength.append(0);
+            }
+            state = m_delta[state * k + symbol];
+        }
+        const quint8 length = static_cast<quint8>(pattern->symbols.size());
+        if (pattern->kind == Answer) m_answerLength[state] = length;
+        else m_blockLength[state] = length;
+    }
+
+    // Обход в ширину: ссылки неудач превращают бор в полный автомат
+    const int states = m_answerLength.size();
+    QVector<qint32> fail(states, 0);
+    m_outputLink.fill(-1, states);
+    QVector<int> queue;
+    queue.reserve(states);
+    for (int symbol = 0; symbol < k; ++symbol) {
+        qint32 &next = m_delta[symbol];
+        if (next < 0) next = 0;
+        else queue.append(next);
+    }
+    for (int head = 0; head < queue.size(); ++head) {
+        const int state = queue[head];
+        const int f = fail[state];
+        m_outputLink[state] = (m_answerLength[f] || m_blockLength[f]) ? f : m_outputLink[f];
+        for (int symbol = 0; symbol < k; ++symbol) {
+            qint32 &next = m_delta[state * k + symbol];
+            if (next < 0) {
+                next = m_delta[f * k + symbol];
+            } else {
+                fail[next] = m_delta[f * k + symbol];
+                queue.append(next);
+            }
+        }
+    }
+}
+
+ChatFilter::Verdict ChatFilter::filter(QString &text) const
+{
+    if (m_answerLength.size() == 1) return Clean;
+
+    // Для каждого символа в окне - где он в исходном тексте и сам символ:
+    // по нему видно, начинается ли совпадение с начала слова
+    int origin[WindowSize];
+    ushort symbols[WindowSize];
+    int spanStart[MaxSpans];
+    int spanEnd[MaxSpans];
+    int spans = 0;
+
+    const int k = m_alphabetSize;
+    int state = 0;
+    int count = 0;
+    bool pendingSpace = false;
+    const QChar *data = text.constData();
+    const int size = text.size();
+
+    for (int i = 0; i < size; ++i) {
+        const QChar c = data[i];
+        if (c.category() == QChar::Mark_NonSpacing) continue;
+        if (!c.isLetterOrNumber()) {
+            if (count > 0 && !pendingSpace) {
+                pendingSpace = true;
+                origin[count % WindowSize] = i;
+            }
+            continue;
+        }
+
+        for (int step = pendingSpace ? 0 : 1; step < 2; ++step) {
+            const ushort symbol = step == 0 ? ushort(' ') : GuessMatcher::fold(c, true);
+            if (step == 1) origin[count % WindowSize] = i;
+            symbols[count % WindowSize] = symbol;
+            state = m_delta[state * k + m_alphabet[symbol]];
+            ++count;
+
+            for (int s = state; s > 0; s = m_outputLink[s]) {
+                if (m_answerLength[s] && startsWord(symbols, count - m_answerLength[s])) {
+                    return Withheld;
+                }
+                const int length = m_blockLength[s];
+                if (length == 0 || !startsWord(symbols, count - length)) continue;
+
+                const int from = origin[(count - length) % WindowSize];
+                if (spans > 0 && from <= spanEnd[spans - 1] + 1) {
+                    spanStart[spans - 1] = qMin(spanStart[spans - 1], from);
+                    spanEnd[spans - 1] = i;
+                } else if (spans < MaxSpans) {
+                    spanStart[spans] = from;
+                    spanEnd[spans] = i;
+                    ++spans;
+                } else {
+                    // Места нет: последний отрезок дотягиваем до конца совпадения
+                    spanEnd[spans - 1] = i;
+                }
+            }
+        }
+        pendingSpace = false;
+    }
+
+    if (spans == 0) return Clean;
+    for (int span = 0; span < spans; ++span) {
+        for (int i = spanStart[span]; i <= spanEnd[span]; ++i) {
+            if (text.at(i).isLetterOrNumber()) text[i] = '*';
+        }
+    }
+    return Masked;
+}
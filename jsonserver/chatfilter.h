@@ -0,0 +1,58 @@
+#ifndef CHATFILTER_H
+#define CHATFILTER_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+// Фильтр чата: автомат Ахо-Корасик по всем образцам сразу, собираемый на раунд.
+// Образцы - основы загаданного слова и его вариантов (без окончания, так что
+// "яблок" ловит и "яблоки", и "яблоком") и общий список запрещенных слов.
+// Текст и образцы сворачиваются как у GuessMatcher (регистр, ё, двойники букв),
+// а разделители схлопываются в пробел. Совпадение засчитывается только с начала
+// слова. Сообщение проходит за один проход без выделения памяти; память нужна,
+// только если в нем есть что замаскировать.
+class ChatFilter
+{
+public:
+    enum Verdict {
+        Clean,
+        Masked,     // запрещенные слова заменены звездочками
+        Withheld    // подсказывает ответ: не рассылать
+    };
+
+    static const int MaxPatternLength = 64;
+
+    ChatFilter();
+
+    void setBlocklist(const QStringList &words);
+    void setAnswer(const QString &word, const QStringList &aliases);
+    void clearAnswer();
+
+    Verdict filter(QString &text) const;
+
+private:
+    enum Kind { Answer, Blocked };
+    struct Pattern {
+        QVector<ushort> symbols;
+        Kind kind;
+    };
+
+    static QVector<ushort> normalize(const QString &text);
+    static QVector<ushort> stem(QVector<ushort> symbols);
+    void rebuild();
+
+    QStringList m_blocklist;
+    QVector<Pattern> m_answerPatterns;
+    QVector<Pattern> m_blockPatterns;
+
+    // Автомат: полная таблица переходов по сжатому алфавиту образцов
+    QVector<quint8> m_alphabet;     // символ -> номер в алфавите, 0 - нет в образцах
+    int m_alphabetSize = 1;
+    QVector<qint32> m_delta;        // состояние * m_alphabetSize + символ -> состояние
+    QVector<quint8> m_answerLength; // длина ответа, который кончается в состоянии, 0 - нет
+    QVector<quint8> m_blockLength;  // то же для запрещенных слов
+    QVector<qint32> m_outputLink;   // ближайший суффикс, где кончается образец, -1 - нет
+};
+
+#endif // CHATFILTER_H
@@ -0,0 +1,101 @@
+#include "connectionbackend.h"
+#include "qtbackend.h"
+#ifdef Q_OS_LINUX
+#include "epollbackend.h"
+#endif
+#include <QDebug>
+#ifdef Q_OS_UNIX
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#endif
+
+ConnectionBackend::ConnectionBackend(QObject *parent) : QObject(parent)
+{
+}
+
+ConnectionBackend *ConnectionBackend::create(const QString &name, QObject *parent)
+{
+    if (name == "qt") return new QtBackend(parent);
+#ifdef Q_OS_LINUX
+    if (name == "epoll") return new EpollBackend(parent);
+#endif
+    return nullptr;
+}
+
+QStringList ConnectionBackend::available()
+{
+    QStringList names;
+    names << "qt";
+#ifdef Q_OS_LINUX
+    names << "epoll";
+#endif
+    return names;
+}
+
+void ConnectionBackend::readInto(int connection, QByteArray &buffer)
+{
+    buffer.append(read(connection));
+}
+
+void ConnectionBackend::writeMany(const QVector<int> &connections, const QByteArray &bytes)
+{
+    for (int connection : connections) {
+        write(connection, bytes);
+    }
+}
+
+int ConnectionBackend::openListener(quint16 port, bool reusePort)
+{
+#ifdef Q_OS_UNIX
+    const int on = 1, off = 0;
+    auto prepare = [&](int fd) {
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        if (reusePort) {
+            setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+        }
+    };
+
+    // Двойной стек, как QHostAddress::Any; без IPv6 - только IPv4
+    int fd = ::socket(AF_INET6, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd >= 0) {
+        prepare(fd);
+        setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off));
+        sockaddr_in6 address = {};
+        address.sin6_family = AF_INET6;
+        address.sin6_addr = in6addr_any;
+        address.sin6_port = htons(port);
+        if (::bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+    if (fd < 0) {
+        fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0) return -1;
+        prepare(fd);
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_ANY);
+        address.sin_port = htons(port);
+        if (::bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0) {
+            qDebug() << "bind failed:" << strerror(errno);
+            ::close(fd);
+            return -1;
+        }
+    }
+
+    if (::listen(fd, SOMAXCONN) != 0) {
+        qDebug() << "listen failed:" << strerror(errno);
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+#else
+    Q_UNUSED(port);
+    Q_UNUSED(reusePort);
+    return -1;
+#endif
+}
@@ -0,0 +1,59 @@
+#ifndef CONNECTIONBACKEND_H
+#define CONNECTIONBACKEND_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QVector>
+#include <QString>
+
+// Транспорт игрового сервера: принимает TCP-соединения и передает байты.
+// Сервер знает соединение только по номеру, который выдает backend: номера
+// плотные и после disconnected выдаются заново. Протокол (строки JSON,
+// кадры сжатия) живет выше и от backend не зависит.
+//
+// qt    - QTcpServer и QTcpSocket на каждое соединение, работает везде
+// epoll - Linux: edge-triggered epoll без QObject на соединение
+class ConnectionBackend : public QObject
+{
+    Q_OBJECT
+public:
+    explicit ConnectionBackend(QObject *parent = nullptr);
+
+    // nullptr - такого backend нет (или он не собран для этой ОС)
+    static ConnectionBackend *create(const QString &name, QObject *parent = nullptr);
+    static QStringList available();
+
+    // reusePort - SO_REUSEPORT: несколько процессов слушают один порт, ядро делит
+    // между ними входящие соединения (Unix; на других ОС listen вернет false)
+    virtual bool listen(quint16 port, bool reusePort = false) = 0;
+    // Все, что пришло с прошлого вызова, но не больше readBufferSize
+    virtual QByteArray read(int connection) = 0;
+    // То же, но дописывает в конец buffer: буфер вызывающего переиспользуется
+    virtual void readInto(int connection, QByteArray &buffer);
+    virtual void write(int connection, const QByteArray &bytes) = 0;
+    // Одни и те же байты многим соединениям: копия не делается, отправка - пачкой
+    virtual void writeMany(const QVector<int> &connections, const QByteArray &bytes);
+    // Закрыть без дописывания очереди; disconnected приходит сразу, из этого вызова
+    virtual void abort(int connection) = 0;
+    // Больше этого соединение не читает из ядра, пока сервер не заберет прочитанное
+    virtual void setReadBufferSize(qint64 size) = 0;
+
+    // Передача соединения другому процессу: копия дескриптора (закрывает вызывающий),
+    // само соединение после этого закрывается через abort. -1 - не поддерживается
+    virtual qintptr duplicateDescriptor(int connection) = 0;
+    // Принимает дескриптор от другого процесса как новое соединение (с newConnection);
+    // -1 - не вышло, дескриптор остается за вызывающим
+    virtual int adopt(qintptr descriptor) = 0;
+
+protected:
+    // Неблокирующий слушающий сокет на всех адресах (IPv6 с IPv4, иначе IPv4); -1 - ошибка
+    static int openListener(quint16 port, bool reusePort);
+
+signals:
+    void newConnection(int connection);
+    void readyRead(int connection);
+    void bytesWritten(int connection, qint64 bytes);
+    void disconnected(int connection);
+};
+
+#endif // CONNECTIONBACKEND_H
@@ -0,0 +1,337 @@
+#include "epollbackend.h"
+#include <QTimer>
+#include <QDebug>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+
+// Сколько кусков очереди отдается ядру одним writev
+static const int MaxIovecs = 64;
+
+EpollBackend::EpollBackend(QObject *parent) : ConnectionBackend(parent),
+    m_receiveBuffer(ReceiveBufferSize, Qt::Uninitialized)
+{
+    m_epoll = epoll_create1(EPOLL_CLOEXEC);
+    if (m_epoll < 0) {
+        qDebug() << "epoll_create1 failed:" << strerror(errno);
+        return;
+    }
+    m_notifier = new QSocketNotifier(m_epoll, QSocketNotifier::Read, this);
+    connect(m_notifier, &QSocketNotifier::activated, this, &EpollBackend::processEvents);
+}
+
+EpollBackend::~EpollBackend()
+{
+    for (Connection &c : m_connections) {
+        if (c.fd >= 0) ::close(c.fd);
+    }
+    if (m_listener >= 0) ::close(m_listener);
+    if (m_epoll >= 0) ::close(m_epoll);
+}
+
+bool EpollBackend::listen(quint16 port, bool reusePort)
+{
+    if (m_epoll < 0) return false;
+
+    m_listener = openListener(port, reusePort);
+    if (m_listener < 0) return false;
+
+    epoll_event event = {};
+    event.events = EPOLLIN | EPOLLET;
+    event.data.u64 = ListenerSlot;
+    return epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_listener, &event) == 0;
+}
+
+QByteArray EpollBackend::read(int connection)
+{
+    if (!isOpen(connection)) return QByteArray();
+
+    Connection &c = m_connections[connection];
+    QByteArray data;
+    data.swap(c.inbox);
+    resumeReceive(connection);
+    return data;
+}
+
+void EpollBackend::readInto(int connection, QByteArray &buffer)
+{
+    if (!isOpen(connection)) return;
+
+    // Копия в буфер сервера. Емкость inbox остается следующим recv только
+    // потому, что receive ее зарезервировал: в Qt5 resize(0) без reserve
+    // освобождает буфер. Разросшийся после всплеска inbox отдаем куче
+    Connection &c = m_connections[connection];
+    buffer.append(c.inbox.constData(), c.inbox.size());
+    if (c.inbox.capacity() > InboxKeepBytes) c.inbox = QByteArray();
+    else c.inbox.resize(0);
+    resumeReceive(connection);
+}
+
+void EpollBackend::resumeReceive(int slot)
+{
+    // Edge-triggered: о данных, оставленных в ядре, epoll больше не напомнит
+    Connection &c = m_connections[slot];
+    if (!c.readBlocked) return;
+    c.readBlocked = false;
+    const quint32 generation = c.generation;
+    QTimer::singleShot(0, this, [this, slot, generation]() {
+        if (isOpen(slot) && m_connections[slot].generation == generation) {
+            receive(slot);
+        }
+    });
+}
+
+void EpollBackend::write(int connection, const QByteArray &bytes)
+{
+    if (!isOpen(connection) || bytes.isEmpty()) return;
+    enqueue(connection, bytes);
+}
+
+void EpollBackend::writeMany(const QVector<int> &connections, const QByteArray &bytes)
+{
+    if (bytes.isEmpty()) return;
+    for (int connection : connections) {
+        if (isOpen(connection)) enqueue(connection, bytes);
+    }
+}
+
+void EpollBackend::abort(int connection)
+{
+    if (isOpen(connection)) close(connection);
+}
+
+void EpollBackend::setReadBufferSize(qint64 size)
+{
+    m_readBufferSize = size;
+}
+
+qintptr EpollBackend::duplicateDescriptor(int connection)
+{
+    if (!isOpen(connection)) return -1;
+    return fcntl(m_connections[connection].fd, F_DUPFD_CLOEXEC, 0);
+}
+
+int EpollBackend::adopt(qintptr descriptor)
+{
+    const int fd = static_cast<int>(descriptor);
+    const int flags = fcntl(fd, F_GETFL);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) != 0) return -1;
+
+    const int slot = addConnection(fd);
+    if (slot < 0) return -1;
+    // Уже пришедшие данные epoll сообщит сам: готовность проверяется при EPOLL_CTL_ADD
+    emit newConnection(slot);
+    return slot;
+}
+
+void EpollBackend::processEvents()
+{
+    epoll_event events[MaxEventsPerWait];
+    const int count = epoll_wait(m_epoll, events, MaxEventsPerWait, 0);
+
+    for (int i = 0; i < count; ++i) {
+        const quint64 data = events[i].data.u64;
+        if (data == ListenerSlot) {
+            acceptAll();
+            continue;
+        }
+
+        const int slot = static_cast<int>(data & 0xffffffffu);
+        const quint32 generation = static_cast<quint32>(data >> 32);
+        if (!isOpen(slot) || m_connections[slot].generation != generation) continue;
+
+        const quint32 flags = events[i].events;
+        if (flags & EPOLLOUT) {
+            flush(slot);
+        }
+        // Остаток данных перед закрытием тоже дочитывается
+        if (isOpen(slot) && (flags & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))) {
+            receive(slot);
+        }
+    }
+}
+
+void EpollBackend::acceptAll()
+{
+    forever {
+        const int fd = accept4(m_listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                qDebug() << "accept failed:" << strerror(errno);
+            }
+            return;
+        }
+
+        const int slot = addConnection(fd);
+        if (slot < 0) {
+            ::close(fd);
+            continue;
+        }
+        emit newConnection(slot);
+    }
+}
+
+int EpollBackend::addConnection(int fd)
+{
+    int slot;
+    if (!m_freeSlots.isEmpty()) {
+        slot = m_freeSlots.takeLast();
+    } else {
+        slot = m_connections.size();
+        m_connections.append(Connection());
+    }
+    Connection &c = m_connections[slot];
+
+    epoll_event event = {};
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    event.data.u64 = (static_cast<quint64>(c.generation) << 32) | static_cast<quint32>(slot);
+    if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, fd, &event) != 0) {
+        m_freeSlots.append(slot);
+        return -1;
+    }
+    c.fd = fd;
+    return slot;
+}
+
+void EpollBackend::receive(int slot)
+{
+    bool received = false;
+    bool closed = false;
+    forever {
+        Connection &c = m_connections[slot];
+        if (m_readBufferSize > 0 && c.inbox.size() >= m_readBufferSize) {
+            c.readBlocked = true;
+            break;
+        }
+        const ssize_t n = ::recv(c.fd, m_receiveBuffer.data(), ReceiveBufferSize, 0);
+        if (n > 0) {
+            if (c.inbox.capacity() == 0) c.inbox.reserve(InboxReserveBytes);
+            c.inbox.append(m_receiveBuffer.constData(), static_cast<int>(n));
+            received = true;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        closed = n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK);
+        break;
+    }
+
+    if (received) {
+        const quint32 generation = m_connections[slot].generation;
+        emit readyRead(slot);
+        // Обработчик мог закрыть соединение сам
+        if (!isOpen(slot) || m_connections[slot].generation != generation) return;
+    }
+    if (closed) {
+        close(slot);
+    }
+}
+
+void EpollBackend::enqueue(int slot, const QByteArray &bytes)
+{
+    m_connections[slot].outbox.append(bytes);
+    queueFlush(slot);
+}
+
+void EpollBackend::queueFlush(int slot)
+{
+    Connection &c = m_connections[slot];
+    if (!c.flushQueued) {
+        c.flushQueued = true;
+        m_flushQueue.append(slot);
+    }
+    if (!m_flushScheduled) {
+        m_flushScheduled = true;
+        QTimer::singleShot(0, this, &EpollBackend::flushQueued);
+    }
+}
+
+void EpollBackend::flushQueued()
+{
+    m_flushScheduled = false;
+    const QVector<int> queue = m_flushQueue;
+    m_flushQueue.clear();
+    for (int slot : queue) {
+        if (!isOpen(slot)) continue;
+        m_connections[slot].flushQueued = false;
+        flush(slot);
+    }
+}
+
+void EpollBackend::flush(int slot)
+{
+    qint64 sent = 0;
+    bool failed = false;
+    forever {
+        Connection &c = m_connections[slot];
+        if (c.outbox.isEmpty()) break;
+
+        iovec iov[MaxIovecs];
+        int count = 0;
+        for (const QByteArray &chunk : c.outbox) {
+            if (count == MaxIovecs) break;
+            const int offset = (count == 0) ? c.outboxOffset : 0;
+            iov[count].iov_base = const_cast<char *>(chunk.constData()) + offset;
+            iov[count].iov_len = static_cast<size_t>(chunk.size() - offset);
+            ++count;
+        }
+
+        msghdr message = {};
+        message.msg_iov = iov;
+        message.msg_iovlen = static_cast<size_t>(count);
+        ssize_t n = ::sendmsg(c.fd, &message, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            // EAGAIN: ядро занято, допишем по EPOLLOUT
+            failed = errno != EAGAIN && errno != EWOULDBLOCK;
+            break;
+        }
+
+        sent += n;
+        while (n > 0) {
+            const int left = c.outbox.first().size() - c.outboxOffset;
+            if (n >= left) {
+                n -= left;
+                c.outbox.removeFirst();
+                c.outboxOffset = 0;
+            } else {
+                c.outboxOffset += static_cast<int>(n);
+                n = 0;
+            }
+        }
+    }
+
+    if (sent > 0) {
+        const quint32 generation = m_connections[slot].generation;
+        emit bytesWritten(slot, sent);
+        if (!isOpen(slot) || m_connections[slot].generation != generation) return;
+    }
+    if (failed) {
+        close(slot);
+    }
+}
+
+void EpollBackend::close(int slot)
+{
+    Connection &c = m_connections[slot];
+    // Сам close регистрацию не снимает, если описание файла живет дальше:
+    // после передачи соединения шарду его держит другой процесс (SCM_RIGHTS),
+    // и каждый байт клиента будил бы нас ради события, которое отсечет generation
+    epoll_ctl(m_epoll, EPOLL_CTL_DEL, c.fd, nullptr);
+    ::close(c.fd);
+    const quint32 generation = c.generation + 1;
+    c = Connection();
+    c.generation = generation;
+    m_freeSlots.append(slot);
+    emit disconnected(slot);
+}
+
+bool EpollBackend::isOpen(int connection) const
+{
+    return connection >= 0 && connection < m_connections.size() && m_connections[connection].fd >= 0;
+}
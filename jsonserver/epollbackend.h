@@ -0,0 +1,74 @@
+#ifndef EPOLLBACKEND_H
+#define EPOLLBACKEND_H
+
+#include "connectionbackend.h"
+#include <QSocketNotifier>
+#include <QList>
+
+// Linux backend для тысяч в основном молчащих соединений (зрители, ожидание resume).
+// Соединение - запись в плотном массиве без QObject и сигналов: все чтения
+// идут через один общий буфер. Молчащее с самого подключения соединение буферов
+// не держит; приславшее хоть что-то держит небольшой inbox (InboxReserveBytes),
+// который переживает чтения сервера, плюс неотправленная очередь.
+// Один epoll (edge-triggered) встроен в цикл событий Qt через QSocketNotifier.
+// Записи копятся до конца прохода цикла событий и уходят одним writev на
+// соединение; writeMany ставит в очереди одну общую копию байтов.
+class EpollBackend : public ConnectionBackend
+{
+    Q_OBJECT
+public:
+    explicit EpollBackend(QObject *parent = nullptr);
+    ~EpollBackend() override;
+
+    bool listen(quint16 port, bool reusePort = false) override;
+    QByteArray read(int connection) override;
+    void readInto(int connection, QByteArray &buffer) override;
+    void write(int connection, const QByteArray &bytes) override;
+    void writeMany(const QVector<int> &connections, const QByteArray &bytes) override;
+    void abort(int connection) override;
+    void setReadBufferSize(qint64 size) override;
+    qintptr duplicateDescriptor(int connection) override;
+    int adopt(qintptr descriptor) override;
+
+private:
+    static const int ReceiveBufferSize = 64 * 1024;
+    static const int InboxReserveBytes = 1024;          // с запасом на несколько команд рисования
+    static const int InboxKeepBytes = 16 * 1024;        // больше после всплеска не держим
+    static const int MaxEventsPerWait = 256;
+    static const quint32 ListenerSlot = 0xffffffffu;
+
+    struct Connection {
+        int fd = -1;                    // -1 - запись свободна
+        quint32 generation = 0;         // отсекает события закрытого соединения в той же пачке
+        QByteArray inbox;               // прочитано из ядра, сервер еще не забрал
+        QList<QByteArray> outbox;       // очередь на отправку, куски общие с другими соединениями
+        int outboxOffset = 0;           // отправленная часть первого куска
+        bool readBlocked = false;       // inbox полон, в ядре остались данные
+        bool flushQueued = false;       // стоит в m_flushQueue
+    };
+
+    void processEvents();
+    void acceptAll();
+    int addConnection(int fd);
+    void receive(int slot);
+    void resumeReceive(int slot);
+    void flush(int slot);
+    void flushQueued();
+    void queueFlush(int slot);
+    void enqueue(int slot, const QByteArray &bytes);
+    void close(int slot);
+    bool isOpen(int connection) const;
+
+    int m_epoll = -1;
+    int m_listener = -1;
+    QSocketNotifier *m_notifier = nullptr;
+
+    QVector<Connection> m_connections;
+    QVector<int> m_freeSlots;
+    QVector<int> m_flushQueue;
+    bool m_flushScheduled = false;
+    qint64 m_readBufferSize = 0;        // 0 - без ограничения
+    QByteArray m_receiveBuffer;         // общий для всех соединений
+};
+
+#endif // EPOLLBACKEND_H
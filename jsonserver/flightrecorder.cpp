@@ -0,0 +1,98 @@
+#include "flightrecorder.h"
+#include <QByteArray>
+#include <string.h>
+
+namespace {
+
+// Без выделения памяти: не-ASCII символы заменяются на '?'
+void copyName(char *target, int size, const QString &source)
+{
+    const int length = qMin(static_cast<int>(source.size()), size - 1);
+    for (int i = 0; i < length; ++i) {
+        const ushort c = source[i].unicode();
+        target[i] = c < 128 ? static_cast<char>(c) : '?';
+    }
+    target[length] = '\0';
+}
+
+}
+
+FlightRecorder::Scope::Scope(FlightRecorder &recorder, const char *handler, const QString &room,
+                             const qint64 &bytesCounter, const QString &type) :
+    m_recorder(recorder),
+    m_parent(recorder.m_top),
+    m_bytesCounter(bytesCounter),
+    m_bytesAtStart(bytesCounter)
+{
+    qstrncpy(m_event.handler, handler, NameSize);
+    copyName(m_event.type, NameSize, type);
+    copyName(m_event.room, RoomSize, room);
+    m_event.startNs = recorder.nowNs();
+    recorder.m_top = this;
+    recorder.setCurrent(this);
+}
+
+FlightRecorder::Scope::~Scope()
+{
+    m_event.durationNs = m_recorder.nowNs() - m_event.startNs;
+    m_event.bytesWritten = m_bytesCounter - m_bytesAtStart;
+
+    const quint64 index = m_recorder.m_next.load(std::memory_order_relaxed);
+    m_recorder.publish(m_recorder.m_ring[index & (Capacity - 1)], m_event);
+    m_recorder.m_next.store(index + 1, std::memory_order_release);
+
+    m_recorder.m_top = m_parent;
+    m_recorder.setCurrent(m_parent);
+}
+
+FlightRecorder::FlightRecorder()
+{
+    m_clock.start();
+}
+
+void FlightRecorder::publish(Slot &slot, const Event &event)
+{
+    const quint32 version = slot.version.load(std::memory_order_relaxed);
+    slot.version.store(version + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(&slot.event, &event, sizeof(Event));
+    slot.version.store(version + 2, std::memory_order_release);
+}
+
+bool FlightRecorder::read(const Slot &slot, Event &event)
+{
+    const quint32 before = slot.version.load(std::memory_order_acquire);
+    if (before & 1) return false;
+    memcpy(&event, &slot.event, sizeof(Event));
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slot.version.load(std::memory_order_relaxed) == before;
+}
+
+void FlightRecorder::setCurrent(const Scope *scope)
+{
+    if (scope) publish(m_current, scope->m_event);
+    m_busy.store(scope != nullptr, std::memory_order_release);
+}
+
+QVector<FlightRecorder::Event> FlightRecorder::recent() const
+{
+    const quint64 next = m_next.load(std::memory_order_acquire);
+    const quint64 first = next > Capacity ? next - Capacity : 0;
+
+    QVector<Event> events;
+    events.reserve(static_cast<int>(next - first));
+    for (quint64 i = first; i < next; ++i) {
+        Event event;
+        // Ячейку как раз переписывают - это уже более новое событие, старое потеряно
+        if (read(m_ring[i & (Capacity - 1)], event)) {
+            events.append(event);
+        }
+    }
+    return events;
+}
+
+bool FlightRecorder::current(Event &event) const
+{
+    if (!m_busy.load(std::memory_order_acquire)) return false;
+    return read(m_current, event);
+}
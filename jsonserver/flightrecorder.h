@@ -0,0 +1,77 @@
+#ifndef FLIGHTRECORDER_H
+#define FLIGHTRECORDER_H
+
+#include <QElapsedTimer>
+#include <QString>
+#include <QVector>
+#include <atomic>
+
+// Бортовой самописец цикла событий: кольцо последних Capacity обработчиков
+// (что, какая комната, сколько шло, сколько байт записал). Пишет только поток
+// цикла событий, читает сторожевой поток (StallWatchdog) - без блокировок:
+// у каждой ячейки счетчик версии (seqlock), нечетный - ячейка переписывается,
+// и читатель, увидевший разные версии до и после копирования, ее пропускает.
+// Отдельная ячейка показывает обработчик, который выполняется прямо сейчас, -
+// именно он и виноват, если цикл стоит.
+class FlightRecorder
+{
+public:
+    static const int Capacity = 1024;   // степень двойки
+    static const int NameSize = 24;
+    static const int RoomSize = 16;
+
+    struct Event {
+        qint64 startNs = 0;         // от создания самописца
+        qint64 durationNs = 0;      // у текущего обработчика - 0
+        qint64 bytesWritten = 0;
+        char handler[NameSize] = {};
+        char type[NameSize] = {};   // тип сообщения, если есть
+        char room[RoomSize] = {};
+    };
+
+    // Замер одного обработчика; вложенные замеры восстанавливают внешний как текущий
+    class Scope
+    {
+    public:
+        Scope(FlightRecorder &recorder, const char *handler, const QString &room,
+              const qint64 &bytesCounter, const QString &type = QString());
+        ~Scope();
+
+    private:
+        FlightRecorder &m_recorder;
+        Scope *m_parent;
+        const qint64 &m_bytesCounter;
+        qint64 m_bytesAtStart;
+        Event m_event;
+
+        friend class FlightRecorder;
+    };
+
+    FlightRecorder();
+
+    qint64 nowNs() const { return m_clock.nsecsElapsed(); }
+
+    // Только для сторожевого потока: события от старых к новым
+    QVector<Event> recent() const;
+    // false - сейчас ничего не выполняется
+    bool current(Event &event) const;
+
+private:
+    struct Slot {
+        std::atomic<quint32> version{0};
+        Event event;
+    };
+
+    void publish(Slot &slot, const Event &event);
+    static bool read(const Slot &slot, Event &event);
+    void setCurrent(const Scope *scope);
+
+    QElapsedTimer m_clock;
+    Slot m_ring[Capacity];
+    std::atomic<quint64> m_next{0};     // сколько событий записано всего
+    Slot m_current;
+    std::atomic<bool> m_busy{false};
+    Scope *m_top = nullptr;             // только поток цикла событий
+};
+
+#endif // FLIGHTRECORDER_H
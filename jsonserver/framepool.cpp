@@ -0,0 +1,71 @@
+#include "framepool.h"
+
+FramePool::FramePool(int slotBytes, int maxSlots, int spareSlots) :
+    m_slotBytes(slotBytes),
+    m_maxSlots(maxSlots),
+    m_spareSlots(spareSlots)
+{
+    m_slots.reserve(maxSlots);
+}
+
+QByteArray &FramePool::acquire()
+{
+    ++m_counters.acquired;
+    const int count = m_slots.size();
+    for (int probe = 0; probe < qMin(ProbeLimit, count); ++probe) {
+        const int index = (m_next + probe) % count;
+        QByteArray &slot = m_slots[index];
+        if (!slot.isDetached()) continue;
+        m_next = (index + 1) % count;
+        ++m_counters.reused;
+        slot.resize(0);
+        return slot;
+    }
+
+    if (count < m_maxSlots) {
+        // Новый буфер - в конец, за O(1). Курсор не двигается: он стоит на
+        // самом старом из выданных, а тот освободится раньше нового
+        m_slots.append(newSlot());
+        ++m_counters.grown;
+        return m_slots.last();
+    }
+
+    ++m_counters.overflow;
+    m_overflow = newSlot();
+    return m_overflow;
+}
+
+void FramePool::resetRound()
+{
+    // Свободные - вперед, занятые - следом в порядке освобождения:
+    // первые поиски нового раунда не упрутся в кадры прошлого
+    QVector<QByteArray> kept;
+    QVector<QByteArray> busy;
+    const int count = m_slots.size();
+    kept.reserve(m_maxSlots);
+    quint64 released = 0;
+    for (int i = 0; i < count; ++i) {
+        QByteArray &slot = m_slots[(m_next + i) % count];
+        if (!slot.isDetached()) {
+            busy.append(slot);
+        } else if (kept.size() < m_spareSlots && slot.capacity() <= m_slotBytes * 2) {
+            kept.append(slot);
+        } else {
+            ++released;
+        }
+    }
+    kept += busy;
+    m_slots.swap(kept);
+    m_next = 0;
+    m_overflow = QByteArray();
+
+    m_counters = Counters();
+    m_counters.released = released;
+}
+
+QByteArray FramePool::newSlot() const
+{
+    QByteArray slot;
+    slot.reserve(m_slotBytes);
+    return slot;
+}
@@ -0,0 +1,57 @@
+#ifndef FRAMEPOOL_H
+#define FRAMEPOOL_H
+
+#include <QByteArray>
+#include <QVector>
+
+// Пул буферов одной емкости для кадров рассылки. Кадр - QByteArray, который
+// делят кольцо повтора и очереди соединений; буфер свободен, когда ссылку
+// на него держит только пул. Свободный буфер переписывается на месте: resize
+// в пределах емкости кучу не трогает, так что в установившемся режиме кадры
+// обходятся без malloc. Кадры освобождаются почти по порядку (кольцо повтора
+// вытесняет самый старый), поэтому поиск идет по кругу от курсора - буфера
+// после последнего выданного - и обычно заканчивается на первой же пробе.
+// Новые буферы добавляются в конец массива, остальные при этом не сдвигаются.
+class FramePool
+{
+public:
+    // Счетчики с начала раунда
+    struct Counters {
+        quint64 acquired = 0;   // выдано буферов
+        quint64 reused = 0;     // из них - уже выделенные пулом
+        quint64 grown = 0;      // пул вырос на буфер
+        quint64 overflow = 0;   // мимо пула: он заполнен до maxSlots
+        quint64 released = 0;   // свободные буферы, отданные куче при сбросе
+    };
+
+    // spareSlots - сколько свободных буферов переживает resetRound
+    FramePool(int slotBytes, int maxSlots, int spareSlots = DefaultSpareSlots);
+
+    // Свободный буфер пула нулевого размера с емкостью не меньше slotBytes.
+    // Заполнять до того, как появится копия: общий буфер при записи копируется.
+    // Ссылка живет до следующего acquire или resetRound
+    QByteArray &acquire();
+    // Начало раунда: свободные буферы сверх запаса возвращаются в кучу,
+    // заметно разросшиеся выше slotBytes - тоже, счетчики обнуляются
+    void resetRound();
+
+    const Counters &counters() const { return m_counters; }
+    int slotCount() const { return m_slots.size(); }
+    int slotBytes() const { return m_slotBytes; }
+
+private:
+    static const int ProbeLimit = 8;        // столько занятых подряд - и пул растет
+    static const int DefaultSpareSlots = 64;
+
+    QByteArray newSlot() const;
+
+    int m_slotBytes;
+    int m_maxSlots;
+    int m_spareSlots;
+    QVector<QByteArray> m_slots;    // емкость - maxSlots, рост без перевыделения
+    int m_next = 0;                 // курсор: с него начинается следующий поиск
+    QByteArray m_overflow;          // буфер мимо пула, когда он заполнен
+    Counters m_counters;
+};
+
+#endif // FRAMEPOOL_H
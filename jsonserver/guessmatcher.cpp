@@ -0,0 +1,163 @@
+#include "guessmatcher.h"
+#include <QDebug>
+#include <string.h>
+
+void GuessMatcher::setWord(const QString &word, const QStringList &aliases)
+{
+    m_targets.clear();
+    // Двойники заменяются только в кириллическом слове: в латинском они и есть буквы
+    m_cyrillic = false;
+    for (QChar c : word) {
+        if (c.script() == QChar::Script_Cyrillic) {
+            m_cyrillic = true;
+            break;
+        }
+    }
+    addTarget(word);
+    for (const QString &alias : aliases) {
+        addTarget(alias);
+    }
+}
+
+int GuessMatcher::closeDistance(int length)
+{
+    if (length <= 3) return 0;
+    if (length <= 7) return 1;
+    return MaxDistance;
+}
+
+void GuessMatcher::addTarget(const QString &text)
+{
+    Target target;
+    target.length = normalize(text, target.text, MaxLength);
+    if (target.length < 0) {
+        qDebug() << "Guess matcher: word is longer than" << MaxLength << "characters, skipped:" << text;
+        return;
+    }
+    if (target.length == 0) return;
+
+    for (int i = 0; i < target.length; ++i) {
+        int s = 0;
+        while (s < target.symbolCount && target.symbols[s] != target.text[i]) ++s;
+        if (s == target.symbolCount) {
+            target.symbols[s] = target.text[i];
+            target.masks[s] = 0;
+            ++target.symbolCount;
+        }
+        target.masks[s] |= quint64(1) << i;
+    }
+    m_targets.append(target);
+}
+
+ushort GuessMatcher::fold(QChar c, bool cyrillic)
+{
+    const ushort u = c.toCaseFolded().unicode();
+    if (u == 0x0451) return 0x0435;     // ё -> е
+    if (!cyrillic) return u;
+
+    switch (u) {
+    case 'a': return 0x0430;    // а
+    case 'b': return 0x0432;    // в
+    case 'c': return 0x0441;    // с
+    case 'e': return 0x0435;    // е
+    case 'h': return 0x043D;    // н
+    case 'k': return 0x043A;    // к
+    case 'm': return 0x043C;    // м
+    case 'o': return 0x043E;    // о
+    case 'p': return 0x0440;    // р
+    case 't': return 0x0442;    // т
+    case 'x': return 0x0445;    // х
+    case 'y': return 0x0443;    // у
+    case '0': return 0x043E;    // о
+    case '3': return 0x0437;    // з
+    case '6': return 0x0431;    // б
+    default: return u;
+    }
+}
+
+int GuessMatcher::normalize(const QString &text, ushort *out, int capacity) const
+{
+    int length = 0;
+    bool pendingSpace = false;
+    for (QChar c : text) {
+        // Знаки, которые не собрались в букву при NFC, ничего не меняют
+        if (c.category() == QChar::Mark_NonSpacing) continue;
+        if (!c.isLetterOrNumber()) {
+            pendingSpace = length > 0;
+            continue;
+        }
+        if (length + (pendingSpace ? 1 : 0) >= capacity) return -1;
+        if (pendingSpace) {
+            out[length++] = ' ';
+            pendingSpace = false;
+        }
+        out[length++] = fold(c, m_cyrillic);
+    }
+    return length;
+}
+
+GuessMatcher::Result GuessMatcher::match(const QString &guess) const
+{
+    if (m_targets.isEmpty()) return Miss;
+
+    // Догадка длиннее самого длинного слова больше чем на MaxDistance близкой не будет
+    ushort text[MaxLength + MaxDistance];
+    bool decomposed = false;
+    for (QChar c : guess) {
+        if (c.category() == QChar::Mark_NonSpacing) {
+            decomposed = true;
+            break;
+        }
+    }
+    // "е" + U+0308 собираем в "ё": редкий путь, только он выделяет память
+    const int length = normalize(decomposed ? guess.normalized(QString::NormalizationForm_C) : guess,
+                                 text, MaxLength + MaxDistance);
+    if (length <= 0) return Miss;
+
+    Result result = Miss;
+    for (const Target &target : m_targets) {
+        if (target.length == length && memcmp(target.text, text, length * sizeof(ushort)) == 0) {
+            return Exact;
+        }
+        const int limit = closeDistance(target.length);
+        if (result == Miss && limit > 0 && distance(target, text, length, limit) <= limit) {
+            result = Close;
+        }
+    }
+    return result;
+}
+
+int GuessMatcher::distance(const Target &target, const ushort *text, int length, int limit)
+{
+    // Майерс в форме Хюрё: столбец матрицы расстояний - два битовых вектора
+    // приращений (+1 и -1), счет ведется в последней строке
+    const int m = target.length;
+    if (qAbs(m - length) > limit) return limit + 1;
+
+    const quint64 last = quint64(1) << (m - 1);
+    quint64 pv = ~quint64(0);
+    quint64 mv = 0;
+    int score = m;
+    for (int j = 0; j < length; ++j) {
+        quint64 eq = 0;
+        for (int s = 0; s < target.symbolCount; ++s) {
+            if (target.symbols[s] == text[j]) {
+                eq = target.masks[s];
+                break;
+            }
+        }
+        const quint64 xv = eq | mv;
+        const quint64 xh = (((eq & pv) + pv) ^ pv) | eq;
+        quint64 ph = mv | ~(xh | pv);
+        quint64 mh = pv & xh;
+        if (ph & last) ++score;
+        else if (mh & last) --score;
+        ph = (ph << 1) | 1;
+        mh <<= 1;
+        pv = mh | ~(xv | ph);
+        mv = ph & xv;
+        // Каждый оставшийся символ уменьшает счет не больше чем на 1
+        if (score - (length - 1 - j) > limit) return limit + 1;
+    }
+    return score;
+}
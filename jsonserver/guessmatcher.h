@@ -0,0 +1,57 @@
+#ifndef GUESSMATCHER_H
+#define GUESSMATCHER_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+// Проверка догадок, собираемая один раз на раунд. Слово и его допустимые
+// варианты хранятся нормализованными: регистр свернут, ё = е, пробелы и знаки
+// препинания схлопнуты в один пробел, а в кириллическом слове латинские
+// двойники букв и цифры-подделки (0 -> о, 3 -> з) читаются как кириллица.
+// Догадка нормализуется в буфер на стеке и сравнивается с каждым вариантом
+// расстоянием Левенштейна по алгоритму Майерса (битовые векторы, слово до
+// 64 символов) - без выделения памяти и с выходом, как только порог превышен.
+class GuessMatcher
+{
+public:
+    enum Result {
+        Miss,
+        Close,      // опечатка: почти угадал, подсказка только ему
+        Exact
+    };
+
+    static const int MaxLength = 64;    // более длинные варианты слова пропускаются
+    static const int MaxDistance = 2;
+
+    void setWord(const QString &word, const QStringList &aliases = QStringList());
+    void clear() { m_targets.clear(); }
+    bool isEmpty() const { return m_targets.isEmpty(); }
+
+    Result match(const QString &guess) const;
+
+    // Сколько опечаток еще считается "почти": короткие слова - только точно
+    static int closeDistance(int length);
+    // Свертка одного символа; cyrillic - читать латинских двойников и 0/3/6 как кириллицу.
+    // Ею же нормализует текст фильтр чата, чтобы оба видели слово одинаково
+    static ushort fold(QChar c, bool cyrillic);
+
+private:
+    struct Target {
+        ushort text[MaxLength];
+        int length = 0;
+        // Таблица Майерса: маска позиций каждого различного символа слова
+        ushort symbols[MaxLength];
+        quint64 masks[MaxLength];
+        int symbolCount = 0;
+    };
+
+    void addTarget(const QString &text);
+    int normalize(const QString &text, ushort *out, int capacity) const;
+    static int distance(const Target &target, const ushort *text, int length, int limit);
+
+    QVector<Target> m_targets;
+    bool m_cyrillic = false;    // латинские двойники читать как кириллицу
+};
+
+#endif // GUESSMATCHER_H
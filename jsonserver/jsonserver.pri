@@ -0,0 +1,55 @@
+# Исходники игрового сервера без main.cpp. Подключаются из jsonserver.pro
+# и из автотестов, которые поднимают сервер в своем процессе
+QT += network
+
+INCLUDEPATH += $$PWD $$PWD/../common
+LIBS += -lz
+
+SOURCES += \
+    $$PWD/myserver.cpp \
+    $$PWD/relayserver.cpp \
+    $$PWD/roomjournal.cpp \
+    $$PWD/timerwheel.cpp \
+    $$PWD/tokenbucket.cpp \
+    $$PWD/memorybudget.cpp \
+    $$PWD/framepool.cpp \
+    $$PWD/connectionbackend.cpp \
+    $$PWD/qtbackend.cpp \
+    $$PWD/roomrouter.cpp \
+    $$PWD/shardlink.cpp \
+    $$PWD/replication.cpp \
+    $$PWD/flightrecorder.cpp \
+    $$PWD/stallwatchdog.cpp \
+    $$PWD/guessmatcher.cpp \
+    $$PWD/chatfilter.cpp \
+    $$PWD/worddictionary.cpp \
+    $$PWD/shufflebag.cpp \
+    $$PWD/../common/deflatestream.cpp \
+    $$PWD/../common/tracing.cpp
+
+HEADERS += \
+    $$PWD/myserver.h \
+    $$PWD/relayserver.h \
+    $$PWD/roomjournal.h \
+    $$PWD/timerwheel.h \
+    $$PWD/tokenbucket.h \
+    $$PWD/memorybudget.h \
+    $$PWD/framepool.h \
+    $$PWD/connectionbackend.h \
+    $$PWD/qtbackend.h \
+    $$PWD/roomrouter.h \
+    $$PWD/shardlink.h \
+    $$PWD/replication.h \
+    $$PWD/flightrecorder.h \
+    $$PWD/stallwatchdog.h \
+    $$PWD/guessmatcher.h \
+    $$PWD/chatfilter.h \
+    $$PWD/worddictionary.h \
+    $$PWD/shufflebag.h \
+    $$PWD/../common/deflatestream.h \
+    $$PWD/../common/tracing.h
+
+linux {
+    SOURCES += $$PWD/epollbackend.cpp
+    HEADERS += $$PWD/epollbackend.h
+}
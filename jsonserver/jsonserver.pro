@@ -2,7 +2,7 @@ QT += core
 QT -= gui
 QT +=network
 
-CONFIG += c++11
+CONFIG += c++17
 
 TARGET = jsonserver
 CONFIG += console
@@ -10,8 +10,24 @@ CONFIG -= app_bundle
 
 TEMPLATE = app
 
-SOURCES += main.cpp \
-    myserver.cpp
+# Общая библиотека протокола (../protocol), собирается первой из summer_practice.pro
+win32:CONFIG(release, debug|release): LIBS += -L$$OUT_PWD/../protocol/release/ -lprotocol
+else:win32:CONFIG(debug, debug|release): LIBS += -L$$OUT_PWD/../protocol/debug/ -lprotocol
+else:unix: LIBS += -L$$OUT_PWD/../protocol/ -lprotocol
+
+INCLUDEPATH += $$PWD/../protocol
+DEPENDPATH += $$PWD/../protocol
+
+win32-g++:CONFIG(release, debug|release): PRE_TARGETDEPS += $$OUT_PWD/../protocol/release/libprotocol.a
+else:win32-g++:CONFIG(debug, debug|release): PRE_TARGETDEPS += $$OUT_PWD/../protocol/debug/libprotocol.a
+else:win32:!win32-g++:CONFIG(release, debug|release): PRE_TARGETDEPS += $$OUT_PWD/../protocol/release/protocol.lib
+else:win32:!win32-g++:CONFIG(debug, debug|release): PRE_TARGETDEPS += $$OUT_PWD/../protocol/debug/protocol.lib
+else:unix: PRE_TARGETDEPS += $$OUT_PWD/../protocol/libprotocol.a
+
+# Исходники сервера - в jsonserver.pri, их же собирают автотесты (tests/backend)
+include(jsonserver.pri)
+
+SOURCES += main.cpp
 
 # The following define makes your compiler emit warnings if you use
 # any feature of Qt which as been marked deprecated (the exact warnings
@@ -23,6 +39,3 @@ DEFINES += QT_DEPRECATED_WARNINGS
 # In order to do so, uncomment the following line.
 # You can also select to disable deprecated APIs only up to a certain version of Qt.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
-
-HEADERS += \
-    myserver.h
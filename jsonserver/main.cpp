@@ -1,12 +1,177 @@
 #include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QLocalSocket>
+#include <QFile>
 #include "myserver.h"
+#include "relayserver.h"
+#include "roomrouter.h"
+#include "tracing.h"
 
 int main(int argc, char *argv[])
 {
     QCoreApplication a(argc, argv);
 
+    // jsonserver                                   - игровой сервер на 5555
+    // jsonserver --data-dir /var/lib/croc          - журнал комнаты в другом каталоге
+    // jsonserver --backend epoll                   - epoll вместо QTcpSocket (Linux)
+    // jsonserver --relay 127.0.0.1:5555 -p 5556     - ретранслятор для зрителей
+    // jsonserver --router /tmp/croc.router         - маршрутизатор комнат для шардов
+    // jsonserver --shard /tmp/croc.router --data-dir data/1
+    //                                              - шард: несколько процессов на 5555, комната на процесс
+    // jsonserver --replicate /tmp/croc.standby      - основной сервер с горячим резервом
+    // jsonserver --follow /tmp/croc.standby --data-dir data/standby
+    //                                              - резерв: займет 5555, когда основной пропадет
+    // jsonserver --router /tmp/croc.router --migrate main
+    //                                              - перенести живую комнату в свободный шард
+    // jsonserver --trace server.json               - зоны горячих путей для chrome://tracing
+    // jsonserver --compile-dictionary words.tsv --dictionary words.dict
+    //                                              - собрать бинарный словарь из текста
+    // jsonserver --dictionary words.dict --category Животные --language ru
+    //                                              - слова из словаря; замена файла подхватывается на ходу
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption portOption({"p", "port"}, "Port to listen on.", "port");
+    QCommandLineOption relayOption("relay", "Run as a spectator relay for the game server at host:port.", "host:port");
+    QCommandLineOption delayOption("delay", "Relay broadcast delay in milliseconds.", "ms", "0");
+    QCommandLineOption backendOption("backend", "Connection backend: " + ConnectionBackend::available().join(", ") + ".", "name", "qt");
+    QCommandLineOption dataOption("data-dir", "Directory for the room journal and snapshot.", "dir", "data");
+    QCommandLineOption routerOption("router", "Run as the room router for shard processes, listening on a unix socket.", "path");
+    QCommandLineOption stallOption("stall-ms", "Dump the flight recorder to the data directory when the event loop stalls this long, 0 to disable.", "ms", "250");
+    QCommandLineOption replicateOption("replicate", "Stream room state to standby servers over a unix socket at path.", "path");
+    QCommandLineOption followOption("follow", "Run as a warm standby for the server replicating at path; take over its port when it fails.", "path");
+    QCommandLineOption migrateOption("migrate", "Ask the router given by --router to move a live room to a free shard.", "room");
+    QCommandLineOption traceOption("trace", "Write Chrome trace JSON of the hot paths to file (open in chrome://tracing or ui.perfetto.dev).", "file");
+    QCommandLineOption dictionaryOption("dictionary", "Binary word dictionary, reloaded when the file is replaced.", "file");
+    QCommandLineOption compileOption("compile-dictionary", "Compile a tab-separated word list (category, difficulty, language, word|alias...) into the file given by --dictionary and exit.", "source");
+    QCommandLineOption categoryOption("category", "Dictionary category for this room.", "name");
+    QCommandLineOption languageOption("language", "Dictionary language for this room.", "name");
+    QCommandLineOption difficultyOption("max-difficulty", "Highest word difficulty for this room, 0 for any.", "level", "0");
+    QCommandLineOption blocklistOption("blocklist", "Words masked in chat, one per line.", "file");
+    QCommandLineOption shardOption("shard", "Share the port with other processes (SO_REUSEPORT), rooms are assigned by the router at path.", "path");
+    parser.addOption(portOption);
+    parser.addOption(relayOption);
+    parser.addOption(delayOption);
+    parser.addOption(dataOption);
+    parser.addOption(backendOption);
+    parser.addOption(routerOption);
+    parser.addOption(shardOption);
+    parser.addOption(migrateOption);
+    parser.addOption(replicateOption);
+    parser.addOption(followOption);
+    parser.addOption(stallOption);
+    parser.addOption(traceOption);
+    parser.addOption(dictionaryOption);
+    parser.addOption(compileOption);
+    parser.addOption(categoryOption);
+    parser.addOption(languageOption);
+    parser.addOption(difficultyOption);
+    parser.addOption(blocklistOption);
+    parser.process(a);
+
+    if (parser.isSet(traceOption)) {
+        Tracing::start(parser.value(traceOption), "jsonserver " + QString::number(a.applicationPid()));
+        QObject::connect(&a, &QCoreApplication::aboutToQuit, &Tracing::stop);
+    }
+
+    if (parser.isSet(compileOption)) {
+        if (!parser.isSet(dictionaryOption)) {
+            qDebug() << "Expected --dictionary with the output file";
+            return 1;
+        }
+        QString error;
+        if (!WordDictionary::compile(parser.value(compileOption), parser.value(dictionaryOption), &error)) {
+            qDebug() << "Dictionary compile failed:" << error;
+            return 1;
+        }
+        return 0;
+    }
+
+    if (parser.isSet(relayOption)) {
+        const QString upstream = parser.value(relayOption);
+        const int colon = upstream.lastIndexOf(':');
+        if (colon <= 0) {
+            qDebug() << "Expected --relay host:port";
+            return 1;
+        }
+        relayserver *relay = new relayserver(upstream.left(colon), upstream.mid(colon + 1).toUShort(),
+                                             parser.value(delayOption).toInt(), &a);
+        relay->startServer(parser.isSet(portOption) ? parser.value(portOption).toUShort() : 5556);
+        return a.exec();
+    }
+
+    if (parser.isSet(routerOption) && parser.isSet(migrateOption)) {
+        // Разовая команда уже запущенному маршрутизатору
+        QLocalSocket control;
+        control.connectToServer(parser.value(routerOption));
+        if (!control.waitForConnected(3000)) {
+            qDebug() << "Router is not reachable:" << control.errorString();
+            return 1;
+        }
+        QJsonObject migrate;
+        migrate["type"] = "migrate";
+        migrate["room"] = parser.value(migrateOption);
+        control.write(QJsonDocument(migrate).toJson(QJsonDocument::Compact) + "\n");
+        QByteArray reply;
+        while (!reply.contains('\n') && control.waitForReadyRead(30000)) {
+            reply += control.readAll();
+        }
+        qDebug() << reply.trimmed();
+        return QJsonDocument::fromJson(reply).object()["ok"].toBool() ? 0 : 1;
+    }
+
+    if (parser.isSet(routerOption)) {
+        RoomRouter *router = new RoomRouter(&a);
+        if (!router->listen(parser.value(routerOption))) {
+            return 1;
+        }
+        return a.exec();
+    }
+
     myserver Server;
-    Server.startServer();
+    if (parser.isSet(dictionaryOption)) {
+        // Без словаря сервер играет встроенным списком; он же остается, если файл сломан
+        DictionaryStore *dictionaries = new DictionaryStore(&a);
+        if (!dictionaries->load(parser.value(dictionaryOption))) {
+            qDebug() << "Dictionary is not loaded yet, using built-in words until the file appears";
+        }
+        Server.setDictionary(dictionaries, parser.value(categoryOption), parser.value(languageOption),
+                             parser.value(difficultyOption).toInt());
+    }
+    if (parser.isSet(blocklistOption)) {
+        QFile blocklist(parser.value(blocklistOption));
+        if (!blocklist.open(QIODevice::ReadOnly | QIODevice::Text)) {
+            qDebug() << "Cannot open blocklist" << parser.value(blocklistOption);
+            return 1;
+        }
+        QStringList words;
+        while (!blocklist.atEnd()) {
+            const QString word = QString::fromUtf8(blocklist.readLine()).trimmed();
+            if (!word.isEmpty() && !word.startsWith('#')) words.append(word);
+        }
+        Server.setChatBlocklist(words);
+    }
+    if (parser.value(stallOption).toInt() > 0) {
+        Server.startWatchdog(parser.value(stallOption).toInt(), parser.value(dataOption));
+    }
+    // Сначала восстанавливаем комнату после падения, потом принимаем клиентов
+    if (!Server.openJournal(parser.value(dataOption))) {
+        qDebug() << "Journal is disabled, room state will not survive a restart";
+    }
+    const quint16 port = parser.isSet(portOption) ? parser.value(portOption).toUShort() : 5555;
+    if (parser.isSet(followOption)) {
+        // Порт откроется только при переходе в основной
+        Server.follow(parser.value(followOption), port, parser.value(backendOption));
+        return a.exec();
+    }
+    if (!Server.startServer(port, parser.value(backendOption), parser.isSet(shardOption))) {
+        return 1;
+    }
+    if (parser.isSet(replicateOption) && !Server.startReplication(parser.value(replicateOption))) {
+        return 1;
+    }
+    if (parser.isSet(shardOption) && !Server.enableSharding(parser.value(shardOption))) {
+        return 1;
+    }
 
     return a.exec();
 }
@@ -0,0 +1,19 @@
+#include "memorybudget.h"
+
+MemoryBudget::MemoryBudget(qint64 limit) :
+    m_limit(limit)
+{
+}
+
+void MemoryBudget::adjust(Category category, qint64 delta)
+{
+    m_used[category] += delta;
+    m_total += delta;
+}
+
+MemoryBudget::Pressure MemoryBudget::pressure() const
+{
+    if (m_total >= m_limit) return Critical;
+    if (m_total >= m_limit / 4 * 3) return High;
+    return Normal;
+}
@@ -0,0 +1,39 @@
+#ifndef MEMORYBUDGET_H
+#define MEMORYBUDGET_H
+
+#include <QtGlobal>
+
+// Учет памяти сервера по видам буферов. Каждый буфер сообщает об изменении
+// своего размера, а сервер по общему давлению решает, когда сбрасывать
+// нагрузку: раньше отключать медленных клиентов, не принимать новых.
+class MemoryBudget
+{
+public:
+    enum Category {
+        Inbound,    // принятые, но еще не разобранные строки
+        Outbound,   // записанное в сокеты и еще не отправленное ядру
+        History,    // история рисования раунда
+        CategoryCount
+    };
+
+    enum Pressure {
+        Normal,
+        High,       // от 3/4 лимита: лимиты соединений ужесточаются
+        Critical    // лимит исчерпан: новые соединения не принимаются
+    };
+
+    explicit MemoryBudget(qint64 limit);
+
+    void adjust(Category category, qint64 delta);
+    qint64 used(Category category) const { return m_used[category]; }
+    qint64 total() const { return m_total; }
+    qint64 limit() const { return m_limit; }
+    Pressure pressure() const;
+
+private:
+    qint64 m_used[CategoryCount] = {};
+    qint64 m_total = 0;
+    qint64 m_limit;
+};
+
+#endif // MEMORYBUDGET_H
@@ -1,197 +1,409 @@
 #include "myserver.h"
 #include <QList>
+#include <QUuid>
+#include <QDataStream>
+#include <QtEndian>
 
-myserver::myserver(QObject *parent) : QTcpServer(parent),
+const QString myserver::DefaultRoom = "main";
+static const int JournalHeaderSize = 9;         // тип события и seq
+
+myserver::myserver(QObject *parent) : QObject(parent),
+    m_memory(MemoryLimitBytes),
+    m_framePool(Protocol::MaxDrawLineBytes + 1, FramePoolSlots),
+    m_chunkPool(RoomChunkBytes, RoomChunkSlots),
     m_gameState(WaitingForPlayers),
     m_currentRound(0)
 {
     m_words << "Крокодил" << "Самолет" << "Малыш Йода" << "Яблоко" << "Программист" << "Слон";
-    connect(&m_roundTimer, &QTimer::timeout, this, &myserver::onRoundTimerTimeout);
+    // Другие принятые ответы; регистр, ё и опечатки матчер учитывает сам
+    m_wordAliases["Малыш Йода"] = QStringList{"Йода", "Грогу"};
+    m_wordAliases["Программист"] = QStringList{"Прогер", "Программер"};
+    m_wordAliases["Самолет"] = QStringList{"Аэроплан"};
+    m_replayRing.resize(ReplayRingSize);
+    // Емкость, которую сохраняет resize(0): буферы переживают очистку
+    m_pendingRoom.reserve(RoomChunkBytes);
+    m_journalRecord.reserve(Protocol::MaxDrawLineBytes + JournalHeaderSize);
+    m_clock.start();
 }
 
 myserver::~myserver()
 {
-    for (QTcpSocket* socket : m_clients){
-        socket->close();
-        socket->deleteLater();
-    }
+    // Сторожевой поток читает m_recorder - останавливаем его до разрушения полей
+    delete m_watchdog;
+    // Соединения закрывает backend; обрывы при этом уже не к нам
+    if (m_backend) m_backend->disconnect(this);
 }
 
-void myserver::startServer()
+bool myserver::startServer(quint16 port, const QString& backend, bool reusePort)
 {
-    if (this->listen(QHostAddress::Any,5555))
+    m_backend = ConnectionBackend::create(backend, this);
+    if (!m_backend) {
+        qDebug() << "Unknown connection backend" << backend << ", available:" << ConnectionBackend::available();
+        return false;
+    }
+    // Дальше MaxInboundBytes backend из ядра не читает - TCP притормаживает отправителя
+    m_backend->setReadBufferSize(MaxInboundBytes);
+    connect(m_backend, &ConnectionBackend::newConnection, this, &myserver::onNewConnection);
+    connect(m_backend, &ConnectionBackend::readyRead, this, [this](int connection) {
+        const int id = m_connectionPlayers.value(connection, -1);
+        if (id >= 0) onReadyRead(id);
+    });
+    connect(m_backend, &ConnectionBackend::bytesWritten, this, [this](int connection, qint64 bytes) {
+        const int id = m_connectionPlayers.value(connection, -1);
+        if (id >= 0) onBytesWritten(id, bytes);
+    });
+    connect(m_backend, &ConnectionBackend::disconnected, this, [this](int connection) {
+        const int id = m_connectionPlayers.value(connection, -1);
+        if (id >= 0) onDisconnected(id);
+    });
+
+    if (m_backend->listen(port, reusePort))
     {
-        qDebug()<<"Listening";
+        qDebug()<<"Listening on" << port << "with" << backend << "backend";
+        return true;
     }
     else
     {
         qDebug()<<"Not listening";
+        return false;
     }
 }
 
-void myserver::incomingConnection(qintptr socketDescriptor)
+void myserver::onNewConnection(int connection)
 {
-    QTcpSocket* socket = new QTcpSocket(this);
-    socket->setSocketDescriptor(socketDescriptor);
-
-    connect(socket, &QTcpSocket::readyRead, this, &myserver::onReadyRead);
-    connect(socket, &QTcpSocket::disconnected, this, &myserver::onDisconnected);
-
-    m_clients.append(socket);
+    FlightRecorder::Scope scope(m_recorder, "accept", roomName(), m_bytesOut);
+    // Память на исходе - новые соединения не принимаем, старые доигрывают
+    if (m_memory.pressure() == MemoryBudget::Critical) {
+        ++m_limits.refusedConnections;
+        scheduleLimitReport();
+        m_backend->abort(connection);
+        return;
+    }
 
-    qDebug()<<socketDescriptor<<" Client connected";
+    addPlayer(connection);
 
-    // Если игра уже идет, отправляем новому клиенту историю рисования
-    if (m_gameState == Drawing && !m_drawingHistory.isEmpty()) {
-        qDebug() << "Sending drawing history to new client";
-        for (const QJsonObject& cmd : m_drawingHistory) {
-            sendToClient(socket, cmd);
-        }
-    }
+    // История рисования уходит после register/resume в составе ключевого кадра
+    qDebug()<<connection<<" Client connected";
 }
 
-void myserver::onReadyRead()
+void myserver::onReadyRead(int playerId)
 {
-    QTcpSocket* socket = qobject_cast<QTcpSocket*>(sender());
-    if (!socket) return;
+    FlightRecorder::Scope scope(m_recorder, "read", roomName(), m_bytesOut);
+    Tracing::Zone zone("onReadyRead");
+    const int connection = m_players[playerId].connection;
+    if (connection < 0) return;
+
+    // Backend отдает не больше MaxInboundBytes, остальное ждет в ядре
+    QByteArray& inbox = m_players[playerId].inbox;
+    if (m_players[playerId].inflate) {
+        QByteArray plain;
+        if (!m_players[playerId].inflate->decompress(m_backend->read(connection), plain, MaxInboundBytes)) {
+            qDebug() << "Broken or oversized compressed stream from" << playerId;
+            m_backend->abort(connection);
+            return;
+        }
+        inbox.append(plain);
+    } else {
+        // Прямо в inbox: его емкость остается от прошлых чтений. Только при
+        // reserve - иначе в Qt5 remove последней строки (resize(0)) ее освобождает
+        if (inbox.capacity() == 0) inbox.reserve(InboxReserveBytes);
+        m_backend->readInto(connection, inbox);
+    }
 
-    m_data.append(socket->readAll());
+    while (inbox.contains("\n")){
+        // Пока маршрутизатор ищет владельца комнаты или комната переезжает,
+        // следующие строки ждут в inbox
+        if (m_migrating || m_players[playerId].routeRequest >= 0) break;
+        int pos = inbox.indexOf("\n");
+        if (pos > MaxFrameBytes) {
+            rejectOversizedFrame(playerId);
+            return;
+        }
 
-    while (m_data.contains("\n")){
-        int pos = m_data.indexOf("\n");
-        QByteArray messageData = m_data.left(pos);
-        m_data.remove(0, pos + 1);
+        // Быстрый путь: команда рисования разбирается прямо в inbox, без копии строки
+        Protocol::DrawCommand command;
+        qint64 clientSeq;
+        bool fastDraw;
+        {
+            Tracing::Zone parseZone("parseDraw");
+            fastDraw = Protocol::parseDraw(inbox.constData(), pos, command, clientSeq);
+        }
+        if (fastDraw) {
+            inbox.remove(0, pos + 1);
+            processDraw(playerId, command);
+            if (m_players[playerId].connection != connection) return;
+            continue;
+        }
 
-        QJsonDocument doc = QJsonDocument::fromJson(messageData);
+        // Строка разбирается на месте: QJsonDocument копирует из нее все, что ему нужно
+        QJsonDocument doc;
+        {
+            Tracing::Zone parseZone("parseJson");
+            doc = QJsonDocument::fromJson(QByteArray::fromRawData(inbox.constData(), pos));
+        }
+        inbox.remove(0, pos + 1);
+        if (doc.isObject() && Protocol::Json::type(doc.object()) == Protocol::MessageType::CompressStart) {
+            // Последняя несжатая строка клиента: дальше идет его поток deflate
+            Player& player = m_players[playerId];
+            if (player.compression == NoCompression || player.inflate) continue;
+            player.inflate.reset(new InflateStream);
+            QByteArray rest;
+            if (!player.inflate->decompress(inbox, rest, MaxInboundBytes)) {
+                m_backend->abort(connection);
+                return;
+            }
+            inbox = rest;
+            continue;
+        }
         if (doc.isObject()){
-            processMessage(doc.object(), socket);
+            processMessage(doc.object(), playerId);
         }
+        // После resume соединение вместе с остатком перешло к другому id
+        if (m_players[playerId].connection != connection) return;
+    }
+
+    // Строку длиннее MaxFrameBytes не ждем до конца
+    if (inbox.size() > MaxFrameBytes) {
+        rejectOversizedFrame(playerId);
+        return;
     }
+    syncInbound(playerId);
 }
 
-void myserver::onDisconnected()
+void myserver::onDisconnected(int playerId)
 {
-    QTcpSocket* socket = qobject_cast<QTcpSocket*>(sender());
-    if (!socket) return;
-    QString playerName = m_clientNames.value(socket, "");
-    if (!playerName.isEmpty()){
-        m_clientNames.remove(socket);
-        m_scores.remove(playerName);
-
-        QJsonObject message;
-        message["type"] = "playerLeft";
-        message["player"] = playerName;
-        broadcast(message);
+    FlightRecorder::Scope scope(m_recorder, "disconnect", roomName(), m_bytesOut);
+    if (m_players[playerId].connection < 0) return;
+
+    // Номер соединения backend выдаст заново - он не должен вести к этому игроку
+    detachConnection(playerId);
+    leaveRoomStream(playerId);
+    releaseConnectionBuffers(playerId);
+    Player& player = m_players[playerId];
+
+    if (player.rosterIndex < 0){
+        removePlayer(playerId);
+        qDebug()<<"Client disconnect";
+        return;
     }
 
-    m_clients.removeOne(socket);
-    socket->deleteLater();
+    // Очки и место в игре сохраняются: клиент может вернуться с токеном
+    startResumeGrace(playerId);
 
-    qDebug()<<"Client disconnect";
+    qDebug()<<"Client disconnect, session" << playerId << "kept for resume";
 }
-void myserver::processMessage(const QJsonObject &message, QTcpSocket *sender) {
-    QString type = message["type"].toString();
-    QString senderName = m_clientNames.value(sender, "");
-    qDebug() << "Message from" << senderName << ":" << message;
+void myserver::processMessage(const QJsonObject &message, int senderId) {
+    const QString type = message["type"].toString();
+    const Protocol::MessageType kind = Protocol::messageType(type);
+    FlightRecorder::Scope scope(m_recorder, "message", roomName(), m_bytesOut, type);
+    Tracing::Zone zone("processMessage", type);
+    Player& sender = m_players[senderId];
+    if (sender.connection < 0) return;
+    // Проверка бюджета - до логирования и разбора: лишнее не должно стоить ничего
+    if (kind != Protocol::MessageType::Draw && !admitMessage(senderId, kind)) return;
+    const QString& senderName = sender.name;
+    qDebug() << "Message from" << senderId << senderName << ":" << message;
+
+    if ((kind == Protocol::MessageType::Register || kind == Protocol::MessageType::Resume
+         || kind == Protocol::MessageType::Subscribe) && !routeToRoom(senderId, message)) {
+        return;
+    }
 
-    if (type == "register") {
+    switch (kind) {
+    case Protocol::MessageType::Register: {
+        if (sender.rosterIndex >= 0 || sender.subscriber) {
+            qDebug() << "Player" << senderId << "is already registered";
+            return;
+        }
+        // Имена могут совпадать: игроков различает id, а не имя
         QString name = message["name"].toString();
-        m_clientNames[sender] = name;
-        m_scores[name] = 0;
+        registerPlayer(senderId, name);
 
-        QJsonObject response;
-        response["type"] = "registered";
+        QJsonObject response = Protocol::Json::encode(Protocol::MessageType::Registered);
         response["success"] = true;
-        sendToClient(sender, response);
-
-        QJsonObject playerJoined;
-        playerJoined["type"] = "playerJoined";
-        playerJoined["name"] = name;
-
-        QJsonObject scoresObject;
-        for (auto it = m_scores.begin(); it != m_scores.end(); ++it) {
-            scoresObject[it.key()] = it.value();
-        }
-        playerJoined["scores"] = scoresObject;
-        broadcast(playerJoined);
-
-        //  Отправка полного списка игроков новому клиенту
-        QJsonObject playerListMsg;
-        playerListMsg["type"] = "playerList";
-        QJsonArray playersArray;
-        for (QTcpSocket* clientSocket : m_clients) {
-            if (m_clientNames.contains(clientSocket)) {
-                QString existingPlayerName = m_clientNames.value(clientSocket);
-                QJsonObject playerObj;
-                playerObj["name"] = existingPlayerName;
-                playerObj["score"] = m_scores.value(existingPlayerName, 0);
-                playersArray.append(playerObj);
-            }
-        }
-        playerListMsg["players"] = playersArray;
-        sendToClient(sender, playerListMsg);
-        if (m_gameState == WaitingForPlayers && m_clientNames.size() >= 2) {                      //!!!!!!!
+        response["id"] = senderId;
+        response["token"] = sender.resumeToken;
+        // Ответ уходит несжатым, все следующее - в выбранном сжатии
+        const Compression compression = negotiateCompression(message, response);
+        sendToClient(senderId, response);
+        enableCompression(senderId, compression);
+
+        // Имя передается только здесь и в playerList, дальше игрок - это id.
+        // Остальным хватает одной новой строки, а не всей таблицы очков
+        Protocol::PlayerJoined joined;
+        joined.id = senderId;
+        joined.name = name;
+        joined.score = sender.score;
+        broadcast(Protocol::Json::encode(joined), senderId);
+
+        //  Отправка полного списка игроков и текущего раунда новому клиенту
+        sendKeyframe(senderId);
+        joinRoomStream(senderId);
+        if (m_gameState == WaitingForPlayers && m_roster.size() >= 2) {                      //!!!!!!!
             startGame();
         }
+        break;
     }
-    else if(type == "draw") {
-        if (m_isRoundActive && senderName == m_currentDrawer) {
-            m_drawingHistory.append(message);
-            broadcast(message);
-            qDebug() << "Draw command from" << senderName << "in round" << m_currentRound;
-        }
-        else {
-            qDebug() << "Draw command rejected. Round active:" << m_isRoundActive
-                     << "Is drawer:" << (senderName == m_currentDrawer);
-        }
+    case Protocol::MessageType::Draw: {
+        // Сюда доходят только команды, которые не взял быстрый путь parseDraw
+        Protocol::DrawCommand command;
+        const bool valid = Protocol::Json::decode(message, command);
+        handleDraw(senderId, command, valid);
+        break;
     }
-    else if (type == "guess") {
-        if (m_gameState == Drawing && senderName != m_currentDrawer) {
-            QString guess = message["text"].toString().trimmed().toLower();
-
-            if (guess.isEmpty()) {
-                qDebug() << "Empty guess from" << senderName;
-                return;
-            }
+    case Protocol::MessageType::Guess: {
+        Protocol::Guess guess;
+        if (!Protocol::Json::decode(message, guess)) break;
+        if (m_gameState == Drawing && sender.rosterIndex >= 0 && senderId != m_currentDrawer) {
+            const GuessMatcher::Result result = m_matcher.match(guess.text);
 
-            if (guess == m_currentWord.toLower()) {
+            if (result == GuessMatcher::Exact) {
                 // Правильный ответ
-                QString guesser = senderName;
-                m_scores[guesser] += 10;
-                m_scores[m_currentDrawer] += 5;
-
-                QJsonObject correctGuess;
-                correctGuess["type"] = "correctGuess";
-                correctGuess["guesser"] = guesser;
-                correctGuess["word"] = m_currentWord;
-                correctGuess["drawer"] = m_currentDrawer;  // Добавлено для информации
-
-                // Формируем обновленные очки
-                QJsonObject scoresObject;
-                for (auto it = m_scores.begin(); it != m_scores.end(); ++it) {
-                    scoresObject[it.key()] = it.value();
+                addScore(senderId, 10);
+                if (m_currentDrawer >= 0) {
+                    addScore(m_currentDrawer, 5);
                 }
-                correctGuess["scores"] = scoresObject;
+                // Рассылаем только изменившиеся очки
+                flushScoreDeltas();
 
-                broadcast(correctGuess);
+                Protocol::CorrectGuess correct;
+                correct.guesser = senderId;
+                correct.word = m_currentWord;
+                correct.drawer = m_currentDrawer;  // Добавлено для информации
+
+                broadcast(Protocol::Json::encode(correct));
                 endRound();
                 ifOver();
             }
-            else {
-                // Неправильный ответ
-                QJsonObject chatMessage;
-                chatMessage["type"] = "chat";
-                chatMessage["player"] = senderName;
-                chatMessage["text"] = message["text"].toString();  // Оригинальный текст (без toLower)
-                broadcast(chatMessage);
+            else if (result == GuessMatcher::Close) {
+                // Почти угадал: подсказка только ему, в чат опечатка не уходит,
+                // чтобы не подсказывать остальным
+                Protocol::CloseGuess close;
+                close.text = guess.text;
+                sendToClient(senderId, Protocol::Json::encode(close));
+            }
+            else if (!guess.text.trimmed().isEmpty()) {
+                // Неправильный ответ уходит в общий чат, если не выдает слово
+                Protocol::Chat chat;
+                chat.player = senderId;
+                chat.text = guess.text;  // Текст, запрещенные слова под звездочками
+                if (m_chatFilter.filter(chat.text) == ChatFilter::Withheld) {
+                    sendToClient(senderId, Protocol::Json::encode(Protocol::MessageType::ChatHidden));
+                    return;
+                }
+                broadcast(Protocol::Json::encode(chat));
             }
         }
+        break;
     }
-    else {
+    case Protocol::MessageType::Resume:
+        resumeSession(senderId, message);
+        break;
+    case Protocol::MessageType::Subscribe: {
+        // Подписка только на чтение (ретранслятор зрителей): поток комнаты без места в игре.
+        // lastSeq есть у ретранслятора, который переподключается
+        if (sender.rosterIndex >= 0) return;
+        sender.subscriber = true;
+        const qint64 lastSeq = message.contains("lastSeq")
+                ? static_cast<qint64>(message["lastSeq"].toDouble()) : -1;
+
+        QJsonObject subscribed = Protocol::Json::encode(Protocol::MessageType::Subscribed);
+        const bool replayed = sendCatchUp(senderId, subscribed, message, lastSeq);
+        qDebug() << "Subscriber" << senderId << "attached" << (replayed ? "(replay)" : "(keyframe)");
+        break;
+    }
+    case Protocol::MessageType::ScoresResync:
+        // Клиент пропустил версию очков - отправляем полный снимок только ему
+        sendScoresSnapshot(senderId);
+        break;
+    case Protocol::MessageType::Ping: {
+        // Клиент меряет RTT: время отправки возвращается ему как есть
+        Protocol::Ping ping;
+        if (!Protocol::Json::decode(message, ping)) break;
+        Protocol::Pong pong;
+        pong.id = ping.id;
+        pong.time = ping.time;
+        sendToClient(senderId, Protocol::Json::encode(pong));
+        break;
+    }
+    default:
         qDebug() << "Unknown message type received:" << type;
+        break;
     }
 }
 
+void myserver::processDraw(int senderId, Protocol::DrawCommand &command){
+    static const QString DrawType = QStringLiteral("draw");
+    FlightRecorder::Scope scope(m_recorder, "message", roomName(), m_bytesOut, DrawType);
+    Tracing::Zone zone("processMessage", DrawType);
+    if (m_players[senderId].connection < 0) return;
+    handleDraw(senderId, command, true);
+}
+
+void myserver::handleDraw(int senderId, Protocol::DrawCommand &command, bool valid){
+    if (valid && m_isRoundActive && senderId == m_currentDrawer) {
+        // Без лога: это почти весь трафик, а строка лога - выделение памяти на отрезок
+        if (!admitDraw(senderId, command)) return;
+        relayDraw(command);
+    }
+    else {
+        // Чужие и испорченные команды рисования тоже не бесплатны
+        if (!admitMessage(senderId, Protocol::MessageType::Draw)) return;
+        qDebug() << "Draw command rejected. Valid:" << valid << "Round active:" << m_isRoundActive
+                 << "Is drawer:" << (senderId == m_currentDrawer);
+    }
+}
+
+void myserver::relayDraw(const Protocol::DrawCommand &command){
+    // Поле trace уходит угадывающим вместе с командой - связь штриха продолжится у них
+    if (Tracing::enabled() && command.trace) {
+        Tracing::flow("stroke", command.trace, 't');
+    }
+
+    // Команда собирается заново из разобранных полей: лишнее от клиента дальше не идет.
+    // Строка пишется в буфер-член: история и журнал копируют из него байты, так что
+    // он не делится и переживает вызов со своей емкостью. QJsonDocument - только для текста
+    QByteArray& line = m_drawLine;
+    line.reserve(Protocol::MaxDrawLineBytes);
+    line.resize(Protocol::MaxDrawLineBytes);
+    const int length = Protocol::writeDraw(command, -1, line.data(), line.size());
+    if (length >= 0) {
+        line.resize(length);
+    } else {
+        line = QJsonDocument(Protocol::Json::encode(command)).toJson(QJsonDocument::Compact);
+    }
+    // Очистка делает всю прежнюю историю ненужной: новичку хватит ее самой
+    if (command.tool == Protocol::Tool::Clear) {
+        clearHistory();
+    } else if (m_drawingHistory.size() + line.size() + 1 > MaxHistoryBytes) {
+        // Холст комнаты переполнен - дальше рисовать можно только после очистки
+        ++m_limits.historyFull;
+        scheduleLimitReport();
+        return;
+    }
+    appendHistory(line);
+    broadcastDraw(command);
+    journal(JournalStroke, line);
+}
+
+void myserver::appendHistory(const QByteArray &line){
+
+    m_drawingHistory.append(line);
+    m_drawingHistory.append('\n');
+    m_memory.adjust(MemoryBudget::History, line.size() + 1);
+}
+
+void myserver::clearHistory(){
+
+    m_memory.adjust(MemoryBudget::History, -m_drawingHistory.size());
+    // Буфер истории - арена раунда: емкость остается следующему. Копию могла
+    // взять очередь сокета (ключевой кадр) - тогда буфер новый той же емкости
+    const int capacity = m_drawingHistory.capacity();
+    if (!m_drawingHistory.isDetached()) m_drawingHistory = QByteArray();
+    m_drawingHistory.reserve(capacity);
+    m_drawingHistory.resize(0);
+}
+
 void myserver::startGame(){
     m_gameState = Drawing;
     m_isRoundActive = true;
@@ -202,93 +414,207 @@ void myserver::startGame(){
 
 
 void myserver::startNewRound() {
+    // Раунд мог начаться раньше паузы (startGame) - ее таймер больше не нужен
+    m_timers.cancel(&m_intermissionTimer);
+    m_timers.cancel(&m_roundTimer);
+    // Все игроки без связи - раунд не начинаем, ждем их еще одну паузу.
+    // Если никто не вернется, сессии истекут и пустая комната освободится сама
+    if (!selectNewDrawer()) {
+        m_isRoundActive = false;
+        m_gameState = RoundEnd;
+        scheduleNextRound();
+        return;
+    }
     m_gameState = Drawing;
     m_isRoundActive = true; // Раунд активен
-    m_drawingHistory.clear();
-
-    selectNewDrawer();
-    m_currentWord = selectRandomWord();
+    clearHistory();
+    // Пулы кадров и пакетов - тоже: запас после пиков прошлого раунда уходит в кучу
+    reportAllocations();
+    m_framePool.resetRound();
+    m_chunkPool.resetRound();
+
+    QStringList aliases;
+    const QString word = selectRandomWord(aliases);
+    setCurrentWord(word, aliases);
+    // Начало раунда в журнале - это снимок: история пуста, он маленький
+    writeSnapshot();
 
     // Отправляем слово только художнику
-    QTcpSocket* drawerSocket = m_clientNames.key(m_currentDrawer);
-    if (drawerSocket) {
-        QJsonObject drawerMsg;
-        drawerMsg["type"] = "yourTurn";
-        drawerMsg["word"] = m_currentWord;
-        sendToClient(drawerSocket, drawerMsg);
+    if (m_currentDrawer >= 0) {
+        Protocol::YourTurn turn;
+        turn.word = m_currentWord;
+        sendToClient(m_currentDrawer, Protocol::Json::encode(turn));
     }
 
     // Уведомляем всех о начале раунда
-    QJsonObject roundStart;
-    roundStart["type"] = "roundStart";
-    roundStart["drawer"] = m_currentDrawer;
-    roundStart["round"] = m_currentRound;
-    broadcast(roundStart);
+    Protocol::RoundStart roundStart;
+    roundStart.drawer = m_currentDrawer;
+    roundStart.round = m_currentRound;
+    broadcast(Protocol::Json::encode(roundStart));
 
     // Явная команда очистки всем
-    QJsonObject clearCmd;
-    clearCmd["type"] = "draw";
-    clearCmd["tool"] = "clear";
-    broadcast(clearCmd);
+    Protocol::DrawCommand clear;
+    clear.tool = Protocol::Tool::Clear;
+    broadcast(Protocol::Json::encode(clear));
 
-    m_roundTimer.start(60000);
+    m_roundTimer = m_timers.start(60000, [this]() { onRoundTimerTimeout(); });
 }
 
 
 void myserver::endRound() {
     m_isRoundActive = false; // Раунд завершен
-    m_roundTimer.stop();
+    m_timers.cancel(&m_roundTimer);
     m_gameState = RoundEnd;
 
-    QJsonObject roundEnd;
-    roundEnd["type"] = "roundEnd";
-
-    QJsonObject scoresObject;
-    for (auto it = m_scores.begin(); it != m_scores.end(); ++it) {
-        scoresObject[it.key()] = it.value();
-    }
-    roundEnd["scores"] = scoresObject;
-    broadcast(roundEnd);
+    // Очки уже разосланы дельтами в момент изменения
+    Protocol::RoundEnd roundEnd;
+    roundEnd.scoreSeq = m_scoreSeq;
+    broadcast(Protocol::Json::encode(roundEnd));
 
     // Сброс состояния для следующего раунда
-    m_currentWord = ""; // Очищаем слово
-    m_drawingHistory.clear(); // Очищаем историю рисования
+    setCurrentWord(QString()); // Очищаем слово
+    clearHistory(); // Очищаем историю рисования
+    journal(JournalRoundEnd);
     // m_currentDrawer - оставляем, чтобы он не смог рисовать в начале нового раунда
     // m_gameState = WaitingForPlayers; // Оставляем, ждем пока пройдет таймаут
-    QTimer::singleShot(5000, this, &myserver::startNewRound); // Запускаем новый раунд через 5 секунд
+    scheduleNextRound(); // Запускаем новый раунд через 5 секунд
+}
+
+void myserver::scheduleNextRound(int delayMs) {
+    m_timers.cancel(&m_intermissionTimer);
+    m_intermissionTimer = m_timers.start(delayMs, [this]() {
+        m_intermissionTimer = 0;
+        FlightRecorder::Scope scope(m_recorder, "intermission", roomName(), m_bytesOut);
+        startNewRound();
+    });
 }
 
-void myserver::selectNewDrawer() {
-    if (m_clientNames.isEmpty()) return;
+bool myserver::selectNewDrawer() {
+    m_currentDrawer = -1;
+    if (m_roster.isEmpty()) return false;
 
-    // все возможных рисовальщики кроме последнего
-    QSet<QString> possibleDrawers;
-    for (const QString& name : m_clientNames.values()) {
-        if (name != lastDrawer) {
-            possibleDrawers.insert(name);
+    // все возможные рисовальщики кроме последнего: случайный индекс среди
+    // остальных и пропуск позиции прошлого художника, без обхода списка
+    const int lastIndex = lastDrawer >= 0 ? m_players[lastDrawer].rosterIndex : -1;
+    int randomIndex;
+    if (lastIndex < 0 || m_roster.size() == 1) {
+        randomIndex = QRandomGenerator::global()->bounded(m_roster.size());
+    } else {
+        randomIndex = QRandomGenerator::global()->bounded(m_roster.size() - 1);
+        if (randomIndex >= lastIndex) ++randomIndex;
+    }
+    // Игрок без связи рисовать не сможет - берем следующего подключенного.
+    // Прошлый художник рисует снова, только если больше некому
+    int candidate = -1;
+    for (int i = 0; i < m_roster.size(); ++i) {
+        const int id = m_roster.at((randomIndex + i) % m_roster.size());
+        if (m_players[id].connection < 0) continue;
+        if (id != lastDrawer) {
+            candidate = id;
+            break;
         }
+        candidate = id;
     }
+    if (candidate < 0) return false;
+    m_currentDrawer = candidate;
+
+    lastDrawer = m_currentDrawer;
+    return true;
+}
+
+void myserver::setCurrentWord(const QString &word, const QStringList &aliases){
 
-    if (possibleDrawers.isEmpty()) {
-        m_currentDrawer = m_clientNames.values().at(QRandomGenerator::global()->bounded(m_clientNames.size()));
+    m_currentWord = word;
+    m_currentAliases = aliases;
+    if (word.isEmpty()) {
+        m_matcher.clear();
+        m_chatFilter.clearAnswer();
     } else {
-        int randomIndex = QRandomGenerator::global()->bounded(possibleDrawers.size());
-        auto it = possibleDrawers.begin();
-        std::advance(it, randomIndex);
-        m_currentDrawer = *it;
+        m_matcher.setWord(word, aliases);
+        m_chatFilter.setAnswer(word, aliases);
     }
+}
 
-    lastDrawer = m_currentDrawer;
+void myserver::setChatBlocklist(const QStringList &words){
+
+    m_chatFilter.setBlocklist(words);
+    // Ответ текущего раунда остается в автомате
+    qDebug() << "Chat blocklist:" << words.size() << "words";
+}
+
+void myserver::setDictionary(DictionaryStore *dictionaries, const QString &category,
+                             const QString &language, int maxDifficulty){
+
+    m_dictionaries = dictionaries;
+    m_wordCategory = category;
+    m_wordLanguage = language;
+    m_maxDifficulty = maxDifficulty;
+    m_bagDictionary.reset();
 }
 
-QString myserver::selectRandomWord(){
+QString myserver::selectRandomWord(QStringList &aliases){
+
+    const QSharedPointer<const WordDictionary> dictionary =
+            m_dictionaries ? m_dictionaries->current() : QSharedPointer<const WordDictionary>();
+    if (dictionary && dictionary->size() > 0) {
+        // Словарь сменился (или перезагружен) - новый мешок
+        if (dictionary != m_bagDictionary) rebuildWordBag(dictionary);
+        if (m_wordBag.size() > 0) {
+            const int next = static_cast<int>(m_wordBag.next());
+            const int index = m_bagFiltered ? m_bagCandidates.at(next) : m_bagFirst + next;
+            const WordDictionary::Word word = dictionary->word(index);
+            aliases = word.aliases;
+            return word.text;
+        }
+    }
 
+    // Без словаря или без подходящих в нем слов - встроенный список
     if (m_words.isEmpty()) return "";
-    return m_words.at(QRandomGenerator::global()->bounded(m_words.size()));
+    if (m_builtinBag.size() != static_cast<quint32>(m_words.size())) m_builtinBag.reset(m_words.size());
+    const QString word = m_words.at(m_builtinBag.next());
+    aliases = m_wordAliases.value(word);
+    return word;
+}
+
+void myserver::rebuildWordBag(const QSharedPointer<const WordDictionary> &dictionary){
+
+    m_bagDictionary = dictionary;
+    int count = dictionary->size();
+    m_bagFirst = 0;
+    const int category = m_wordCategory.isEmpty() ? -1 : dictionary->findCategory(m_wordCategory);
+    if (category >= 0) {
+        dictionary->categoryRange(category, m_bagFirst, count);
+    } else if (!m_wordCategory.isEmpty()) {
+        qDebug() << "No category" << m_wordCategory << "in the dictionary, using all words";
+    }
+    const int language = m_wordLanguage.isEmpty() ? -1 : dictionary->findLanguage(m_wordLanguage);
+    if (!m_wordLanguage.isEmpty() && language < 0) {
+        qDebug() << "No language" << m_wordLanguage << "in the dictionary, using all words";
+    }
+
+    // Без фильтра мешок идет прямо по диапазону категории. С фильтром подходящие
+    // номера отбираются здесь один раз, а не просматриваются каждый раунд
+    m_bagFiltered = language >= 0 || m_maxDifficulty > 0;
+    m_bagCandidates.clear();
+    if (!m_bagFiltered) {
+        m_wordBag.reset(count);
+        return;
+    }
+    for (int index = m_bagFirst; index < m_bagFirst + count; ++index) {
+        if (language >= 0 && dictionary->language(index) != language) continue;
+        if (m_maxDifficulty > 0 && dictionary->difficulty(index) > m_maxDifficulty) continue;
+        m_bagCandidates.append(index);
+    }
+    m_bagCandidates.squeeze();
+    m_wordBag.reset(m_bagCandidates.size());
+    if (m_bagCandidates.isEmpty()) {
+        qDebug() << "No dictionary word matches the room filter, using built-in words";
+    }
 }
 
 void myserver::onRoundTimerTimeout(){
 
+    FlightRecorder::Scope scope(m_recorder, "roundTimer", roomName(), m_bytesOut);
     endRound();
     ifOver();
 }
@@ -298,12 +624,12 @@ void myserver::ifOver(){
     bool gameOver = true;
     int totalScore = 0;
 
-    for (auto it = m_scores.begin(); it != m_scores.end(); ++it) {
-        if (it.value() < 10) {
+    for (int id : m_roster) {
+        if (m_players[id].score < 10) {
             gameOver = false;
             break;
         }
-        totalScore += it.value();
+        totalScore += m_players[id].score;
     }
 
     if (gameOver && totalScore > 100) {
@@ -312,49 +638,1308 @@ void myserver::ifOver(){
 }
 
 void myserver::gameOverLogic(){
-    QJsonObject gameOver;
-    gameOver["type"] = "gameOver";
+    // Итоговые очки у клиентов уже есть; версия позволяет убедиться, что они актуальны
+    Protocol::GameOver gameOver;
+    gameOver.scoreSeq = m_scoreSeq;
+    broadcast(Protocol::Json::encode(gameOver));
+}
+
+
 
-    QJsonObject scoresObject;
-    for (auto it = m_scores.begin(); it != m_scores.end(); ++it) {
-        scoresObject[it.key()] = it.value();
+void myserver::sendToClient(int id, const QJsonObject &message){
+
+    QJsonDocument doc(message);
+    sendData(id, doc.toJson(QJsonDocument::Compact) + "\n");
+}
+
+void myserver::sendData(int id, const QByteArray &lines){
+
+    Player& player = m_players[id];
+    if (player.connection < 0) return;
+
+    if (player.compression == NoCompression) {
+        writeToConnection(id, lines);
+        return;
     }
-    gameOver["scores"] = scoresObject;
-    broadcast(gameOver);
+
+    // Личное сообщение не должно обогнать уже разосланные кадры комнаты
+    if (player.inRoomStream) flushRoomStream();
+    writeToConnection(id, StreamFrame::encode(StreamFrame::Direct, player.deflate->compress(lines)));
 }
 
+void myserver::writeToConnection(int id, const QByteArray &bytes){
 
+    if (reserveOutbound(id, bytes.size())) {
+        m_backend->write(m_players[id].connection, bytes);
+    }
+}
 
-void myserver::sendToClient(QTcpSocket *socket, const QJsonObject &message){
+bool myserver::reserveOutbound(int id, qint64 bytes){
+
+    Player& player = m_players[id];
+    if (player.connection < 0 || player.shedding) return false;
+
+    // Клиент не успевает читать: копить для него очередь без предела нельзя.
+    // Проверяется уже накопленное, так что большой ключевой кадр в пустую
+    // очередь пройдет. Отключенный вернется через resume и получит ключевой кадр
+    if (player.outboundBytes > outboundLimit()) {
+        player.shedding = true;
+        ++m_limits.slowConsumers;
+        scheduleLimitReport();
+        qDebug() << "Client" << id << "is not reading," << player.outboundBytes << "bytes queued, disconnecting";
+        // Не из середины рассылки: обрыв меняет таблицу сессий
+        const int connection = player.connection;
+        QTimer::singleShot(0, this, [this, id, connection]() {
+            if (m_players[id].connection == connection && m_players[id].shedding) {
+                m_backend->abort(connection);
+            }
+        });
+        return false;
+    }
+    player.outboundBytes += bytes;
+    m_bytesOut += bytes;
+    m_memory.adjust(MemoryBudget::Outbound, bytes);
+    return true;
+}
 
-    if (!socket || socket->state() != QTcpSocket::ConnectedState) return;
+void myserver::onBytesWritten(int id, qint64 bytes){
 
-    QJsonDocument doc(message);
-    socket->write(doc.toJson(QJsonDocument::Compact) + "\n");
+    Player& player = m_players[id];
+    const qint64 released = qMin(bytes, player.outboundBytes);
+    player.outboundBytes -= released;
+    m_memory.adjust(MemoryBudget::Outbound, -released);
 }
 
-void myserver::broadcast(const QJsonObject& message, QTcpSocket *exclude){
+qint64 myserver::outboundLimit() const{
 
-    QJsonDocument doc(message);
-    QByteArray data = doc.toJson(QJsonDocument::Compact) + "\n";
+    // При нехватке памяти медленных клиентов отключаем раньше
+    const qint64 limit = MaxOutboundBytes;
+    return m_memory.pressure() == MemoryBudget::Normal ? limit : limit / 4;
+}
+
+void myserver::syncInbound(int id){
+
+    Player& player = m_players[id];
+    m_memory.adjust(MemoryBudget::Inbound, player.inbox.size() - player.inboundBytes);
+    player.inboundBytes = player.inbox.size();
+}
+
+void myserver::releaseConnectionBuffers(int id){
+
+    Player& player = m_players[id];
+    player.inbox.clear();
+    syncInbound(id);
+    m_memory.adjust(MemoryBudget::Outbound, -player.outboundBytes);
+    player.outboundBytes = 0;
+    player.shedding = false;
+}
+
+void myserver::rejectOversizedFrame(int id){
+
+    ++m_limits.oversizedFrames;
+    scheduleLimitReport();
+    qDebug() << "Client" << id << "sent a frame over" << MaxFrameBytes << "bytes, disconnecting";
+    m_backend->abort(m_players[id].connection);
+}
+
+void myserver::broadcast(const QJsonObject& message, int excludeId){
+    Tracing::Zone zone("broadcast");
 
-    for (QTcpSocket* socket : m_clients){
-        if (socket != exclude && socket->state() == QTcpSocket::ConnectedState){
-            socket->write(data);
+    QJsonObject numbered = message;
+    numbered["seq"] = ++m_roomSeq;
+    QJsonDocument doc(numbered);
+    broadcastFrame(doc.toJson(QJsonDocument::Compact) + "\n", excludeId);
+}
+
+void myserver::broadcastDraw(const Protocol::DrawCommand& command){
+    Tracing::Zone zone("broadcast");
+
+    // Кадр пишется сразу в буфер пула; дальше его делят кольцо повтора
+    // и очереди сокетов, а пул заберет буфер обратно, когда все его отпустят
+    QByteArray& slot = m_framePool.acquire();
+    slot.resize(Protocol::MaxDrawLineBytes + 1);
+    const int length = Protocol::writeDraw(command, m_roomSeq + 1, slot.data(), Protocol::MaxDrawLineBytes);
+    if (length < 0) {
+        slot.resize(0);
+        broadcast(Protocol::Json::encode(command));
+        return;
+    }
+    ++m_roomSeq;
+    slot[length] = '\n';
+    slot.resize(length + 1);
+    const QByteArray frame = slot;
+    broadcastFrame(frame);
+}
+
+void myserver::broadcastFrame(const QByteArray& data, int excludeId){
+
+    ReplayFrame& entry = m_replayRing[m_roomSeq % ReplayRingSize];
+    entry.data = data;
+    entry.excludeId = excludeId;
+
+    // Одна общая копия кадра уходит всем несжатым соединениям одной пачкой
+    QVector<int>& targets = m_broadcastTargets;
+    targets.resize(0);
+    for (int id = 0; id < m_players.size(); ++id){
+        const Player& player = m_players[id];
+        // Сжатые соединения получают кадр из общего потока комнаты. exclude на них
+        // не действует: поток один на всех, а новичок входит в него только после ключевого кадра
+        if (player.compression != NoCompression || id == excludeId) continue;
+        // Гость до register/subscribe может ждать маршрутизатора и уйти в другую
+        // комнату (шард) - чужой поток ему на сокет попадать не должен
+        if (player.rosterIndex < 0 && !player.subscriber) continue;
+        if (reserveOutbound(id, data.size())){
+            targets.append(player.connection);
         }
     }
+    if (!targets.isEmpty()) {
+        m_backend->writeMany(targets, data);
+    }
+
+    if (m_roomStreamMembers > 0) {
+        m_pendingRoom.append(data);
+        scheduleRoomFlush();
+    }
+}
+
+int myserver::addPlayer(int connection){
+
+    int id;
+    if (!m_freeIds.isEmpty()) {
+        id = m_freeIds.takeLast();
+    } else {
+        id = m_players.size();
+        m_players.append(Player());
+    }
+    attachConnection(id, connection);
+    return id;
+}
+
+void myserver::attachConnection(int id, int connection){
+
+    // Новое соединение начинает без сжатия, пока не договорится о нем
+    leaveRoomStream(id);
+    releaseConnectionBuffers(id);
+    Player& player = m_players[id];
+    player.compression = NoCompression;
+    player.deflate.reset();
+    player.inflate.reset();
+
+    // Номера соединений плотные, как и id игроков: поиск в обе стороны - индекс
+    player.connection = connection;
+    while (m_connectionPlayers.size() <= connection) {
+        m_connectionPlayers.append(-1);
+    }
+    m_connectionPlayers[connection] = id;
+}
+
+void myserver::detachConnection(int id){
+
+    Player& player = m_players[id];
+    if (player.connection < 0) return;
+    m_connectionPlayers[player.connection] = -1;
+    player.connection = -1;
+}
+
+void myserver::registerPlayer(int id, const QString &name){
+
+    Player& player = m_players[id];
+    player.name = name;
+    player.resumeToken = QUuid::createUuid().toString(QUuid::WithoutBraces);
+    m_resumeTokens[player.resumeToken] = id;
+    player.score = 0;
+    player.rosterIndex = m_roster.size();
+    m_roster.append(id);
+
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_12);
+    out << qint32(id) << name << player.resumeToken;
+    journal(JournalJoin, payload);
+}
+
+void myserver::removePlayer(int id){
+
+    leaveRoomStream(id);
+    releaseConnectionBuffers(id);
+    Player& player = m_players[id];
+    m_timers.cancel(&player.graceTimer);
+    if (player.scoreDirty) {
+        m_dirtyScores.removeOne(id);
+    }
+    if (!player.resumeToken.isEmpty()) {
+        m_resumeTokens.remove(player.resumeToken);
+    }
+    if (player.rosterIndex >= 0) {
+        // Последний в списке встает на место удаляемого
+        const int movedId = m_roster.last();
+        m_roster[player.rosterIndex] = movedId;
+        m_players[movedId].rosterIndex = player.rosterIndex;
+        m_roster.removeLast();
+    }
+    player = Player();
+    m_freeIds.append(id);
+    // id выдадут заново - художником новичок от этого стать не должен
+    if (id == m_currentDrawer) m_currentDrawer = -1;
+    if (id == lastDrawer) lastDrawer = -1;
+}
+
+void myserver::dropPlayer(int id){
+
+    removePlayer(id);
+
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    out << qint32(id);
+    journal(JournalLeave, payload);
+
+    Protocol::PlayerLeft left;
+    left.id = id;
+    broadcast(Protocol::Json::encode(left));
+    qDebug() << "Session" << id << "expired";
+
+    if (m_roster.isEmpty()) releaseRoom();
+}
+
+QJsonObject myserver::scoresObject() const{
+
+    // Ключ - id игрока (ключи JSON-объекта всегда строки)
+    QJsonObject scores;
+    for (int id : m_roster) {
+        scores[QString::number(id)] = m_players[id].score;
+    }
+    return scores;
+}
+
+void myserver::addScore(int id, int points){
+
+    Player& player = m_players[id];
+    player.score += points;
+    if (!player.scoreDirty) {
+        player.scoreDirty = true;
+        m_dirtyScores.append(id);
+    }
+}
+
+void myserver::flushScoreDeltas(){
+
+    if (m_dirtyScores.isEmpty()) return;
+
+    QJsonObject changes;
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    out << qint32(m_scoreSeq + 1) << qint32(m_dirtyScores.size());
+    for (int id : m_dirtyScores) {
+        changes[QString::number(id)] = m_players[id].score;
+        out << qint32(id) << qint32(m_players[id].score);
+        m_players[id].scoreDirty = false;
+    }
+    m_dirtyScores.clear();
+    journal(JournalScores, payload);
+
+    QJsonObject delta = Protocol::Json::encode(Protocol::MessageType::Scores);
+    delta["scoreSeq"] = ++m_scoreSeq;
+    delta["scores"] = changes;
+    broadcast(delta);
+}
+
+void myserver::sendScoresSnapshot(int id){
+
+    QJsonObject snapshot = Protocol::Json::encode(Protocol::MessageType::Scores);
+    snapshot["scoreSeq"] = m_scoreSeq;
+    snapshot["full"] = true;
+    snapshot["scores"] = scoresObject();
+    sendToClient(id, snapshot);
+}
+
+void myserver::resumeSession(int senderId, const QJsonObject &request){
+
+    const QString token = request["token"].toString();
+    const qint64 lastSeq = static_cast<qint64>(request["lastSeq"].toDouble());
+
+    const int connection = m_players[senderId].connection;
+    const int id = m_resumeTokens.value(token, -1);
+    if (id < 0 || id == senderId) {
+        sendToClient(senderId, Protocol::Json::encode(Protocol::MessageType::ResumeFailed));
+        return;
+    }
+
+    // Временный слот нового подключения освобождается, сокет переходит к сессии
+    // вместе с еще не разобранными строками
+    const QByteArray leftover = m_players[senderId].inbox;
+    detachConnection(senderId);
+    removePlayer(senderId);
+
+    Player& player = m_players[id];
+    if (player.connection >= 0) {
+        // Старое соединение еще не заметило обрыв (полуоткрытый TCP)
+        const int stale = player.connection;
+        detachConnection(id);
+        m_backend->abort(stale);
+    }
+    m_timers.cancel(&player.graceTimer);
+    attachConnection(id, connection);
+    if (!leftover.isEmpty()) {
+        player.inbox = leftover;
+        syncInbound(id);
+        QTimer::singleShot(0, this, [this, id]() { onReadyRead(id); });
+    }
+
+    QJsonObject resumed = Protocol::Json::encode(Protocol::MessageType::Resumed);
+    resumed["id"] = id;
+    const bool replayed = sendCatchUp(id, resumed, request, lastSeq);
+    qDebug() << "Session" << id << "resumed from seq" << lastSeq << "at" << m_roomSeq
+             << (replayed ? "(replay)" : "(keyframe)");
+}
+
+bool myserver::sendCatchUp(int id, QJsonObject reply, const QJsonObject &request, qint64 lastSeq){
+
+    // Пропущенное досылается из кольца, если оно еще там; иначе - ключевой кадр.
+    // Художнику - всегда ключевой кадр: личного yourTurn со словом в кольце нет
+    const bool isDrawer = m_gameState == Drawing && id == m_currentDrawer;
+    const bool canReplay = !isDrawer && lastSeq >= m_replayFloor && lastSeq <= m_roomSeq
+            && m_roomSeq - lastSeq < ReplayRingSize;
+    reply["full"] = !canReplay;
+    if (!canReplay) {
+        reply["seq"] = m_roomSeq;
+    }
+    const Compression compression = negotiateCompression(request, reply);
+    sendToClient(id, reply);
+    enableCompression(id, compression);
+
+    if (canReplay) {
+        replaySince(id, lastSeq);
+    } else {
+        sendKeyframe(id);
+    }
+    joinRoomStream(id);
+    return canReplay;
 }
 
-//Для смены ролей from Kirya
+void myserver::replaySince(int id, qint64 lastSeq){
+
+    // Одной порцией: при сжатии это один кадр с общим словарем
+    QByteArray missed;
+    for (qint64 seq = lastSeq + 1; seq <= m_roomSeq; ++seq) {
+        const ReplayFrame& entry = m_replayRing[seq % ReplayRingSize];
+        if (entry.excludeId != id) missed.append(entry.data);
+    }
+    if (!missed.isEmpty()) {
+        sendData(id, missed);
+    }
+}
+
+void myserver::sendKeyframe(int id){
+
+    // Состояние комнаты на момент m_roomSeq: список игроков с очками,
+    // текущий раунд и история рисования
+    sendPlayerList(id);
+
+    if (m_gameState == Drawing) {
+        Protocol::RoundStart roundStart;
+        roundStart.drawer = m_currentDrawer;
+        roundStart.round = m_currentRound;
+        sendToClient(id, Protocol::Json::encode(roundStart));
 
-void myserver::assignRoles() {
-    if (clients.size() == 1) {
-        clients[clients.keys().first()] = true; // Первый — художник
+        if (id == m_currentDrawer) {
+            Protocol::YourTurn turn;
+            turn.word = m_currentWord;
+            sendToClient(id, Protocol::Json::encode(turn));
+        }
+
+        qDebug() << "Sending drawing history to client" << id;
+        if (!m_drawingHistory.isEmpty()) {
+            sendData(id, m_drawingHistory);
+        }
     } else {
-        clients[clients.keys().last()] = false; // Остальные — наблюдатели
+        Protocol::DrawCommand clear;
+        clear.tool = Protocol::Tool::Clear;
+        sendToClient(id, Protocol::Json::encode(clear));
+    }
+}
+
+void myserver::sendPlayerList(int id){
+
+    QJsonObject playerListMsg = Protocol::Json::encode(Protocol::MessageType::PlayerList);
+    QJsonArray playersArray;
+    for (int id : m_roster) {
+        QJsonObject playerObj;
+        playerObj["id"] = id;
+        playerObj["name"] = m_players[id].name;
+        playerObj["score"] = m_players[id].score;
+        playersArray.append(playerObj);
+    }
+    playerListMsg["players"] = playersArray;
+    playerListMsg["scoreSeq"] = m_scoreSeq; // с этой версии клиент применяет дельты очков
+    playerListMsg["seq"] = m_roomSeq;       // и номера потока комнаты
+    sendToClient(id, playerListMsg);
+}
+
+myserver::Compression myserver::negotiateCompression(const QJsonObject &request, QJsonObject &response) const{
+
+    // Клиент перечисляет, что умеет; пока есть только deflate
+    const QJsonArray offered = request["compression"].toArray();
+    for (const QJsonValue& value : offered) {
+        if (value.toString() == "deflate") {
+            response["compression"] = "deflate";
+            return Deflate;
+        }
     }
+    return NoCompression;
 }
 
+void myserver::enableCompression(int id, Compression compression){
+
+    Player& player = m_players[id];
+    player.compression = compression;
+    if (compression == Deflate) {
+        player.deflate.reset(new DeflateStream);
+    }
+}
+
+void myserver::joinRoomStream(int id){
+
+    Player& player = m_players[id];
+    if (player.compression == NoCompression || player.inRoomStream) return;
+
+    // Ключевой кадр или досылка уже отражают все до m_roomSeq -
+    // накопленные кадры уходят старым участникам без новичка
+    flushRoomStream();
+    player.inRoomStream = true;
+    player.roomStreamFresh = true;
+    ++m_roomStreamMembers;
+    m_roomStreamReset = true;
+}
+
+void myserver::leaveRoomStream(int id){
+
+    Player& player = m_players[id];
+    if (!player.inRoomStream) return;
+    player.inRoomStream = false;
+    player.roomStreamFresh = false;
+    --m_roomStreamMembers;
+}
+
+void myserver::scheduleRoomFlush(){
+
+    if (m_roomFlushScheduled) return;
+    m_roomFlushScheduled = true;
+    // Конец тика: все кадры текущего прохода цикла событий сжимаются вместе
+    QTimer::singleShot(0, this, [this]() {
+        m_roomFlushScheduled = false;
+        flushRoomStream();
+    });
+}
+
+void myserver::flushRoomStream(){
+
+    FlightRecorder::Scope scope(m_recorder, "roomFlush", roomName(), m_bytesOut);
+    if (m_pendingRoom.isEmpty()) return;
+
+    // После сброса словаря поток можно читать с нуля: новички начинают с пакета,
+    // а старые участники получают и точку сброса, чтобы их словарь совпадал
+    QByteArray resetFrame;
+    if (m_roomStreamReset) {
+        resetFrame = StreamFrame::encode(StreamFrame::Room, m_roomDeflate.resetPoint());
+        m_roomStreamReset = false;
+    }
+    // Пакет сжимается сразу за заголовком в буфер пула
+    QByteArray& chunk = m_chunkPool.acquire();
+    chunk.resize(StreamFrame::HeaderSize);
+    m_roomDeflate.compress(m_pendingRoom, chunk);
+    StreamFrame::writeHeader(StreamFrame::Room, chunk.size() - StreamFrame::HeaderSize, chunk.data());
+    const QByteArray batch = chunk;
+    m_pendingRoom.resize(0);
+
+    QVector<int>& resetTargets = m_resetTargets;
+    QVector<int>& batchTargets = m_broadcastTargets;
+    resetTargets.resize(0);
+    batchTargets.resize(0);
+    for (int id = 0; id < m_players.size(); ++id) {
+        Player& player = m_players[id];
+        if (!player.inRoomStream || player.connection < 0) continue;
+        const bool needsReset = !player.roomStreamFresh && !resetFrame.isEmpty();
+        player.roomStreamFresh = false;
+        if (!reserveOutbound(id, batch.size() + (needsReset ? resetFrame.size() : 0))) continue;
+        if (needsReset) {
+            resetTargets.append(player.connection);
+        }
+        batchTargets.append(player.connection);
+    }
+    // Точка сброса уходит раньше пакета: очереди соединений сохраняют порядок
+    if (!resetTargets.isEmpty()) {
+        m_backend->writeMany(resetTargets, resetFrame);
+    }
+    if (!batchTargets.isEmpty()) {
+        m_backend->writeMany(batchTargets, batch);
+    }
+}
+
+void myserver::startResumeGrace(int id){
+
+    // Вернувшийся игрок отменяет таймер; если он снова отвалится - заведется новый
+    Player& player = m_players[id];
+    m_timers.cancel(&player.graceTimer);
+    player.graceTimer = m_timers.start(ResumeGraceMs, [this, id]() {
+        m_players[id].graceTimer = 0;
+        FlightRecorder::Scope scope(m_recorder, "resumeGrace", roomName(), m_bytesOut);
+        dropPlayer(id);
+    });
+}
+
+bool myserver::openJournal(const QString &directory){
+
+    QByteArray snapshot;
+    QList<QByteArray> records;
+    if (!m_journal.open(directory, "room", snapshot, records)) return false;
+    if (snapshot.isEmpty() && records.isEmpty()) return true;
+
+    qint64 lastSeq = 0;
+    if (!snapshot.isEmpty() && !restoreSnapshot(snapshot, lastSeq)) {
+        qDebug() << "Journal: snapshot is unreadable, starting an empty room";
+        records.clear();
+    }
+    int applied = 0;
+    for (const QByteArray& record : records) {
+        // Дальше первой непонятной записи состояние уже не восстановить
+        if (!applyJournalRecord(record, lastSeq)) break;
+        ++applied;
+    }
+
+    finishRecovery(lastSeq);
+    qDebug() << "Room recovered:" << m_roster.size() << "players, round" << m_currentRound
+             << "," << applied << "journal records replayed";
+    return true;
+}
+
+void myserver::finishRecovery(qint64 lastSeq){
+
+    // Все восстановленные игроки без связи: у них есть ResumeGraceMs, чтобы вернуться
+    m_freeIds.clear();
+    for (int id = m_players.size() - 1; id >= 0; --id) {
+        if (m_players[id].rosterIndex < 0) {
+            m_players[id] = Player();
+            m_freeIds.append(id);
+        }
+    }
+    for (int id : m_roster) {
+        startResumeGrace(id);
+    }
+
+    // Кольцо досылки пусто - любой resume со старым lastSeq получит ключевой кадр
+    m_roomSeq = lastSeq + RecoverySeqGap;
+    m_replayFloor = m_roomSeq;
+
+    if (m_gameState == Drawing) {
+        m_isRoundActive = true;
+        m_roundTimer = m_timers.start(60000, [this]() { onRoundTimerTimeout(); });
+    } else if (m_gameState == RoundEnd) {
+        scheduleNextRound();
+    }
+
+    // Свежий снимок вместо прочитанного хвоста: следующий рестарт начнет с него
+    writeSnapshot();
+}
+
+void myserver::clearRoom(){
+
+    const QVector<int> roster = m_roster;
+    for (int id : roster) {
+        removePlayer(id);
+    }
+    m_players.clear();
+    m_freeIds.clear();
+    resetRoom();
+}
+
+void myserver::startWatchdog(int thresholdMs, const QString &directory){
+
+    m_watchdog = new StallWatchdog(this, m_recorder, thresholdMs, directory);
+    m_watchdog->start(QThread::LowPriority);
+    qDebug() << "Stall watchdog: threshold" << thresholdMs << "ms, dumps go to" << directory;
+}
+
+bool myserver::startReplication(const QString &path){
+
+    m_replication = new ReplicationPrimary(this);
+    // Новый резерв начинает со снимка, дальше получает записи
+    connect(m_replication, &ReplicationPrimary::followerJoined, this, [this]() {
+        m_replication->appendSnapshot(encodeSnapshot());
+    });
+    return m_replication->listen(path);
+}
+
+void myserver::follow(const QString &path, quint16 port, const QString &backend){
+
+    m_replicationPath = path;
+    m_takeoverPort = port;
+    m_takeoverBackend = backend;
+    m_follower = new ReplicationFollower(this);
+    connect(m_follower, &ReplicationFollower::snapshotReceived, this, &myserver::onReplicatedSnapshot);
+    connect(m_follower, &ReplicationFollower::recordReceived, this, &myserver::onReplicatedRecord);
+    connect(m_follower, &ReplicationFollower::primaryLost, this, &myserver::onPrimaryLost);
+    m_follower->connectToPrimary(path);
+    qDebug() << "Following primary at" << path;
+}
+
+void myserver::onReplicatedSnapshot(const QByteArray &snapshot){
+
+    clearRoom();
+    if (!restoreSnapshot(snapshot, m_followSeq)) {
+        qDebug() << "Replication: unreadable snapshot";
+        clearRoom();
+        return;
+    }
+    // Резерв ведет свой журнал: его собственный рестарт не теряет копию
+    if (m_journal.isOpen()) m_journal.writeSnapshot(snapshot);
+}
+
+void myserver::onReplicatedRecord(const QByteArray &record){
+
+    if (!applyJournalRecord(record, m_followSeq)) {
+        qDebug() << "Replication: unreadable record";
+        return;
+    }
+    if (m_journal.isOpen()) m_journal.append(record);
+}
+
+void myserver::onPrimaryLost(){
+
+    // Порт занят - основной жив (связь с ним порвалась сама): догоняем его заново
+    if (!startServer(m_takeoverPort, m_takeoverBackend)) {
+        delete m_backend;
+        m_backend = nullptr;
+        QTimer::singleShot(FollowerRetryMs, this, [this]() { m_follower->connectToPrimary(m_replicationPath); });
+        return;
+    }
+
+    m_follower->deleteLater();
+    m_follower = nullptr;
+    finishRecovery(m_followSeq);
+    // Бывший основной после рестарта может стать резервом уже для нас
+    startReplication(m_replicationPath);
+    qDebug() << "Took over as primary:" << m_roster.size() << "players, round" << m_currentRound;
+}
+
+void myserver::journal(JournalEvent event, const QByteArray &payload){
+
+    const bool replicating = m_replication && m_replication->hasFollowers();
+    if (!m_journal.isOpen() && !replicating) return;
+
+    // Заголовок как у QDataStream (big-endian), но без QBuffer на каждую запись
+    QByteArray& record = m_journalRecord;
+    record.resize(JournalHeaderSize);
+    record[0] = static_cast<char>(event);
+    qToBigEndian<qint64>(m_roomSeq, record.data() + 1);
+    record.append(payload);
+    if (replicating) m_replication->appendRecord(record);
+    if (!m_journal.isOpen()) return;
+    m_journal.append(record);
+
+    if (m_journal.recordsSinceSnapshot() >= SnapshotEveryRecords) {
+        writeSnapshot();
+    }
+}
+
+void myserver::writeSnapshot(){
+
+    // Снимок в начале раунда несет слово и художника - записей для них нет,
+    // поэтому резерв получает и снимки
+    const bool replicating = m_replication && m_replication->hasFollowers();
+    if (!m_journal.isOpen() && !replicating) return;
+
+    const QByteArray snapshot = encodeSnapshot();
+    if (m_journal.isOpen()) m_journal.writeSnapshot(snapshot);
+    if (replicating) m_replication->appendSnapshot(snapshot);
+}
+
+static const quint32 SnapshotMagic = 0x43524f43; // "CROC"
+static const quint32 SnapshotVersion = 3;
+
+QByteArray myserver::encodeSnapshot() const{
+
+    QByteArray snapshot;
+    QDataStream out(&snapshot, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_12);
+    out << SnapshotMagic << SnapshotVersion;
+    out << m_roomSeq << qint32(m_scoreSeq) << qint32(m_gameState) << qint32(m_currentRound)
+        << m_currentWord << m_currentAliases << qint32(m_currentDrawer) << qint32(lastDrawer);
+
+    // id сохраняются как есть, чтобы токены и id у клиентов остались верными
+    out << qint32(m_players.size()) << qint32(m_roster.size());
+    for (int id : m_roster) {
+        const Player& player = m_players[id];
+        out << qint32(id) << player.name << player.resumeToken << qint32(player.score);
+    }
+    out << m_drawingHistory;
+    return snapshot;
+}
+
+bool myserver::restoreSnapshot(const QByteArray &snapshot, qint64 &lastSeq, bool keepIds){
+
+    QDataStream in(snapshot);
+    in.setVersion(QDataStream::Qt_5_12);
+    quint32 magic = 0, version = 0;
+    in >> magic >> version;
+    // Версия 2 - без вариантов слова: снимки до обновления еще читаются
+    if (magic != SnapshotMagic || version < 2 || version > SnapshotVersion) return false;
+
+    qint32 scoreSeq, gameState, round, drawer, previousDrawer, playerCount, rosterSize;
+    QString word;
+    QStringList aliases;
+    in >> lastSeq >> scoreSeq >> gameState >> round >> word;
+    if (version >= 3) in >> aliases;
+    in >> drawer >> previousDrawer;
+    setCurrentWord(word, aliases);
+    in >> playerCount >> rosterSize;
+    if (in.status() != QDataStream::Ok || playerCount < 0 || rosterSize < 0 || rosterSize > playerCount) {
+        return false;
+    }
+
+    if (keepIds) {
+        m_players.fill(Player(), playerCount);
+    }
+    QHash<int, int> ids;    // id в снимке -> id здесь
+    for (int i = 0; i < rosterSize; ++i) {
+        qint32 id, score;
+        QString name, token;
+        in >> id >> name >> token >> score;
+        if (in.status() != QDataStream::Ok || id < 0 || id >= playerCount) return false;
+
+        int local = id;
+        if (!keepIds) {
+            local = m_freeIds.isEmpty() ? m_players.size() : m_freeIds.takeLast();
+            if (local == m_players.size()) m_players.append(Player());
+        }
+        ids.insert(id, local);
+        Player& player = m_players[local];
+        player.name = name;
+        player.resumeToken = token;
+        player.score = score;
+        player.rosterIndex = m_roster.size();
+        m_roster.append(local);
+        m_resumeTokens[token] = local;
+    }
+
+    QByteArray history;
+    in >> history;
+    if (in.status() != QDataStream::Ok) return false;
+    clearHistory();
+    m_drawingHistory = history;
+    m_memory.adjust(MemoryBudget::History, history.size());
+
+    m_scoreSeq = scoreSeq;
+    m_gameState = static_cast<GameState>(gameState);
+    m_currentRound = round;
+    m_currentDrawer = ids.value(drawer, -1);
+    lastDrawer = ids.value(previousDrawer, -1);
+    return true;
+}
+
+bool myserver::applyJournalRecord(const QByteArray &record, qint64 &lastSeq){
+
+    QDataStream in(record);
+    in.setVersion(QDataStream::Qt_5_12);
+    quint8 event;
+    qint64 seq;
+    in >> event >> seq;
+
+    switch (event) {
+    case JournalJoin: {
+        qint32 id;
+        QString name, token;
+        in >> id >> name >> token;
+        if (in.status() != QDataStream::Ok || id < 0 || id > m_players.size()) return false;
+        if (id == m_players.size()) m_players.append(Player());
+
+        Player& player = m_players[id];
+        if (player.rosterIndex >= 0) return false;
+        player.name = name;
+        player.resumeToken = token;
+        player.score = 0;
+        player.rosterIndex = m_roster.size();
+        m_roster.append(id);
+        m_resumeTokens[token] = id;
+        break;
+    }
+    case JournalLeave: {
+        qint32 id;
+        in >> id;
+        if (in.status() != QDataStream::Ok || id < 0 || id >= m_players.size()) return false;
+        removePlayer(id);
+        break;
+    }
+    case JournalScores: {
+        qint32 scoreSeq, count;
+        in >> scoreSeq >> count;
+        for (int i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+            qint32 id, score;
+            in >> id >> score;
+            if (id < 0 || id >= m_players.size()) return false;
+            m_players[id].score = score;
+        }
+        if (in.status() != QDataStream::Ok) return false;
+        m_scoreSeq = scoreSeq;
+        break;
+    }
+    case JournalRoundEnd:
+        m_gameState = RoundEnd;
+        m_isRoundActive = false;
+        setCurrentWord(QString());
+        clearHistory();
+        break;
+    case JournalStroke:
+        // После заголовка записи - штрих в компактном JSON, как его разослали
+    {
+        const QByteArray line = record.mid(JournalHeaderSize);
+        const QJsonObject stroke = QJsonDocument::fromJson(line).object();
+        if (Protocol::tool(stroke["tool"].toString()) == Protocol::Tool::Clear) {
+            clearHistory();
+        }
+        appendHistory(line);
+    }
+        break;
+    default:
+        return false;
+    }
+
+    if (in.status() != QDataStream::Ok) return false;
+    lastSeq = qMax(lastSeq, seq);
+    return true;
+}
+
+bool myserver::admitMessage(int id, Protocol::MessageType type){
+
+    Player& player = m_players[id];
+    const qint64 now = m_clock.elapsed();
+    if (type == Protocol::MessageType::Guess) {
+        if (player.guessBudget.tryTake(1, now)) return true;
+        ++m_limits.guessDropped;
+    } else {
+        if (player.controlBudget.tryTake(1, now)) return true;
+        ++m_limits.controlDropped;
+    }
+    penalize(id);
+    return false;
+}
+
+bool myserver::admitDraw(int id, Protocol::DrawCommand &command){
+
+    Player& player = m_players[id];
+    TokenBucket& budget = player.drawBudget;
+    const qint64 now = m_clock.elapsed();
+
+    switch (command.action) {
+    case Protocol::DrawAction::Move: {
+        // Сверх бюджета отрезки склеиваются: рисунок грубее, но без разрывов
+        Protocol::DrawCommand candidate = command;
+        if (player.coalescedMove.tool != Protocol::Tool::Unknown) {
+            candidate = player.coalescedMove;
+            candidate.x2 = command.x2;
+            candidate.y2 = command.y2;
+        }
+        if (budget.tryTake(drawCost(candidate), now)) {
+            player.coalescedMove = Protocol::DrawCommand();
+            command = candidate;
+            return true;
+        }
+        player.coalescedMove = candidate;
+        ++m_limits.drawCoalesced;
+        penalize(id);
+        return false;
+    }
+
+    case Protocol::DrawAction::Start:
+        // Новый штрих платит сразу: иначе поток начал (в т.ч. заливок) шел бы без предела.
+        // Накопленный отрезок закрывает свой штрих; новому штриху (или раунду) он чужой
+        player.coalescedMove = Protocol::DrawCommand();
+        if (!budget.tryTake(drawCost(command), now)) {
+            ++m_limits.drawDropped;
+            penalize(id);
+            return false;
+        }
+        player.strokeOpen = true;
+        return true;
+
+    case Protocol::DrawAction::Release:
+        // Без конца начатый штрих у клиентов сломается - его пропускаем в долг,
+        // но не глубже одного burst. Конец без начала платит как обычная команда
+        if (!player.strokeOpen) break;
+        player.strokeOpen = false;
+        if (budget.available(now) < -DrawBurst) {
+            player.coalescedMove = Protocol::DrawCommand();
+            ++m_limits.drawDropped;
+            penalize(id);
+            return false;
+        }
+        if (player.coalescedMove.tool != Protocol::Tool::Unknown) {
+            const Protocol::DrawCommand pending = player.coalescedMove;
+            player.coalescedMove = Protocol::DrawCommand();
+            budget.take(drawCost(pending), now);
+            relayDraw(pending);
+        }
+        budget.take(drawCost(command), now);
+        return true;
+
+    default:
+        break;
+    }
+
+    if (budget.tryTake(drawCost(command), now)) return true;
+    ++m_limits.drawDropped;
+    penalize(id);
+    return false;
+}
+
+double myserver::drawCost(const Protocol::DrawCommand &command){
+
+    // Цена примерно пропорциональна числу пикселей, которые перерисуют клиенты
+    switch (command.tool) {
+    case Protocol::Tool::Fill:
+        return 25;
+    case Protocol::Tool::Clear:
+        return 5;
+    case Protocol::Tool::Text:
+        return 2 + command.text.size() / 10.0;
+    default:
+        break;
+    }
+    if (command.action == Protocol::DrawAction::Start) return 1;
+
+    const double width = qBound(1, command.width, 200);
+    const double dx = qAbs(command.x2 - command.x1);
+    const double dy = qAbs(command.y2 - command.y1);
+    if (command.tool == Protocol::Tool::Rectangle || command.tool == Protocol::Tool::Ellipse) {
+        return 1 + (dx + width) * (dy + width) / 20000.0;
+    }
+    return 1 + (dx + dy) * width / 2000.0;
+}
+
+void myserver::scheduleLimitReport(){
+
+    if (m_limitReportTimer) return;
+    m_limitReportTimer = m_timers.start(LimitReportMs, [this]() {
+        m_limitReportTimer = 0;
+        reportLimits();
+    });
+}
+
+void myserver::penalize(int id){
+
+    scheduleLimitReport();
+    Player& player = m_players[id];
+    if (player.strikes.tryTake(1, m_clock.elapsed())) return;
+
+    // Нарушает дольше, чем можно списать на всплеск, - отключаем. Сессия остается
+    // на обычных условиях resume, но ведра жетонов вернутся вместе с ней
+    ++m_limits.disconnected;
+    qDebug() << "Client" << id << "exceeded its message budget, disconnecting";
+    if (player.connection >= 0) {
+        m_backend->abort(player.connection);
+    }
+}
+
+void myserver::reportLimits(){
+
+    qDebug() << "Rate limits: draw coalesced" << m_limits.drawCoalesced
+             << "draw dropped" << m_limits.drawDropped
+             << "guess dropped" << m_limits.guessDropped
+             << "control dropped" << m_limits.controlDropped
+             << "disconnected" << m_limits.disconnected;
+    qDebug() << "Memory limits: oversized frames" << m_limits.oversizedFrames
+             << "slow consumers" << m_limits.slowConsumers
+             << "history full" << m_limits.historyFull
+             << "refused connections" << m_limits.refusedConnections
+             << "in use" << m_memory.total() << "of" << m_memory.limit() << "bytes (inbound"
+             << m_memory.used(MemoryBudget::Inbound) << "outbound" << m_memory.used(MemoryBudget::Outbound)
+             << "history" << m_memory.used(MemoryBudget::History) << ")";
+}
+
+void myserver::reportAllocations(){
+
+    const FramePool::Counters& frames = m_framePool.counters();
+    const FramePool::Counters& chunks = m_chunkPool.counters();
+    if (!frames.acquired && !chunks.acquired) return;
+    qDebug() << "Round allocations: frames" << frames.acquired << "reused" << frames.reused
+             << "grown" << frames.grown << "overflow" << frames.overflow << "released" << frames.released
+             << "slots" << m_framePool.slotCount() << "x" << m_framePool.slotBytes() << "bytes";
+    qDebug() << "Round allocations: room chunks" << chunks.acquired << "reused" << chunks.reused
+             << "grown" << chunks.grown << "overflow" << chunks.overflow << "released" << chunks.released
+             << "slots" << m_chunkPool.slotCount() << "x" << m_chunkPool.slotBytes() << "bytes,"
+             << "history capacity" << m_drawingHistory.capacity();
+}
+
+bool myserver::enableSharding(const QString& routerPath){
+
+    m_shard = new ShardLink(routerPath, this);
+    connect(m_shard, &ShardLink::ownerFound, this, &myserver::onRoomOwner);
+    connect(m_shard, &ShardLink::connectionReceived, this, &myserver::adoptConnection);
+    connect(m_shard, &ShardLink::migrateRequested, this, &myserver::beginMigration);
+    connect(m_shard, &ShardLink::migrationFinished, this, &myserver::finishMigration);
+    connect(m_shard, &ShardLink::roomStateReceived, this, &myserver::adoptRoom);
+    return m_shard->start();
+}
+
+bool myserver::routeToRoom(int id, const QJsonObject& message){
+
+    // true - обрабатываем здесь, false - ждем ответа маршрутизатора
+    Player& player = m_players[id];
+    if (!m_shard || player.rosterIndex >= 0 || player.subscriber) return true;
+    const QString room = message["room"].toString(DefaultRoom);
+    if (room == m_room) return true;
+    if (player.routeRequest >= 0) return false;
+
+    player.routeRequest = m_nextRouteRequest++;
+    player.routedMessage = message;
+    m_routeRequests.insert(player.routeRequest, id);
+    m_shard->lookup(room, player.routeRequest);
+    return false;
+}
+
+void myserver::onRoomOwner(int request, const QString& room, const QString& shard){
+
+    const int id = m_routeRequests.value(request, -1);
+    m_routeRequests.remove(request);
+    if (id < 0 || m_players[id].routeRequest != request) return;   // соединение уже закрылось
+
+    Player& player = m_players[id];
+    const QJsonObject message = player.routedMessage;
+    const int connection = player.connection;
+    player.routeRequest = -1;
+    player.routedMessage = QJsonObject();
+    if (connection < 0) return;
+
+    if (m_migrating && room == m_room) {
+        // Комната как раз переезжает: запрос подождет в inbox вместе с остальным
+        player.inbox.prepend(QJsonDocument(message).toJson(QJsonDocument::Compact) + "\n");
+        syncInbound(id);
+        return;
+    }
+    if (shard == m_shard->path() && (m_room.isEmpty() || m_room == room)) {
+        if (m_room.isEmpty()) {
+            m_room = room;
+            qDebug() << "Hosting room" << room;
+        }
+        processMessage(message, id);
+        // Строки, пришедшие за время ожидания
+        QTimer::singleShot(0, this, [this, id, connection]() {
+            if (m_players[id].connection == connection) onReadyRead(id);
+        });
+        return;
+    }
+
+    // Владелец - другой процесс: он получает сокет и все, что мы успели прочитать,
+    // начиная с самого запроса. Сжатый вход не передать - состояние inflate здесь
+    bool handedOff = false;
+    if (!shard.isEmpty() && !player.inflate) {
+        player.inbox.append(m_backend->read(connection));
+        const QByteArray buffered = QJsonDocument(message).toJson(QJsonDocument::Compact) + "\n" + player.inbox;
+        const qintptr descriptor = m_backend->duplicateDescriptor(connection);
+        if (descriptor >= 0) {
+            handedOff = m_shard->handOff(shard, descriptor, buffered);
+            ShardLink::closeDescriptor(descriptor);
+        }
+    }
+    if (handedOff) {
+        qDebug() << "Client" << id << "handed off to" << shard << "for room" << room;
+    } else {
+        qDebug() << "Room" << room << "is unavailable for client" << id;
+    }
+    m_backend->abort(connection);
+}
+
+void myserver::adoptConnection(qintptr descriptor, const QByteArray& buffered){
+
+    const int connection = m_backend->adopt(descriptor);
+    if (connection < 0) {
+        ShardLink::closeDescriptor(descriptor);
+        return;
+    }
+    // onNewConnection мог отказать по памяти
+    const int id = m_connectionPlayers.value(connection, -1);
+    if (id < 0) return;
+
+    m_players[id].inbox = buffered;
+    syncInbound(id);
+    QTimer::singleShot(0, this, [this, id, connection]() {
+        if (m_players[id].connection == connection) onReadyRead(id);
+    });
+}
+
+void myserver::releaseRoom(){
+
+    if (!m_shard || m_room.isEmpty() || m_migrating) return;
+
+    detachSubscribers(m_room);
+    resetRoom();
+    m_shard->release(m_room);
+    qDebug() << "Room" << m_room << "released";
+    m_room.clear();
+}
+
+void myserver::detachSubscribers(const QString& room){
+
+    // Шард отдают следующей комнате - ее поток ретрансляторам прошлой не нужен.
+    // Они переподключаются сами, и маршрутизатор приводит их к новому владельцу
+    for (int id = 0; id < m_players.size(); ++id) {
+        Player& player = m_players[id];
+        if (!player.subscriber || player.connection < 0) continue;
+        QJsonObject migrate = Protocol::Json::encode(Protocol::MessageType::Migrate);
+        migrate["room"] = room;
+        sendToClient(id, migrate);
+        // Пока migrate дописывается, соединение - гость: ни рассылок, ни потока комнаты
+        player.subscriber = false;
+        leaveRoomStream(id);
+        const int connection = player.connection;
+        m_timers.start(MigrationDrainMs, [this, id, connection]() {
+            const Player& guest = m_players[id];
+            if (guest.connection == connection && guest.rosterIndex < 0 && !guest.subscriber) {
+                m_backend->abort(connection);
+            }
+        });
+    }
+}
+
+void myserver::resetRoom(){
+
+    // Шард достанется следующей комнате - прошлая игра в нее переходить не должна
+    m_timers.cancel(&m_roundTimer);
+    m_timers.cancel(&m_intermissionTimer);
+    m_gameState = WaitingForPlayers;
+    m_isRoundActive = false;
+    m_currentRound = 0;
+    setCurrentWord(QString());
+    m_currentDrawer = -1;
+    lastDrawer = -1;
+    clearHistory();
+}
+
+void myserver::beginMigration(const QString& room, const QString& target){
+
+    if (room != m_room || m_migrating) {
+        m_shard->sendRoomState(room, QByteArray());
+        return;
+    }
+
+    // Замораживаем: все, что случится дальше, цель уже не увидит
+    m_migrating = true;
+    flushScoreDeltas();
+    m_frozenRoundMs = m_timers.remaining(m_roundTimer);
+    m_frozenIntermissionMs = m_timers.remaining(m_intermissionTimer);
+    m_timers.cancel(&m_roundTimer);
+    m_timers.cancel(&m_intermissionTimer);
+
+    QByteArray state;
+    QDataStream out(&state, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_12);
+    out << encodeSnapshot() << qint32(m_frozenRoundMs) << qint32(m_frozenIntermissionMs);
+    m_shard->sendRoomState(room, state);
+    qDebug() << "Migrating room" << room << "to" << target << "," << m_roster.size() << "players,"
+             << state.size() << "bytes of state";
+}
+
+void myserver::finishMigration(const QString& room, bool ok){
+
+    if (!m_migrating || room != m_room) return;
+    m_migrating = false;
+
+    if (!ok) {
+        // Комната остается здесь: таймеры идут дальше с того же места
+        if (m_frozenRoundMs >= 0) {
+            m_roundTimer = m_timers.start(m_frozenRoundMs, [this]() { onRoundTimerTimeout(); });
+        }
+        if (m_frozenIntermissionMs >= 0) {
+            scheduleNextRound(m_frozenIntermissionMs);
+        }
+        qDebug() << "Migration of room" << room << "failed, room stays here";
+        resumeInput();
+        return;
+    }
+
+    // Клиенты переподключаются с тем же токеном, маршрутизатор приведет их к новому владельцу.
+    // Соединение до закрытия остается безымянным гостем, как до register
+    const QVector<int> roster = m_roster;
+    for (int id : roster) {
+        const int connection = m_players[id].connection;
+        if (connection >= 0) {
+            QJsonObject migrate = Protocol::Json::encode(Protocol::MessageType::Migrate);
+            migrate["room"] = room;
+            migrate["token"] = m_players[id].resumeToken;
+            sendToClient(id, migrate);
+        }
+        detachConnection(id);
+        removePlayer(id);
+        if (connection < 0) continue;
+
+        const int guest = addPlayer(connection);
+        m_timers.start(MigrationDrainMs, [this, guest, connection]() {
+            if (m_players[guest].connection == connection && m_players[guest].rosterIndex < 0) {
+                m_backend->abort(connection);
+            }
+        });
+    }
+    detachSubscribers(room);
+    resetRoom();
+    m_room.clear();
+    // Без этого рестарт процесса поднял бы уже переехавшую комнату
+    writeSnapshot();
+    qDebug() << "Room" << room << "migrated," << roster.size() << "players redirected";
+    resumeInput();
+}
+
+void myserver::adoptRoom(const QString& room, const QByteArray& state){
+
+    QDataStream in(state);
+    in.setVersion(QDataStream::Qt_5_12);
+    QByteArray snapshot;
+    qint32 roundMs = -1, intermissionMs = -1;
+    in >> snapshot >> roundMs >> intermissionMs;
+
+    qint64 lastSeq = 0;
+    // id игроков здесь могут быть заняты гостями - раздаем свободные
+    const bool restored = m_room.isEmpty() && m_roster.isEmpty() && in.status() == QDataStream::Ok
+            && restoreSnapshot(snapshot, lastSeq, false);
+    if (!restored) {
+        const QVector<int> partial = m_roster;
+        for (int id : partial) removePlayer(id);
+        resetRoom();
+        qDebug() << "Cannot adopt room" << room;
+        m_shard->confirmAdoption(room, false);
+        return;
+    }
+
+    m_room = room;
+    for (int id : m_roster) {
+        startResumeGrace(id);
+    }
+    // id сменились - всем вернувшимся нужен ключевой кадр, досылка из кольца невозможна
+    m_roomSeq = lastSeq + RecoverySeqGap;
+    m_replayFloor = m_roomSeq;
+
+    if (m_gameState == Drawing) {
+        m_isRoundActive = true;
+        m_roundTimer = m_timers.start(roundMs >= 0 ? roundMs : 60000, [this]() { onRoundTimerTimeout(); });
+    } else if (m_gameState == RoundEnd) {
+        scheduleNextRound(intermissionMs >= 0 ? intermissionMs : 5000);
+    }
+    writeSnapshot();
+    m_shard->confirmAdoption(room, true);
+    qDebug() << "Adopted room" << room << "with" << m_roster.size() << "players";
+}
+
+void myserver::resumeInput(){
+
+    // Строки, отложенные на время переноса
+    for (int id = 0; id < m_players.size(); ++id) {
+        const int connection = m_players[id].connection;
+        if (connection < 0 || m_players[id].inbox.isEmpty()) continue;
+        QTimer::singleShot(0, this, [this, id, connection]() {
+            if (m_players[id].connection == connection) onReadyRead(id);
+        });
+    }
+}
+
+
 
 
 
@@ -1,9 +1,11 @@
 #ifndef MYSERVER_H
 #define MYSERVER_H
 
-#include <QTcpServer>
+#include <QObject>
 #include <QTcpSocket>
 #include <QMap>
+#include <QHash>
+#include <QVector>
 #include <QTimer>
 #include <QJsonObject>
 #include <QJsonDocument>
@@ -12,8 +14,28 @@
 #include <QDebug>
 #include <QJsonArray>
 #include <QRandomGenerator>
+#include <QSharedPointer>
+#include "deflatestream.h"
+#include "roomjournal.h"
+#include "timerwheel.h"
+#include "tokenbucket.h"
+#include "memorybudget.h"
+#include "framepool.h"
+#include "connectionbackend.h"
+#include "shardlink.h"
+#include "replication.h"
+#include "flightrecorder.h"
+#include "stallwatchdog.h"
+#include "tracing.h"
+#include "guessmatcher.h"
+#include "chatfilter.h"
+#include "worddictionary.h"
+#include "shufflebag.h"
+#include "jsoncodec.h"
+#include "drawparser.h"
+#include <QElapsedTimer>
 
-class myserver: public QTcpServer
+class myserver: public QObject
 {
     Q_OBJECT
 public:
@@ -28,43 +50,336 @@ public:
         GameEnd
     };
 
-    void startServer();
+    // backend - "qt" или "epoll" (Linux), см. ConnectionBackend::available().
+    // reusePort - порт делят несколько процессов (шарды, см. enableSharding)
+    bool startServer(quint16 port = 5555, const QString& backend = "qt", bool reusePort = false);
+    // Процесс становится шардом: держит одну комнату, которую выдает маршрутизатор
+    // routerPath (RoomRouter), а чужие соединения передает их владельцам
+    bool enableSharding(const QString& routerPath);
+    // Восстанавливает комнату из снимка и журнала в directory и дальше ведет журнал там
+    bool openJournal(const QString& directory);
+    // Основной сервер: поток журнала уходит резервным процессам через unix-сокет path
+    bool startReplication(const QString& path);
+    // Резерв: держит копию комнаты основного сервера с path и, когда тот пропадет,
+    // сам открывает port и становится основным (с репликацией на тот же path)
+    void follow(const QString& path, quint16 port, const QString& backend);
+    // Сторожевой поток: цикл событий стоит дольше thresholdMs - самописец пишется в directory
+    void startWatchdog(int thresholdMs, const QString& directory);
+    // Слова из словаря вместо встроенного списка; пустые category и language - любые,
+    // maxDifficulty 0 - любая сложность
+    void setDictionary(DictionaryStore *dictionaries, const QString& category,
+                       const QString& language, int maxDifficulty);
+    // Слова, которые в чате заменяются звездочками
+    void setChatBlocklist(const QStringList& words);
+
+    // Сжатие потока сервер -> клиент, выбирается при register/resume
+    enum Compression {
+        NoCompression,
+        Deflate
+    };
 
 private:
 
+    // Ограничение входящего трафика: у каждого соединения свое ведро жетонов
+    // на класс сообщений. Команда рисования стоит тем больше, чем больше
+    // пикселей она заденет у всех клиентов; заливка - дороже всего.
+    // Превышение: отрезок карандаша склеивается со следующим, остальное
+    // выбрасывается, а каждое нарушение берет жетон из m_strikes - кто
+    // исчерпал и его, отключается
+    static constexpr double DrawRatePerSecond = 120;
+    static constexpr double DrawBurst = 240;
+    static constexpr double GuessRatePerSecond = 3;
+    static constexpr double GuessBurst = 10;
+    static constexpr double ControlRatePerSecond = 2;
+    static constexpr double ControlBurst = 20;
+    static constexpr double StrikeRatePerSecond = 5;
+    static constexpr double StrikeBurst = 100;
+    static const int LimitReportMs = 60000;
+
+    // Память: у каждого соединения ограничены строка, непрочитанный вход и
+    // очередь на отправку, у комнаты - история рисования, у сервера - все вместе
+    static const int MaxFrameBytes = 64 * 1024;         // одна строка JSON
+    static const int InboxReserveBytes = 1024;          // inbox игрока, переживает разбор строк
+    static const int MaxInboundBytes = 256 * 1024;      // за одно чтение, в т.ч. после распаковки
+    static const qint64 MaxOutboundBytes = 256 * 1024;  // очередь сокета; при давлении - четверть
+    static const int MaxHistoryBytes = 1024 * 1024;
+    static const qint64 MemoryLimitBytes = 512LL * 1024 * 1024;
+
+    // Счетчики нарушений, раз в LimitReportMs уходят в лог, если что-то изменилось
+    struct LimitCounters {
+        quint64 drawCoalesced = 0;
+        quint64 drawDropped = 0;
+        quint64 guessDropped = 0;
+        quint64 controlDropped = 0;
+        quint64 disconnected = 0;
+        quint64 oversizedFrames = 0;
+        quint64 slowConsumers = 0;
+        quint64 historyFull = 0;
+        quint64 refusedConnections = 0;
+    };
+
+    // Сессия подключения. id игрока - индекс в m_players, поэтому поиск
+    // по id бесплатный, а сокет знает свой id через захват в лямбде слота
+    struct Player {
+        int connection = -1;            // номер у backend; -1 - связь потеряна, сессия ждет resume
+        QString name;
+        QString resumeToken;
+        TimerWheel::Handle graceTimer = 0; // ожидание resume после обрыва связи
+        int score = 0;
+        int rosterIndex = -1;   // позиция в m_roster, -1 - еще не зарегистрирован
+        bool scoreDirty = false; // очки изменились с последней рассылки дельты
+
+        Compression compression = NoCompression;
+        QSharedPointer<DeflateStream> deflate;  // личный поток сервер -> клиент
+        QSharedPointer<InflateStream> inflate;  // поток клиент -> сервер после "compressStart"
+        bool inRoomStream = false;      // получает общий сжатый поток комнаты
+        bool roomStreamFresh = false;   // вошел после последнего пакета - начинает с точки сброса
+        bool subscriber = false;        // ретранслятор/зритель: только чтение, в игре не участвует
+
+        TokenBucket drawBudget{DrawRatePerSecond, DrawBurst};
+        TokenBucket guessBudget{GuessRatePerSecond, GuessBurst};
+        TokenBucket controlBudget{ControlRatePerSecond, ControlBurst};
+        TokenBucket strikes{StrikeRatePerSecond, StrikeBurst};
+        Protocol::DrawCommand coalescedMove;    // отрезки карандаша сверх бюджета, склеенные в один; Tool::Unknown - нет
+        bool strokeOpen = false;                // начало штриха принято, конец еще нет: конец пойдет в долг
+
+        QByteArray inbox;               // принятое, но еще не разобранное на строки
+        qint64 inboundBytes = 0;        // размер inbox, уже учтенный в m_memory
+        qint64 outboundBytes = 0;       // записано в сокет, но еще не ушло в ядро
+        bool shedding = false;          // очередь переполнена, соединение закрывается
+
+        int routeRequest = -1;          // ждет ответа маршрутизатора, какой шард держит комнату
+        QJsonObject routedMessage;      // register/resume/subscribe, отложенный до ответа
+    };
+
     // cокеты и данные
-    QList<QTcpSocket*> m_clients;
-    QMap<QTcpSocket*, QString> m_clientNames;
-    QMap<QString, int> m_scores;
-    QByteArray m_data;
+    ConnectionBackend* m_backend = nullptr;
+    QVector<int> m_connectionPlayers;   // номер соединения -> id игрока, -1 - ничей
+    QVector<Player> m_players;
+    QVector<int> m_freeIds;     // освободившиеся id, выдаются повторно - таблица остается плотной
+    QVector<int> m_roster;      // id зарегистрированных игроков, удаление перестановкой с последним
+    QVector<int> m_dirtyScores; // id с измененными очками, ждут flushScoreDeltas()
+    int m_scoreSeq = 0;         // номер версии таблицы очков, растет с каждой дельтой
+    MemoryBudget m_memory;      // буферы всех соединений и история комнаты
+
+    // Поток комнаты: каждое широковещательное сообщение получает номер seq и
+    // остается в кольце, чтобы после переподключения дослать только пропущенное
+    static const int ReplayRingSize = 4096;
+    static const int ResumeGraceMs = 60000;  // сколько держим сессию после обрыва
+    qint64 m_roomSeq = 0;
+    // Кадр помнит, кому он не ушел: при досылке тот его тоже не получит
+    struct ReplayFrame {
+        QByteArray data;
+        int excludeId = -1;
+    };
+    QVector<ReplayFrame> m_replayRing;       // кадр с номером seq лежит в [seq % ReplayRingSize]
+    QHash<QString, int> m_resumeTokens;      // токен -> id игрока
+    qint64 m_replayFloor = 0;                // кадры до этого номера в кольцо не попадали (рестарт)
+
+    // Память раунда: кадры draw и пакеты общего потока берутся из пулов, история
+    // и служебные списки рассылки переиспользуют свою емкость. Все это сбрасывается
+    // целиком в startNewRound, а рисование в середине раунда кучу не трогает.
+    // Кадр пула держит кольцо повтора, поэтому пул кадров больше кольца
+    static const int FramePoolSlots = 2 * ReplayRingSize;
+    static const int RoomChunkBytes = 32 * 1024;    // пакет общего потока с заголовком
+    static const int RoomChunkSlots = 64;
+    FramePool m_framePool;
+    FramePool m_chunkPool;
+    QVector<int> m_broadcastTargets;        // соединения текущей рассылки
+    QVector<int> m_resetTargets;
+    QByteArray m_journalRecord;             // запись журнала собирается здесь
+    QByteArray m_drawLine;                  // строка принятой команды рисования (relayDraw)
+
+    // Общий поток комнаты для клиентов с Deflate: кадр broadcast сжимается
+    // один раз на класс сжатия, а не на каждого клиента. Кадры копятся до
+    // конца текущего прохода цикла событий и уходят одним пакетом
+    DeflateStream m_roomDeflate;
+    QByteArray m_pendingRoom;
+    int m_roomStreamMembers = 0;
+    bool m_roomStreamReset = false;     // кто-то вошел - перед пакетом сбросить словарь
+    bool m_roomFlushScheduled = false;
+
+    // Журнал событий, меняющих состояние комнаты: вход, выход, очки, раунды,
+    // штрихи. Снимок пишется в начале раунда и каждые SnapshotEveryRecords записей
+    enum JournalEvent : quint8 {
+        JournalJoin = 1,
+        JournalLeave,
+        JournalScores,
+        JournalRoundEnd,
+        JournalStroke
+    };
+    static const int SnapshotEveryRecords = 4096;
+    // После рестарта номера кадров продолжаются с запасом: клиенты могли
+    // получить кадры (чат), которые в журнал не попадают
+    static const qint64 RecoverySeqGap = 1 << 20;
+    RoomJournal m_journal;
+
+    // Репликация: основной раздает поток журнала, резерв применяет его к своей копии
+    static const int FollowerRetryMs = 500;
+    ReplicationPrimary* m_replication = nullptr;
+    ReplicationFollower* m_follower = nullptr;
+    QString m_replicationPath;
+    quint16 m_takeoverPort = 0;
+    QString m_takeoverBackend;
+    qint64 m_followSeq = 0;             // seq последней примененной записи основного
+
+    // Самописец обработчиков цикла событий для разбора зависаний
+    FlightRecorder m_recorder;
+    qint64 m_bytesOut = 0;              // всего поставлено в очереди сокетов
+    StallWatchdog* m_watchdog = nullptr;
+    const QString& roomName() const { return m_room.isEmpty() ? DefaultRoom : m_room; }
+
+    // Шардинг: без маршрутизатора процесс держит одну безымянную комнату, как раньше
+    static const QString DefaultRoom;
+    ShardLink* m_shard = nullptr;
+    QString m_room;                     // комната этого шарда, пусто - шард свободен
+    QHash<int, int> m_routeRequests;    // номер запроса к маршрутизатору -> id игрока
+    int m_nextRouteRequest = 0;
+
+    // Перенос комнаты в другой процесс: на время переноса комната заморожена -
+    // входящие строки ждут в inbox, таймеры раунда стоят. Потом клиенты получают
+    // "migrate" и переподключаются, а оставшиеся соединения закрываются через MigrationDrainMs
+    static const int MigrationDrainMs = 5000;
+    bool m_migrating = false;
+    int m_frozenRoundMs = -1;           // остаток таймеров на момент заморозки
+    int m_frozenIntermissionMs = -1;
 
     // bгровые переменные
     GameState m_gameState;
     int m_currentRound;
     QString m_currentWord;
-    QString m_currentDrawer;
-    QTimer m_roundTimer;
+    QStringList m_currentAliases;
+    GuessMatcher m_matcher;     // собирается из m_currentWord при каждой его смене
+    ChatFilter m_chatFilter;    // тоже: ответ раунда плюс запрещенные слова
+    int m_currentDrawer = -1;
+    // Все игровые таймеры идут от одного колеса. Handle отменяется при смене
+    // фазы, так что таймер прошлого раунда не сработает в новом
+    TimerWheel m_timers;
+    TimerWheel::Handle m_roundTimer = 0;        // конец раунда по времени
+    TimerWheel::Handle m_intermissionTimer = 0; // пауза перед следующим раундом
+
+    QElapsedTimer m_clock;      // общие часы для ведер жетонов
+    LimitCounters m_limits;
+    TimerWheel::Handle m_limitReportTimer = 0;
     QStringList m_words;
+    QHash<QString, QStringList> m_wordAliases;  // слово -> другие принятые ответы
 
-    QString lastDrawer;
+    // Слова без повторов: мешок перестановки по диапазону категории словаря
+    DictionaryStore *m_dictionaries = nullptr;
+    QString m_wordCategory;
+    QString m_wordLanguage;
+    int m_maxDifficulty = 0;
+    QSharedPointer<const WordDictionary> m_bagDictionary;   // словарь, по которому собран мешок
+    int m_bagFirst = 0;
+    bool m_bagFiltered = false;     // мешок идет по m_bagCandidates, а не по диапазону
+    QVector<int> m_bagCandidates;   // номера слов, прошедших фильтр языка и сложности
+    ShuffleBag m_wordBag;
+    ShuffleBag m_builtinBag;        // по m_words, когда словаря нет или в нем нечего выбрать
 
-    //для смены ролей
-    QMap<QTcpSocket*, bool> clients;  // true = художник, false = наблюдатель
-    QList<QJsonObject> m_drawingHistory;
+    int lastDrawer = -1;        // сбрасывается в removePlayer: id может достаться другому
+
+    QByteArray m_drawingHistory;    // команды draw раунда, строки компактного JSON
     bool m_isRoundActive; // Флаг активности раунда
 
-    void assignRoles();
     // cетевые методы
-    void sendToClient(QTcpSocket* socket, const QJsonObject& message);
-    void broadcast(const QJsonObject& message, QTcpSocket* exclude = nullptr);
-    void processMessage(const QJsonObject& message, QTcpSocket* sender);
+    void sendToClient(int id, const QJsonObject& message);
+    void sendData(int id, const QByteArray& lines);
+    void writeToConnection(int id, const QByteArray& bytes);
+    bool reserveOutbound(int id, qint64 bytes);
+    void onBytesWritten(int id, qint64 bytes);
+    qint64 outboundLimit() const;
+
+    // учет памяти соединения
+    void syncInbound(int id);
+    void releaseConnectionBuffers(int id);
+    void rejectOversizedFrame(int id);
+    void broadcast(const QJsonObject& message, int excludeId = -1);
+    void broadcastDraw(const Protocol::DrawCommand& command);
+    void broadcastFrame(const QByteArray& data, int excludeId = -1);   // строка уже с seq и '\n'
+    void processMessage(const QJsonObject& message, int senderId);
+    // Команда рисования с быстрого пути: без QJsonObject от кадра до рассылки
+    void processDraw(int senderId, Protocol::DrawCommand& command);
+    void handleDraw(int senderId, Protocol::DrawCommand& command, bool valid);
+    void relayDraw(const Protocol::DrawCommand& command);
+    void appendHistory(const QByteArray& line);
+    void clearHistory();
+
+    // ограничение трафика
+    bool admitMessage(int id, Protocol::MessageType type);
+    bool admitDraw(int id, Protocol::DrawCommand& command);
+    static double drawCost(const Protocol::DrawCommand& command);
+    void penalize(int id);
+    void scheduleLimitReport();
+    void reportLimits();
+    void reportAllocations();
+
+    // таблица сессий
+    int addPlayer(int connection);
+    void attachConnection(int id, int connection);
+    void detachConnection(int id);
+    void registerPlayer(int id, const QString& name);
+    void removePlayer(int id);
+    void dropPlayer(int id);
+    QJsonObject scoresObject() const;
+
+    // очки: клиенты получают полный снимок только при входе или по запросу,
+    // дальше - дельты с номером версии
+    void addScore(int id, int points);
+    void flushScoreDeltas();
+    void sendScoresSnapshot(int id);
+
+    // восстановление сессии
+    void resumeSession(int senderId, const QJsonObject& request);
+    bool sendCatchUp(int id, QJsonObject reply, const QJsonObject& request, qint64 lastSeq);
+    void replaySince(int id, qint64 lastSeq);
+    void sendKeyframe(int id);
+    void sendPlayerList(int id);
+
+    // шардинг
+    bool routeToRoom(int id, const QJsonObject& message);
+    void onRoomOwner(int request, const QString& room, const QString& shard);
+    void adoptConnection(qintptr descriptor, const QByteArray& buffered);
+    void releaseRoom();
+    void detachSubscribers(const QString& room);
+    void resetRoom();
+    void beginMigration(const QString& room, const QString& target);
+    void finishMigration(const QString& room, bool ok);
+    void adoptRoom(const QString& room, const QByteArray& state);
+    void resumeInput();
+
+    // журнал
+    void journal(JournalEvent event, const QByteArray& payload = QByteArray());
+    void writeSnapshot();
+    QByteArray encodeSnapshot() const;
+    // keepIds = false - игроки получают свободные id (комната переносится в занятый процесс)
+    bool restoreSnapshot(const QByteArray& snapshot, qint64& lastSeq, bool keepIds = true);
+    bool applyJournalRecord(const QByteArray& record, qint64& lastSeq);
+    void startResumeGrace(int id);
+    void finishRecovery(qint64 lastSeq);
+    void clearRoom();
+
+    // репликация
+    void onReplicatedSnapshot(const QByteArray& snapshot);
+    void onReplicatedRecord(const QByteArray& record);
+    void onPrimaryLost();
+
+    // сжатие
+    Compression negotiateCompression(const QJsonObject& request, QJsonObject& response) const;
+    void enableCompression(int id, Compression compression);
+    void joinRoomStream(int id);
+    void leaveRoomStream(int id);
+    void scheduleRoomFlush();
+    void flushRoomStream();
 
     // игровые методы
     void startGame();
     void startNewRound();
     void endRound();
-    void selectNewDrawer();
-    QString selectRandomWord();
+    void scheduleNextRound(int delayMs = 5000);
+    bool selectNewDrawer();     // false - рисовать некому: все без связи
+    QString selectRandomWord(QStringList &aliases);
+    void rebuildWordBag(const QSharedPointer<const WordDictionary> &dictionary);
+    void setCurrentWord(const QString &word, const QStringList &aliases = QStringList());
     void updateAllClientsGameState();
 
     void ifOver();
@@ -73,13 +388,10 @@ private:
 signals:
     void roundStarted(const QString &drawerName);
 //
-protected:
-    void incomingConnection(qintptr socketDescriptor) override;
-
-
 private slots:
-    void onReadyRead();
-    void onDisconnected();
+    void onNewConnection(int connection);
+    void onReadyRead(int playerId);
+    void onDisconnected(int playerId);
     void onRoundTimerTimeout();
 };
 
@@ -0,0 +1,146 @@
+#include "qtbackend.h"
+#include <QTimer>
+#include <QDebug>
+#ifdef Q_OS_UNIX
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+QtBackend::QtBackend(QObject *parent) : ConnectionBackend(parent)
+{
+    connect(&m_server, &QTcpServer::newConnection, this, &QtBackend::accept);
+}
+
+QtBackend::~QtBackend()
+{
+    // Сокеты закрываются молча: сервер, которому шли бы сигналы, уже разрушается
+    for (QTcpSocket *socket : m_sockets) {
+        if (!socket) continue;
+        socket->disconnect(this);
+        socket->abort();
+        delete socket;
+    }
+}
+
+bool QtBackend::listen(quint16 port, bool reusePort)
+{
+    if (!reusePort) {
+        return m_server.listen(QHostAddress::Any, port);
+    }
+    // QTcpServer не умеет SO_REUSEPORT - сокет готовим сами и отдаем ему
+    const int fd = openListener(port, true);
+    return fd >= 0 && m_server.setSocketDescriptor(fd);
+}
+
+QByteArray QtBackend::read(int connection)
+{
+    QTcpSocket *socket = m_sockets.value(connection);
+    return socket ? socket->readAll() : QByteArray();
+}
+
+void QtBackend::readInto(int connection, QByteArray &buffer)
+{
+    QTcpSocket *socket = m_sockets.value(connection);
+    if (!socket) return;
+    const qint64 available = socket->bytesAvailable();
+    if (available <= 0) return;
+    const int used = buffer.size();
+    buffer.resize(used + static_cast<int>(available));
+    const qint64 received = socket->read(buffer.data() + used, available);
+    buffer.resize(used + static_cast<int>(qMax<qint64>(received, 0)));
+}
+
+void QtBackend::write(int connection, const QByteArray &bytes)
+{
+    QTcpSocket *socket = m_sockets.value(connection);
+    if (socket && socket->state() == QTcpSocket::ConnectedState) {
+        socket->write(bytes);
+    }
+}
+
+void QtBackend::abort(int connection)
+{
+    QTcpSocket *socket = m_sockets.value(connection);
+    if (!socket) return;
+
+    // abort() сам шлет disconnected только подключенному сокету
+    const bool wasConnected = socket->state() != QTcpSocket::UnconnectedState;
+    socket->abort();
+    if (!wasConnected && m_sockets.value(connection) == socket) {
+        release(connection);
+    }
+}
+
+void QtBackend::setReadBufferSize(qint64 size)
+{
+    m_readBufferSize = size;
+    for (QTcpSocket *socket : m_sockets) {
+        if (socket) socket->setReadBufferSize(size);
+    }
+}
+
+qintptr QtBackend::duplicateDescriptor(int connection)
+{
+#ifdef Q_OS_UNIX
+    QTcpSocket *socket = m_sockets.value(connection);
+    if (!socket) return -1;
+    return fcntl(static_cast<int>(socket->socketDescriptor()), F_DUPFD_CLOEXEC, 0);
+#else
+    Q_UNUSED(connection);
+    return -1;
+#endif
+}
+
+int QtBackend::adopt(qintptr descriptor)
+{
+    QTcpSocket *socket = new QTcpSocket(this);
+    if (!socket->setSocketDescriptor(descriptor)) {
+        delete socket;
+        return -1;
+    }
+    const int connection = addSocket(socket);
+    // Данные могли прийти раньше, чем сокет попал в цикл событий
+    if (socket->bytesAvailable() > 0) {
+        QTimer::singleShot(0, socket, [this, connection]() { emit readyRead(connection); });
+    }
+    return connection;
+}
+
+void QtBackend::accept()
+{
+    while (QTcpSocket *socket = m_server.nextPendingConnection()) {
+        addSocket(socket);
+    }
+}
+
+int QtBackend::addSocket(QTcpSocket *socket)
+{
+    int connection;
+    if (!m_freeSlots.isEmpty()) {
+        connection = m_freeSlots.takeLast();
+        m_sockets[connection] = socket;
+    } else {
+        connection = m_sockets.size();
+        m_sockets.append(socket);
+    }
+
+    socket->setParent(this);
+    socket->setReadBufferSize(m_readBufferSize);
+    connect(socket, &QTcpSocket::readyRead, this, [this, connection]() { emit readyRead(connection); });
+    connect(socket, &QTcpSocket::bytesWritten, this, [this, connection](qint64 bytes) {
+        emit bytesWritten(connection, bytes);
+    });
+    connect(socket, &QTcpSocket::disconnected, this, [this, connection]() { release(connection); });
+    emit newConnection(connection);
+    return connection;
+}
+
+void QtBackend::release(int connection)
+{
+    QTcpSocket *socket = m_sockets[connection];
+    socket->disconnect(this);
+    socket->deleteLater();
+    m_sockets[connection] = nullptr;
+    m_freeSlots.append(connection);
+    emit disconnected(connection);
+}
@@ -0,0 +1,36 @@
+#ifndef QTBACKEND_H
+#define QTBACKEND_H
+
+#include "connectionbackend.h"
+#include <QTcpServer>
+#include <QTcpSocket>
+
+// Переносимый backend: QTcpSocket на каждое соединение
+class QtBackend : public ConnectionBackend
+{
+    Q_OBJECT
+public:
+    explicit QtBackend(QObject *parent = nullptr);
+    ~QtBackend() override;
+
+    bool listen(quint16 port, bool reusePort = false) override;
+    QByteArray read(int connection) override;
+    void readInto(int connection, QByteArray &buffer) override;
+    void write(int connection, const QByteArray &bytes) override;
+    void abort(int connection) override;
+    void setReadBufferSize(qint64 size) override;
+    qintptr duplicateDescriptor(int connection) override;
+    int adopt(qintptr descriptor) override;
+
+private:
+    void accept();
+    int addSocket(QTcpSocket *socket);
+    void release(int connection);
+
+    QTcpServer m_server;
+    QVector<QTcpSocket *> m_sockets;    // номер соединения -> сокет, nullptr - свободен
+    QVector<int> m_freeSlots;
+    qint64 m_readBufferSize = 0;
+};
+
+#endif // QTBACKEND_H
@@ -0,0 +1,355 @@
+#include "relayserver.h"
+#include <QRandomGenerator>
+
+relayserver::relayserver(const QString &upstreamHost, quint16 upstreamPort, int delayMs, QObject *parent) :
+    QTcpServer(parent),
+    m_upstream(new QTcpSocket(this)),
+    m_upstreamHost(upstreamHost),
+    m_upstreamPort(upstreamPort),
+    m_linePool(Protocol::MaxDrawLineBytes + 1, LinePoolSlots, LinePoolSlots),
+    m_delayMs(delayMs)
+{
+    m_upstreamData.reserve(UpstreamReserveBytes);
+    connect(m_upstream, &QTcpSocket::connected, this, &relayserver::onUpstreamConnected);
+    connect(m_upstream, &QTcpSocket::readyRead, this, &relayserver::onUpstreamReadyRead);
+    connect(m_upstream, &QTcpSocket::disconnected, this, &relayserver::onUpstreamDisconnected);
+    connect(m_upstream, &QTcpSocket::errorOccurred, this, [this]() { scheduleReconnect(); });
+
+    m_reconnectTimer.setSingleShot(true);
+    connect(&m_reconnectTimer, &QTimer::timeout, this, &relayserver::connectUpstream);
+
+    m_releaseTimer.setSingleShot(true);
+    connect(&m_releaseTimer, &QTimer::timeout, this, &relayserver::releaseDue);
+
+    m_clock.start();
+}
+
+relayserver::~relayserver()
+{
+    for (QTcpSocket* socket : m_spectators){
+        socket->close();
+        socket->deleteLater();
+    }
+}
+
+void relayserver::startServer(quint16 port)
+{
+    if (this->listen(QHostAddress::Any, port))
+    {
+        qDebug() << "Relay listening on" << port << "upstream" << m_upstreamHost << m_upstreamPort
+                 << "delay" << m_delayMs << "ms";
+    }
+    else
+    {
+        qDebug() << "Relay not listening";
+    }
+    connectUpstream();
+}
+
+void relayserver::connectUpstream()
+{
+    m_upstream->abort();
+    m_upstream->connectToHost(m_upstreamHost, m_upstreamPort);
+}
+
+void relayserver::scheduleReconnect()
+{
+    // disconnected и errorOccurred приходят парой - планируем один раз
+    if (m_reconnectTimer.isActive()) return;
+
+    const int delay = qMin(MaxReconnectDelayMs, 500 << qMin(m_reconnectAttempts, 5));
+    ++m_reconnectAttempts;
+    m_reconnectTimer.start(delay / 2 + QRandomGenerator::global()->bounded(delay / 2 + 1));
+    qDebug() << "Upstream lost, reconnect attempt" << m_reconnectAttempts;
+}
+
+void relayserver::onUpstreamConnected()
+{
+    m_reconnectAttempts = 0;
+    m_upstreamData.resize(0);
+
+    // После обрыва сервер дошлет пропущенное по lastSeq или пришлет ключевой кадр
+    QJsonObject subscribe = Protocol::Json::encode(Protocol::MessageType::Subscribe);
+    if (m_lastSeq >= 0) {
+        subscribe["lastSeq"] = m_lastSeq;
+    }
+    m_upstream->write(QJsonDocument(subscribe).toJson(QJsonDocument::Compact) + "\n");
+    qDebug() << "Subscribed to" << m_upstreamHost << m_upstreamPort << "from seq" << m_lastSeq;
+}
+
+void relayserver::onUpstreamReadyRead()
+{
+    // Прямо в m_upstreamData: емкость зарезервирована, readAll выделял бы каждый раз
+    const qint64 available = m_upstream->bytesAvailable();
+    if (available > 0) {
+        const int used = m_upstreamData.size();
+        m_upstreamData.resize(used + static_cast<int>(available));
+        const qint64 received = m_upstream->read(m_upstreamData.data() + used, available);
+        m_upstreamData.resize(used + static_cast<int>(qMax<qint64>(received, 0)));
+    }
+
+    int pos;
+    while ((pos = m_upstreamData.indexOf('\n')) >= 0){
+        const int length = pos + 1;
+        if (length <= m_linePool.slotBytes()) {
+            QByteArray& slot = m_linePool.acquire();
+            slot.append(m_upstreamData.constData(), length);
+            // Своя ссылка на буфер: resetRound в applyToModel переставляет слоты пула
+            const QByteArray line = slot;
+            m_upstreamData.remove(0, length);
+            enqueue(line);
+        } else {
+            // Длинные строки (список игроков, счет) редки - мимо пула
+            const QByteArray line = m_upstreamData.left(length);
+            m_upstreamData.remove(0, length);
+            enqueue(line);
+        }
+    }
+}
+
+void relayserver::onUpstreamDisconnected()
+{
+    scheduleReconnect();
+}
+
+relayserver::Line relayserver::parseLine(const QByteArray &data)
+{
+    Line line;
+    line.data = data;
+    // data - со своим '\n'
+    if (Protocol::parseDraw(data.constData(), data.size() - 1, line.draw, line.seq)) {
+        line.type = Protocol::MessageType::Draw;
+        return line;
+    }
+
+    line.message = QJsonDocument::fromJson(data).object();
+    line.type = Protocol::Json::type(line.message);
+    if (line.message.contains("seq")) {
+        line.seq = static_cast<qint64>(line.message["seq"].toDouble());
+    }
+    // Испорченная команда уходит зрителям как есть (клиент ее отбросит), но в модель не попадает
+    if (line.type == Protocol::MessageType::Draw && !Protocol::Json::decode(line.message, line.draw)) {
+        line.draw.tool = Protocol::Tool::Unknown;
+    }
+    return line;
+}
+
+void relayserver::enqueue(const QByteArray &data)
+{
+    const Line line = parseLine(data);
+    // Номер запоминается сразу: при переподключении важно, что получено, а не что показано
+    if (line.seq >= 0) {
+        m_lastSeq = line.seq;
+    }
+    if (line.type == Protocol::MessageType::Subscribed) return;
+    if (line.type == Protocol::MessageType::Migrate) {
+        // Комната уехала с этого сервера: переподключаемся, маршрутизатор
+        // приведет к новому владельцу. Зрителям это сообщение ни к чему
+        qDebug() << "Upstream room migrated, reconnecting";
+        m_upstream->abort();
+        scheduleReconnect();
+        return;
+    }
+
+    if (m_delayMs <= 0) {
+        relay(line);
+        return;
+    }
+
+    m_delayed.enqueue({m_clock.elapsed() + m_delayMs, line});
+    if (!m_releaseTimer.isActive()) {
+        m_releaseTimer.start(m_delayMs);
+    }
+}
+
+void relayserver::releaseDue()
+{
+    const qint64 now = m_clock.elapsed();
+    while (!m_delayed.isEmpty() && m_delayed.head().releaseAt <= now) {
+        relay(m_delayed.dequeue().line);
+    }
+    if (!m_delayed.isEmpty()) {
+        m_releaseTimer.start(int(m_delayed.head().releaseAt - now));
+    }
+}
+
+void relayserver::relay(const Line &line)
+{
+    applyToModel(line);
+
+    // Строка уходит зрителям как есть, без повторной сериализации
+    for (QTcpSocket* socket : m_spectators){
+        if (socket->state() != QTcpSocket::ConnectedState || m_lagging.contains(socket)) continue;
+        if (socket->bytesToWrite() > MaxSpectatorBacklogBytes) {
+            m_lagging.insert(socket);
+            ++m_resyncs;
+            qDebug() << "Spectator is not reading," << socket->bytesToWrite()
+                     << "bytes queued, resync after drain (total resyncs" << m_resyncs << ")";
+            continue;
+        }
+        socket->write(line.data);
+    }
+}
+
+void relayserver::applyToModel(const Line &line)
+{
+    if (line.seq >= 0) {
+        m_relayedSeq = line.seq;
+    }
+
+    const QJsonObject &message = line.message;
+    switch (line.type) {
+    case Protocol::MessageType::PlayerList:
+        m_roomPlayers.clear();
+        for (const QJsonValue& value : message["players"].toArray()) {
+            QJsonObject playerObj = value.toObject();
+            PlayerInfo& info = m_roomPlayers[playerObj["id"].toInt()];
+            info.name = playerObj["name"].toString();
+            info.score = playerObj["score"].toInt();
+        }
+        m_scoreSeq = message["scoreSeq"].toInt();
+        break;
+    case Protocol::MessageType::PlayerJoined: {
+        Protocol::PlayerJoined joined;
+        if (!Protocol::Json::decode(message, joined)) break;
+        PlayerInfo& info = m_roomPlayers[joined.id];
+        info.name = joined.name;
+        info.score = joined.score;
+        break;
+    }
+    case Protocol::MessageType::PlayerLeft: {
+        Protocol::PlayerLeft left;
+        if (Protocol::Json::decode(message, left)) m_roomPlayers.remove(left.id);
+        break;
+    }
+    case Protocol::MessageType::Scores: {
+        const QJsonObject scores = message["scores"].toObject();
+        for (auto it = scores.begin(); it != scores.end(); ++it) {
+            auto player = m_roomPlayers.find(it.key().toInt());
+            if (player != m_roomPlayers.end()) {
+                player->score = it.value().toInt();
+            }
+        }
+        m_scoreSeq = message["scoreSeq"].toInt();
+        break;
+    }
+    case Protocol::MessageType::RoundStart:
+        m_roundStartLine = line.data;
+        m_strokes.resize(0);
+        reportAllocations();
+        m_linePool.resetRound();
+        break;
+    case Protocol::MessageType::RoundEnd:
+    case Protocol::MessageType::GameOver:
+        m_roundStartLine.clear();
+        m_strokes.resize(0);
+        break;
+    case Protocol::MessageType::Draw:
+        if (line.draw.tool == Protocol::Tool::Clear) {
+            m_strokes.resize(0);
+        } else if (line.draw.tool != Protocol::Tool::Unknown) {
+            m_strokes.append(line.data);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+void relayserver::reportAllocations()
+{
+    // Сокеты зрителей копируют строку в свою очередь записи - это выделения
+    // Qt, пулом они не покрыты и здесь не считаются
+    const FramePool::Counters& lines = m_linePool.counters();
+    if (!lines.acquired) return;
+    qDebug() << "Round allocations: relay lines" << lines.acquired << "reused" << lines.reused
+             << "grown" << lines.grown << "overflow" << lines.overflow << "released" << lines.released
+             << "slots" << m_linePool.slotCount() << "x" << m_linePool.slotBytes() << "bytes,"
+             << "strokes capacity" << m_strokes.capacity();
+}
+
+void relayserver::incomingConnection(qintptr socketDescriptor)
+{
+    QTcpSocket* socket = new QTcpSocket(this);
+    socket->setSocketDescriptor(socketDescriptor);
+
+    connect(socket, &QTcpSocket::readyRead, this, [this, socket]() { onSpectatorReadyRead(socket); });
+    connect(socket, &QTcpSocket::bytesWritten, this, [this, socket]() { onSpectatorBytesWritten(socket); });
+    connect(socket, &QTcpSocket::disconnected, this, [this, socket]() { onSpectatorDisconnected(socket); });
+
+    qDebug() << socketDescriptor << "Spectator connected";
+}
+
+void relayserver::onSpectatorReadyRead(QTcpSocket *socket)
+{
+    // Зрители только смотрят: кроме входа (register/subscribe) все игнорируется
+    while (socket->canReadLine()) {
+        const QJsonObject message = QJsonDocument::fromJson(socket->readLine()).object();
+        const Protocol::MessageType type = Protocol::Json::type(message);
+        if ((type == Protocol::MessageType::Register || type == Protocol::MessageType::Subscribe)
+                && !m_spectators.contains(socket)) {
+            addSpectator(socket);
+        }
+    }
+}
+
+void relayserver::onSpectatorBytesWritten(QTcpSocket *socket)
+{
+    // Отставший догнал свою очередь - начинает заново с ключевого кадра
+    if (!m_lagging.contains(socket) || socket->bytesToWrite() > 0) return;
+    m_lagging.remove(socket);
+    sendKeyframe(socket);
+}
+
+void relayserver::onSpectatorDisconnected(QTcpSocket *socket)
+{
+    m_spectators.removeOne(socket);
+    m_lagging.remove(socket);
+    socket->deleteLater();
+    qDebug() << "Spectator disconnected," << m_spectators.size() << "left";
+}
+
+void relayserver::addSpectator(QTcpSocket *socket)
+{
+    // id -1 - не игрок: клиент не станет художником и не получит токен для resume
+    QJsonObject registered = Protocol::Json::encode(Protocol::MessageType::Registered);
+    registered["success"] = true;
+    registered["id"] = -1;
+    registered["spectator"] = true;
+    socket->write(QJsonDocument(registered).toJson(QJsonDocument::Compact) + "\n");
+
+    sendKeyframe(socket);
+    m_spectators.append(socket);
+}
+
+void relayserver::sendKeyframe(QTcpSocket *socket)
+{
+    // Тот же ключевой кадр, что у игрового сервера, но из локальной копии
+    QJsonObject playerListMsg = Protocol::Json::encode(Protocol::MessageType::PlayerList);
+    QJsonArray playersArray;
+    for (auto it = m_roomPlayers.begin(); it != m_roomPlayers.end(); ++it) {
+        QJsonObject playerObj;
+        playerObj["id"] = it.key();
+        playerObj["name"] = it.value().name;
+        playerObj["score"] = it.value().score;
+        playersArray.append(playerObj);
+    }
+    playerListMsg["players"] = playersArray;
+    playerListMsg["scoreSeq"] = m_scoreSeq;
+    playerListMsg["seq"] = m_relayedSeq;
+
+    QByteArray keyframe = QJsonDocument(playerListMsg).toJson(QJsonDocument::Compact) + "\n";
+    if (!m_roundStartLine.isEmpty()) {
+        keyframe.append(m_roundStartLine);
+        for (const QByteArray& stroke : m_strokes) {
+            keyframe.append(stroke);
+        }
+    } else {
+        Protocol::DrawCommand clear;
+        clear.tool = Protocol::Tool::Clear;
+        char buffer[Protocol::MaxDrawLineBytes];
+        const int length = Protocol::writeDraw(clear, -1, buffer, sizeof(buffer));
+        keyframe.append(buffer, length).append('\n');
+    }
+    socket->write(keyframe);
+}
@@ -0,0 +1,122 @@
+#ifndef RELAYSERVER_H
+#define RELAYSERVER_H
+
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QJsonObject>
+#include <QJsonDocument>
+#include <QJsonArray>
+#include <QList>
+#include <QVector>
+#include <QMap>
+#include <QQueue>
+#include <QSet>
+#include <QString>
+#include <QDebug>
+#include "jsoncodec.h"
+#include "drawparser.h"
+#include "framepool.h"
+
+// Ретранслятор для зрителей. Держит одно подключение к игровому серверу
+// (подписка "subscribe"), хранит свою копию ключевого кадра и штрихов
+// раунда и раздает поток многим зрителям только на чтение, по желанию -
+// с задержкой. Игровой сервер видит одного подписчика вместо тысяч зрителей.
+class relayserver: public QTcpServer
+{
+    Q_OBJECT
+public:
+
+    explicit relayserver(const QString& upstreamHost, quint16 upstreamPort,
+                         int delayMs = 0, QObject *parent = nullptr);
+    ~relayserver();
+
+    void startServer(quint16 port);
+
+private:
+
+    struct PlayerInfo {
+        QString name;
+        int score = 0;
+    };
+
+    // Строка от сервера, разобранная один раз: draw - быстрым путем без
+    // QJsonDocument, остальное - кодеком протокола. Зрителям уходит data как есть
+    struct Line {
+        QByteArray data;
+        Protocol::MessageType type = Protocol::MessageType::Unknown;
+        qint64 seq = -1;                // -1 - без номера
+        QJsonObject message;            // пусто, если строку взял быстрый путь
+        Protocol::DrawCommand draw;     // для MessageType::Draw
+    };
+
+    // Строка, ждущая своей очереди при задержке трансляции
+    struct Delayed {
+        qint64 releaseAt;
+        Line line;
+    };
+
+    static const int MaxReconnectDelayMs = 10000;
+    // Очередь сокета зрителя. Кто ее превысил, больше не получает строки, пока
+    // очередь не опустеет, а потом получает ключевой кадр: пропущенное
+    // досылать незачем, зритель только смотрит. Предел больше ключевого кадра
+    // (история раунда - до 1 МБ), иначе кадр сам вызывал бы новую синхронизацию
+    static const qint64 MaxSpectatorBacklogBytes = 2 * 1024 * 1024;
+    // Строки короче слота копируются из m_upstreamData в буферы пула. Штрихи
+    // раунда держат свои буферы до его конца, поэтому пул рассчитан на раунд
+    // целиком и свободные буферы не отдает: со второго раунда draw без malloc
+    static const int LinePoolSlots = 16 * 1024;
+    static const int UpstreamReserveBytes = 64 * 1024;
+
+    // подключение к игровому серверу
+    QTcpSocket* m_upstream;
+    QString m_upstreamHost;
+    quint16 m_upstreamPort;
+    QByteArray m_upstreamData;
+    FramePool m_linePool;
+    QTimer m_reconnectTimer;
+    int m_reconnectAttempts = 0;
+    qint64 m_lastSeq = -1;          // последний полученный seq потока комнаты
+
+    // задержка трансляции
+    int m_delayMs;
+    QElapsedTimer m_clock;
+    QQueue<Delayed> m_delayed;
+    QTimer m_releaseTimer;
+
+    // модель комнаты на момент последней отданной зрителям строки
+    QMap<int, PlayerInfo> m_roomPlayers;
+    int m_scoreSeq = 0;
+    qint64 m_relayedSeq = 0;
+    QByteArray m_roundStartLine;    // пусто - раунд не идет
+    QVector<QByteArray> m_strokes;  // команды draw с начала раунда; resize(0) сохраняет емкость
+
+    QList<QTcpSocket*> m_spectators;
+    QSet<QTcpSocket*> m_lagging;    // отстали, ждут пустой очереди и ключевого кадра
+    quint64 m_resyncs = 0;
+
+    void connectUpstream();
+    void scheduleReconnect();
+    static Line parseLine(const QByteArray& data);
+    void enqueue(const QByteArray& data);
+    void releaseDue();
+    void relay(const Line& line);
+    void applyToModel(const Line& line);
+    void reportAllocations();
+    void addSpectator(QTcpSocket* socket);
+    void sendKeyframe(QTcpSocket* socket);
+
+protected:
+    void incomingConnection(qintptr socketDescriptor) override;
+
+private slots:
+    void onUpstreamConnected();
+    void onUpstreamReadyRead();
+    void onUpstreamDisconnected();
+    void onSpectatorReadyRead(QTcpSocket* socket);
+    void onSpectatorBytesWritten(QTcpSocket* socket);
+    void onSpectatorDisconnected(QTcpSocket* socket);
+};
+
+#endif // RELAYSERVER_H
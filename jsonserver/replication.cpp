@@ -0,0 +1,163 @@
+#include "replication.h"
+#include <QtEndian>
+#include <QDebug>
+#include <string.h>
+
+ReplicationPrimary::ReplicationPrimary(QObject *parent) : QObject(parent)
+{
+    // resize(0) после отправки сохраняет емкость только зарезервированному буферу
+    m_pending.reserve(PendingReserveBytes);
+    connect(&m_server, &QLocalServer::newConnection, this, &ReplicationPrimary::onNewConnection);
+    m_heartbeat.setInterval(HeartbeatMs);
+    connect(&m_heartbeat, &QTimer::timeout, this, &ReplicationPrimary::heartbeat);
+}
+
+bool ReplicationPrimary::listen(const QString &path)
+{
+    QLocalServer::removeServer(path);
+    if (!m_server.listen(path)) {
+        qDebug() << "Replication is not listening:" << m_server.errorString();
+        return false;
+    }
+    qDebug() << "Replicating to followers on" << path;
+    return true;
+}
+
+void ReplicationPrimary::appendSnapshot(const QByteArray &snapshot)
+{
+    append(Snapshot, snapshot);
+}
+
+void ReplicationPrimary::appendRecord(const QByteArray &record)
+{
+    append(Record, record);
+}
+
+QByteArray ReplicationPrimary::frame(FrameKind kind, const QByteArray &payload)
+{
+    QByteArray framed(FrameHeaderSize, Qt::Uninitialized);
+    qToBigEndian<quint32>(static_cast<quint32>(payload.size() + 1), framed.data());
+    framed[4] = static_cast<char>(kind);
+    framed.append(payload);
+    return framed;
+}
+
+void ReplicationPrimary::onNewConnection()
+{
+    while (QLocalSocket *socket = m_server.nextPendingConnection()) {
+        // Накопленное уже отражено в снимке, который получит новый резерв
+        flush();
+        m_followers.append(socket);
+        connect(socket, &QLocalSocket::disconnected, this, [this, socket]() {
+            m_followers.removeOne(socket);
+            socket->deleteLater();
+            if (m_followers.isEmpty()) m_heartbeat.stop();
+            qDebug() << "Replication follower disconnected";
+        });
+        qDebug() << "Replication follower connected";
+        emit followerJoined();
+        flush();
+    }
+    if (!m_followers.isEmpty()) m_heartbeat.start();
+}
+
+void ReplicationPrimary::append(FrameKind kind, const QByteArray &payload)
+{
+    if (m_followers.isEmpty()) return;
+    // Кадр пишется сразу в очередь, без промежуточного QByteArray
+    const int at = m_pending.size();
+    m_pending.resize(at + FrameHeaderSize + payload.size());
+    char *out = m_pending.data() + at;
+    qToBigEndian<quint32>(static_cast<quint32>(payload.size() + 1), out);
+    out[4] = static_cast<char>(kind);
+    memcpy(out + FrameHeaderSize, payload.constData(), static_cast<size_t>(payload.size()));
+    if (m_flushScheduled) return;
+    m_flushScheduled = true;
+    QTimer::singleShot(0, this, [this]() {
+        m_flushScheduled = false;
+        flush();
+    });
+}
+
+void ReplicationPrimary::flush()
+{
+    if (m_pending.isEmpty()) return;
+    const QList<QLocalSocket*> followers = m_followers;
+    for (QLocalSocket *socket : followers) {
+        if (socket->bytesToWrite() > MaxBacklogBytes) {
+            qDebug() << "Replication follower is too far behind, dropping it";
+            socket->abort();
+            continue;
+        }
+        socket->write(m_pending);
+    }
+    m_pending.resize(0);
+    // Запись была - сердцебиение до следующего интервала не нужно
+    if (!m_followers.isEmpty()) m_heartbeat.start();
+}
+
+void ReplicationPrimary::heartbeat()
+{
+    for (QLocalSocket *socket : m_followers) {
+        socket->write(frame(Heartbeat, QByteArray()));
+    }
+}
+
+ReplicationFollower::ReplicationFollower(QObject *parent) : QObject(parent)
+{
+    m_silence.setSingleShot(true);
+    m_silence.setInterval(SilenceMs);
+    connect(&m_silence, &QTimer::timeout, this, [this]() {
+        qDebug() << "Primary is silent for" << SilenceMs << "ms";
+        lost();
+    });
+    connect(&m_socket, &QLocalSocket::readyRead, this, &ReplicationFollower::onReadyRead);
+    connect(&m_socket, &QLocalSocket::disconnected, this, &ReplicationFollower::lost);
+    connect(&m_socket, &QLocalSocket::errorOccurred, this, [this](QLocalSocket::LocalSocketError) {
+        if (m_socket.state() == QLocalSocket::UnconnectedState) lost();
+    });
+}
+
+void ReplicationFollower::connectToPrimary(const QString &path)
+{
+    m_lost = false;
+    m_inbox.clear();
+    m_socket.connectToServer(path);
+    m_silence.start();
+}
+
+void ReplicationFollower::onReadyRead()
+{
+    m_silence.start();
+    m_inbox.append(m_socket.readAll());
+
+    int offset = 0;
+    while (m_inbox.size() - offset >= 5) {
+        const quint32 length = qFromBigEndian<quint32>(m_inbox.constData() + offset);
+        if (length == 0) {
+            lost();
+            return;
+        }
+        if (m_inbox.size() - offset - 4 < static_cast<qint64>(length)) break;
+
+        const quint8 kind = static_cast<quint8>(m_inbox[offset + 4]);
+        const QByteArray payload = m_inbox.mid(offset + 5, static_cast<int>(length) - 1);
+        offset += 4 + static_cast<int>(length);
+        if (kind == ReplicationPrimary::Snapshot) {
+            emit snapshotReceived(payload);
+        } else if (kind == ReplicationPrimary::Record) {
+            emit recordReceived(payload);
+        }
+        if (m_lost) return;
+    }
+    m_inbox.remove(0, offset);
+}
+
+void ReplicationFollower::lost()
+{
+    if (m_lost) return;
+    m_lost = true;
+    m_silence.stop();
+    m_socket.abort();
+    emit primaryLost();
+}
@@ -0,0 +1,89 @@
+#ifndef REPLICATION_H
+#define REPLICATION_H
+
+#include <QObject>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QTimer>
+#include <QByteArray>
+#include <QList>
+
+// Репликация комнаты на резервный процесс (warm standby).
+// Основной сервер отдает подписчикам тот же поток, что пишет в журнал:
+// снимки и записи событий. Кадр: [u32 длина][u8 вид][данные], big-endian,
+// длина считает вид и данные. Кадры копятся до конца прохода цикла событий и
+// уходят одной записью - путь рисования не ждет ни сокета, ни резерва.
+// Пока событий нет, раз в HeartbeatMs уходит пустой кадр: по его отсутствию
+// резерв отличает зависший основной процесс от тихой комнаты.
+class ReplicationPrimary : public QObject
+{
+    Q_OBJECT
+public:
+    enum FrameKind : quint8 {
+        Snapshot = 1,
+        Record,
+        Heartbeat
+    };
+
+    static const int HeartbeatMs = 500;
+    static const int FrameHeaderSize = 5;       // длина (4 байта) и вид кадра
+    // Резерв, отставший больше чем на столько, отключается и догоняет снимком
+    static const qint64 MaxBacklogBytes = 16 * 1024 * 1024;
+
+    explicit ReplicationPrimary(QObject *parent = nullptr);
+
+    bool listen(const QString &path);
+    bool hasFollowers() const { return !m_followers.isEmpty(); }
+
+    void appendSnapshot(const QByteArray &snapshot);
+    void appendRecord(const QByteArray &record);
+
+    static QByteArray frame(FrameKind kind, const QByteArray &payload);
+
+signals:
+    // Новому резерву нужен снимок текущего состояния - его кладет обработчик
+    void followerJoined();
+
+private:
+    void onNewConnection();
+    void append(FrameKind kind, const QByteArray &payload);
+    void flush();
+    void heartbeat();
+
+    QLocalServer m_server;
+    QList<QLocalSocket*> m_followers;
+    static const int PendingReserveBytes = 64 * 1024;
+
+    QByteArray m_pending;           // кадры до конца прохода цикла событий
+    bool m_flushScheduled = false;
+    QTimer m_heartbeat;
+};
+
+// Резервный процесс: принимает поток основного и отдает кадры myserver.
+// Обрыв или молчание дольше SilenceMs - основной пропал (primaryLost).
+class ReplicationFollower : public QObject
+{
+    Q_OBJECT
+public:
+    static const int SilenceMs = 2000;
+
+    explicit ReplicationFollower(QObject *parent = nullptr);
+
+    void connectToPrimary(const QString &path);
+
+signals:
+    void snapshotReceived(const QByteArray &snapshot);
+    void recordReceived(const QByteArray &record);
+    void primaryLost();
+
+private:
+    void onReadyRead();
+    void lost();
+
+    QLocalSocket m_socket;
+    QByteArray m_inbox;
+    QTimer m_silence;
+    bool m_lost = false;
+};
+
+#endif // REPLICATION_H
@@ -0,0 +1,217 @@
+#include "roomjournal.h"
+#include <QDir>
+#include <QSaveFile>
+#include <QtEndian>
+#include <QDebug>
+#include <zlib.h>
+#include <string.h>
+#ifdef Q_OS_WIN
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+// Запись: [длина, 4 байта][crc32, 4 байта][номер записи, 8 байт][данные].
+// Оборванная при падении последняя запись отбрасывается по длине или crc.
+// Снимок начинается с номера первой записи после него: если упасть между
+// заменой снимка и обрезкой журнала, старые записи просто пропускаются
+static const int RecordHeaderSize = 16;
+static const int SnapshotHeaderSize = 8;
+// Емкость обоих буферов записей; resize(0) сохраняет ее только после reserve
+static const int PendingReserveBytes = 64 * 1024;
+
+RoomJournal::RoomJournal(QObject *parent) : QThread(parent)
+{
+    m_pending.reserve(PendingReserveBytes);
+    m_writing.reserve(PendingReserveBytes);
+}
+
+RoomJournal::~RoomJournal()
+{
+    close();
+}
+
+bool RoomJournal::open(const QString &directory, const QString &roomName,
+                       QByteArray &snapshot, QList<QByteArray> &records)
+{
+    QDir dir(directory);
+    if (!dir.mkpath(".")) {
+        qDebug() << "Journal: cannot create" << directory;
+        return false;
+    }
+    m_journalPath = dir.filePath(roomName + ".journal");
+    m_snapshotPath = dir.filePath(roomName + ".snapshot");
+
+    quint64 firstIndex = 0;
+    QFile snapshotFile(m_snapshotPath);
+    if (snapshotFile.open(QIODevice::ReadOnly)) {
+        const QByteArray data = snapshotFile.readAll();
+        if (data.size() >= SnapshotHeaderSize) {
+            firstIndex = qFromBigEndian<quint64>(data.constData());
+            snapshot = data.mid(SnapshotHeaderSize);
+        }
+    }
+
+    m_file.setFileName(m_journalPath);
+    if (!m_file.open(QIODevice::ReadWrite)) {
+        qDebug() << "Journal: cannot open" << m_journalPath;
+        return false;
+    }
+    const QByteArray existing = m_file.readAll();
+    m_nextIndex = firstIndex;
+    const qint64 validSize = readRecords(existing, firstIndex, records, m_nextIndex);
+
+    // Хвост после последней целой записи обрезаем, чтобы дописывать за ней
+    m_file.resize(validSize);
+    m_file.seek(validSize);
+    m_recordsSinceSnapshot = records.size();
+
+    m_stopping = false;
+    m_open = true;
+    start(QThread::LowPriority);
+    qDebug() << "Journal" << m_journalPath << ":" << records.size() << "records after snapshot of"
+             << snapshot.size() << "bytes";
+    return true;
+}
+
+void RoomJournal::close()
+{
+    if (!m_open) return;
+
+    {
+        QMutexLocker locker(&m_mutex);
+        m_stopping = true;
+        m_wake.wakeOne();
+    }
+    wait(); // поток дописывает очередь перед выходом
+    m_file.close();
+    m_open = false;
+}
+
+void RoomJournal::append(const QByteArray &record)
+{
+    if (!m_open) return;
+
+    QMutexLocker locker(&m_mutex);
+    // Запись кадрируется прямо в очереди: в емкости буфера без выделения памяти
+    const int at = m_pending.size();
+    m_pending.resize(at + RecordHeaderSize + record.size());
+    frame(m_nextIndex++, record, m_pending.data() + at);
+    ++m_recordsSinceSnapshot;
+    m_wake.wakeOne();
+}
+
+void RoomJournal::writeSnapshot(const QByteArray &snapshot)
+{
+    if (!m_open) return;
+
+    QMutexLocker locker(&m_mutex);
+    // Записи, добавленные раньше, уже учтены в снимке и не нужны
+    m_pending.resize(0);
+    m_pendingSnapshot = QByteArray(SnapshotHeaderSize, Qt::Uninitialized);
+    qToBigEndian<quint64>(m_nextIndex, m_pendingSnapshot.data());
+    m_pendingSnapshot.append(snapshot);
+    m_hasSnapshot = true;
+    m_recordsSinceSnapshot = 0;
+    m_wake.wakeOne();
+}
+
+void RoomJournal::run()
+{
+    forever {
+        QByteArray snapshot;
+        bool hasSnapshot = false;
+        {
+            QMutexLocker locker(&m_mutex);
+            while (m_pending.isEmpty() && !m_hasSnapshot && !m_stopping) {
+                m_wake.wait(&m_mutex);
+            }
+            if (m_pending.isEmpty() && !m_hasSnapshot && m_stopping) return;
+
+            // Все, что накопилось, пока шел прошлый fsync, уходит одной пачкой.
+            // Буферы меняются местами: оба остаются со своей емкостью
+            m_writing.swap(m_pending);
+            hasSnapshot = m_hasSnapshot;
+            snapshot.swap(m_pendingSnapshot);
+            m_hasSnapshot = false;
+        }
+
+        if (hasSnapshot) {
+            replaceSnapshot(snapshot);
+        }
+        if (!m_writing.isEmpty()) {
+            writeRecords(m_writing);
+            m_writing.resize(0);
+        }
+    }
+}
+
+void RoomJournal::writeRecords(const QByteArray &block)
+{
+    if (m_file.write(block) != block.size()) {
+        qDebug() << "Journal: write failed:" << m_file.errorString();
+        return;
+    }
+    sync();
+}
+
+void RoomJournal::replaceSnapshot(const QByteArray &snapshot)
+{
+    // QSaveFile пишет во временный файл и атомарно переименовывает:
+    // при падении посередине остается старый снимок со своим журналом
+    QSaveFile file(m_snapshotPath);
+    if (!file.open(QIODevice::WriteOnly) || file.write(snapshot) != snapshot.size() || !file.commit()) {
+        qDebug() << "Journal: snapshot failed:" << file.errorString();
+        return;
+    }
+    m_file.resize(0);
+    m_file.seek(0);
+    sync();
+}
+
+void RoomJournal::sync()
+{
+    m_file.flush();
+#ifdef Q_OS_WIN
+    _commit(m_file.handle());
+#else
+    ::fsync(m_file.handle());
+#endif
+}
+
+void RoomJournal::frame(quint64 index, const QByteArray &payload, char *out)
+{
+    qToBigEndian<quint32>(static_cast<quint32>(payload.size()), out);
+    qToBigEndian<quint64>(index, out + 8);
+    memcpy(out + RecordHeaderSize, payload.constData(), static_cast<size_t>(payload.size()));
+
+    // crc покрывает номер и данные
+    const quint32 crc = crc32(0, reinterpret_cast<const Bytef *>(out + 8),
+                              static_cast<uInt>(RecordHeaderSize - 8 + payload.size()));
+    qToBigEndian<quint32>(crc, out + 4);
+}
+
+qint64 RoomJournal::readRecords(const QByteArray &data, quint64 firstIndex, QList<QByteArray> &records,
+                                quint64 &nextIndex)
+{
+    int pos = 0;
+    while (data.size() - pos >= RecordHeaderSize) {
+        const char *header = data.constData() + pos;
+        const quint32 length = qFromBigEndian<quint32>(header);
+        const quint32 crc = qFromBigEndian<quint32>(header + 4);
+        if (length > static_cast<quint32>(data.size() - pos - RecordHeaderSize)) break;
+
+        const quint32 actual = crc32(0, reinterpret_cast<const Bytef *>(header + 8),
+                                     static_cast<uInt>(RecordHeaderSize - 8 + length));
+        if (actual != crc) break;
+
+        // Записи старше снимка уже в нем учтены
+        const quint64 index = qFromBigEndian<quint64>(header + 8);
+        if (index >= firstIndex) {
+            records.append(data.mid(pos + RecordHeaderSize, static_cast<int>(length)));
+            nextIndex = index + 1;
+        }
+        pos += RecordHeaderSize + static_cast<int>(length);
+    }
+    return pos;
+}
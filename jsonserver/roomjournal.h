@@ -0,0 +1,67 @@
+#ifndef ROOMJOURNAL_H
+#define ROOMJOURNAL_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QByteArray>
+#include <QString>
+#include <QList>
+#include <QFile>
+
+// Журнал упреждающей записи одной комнаты.
+// Цикл событий только добавляет записи в очередь под мьютексом, а фоновый
+// поток пишет все накопившееся одним блоком и делает один fsync на пачку
+// (групповая фиксация). Снимок состояния заменяет журнал целиком, поэтому
+// восстановление читает снимок и короткий хвост записей после него.
+// Содержимое записей и снимков журналу не важно - их кодирует myserver.
+class RoomJournal : public QThread
+{
+    Q_OBJECT
+public:
+    explicit RoomJournal(QObject *parent = nullptr);
+    ~RoomJournal() override;
+
+    // Читает снимок и уцелевшие записи (до первой оборванной) и запускает запись
+    bool open(const QString &directory, const QString &roomName,
+              QByteArray &snapshot, QList<QByteArray> &records);
+    void close();
+
+    bool isOpen() const { return m_open; }
+
+    void append(const QByteArray &record);
+    // Снимок отражает все записи, добавленные до вызова; журнал после него начинается заново
+    void writeSnapshot(const QByteArray &snapshot);
+
+    int recordsSinceSnapshot() const { return m_recordsSinceSnapshot; }
+
+protected:
+    void run() override;
+
+private:
+    void writeRecords(const QByteArray &block);
+    void replaceSnapshot(const QByteArray &snapshot);
+    void sync();
+    // Пишет запись с заголовком в out (RecordHeaderSize + размер payload байт)
+    static void frame(quint64 index, const QByteArray &payload, char *out);
+    static qint64 readRecords(const QByteArray &data, quint64 firstIndex, QList<QByteArray> &records,
+                              quint64 &nextIndex);
+
+    QString m_journalPath;
+    QString m_snapshotPath;
+    QFile m_file;                   // используется только фоновым потоком после open()
+    QByteArray m_writing;           // пачка, которую пишет фоновый поток; только он ее и трогает
+    bool m_open = false;
+    int m_recordsSinceSnapshot = 0; // только для цикла событий
+    quint64 m_nextIndex = 0;        // сквозной номер следующей записи, только для цикла событий
+
+    // общие с фоновым потоком, под m_mutex
+    QMutex m_mutex;
+    QWaitCondition m_wake;
+    QByteArray m_pending;           // записи, ждущие фиксации; меняется местами с m_writing
+    QByteArray m_pendingSnapshot;
+    bool m_hasSnapshot = false;
+    bool m_stopping = false;
+};
+
+#endif // ROOMJOURNAL_H
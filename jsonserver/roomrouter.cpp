@@ -0,0 +1,215 @@
+#include "roomrouter.h"
+#include <QJsonDocument>
+#include <QDebug>
+
+RoomRouter::RoomRouter(QObject *parent) : QObject(parent)
+{
+    connect(&m_server, &QLocalServer::newConnection, this, &RoomRouter::onNewConnection);
+}
+
+bool RoomRouter::listen(const QString &path)
+{
+    // Сокет от прошлого запуска мешает listen
+    QLocalServer::removeServer(path);
+    if (!m_server.listen(path)) {
+        qDebug() << "Router is not listening:" << m_server.errorString();
+        return false;
+    }
+    qDebug() << "Room router listening on" << path;
+    return true;
+}
+
+void RoomRouter::onNewConnection()
+{
+    while (QLocalSocket *socket = m_server.nextPendingConnection()) {
+        m_shards.insert(socket, Shard());
+        connect(socket, &QLocalSocket::readyRead, this, [this, socket]() { onReadyRead(socket); });
+        connect(socket, &QLocalSocket::disconnected, this, [this, socket]() { onDisconnected(socket); });
+    }
+}
+
+void RoomRouter::onReadyRead(QLocalSocket *socket)
+{
+    QByteArray &inbox = m_shards[socket].inbox;
+    inbox.append(socket->readAll());
+    while (inbox.contains('\n')) {
+        const int pos = inbox.indexOf('\n');
+        const QJsonDocument doc = QJsonDocument::fromJson(inbox.left(pos));
+        inbox.remove(0, pos + 1);
+        if (doc.isObject()) {
+            processMessage(socket, doc.object());
+        }
+        if (!m_shards.contains(socket)) return;
+    }
+}
+
+void RoomRouter::onDisconnected(QLocalSocket *socket)
+{
+    // Перенос, в котором участвовал шард, не состоится
+    const QStringList migrating = m_migrations.keys();
+    for (const QString &room : migrating) {
+        Migration &migration = m_migrations[room];
+        if (migration.requester == socket) migration.requester = nullptr;
+        if (migration.target == socket || m_owners.value(room) == socket) {
+            finishMigration(room, false, "shard disconnected");
+        }
+    }
+
+    const Shard shard = m_shards.take(socket);
+    if (!shard.room.isEmpty() && m_owners.value(shard.room) == socket) {
+        m_owners.remove(shard.room);
+        qDebug() << "Shard" << shard.path << "is gone, room" << shard.room << "released";
+    }
+    socket->deleteLater();
+}
+
+void RoomRouter::processMessage(QLocalSocket *socket, const QJsonObject &message)
+{
+    const QString type = message["type"].toString();
+    Shard &shard = m_shards[socket];
+
+    if (type == "hello") {
+        shard.path = message["shard"].toString();
+        qDebug() << "Shard joined:" << shard.path;
+    }
+    else if (type == "lookup") {
+        const QString room = message["room"].toString();
+        QJsonObject reply;
+        reply["type"] = "owner";
+        reply["room"] = room;
+        reply["request"] = message["request"];
+        reply["shard"] = assign(socket, room);
+        send(socket, reply);
+    }
+    else if (type == "migrate") {
+        startMigration(socket, message["room"].toString());
+    }
+    else if (type == "roomState") {
+        const QString room = message["room"].toString();
+        if (!m_migrations.contains(room) || m_owners.value(room) != socket) return;
+        if (message["state"].toString().isEmpty()) {
+            finishMigration(room, false, "owner refused");
+            return;
+        }
+        send(m_migrations[room].target, message);
+    }
+    else if (type == "adopted") {
+        const QString room = message["room"].toString();
+        if (!m_migrations.contains(room) || m_migrations[room].target != socket) return;
+        finishMigration(room, message["ok"].toBool(), "target could not restore the room");
+    }
+    else if (type == "release") {
+        const QString room = message["room"].toString();
+        if (shard.room == room && !m_migrations.contains(room)) {
+            shard.room.clear();
+            m_owners.remove(room);
+            qDebug() << "Room" << room << "released by" << shard.path;
+        }
+    }
+}
+
+QString RoomRouter::assign(QLocalSocket *requester, const QString &room)
+{
+    if (room.isEmpty()) return QString();
+
+    QLocalSocket *owner = m_owners.value(room);
+    if (!owner) {
+        // Лучше всего - шард, куда уже пришло соединение: обойдемся без передачи
+        if (m_shards[requester].room.isEmpty() && !m_shards[requester].path.isEmpty()) {
+            owner = requester;
+        } else {
+            for (auto it = m_shards.begin(); it != m_shards.end(); ++it) {
+                if (it->room.isEmpty() && !it->path.isEmpty()) {
+                    owner = it.key();
+                    break;
+                }
+            }
+        }
+        if (!owner) {
+            qDebug() << "No free shard for room" << room;
+            return QString();
+        }
+        m_shards[owner].room = room;
+        m_owners.insert(room, owner);
+        qDebug() << "Room" << room << "assigned to" << m_shards[owner].path;
+    }
+    return m_shards[owner].path;
+}
+
+void RoomRouter::startMigration(QLocalSocket *requester, const QString &room)
+{
+    QLocalSocket *owner = m_owners.value(room);
+    QLocalSocket *target = nullptr;
+    for (auto it = m_shards.begin(); it != m_shards.end(); ++it) {
+        if (it.key() != owner && it->room.isEmpty() && !it->path.isEmpty()) {
+            target = it.key();
+            break;
+        }
+    }
+
+    QString reason;
+    if (!owner) reason = "no such room";
+    else if (m_migrations.contains(room)) reason = "already migrating";
+    else if (!target) reason = "no free shard";
+    if (!reason.isEmpty()) {
+        QJsonObject result;
+        result["type"] = "migrateResult";
+        result["room"] = room;
+        result["ok"] = false;
+        result["reason"] = reason;
+        send(requester, result);
+        return;
+    }
+
+    // Цель занята заранее, чтобы lookup не отдал ее другой комнате
+    m_shards[target].room = room;
+    Migration migration;
+    migration.requester = requester;
+    migration.target = target;
+    m_migrations.insert(room, migration);
+
+    QJsonObject order;
+    order["type"] = "migrate";
+    order["room"] = room;
+    order["target"] = m_shards[target].path;
+    send(owner, order);
+    qDebug() << "Migrating room" << room << "from" << m_shards[owner].path << "to" << m_shards[target].path;
+}
+
+void RoomRouter::finishMigration(const QString &room, bool ok, const QString &reason)
+{
+    const Migration migration = m_migrations.take(room);
+    QLocalSocket *owner = m_owners.value(room);
+    const QString targetPath = m_shards.value(migration.target).path;
+
+    if (ok) {
+        if (owner) m_shards[owner].room.clear();
+        m_owners.insert(room, migration.target);
+    } else if (m_shards.contains(migration.target)) {
+        m_shards[migration.target].room.clear();
+    }
+
+    if (owner) {
+        QJsonObject migrated;
+        migrated["type"] = "migrated";
+        migrated["room"] = room;
+        migrated["ok"] = ok;
+        migrated["target"] = targetPath;
+        send(owner, migrated);
+    }
+    if (migration.requester && m_shards.contains(migration.requester)) {
+        QJsonObject result;
+        result["type"] = "migrateResult";
+        result["room"] = room;
+        result["ok"] = ok;
+        if (ok) result["shard"] = targetPath;
+        else result["reason"] = reason;
+        send(migration.requester, result);
+    }
+    qDebug() << "Migration of room" << room << (ok ? "done" : "failed:") << (ok ? targetPath : reason);
+}
+
+void RoomRouter::send(QLocalSocket *socket, const QJsonObject &message)
+{
+    socket->write(QJsonDocument(message).toJson(QJsonDocument::Compact) + "\n");
+}
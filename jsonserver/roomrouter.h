@@ -0,0 +1,63 @@
+#ifndef ROOMROUTER_H
+#define ROOMROUTER_H
+
+#include <QObject>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QHash>
+#include <QJsonObject>
+
+// Локальный маршрутизатор комнат для нескольких процессов jsonserver на одном
+// порту (SO_REUSEPORT). Каждый процесс-шард держит одну комнату; маршрутизатор
+// помнит, какой шард владеет какой комнатой, и раздает свободные шарды новым.
+//
+// Протокол - строки JSON по unix-сокету:
+//   шард -> "hello"   {shard: путь сокета передачи соединений}
+//   шард -> "lookup"  {room, request}   ответ "owner" {room, request, shard}
+//   шард -> "release" {room}            комната опустела
+// shard в ответе пустой, если свободных шардов нет. Если шард отвалился,
+// его комнаты освобождаются.
+//
+// Перенос живой комнаты (разгрузка процесса, выкладка):
+//   кто угодно -> "migrate" {room}              ответ "migrateResult" {room, ok, shard|reason}
+//   владелец   <- "migrate" {room, target}      замораживает комнату
+//   владелец   -> "roomState" {room, state}     пересылается цели
+//   цель       -> "adopted" {room, ok}          комната восстановлена из состояния
+//   владелец   <- "migrated" {room, ok, target} владение уже у цели, клиенты уходят туда
+// На время переноса цель зарезервирована, lookup отвечает прежним владельцем.
+class RoomRouter : public QObject
+{
+    Q_OBJECT
+public:
+    explicit RoomRouter(QObject *parent = nullptr);
+
+    bool listen(const QString &path);
+
+private:
+    struct Shard {
+        QString path;
+        QByteArray inbox;
+        QString room;       // пусто - шард свободен
+    };
+
+    void onNewConnection();
+    void onReadyRead(QLocalSocket *socket);
+    void onDisconnected(QLocalSocket *socket);
+    void processMessage(QLocalSocket *socket, const QJsonObject &message);
+    QString assign(QLocalSocket *requester, const QString &room);
+    void startMigration(QLocalSocket *requester, const QString &room);
+    void finishMigration(const QString &room, bool ok, const QString &reason = QString());
+    void send(QLocalSocket *socket, const QJsonObject &message);
+
+    QLocalServer m_server;
+    QHash<QLocalSocket*, Shard> m_shards;
+    QHash<QString, QLocalSocket*> m_owners;     // комната -> шард-владелец
+
+    struct Migration {
+        QLocalSocket *requester = nullptr;  // ждет migrateResult
+        QLocalSocket *target = nullptr;
+    };
+    QHash<QString, Migration> m_migrations;
+};
+
+#endif // ROOMROUTER_H
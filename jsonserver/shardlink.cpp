@@ -0,0 +1,325 @@
+#include "shardlink.h"
+#include <QCoreApplication>
+#include <QJsonDocument>
+#include <QDebug>
+#ifdef Q_OS_UNIX
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#endif
+
+namespace {
+
+#ifdef Q_OS_UNIX
+bool fillAddress(sockaddr_un &address, const QString &path)
+{
+    const QByteArray native = path.toLocal8Bit();
+    if (native.size() >= static_cast<int>(sizeof(address.sun_path))) return false;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    memcpy(address.sun_path, native.constData(), native.size());
+    return true;
+}
+#endif
+
+}
+
+ShardLink::ShardLink(const QString &routerPath, QObject *parent) : QObject(parent),
+    m_routerPath(routerPath),
+    m_path(routerPath + "." + QString::number(QCoreApplication::applicationPid()))
+{
+    m_reconnectTimer.setSingleShot(true);
+    m_reconnectTimer.setInterval(ReconnectMs);
+    connect(&m_reconnectTimer, &QTimer::timeout, this, &ShardLink::connectToRouter);
+    connect(&m_router, &QLocalSocket::connected, this, &ShardLink::onRouterConnected);
+    connect(&m_router, &QLocalSocket::disconnected, this, &ShardLink::onRouterDisconnected);
+    connect(&m_router, &QLocalSocket::errorOccurred, this, [this](QLocalSocket::LocalSocketError) {
+        if (m_router.state() == QLocalSocket::UnconnectedState) m_reconnectTimer.start();
+    });
+    connect(&m_router, &QLocalSocket::readyRead, this, &ShardLink::onRouterReadyRead);
+}
+
+ShardLink::~ShardLink()
+{
+#ifdef Q_OS_UNIX
+    for (auto it = m_incoming.begin(); it != m_incoming.end(); ++it) {
+        delete it.value();
+        ::close(it.key());
+    }
+    if (m_listener >= 0) {
+        delete m_listenerNotifier;
+        ::close(m_listener);
+        ::unlink(m_path.toLocal8Bit().constData());
+    }
+#endif
+}
+
+bool ShardLink::start()
+{
+#ifdef Q_OS_UNIX
+    sockaddr_un address;
+    if (!fillAddress(address, m_path)) {
+        qDebug() << "Handoff socket path is too long:" << m_path;
+        return false;
+    }
+    ::unlink(address.sun_path);
+    m_listener = ::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (m_listener < 0
+            || ::bind(m_listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0
+            || ::listen(m_listener, SOMAXCONN) != 0) {
+        qDebug() << "Handoff socket failed:" << strerror(errno);
+        if (m_listener >= 0) ::close(m_listener);
+        m_listener = -1;
+        return false;
+    }
+    m_listenerNotifier = new QSocketNotifier(m_listener, QSocketNotifier::Read, this);
+    connect(m_listenerNotifier, &QSocketNotifier::activated, this, &ShardLink::acceptHandoffs);
+
+    connectToRouter();
+    return true;
+#else
+    qDebug() << "Sharding needs Unix domain sockets";
+    return false;
+#endif
+}
+
+void ShardLink::lookup(const QString &room, int request)
+{
+    if (m_router.state() != QLocalSocket::ConnectedState) {
+        // Без маршрутизатора не знаем, свободна ли комната в другом процессе
+        emit ownerFound(request, room, QString());
+        return;
+    }
+    m_pending.insert(request, room);
+    QJsonObject message;
+    message["type"] = "lookup";
+    message["room"] = room;
+    message["request"] = request;
+    send(message);
+}
+
+void ShardLink::release(const QString &room)
+{
+    if (m_room == room) m_room.clear();
+    QJsonObject message;
+    message["type"] = "release";
+    message["room"] = room;
+    send(message);
+}
+
+bool ShardLink::handOff(const QString &shard, qintptr descriptor, const QByteArray &buffered)
+{
+#ifdef Q_OS_UNIX
+    sockaddr_un address;
+    if (buffered.isEmpty() || buffered.size() > MaxHandoffBytes || !fillAddress(address, shard)) return false;
+
+    const int fd = ::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd < 0) return false;
+    if (::connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0) {
+        qDebug() << "Cannot reach shard" << shard << ":" << strerror(errno);
+        ::close(fd);
+        return false;
+    }
+
+    iovec data;
+    data.iov_base = const_cast<char *>(buffered.constData());
+    data.iov_len = static_cast<size_t>(buffered.size());
+    union {
+        char buffer[CMSG_SPACE(sizeof(int))];
+        cmsghdr align;
+    } control;
+    memset(&control, 0, sizeof(control));
+
+    msghdr message = {};
+    message.msg_iov = &data;
+    message.msg_iovlen = 1;
+    message.msg_control = control.buffer;
+    message.msg_controllen = sizeof(control.buffer);
+    cmsghdr *rights = CMSG_FIRSTHDR(&message);
+    rights->cmsg_level = SOL_SOCKET;
+    rights->cmsg_type = SCM_RIGHTS;
+    rights->cmsg_len = CMSG_LEN(sizeof(int));
+    const int passed = static_cast<int>(descriptor);
+    memcpy(CMSG_DATA(rights), &passed, sizeof(int));
+
+    const bool sent = ::sendmsg(fd, &message, MSG_NOSIGNAL) == static_cast<ssize_t>(buffered.size());
+    if (!sent) qDebug() << "Handoff to" << shard << "failed:" << strerror(errno);
+    ::close(fd);
+    return sent;
+#else
+    Q_UNUSED(shard);
+    Q_UNUSED(descriptor);
+    Q_UNUSED(buffered);
+    return false;
+#endif
+}
+
+void ShardLink::sendRoomState(const QString &room, const QByteArray &state)
+{
+    if (state.isEmpty()) m_migratingRoom.clear();
+    QJsonObject message;
+    message["type"] = "roomState";
+    message["room"] = room;
+    message["state"] = QString::fromLatin1(state.toBase64());
+    send(message);
+}
+
+void ShardLink::confirmAdoption(const QString &room, bool ok)
+{
+    if (ok) m_room = room;
+    QJsonObject message;
+    message["type"] = "adopted";
+    message["room"] = room;
+    message["ok"] = ok;
+    send(message);
+}
+
+void ShardLink::closeDescriptor(qintptr descriptor)
+{
+#ifdef Q_OS_UNIX
+    ::close(static_cast<int>(descriptor));
+#else
+    Q_UNUSED(descriptor);
+#endif
+}
+
+void ShardLink::connectToRouter()
+{
+    m_router.abort();
+    m_inbox.clear();
+    m_router.connectToServer(m_routerPath);
+}
+
+void ShardLink::onRouterConnected()
+{
+    QJsonObject hello;
+    hello["type"] = "hello";
+    hello["shard"] = m_path;
+    send(hello);
+
+    // Маршрутизатор перезапускался - комната все еще у нас
+    if (!m_room.isEmpty()) {
+        QJsonObject claim;
+        claim["type"] = "lookup";
+        claim["room"] = m_room;
+        claim["request"] = -1;
+        send(claim);
+    }
+    qDebug() << "Connected to room router" << m_routerPath;
+}
+
+void ShardLink::onRouterDisconnected()
+{
+    qDebug() << "Room router is gone, reconnecting";
+    const QHash<int, QString> pending = m_pending;
+    m_pending.clear();
+    for (auto it = pending.begin(); it != pending.end(); ++it) {
+        emit ownerFound(it.key(), it.value(), QString());
+    }
+    // Чем кончился перенос, не узнать - комната остается у нас
+    if (!m_migratingRoom.isEmpty()) {
+        const QString room = m_migratingRoom;
+        m_migratingRoom.clear();
+        emit migrationFinished(room, false);
+    }
+    m_reconnectTimer.start();
+}
+
+void ShardLink::onRouterReadyRead()
+{
+    m_inbox.append(m_router.readAll());
+    while (m_inbox.contains('\n')) {
+        const int pos = m_inbox.indexOf('\n');
+        const QJsonDocument doc = QJsonDocument::fromJson(m_inbox.left(pos));
+        m_inbox.remove(0, pos + 1);
+
+        const QJsonObject message = doc.object();
+        const QString type = message["type"].toString();
+        const QString room = message["room"].toString();
+        if (type == "owner") {
+            const int request = message["request"].toInt();
+            const QString shard = message["shard"].toString();
+            if (shard == m_path) m_room = room;
+            if (m_pending.remove(request) > 0) {
+                emit ownerFound(request, room, shard);
+            }
+        }
+        else if (type == "migrate") {
+            m_migratingRoom = room;
+            emit migrateRequested(room, message["target"].toString());
+        }
+        else if (type == "roomState") {
+            emit roomStateReceived(room, QByteArray::fromBase64(message["state"].toString().toLatin1()));
+        }
+        else if (type == "migrated") {
+            const bool ok = message["ok"].toBool();
+            if (ok && m_room == room) m_room.clear();
+            m_migratingRoom.clear();
+            emit migrationFinished(room, ok);
+        }
+    }
+}
+
+void ShardLink::send(const QJsonObject &message)
+{
+    if (m_router.state() != QLocalSocket::ConnectedState) return;
+    m_router.write(QJsonDocument(message).toJson(QJsonDocument::Compact) + "\n");
+}
+
+void ShardLink::acceptHandoffs()
+{
+#ifdef Q_OS_UNIX
+    forever {
+        const int fd = ::accept4(m_listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) return;
+        QSocketNotifier *notifier = new QSocketNotifier(fd, QSocketNotifier::Read, this);
+        connect(notifier, &QSocketNotifier::activated, this, [this, fd]() { receiveHandoff(fd); });
+        m_incoming.insert(fd, notifier);
+    }
+#endif
+}
+
+void ShardLink::receiveHandoff(int fd)
+{
+#ifdef Q_OS_UNIX
+    QByteArray buffered(MaxHandoffBytes, Qt::Uninitialized);
+    iovec data;
+    data.iov_base = buffered.data();
+    data.iov_len = static_cast<size_t>(buffered.size());
+    union {
+        char buffer[CMSG_SPACE(sizeof(int))];
+        cmsghdr align;
+    } control;
+
+    msghdr message = {};
+    message.msg_iov = &data;
+    message.msg_iovlen = 1;
+    message.msg_control = control.buffer;
+    message.msg_controllen = sizeof(control.buffer);
+
+    const ssize_t received = ::recvmsg(fd, &message, MSG_CMSG_CLOEXEC);
+    if (received < 0 && (errno == EAGAIN || errno == EINTR)) return;
+
+    // Одно сообщение на соединение: дальше этот сокет не нужен
+    m_incoming.take(fd)->deleteLater();
+    ::close(fd);
+
+    int descriptor = -1;
+    for (cmsghdr *c = CMSG_FIRSTHDR(&message); received > 0 && c; c = CMSG_NXTHDR(&message, c)) {
+        if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_RIGHTS) {
+            memcpy(&descriptor, CMSG_DATA(c), sizeof(int));
+        }
+    }
+    if (descriptor < 0) return;
+    if (message.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) {
+        ::close(descriptor);
+        return;
+    }
+    buffered.resize(static_cast<int>(received));
+    emit connectionReceived(descriptor, buffered);
+#else
+    Q_UNUSED(fd);
+#endif
+}
@@ -0,0 +1,80 @@
+#ifndef SHARDLINK_H
+#define SHARDLINK_H
+
+#include <QObject>
+#include <QLocalSocket>
+#include <QSocketNotifier>
+#include <QHash>
+#include <QTimer>
+#include <QJsonObject>
+
+// Связь процесса-шарда с маршрутизатором комнат (RoomRouter) и с соседними
+// шардами. Соединение, пришедшее не в тот процесс, передается владельцу
+// комнаты вместе с дескриптором (SCM_RIGHTS) и уже прочитанными байтами одним
+// сообщением SOCK_SEQPACKET: граница сообщения сохраняется, а дескриптор не
+// может прийти отдельно от своих данных.
+// Только Unix; на других ОС start() возвращает false.
+class ShardLink : public QObject
+{
+    Q_OBJECT
+public:
+    // Больше в одно сообщение передачи не кладем - гарантированно влезает в буфер сокета
+    static const int MaxHandoffBytes = 128 * 1024;
+
+    ShardLink(const QString &routerPath, QObject *parent = nullptr);
+    ~ShardLink();
+
+    // Открывает свой сокет передачи и подключается к маршрутизатору
+    bool start();
+    // Путь сокета передачи - им шард представляется маршрутизатору
+    QString path() const { return m_path; }
+
+    // Ответ приходит сигналом ownerFound с тем же request
+    void lookup(const QString &room, int request);
+    void release(const QString &room);
+    // Отдает копию дескриптора соединения шарду shard; descriptor закрывает вызывающий
+    bool handOff(const QString &shard, qintptr descriptor, const QByteArray &buffered);
+    static void closeDescriptor(qintptr descriptor);
+
+    // Перенос комнаты: состояние уходит цели через маршрутизатор; пустое - отказ
+    void sendRoomState(const QString &room, const QByteArray &state);
+    void confirmAdoption(const QString &room, bool ok);
+
+signals:
+    // shard == path() - комната наша; пусто - свободных шардов нет или маршрутизатор недоступен
+    void ownerFound(int request, const QString &room, const QString &shard);
+    // Принятый от соседа дескриптор теперь принадлежит получателю сигнала
+    void connectionReceived(qintptr descriptor, const QByteArray &buffered);
+    // Маршрутизатор просит отдать комнату шарду target
+    void migrateRequested(const QString &room, const QString &target);
+    // Нам переносят комнату - ответ через confirmAdoption
+    void roomStateReceived(const QString &room, const QByteArray &state);
+    // ok - владение уже у цели, клиентов пора отправлять туда
+    void migrationFinished(const QString &room, bool ok);
+
+private:
+    static const int ReconnectMs = 1000;
+
+    void connectToRouter();
+    void onRouterConnected();
+    void onRouterDisconnected();
+    void onRouterReadyRead();
+    void send(const QJsonObject &message);
+    void acceptHandoffs();
+    void receiveHandoff(int fd);
+
+    QString m_routerPath;
+    QString m_path;
+    QLocalSocket m_router;
+    QByteArray m_inbox;
+    QTimer m_reconnectTimer;
+    QHash<int, QString> m_pending;      // request -> комната, ждут ответа маршрутизатора
+    QString m_room;                     // наша комната, заявляется заново после переподключения
+    QString m_migratingRoom;            // отдаем комнату, ждем "migrated"
+
+    int m_listener = -1;
+    QSocketNotifier *m_listenerNotifier = nullptr;
+    QHash<int, QSocketNotifier*> m_incoming;    // принятые соединения передачи, ждут сообщения
+};
+
+#endif // SHARDLINK_H
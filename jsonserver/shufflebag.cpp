@@ -0,0 +1,48 @@
+#include "shufflebag.h"
+#include <QRandomGenerator>
+
+void ShuffleBag::reset(quint32 size)
+{
+    m_size = size;
+    m_halfBits = 1;
+    while (m_halfBits < 16 && (quint64(1) << (2 * m_halfBits)) < size) {
+        ++m_halfBits;
+    }
+    reshuffle();
+}
+
+void ShuffleBag::reshuffle()
+{
+    for (quint32 &key : m_keys) {
+        key = QRandomGenerator::global()->generate();
+    }
+    m_position = 0;
+}
+
+quint32 ShuffleBag::next()
+{
+    if (m_size == 0) return 0;
+    const quint64 domain = quint64(1) << (2 * m_halfBits);
+    // Область меньше 4 * size: в среднем меньше четырех попыток
+    forever {
+        if (m_position >= domain) reshuffle();
+        const quint32 value = permute(m_position++);
+        if (value < m_size) return value;
+    }
+}
+
+quint32 ShuffleBag::permute(quint32 value) const
+{
+    const quint32 mask = (quint32(1) << m_halfBits) - 1;
+    quint32 left = (value >> m_halfBits) & mask;
+    quint32 right = value & mask;
+    for (quint32 key : m_keys) {
+        // Любая функция раунда дает биекцию; эта хорошо перемешивает биты
+        quint32 f = (right ^ key) * 0x9E3779B1u;
+        f ^= f >> 15;
+        const quint32 next = left ^ (f & mask);
+        left = right;
+        right = next;
+    }
+    return (left << m_halfBits) | right;
+}
@@ -0,0 +1,30 @@
+#ifndef SHUFFLEBAG_H
+#define SHUFFLEBAG_H
+
+#include <QtGlobal>
+
+// Мешок без повторов: выдает номера 0..size-1 в случайном порядке, каждый
+// по разу, потом перемешивает заново. Порядок - псевдослучайная перестановка
+// (сеть Фейстеля на 4^k >= size, лишние значения пропускаются), поэтому память
+// не зависит от размера: мешок на 200 тысяч слов стоит несколько чисел
+class ShuffleBag
+{
+public:
+    void reset(quint32 size);
+    quint32 size() const { return m_size; }
+    // Для пустого мешка - 0
+    quint32 next();
+
+private:
+    static const int Rounds = 4;
+
+    void reshuffle();
+    quint32 permute(quint32 value) const;
+
+    quint32 m_size = 0;
+    int m_halfBits = 1;
+    quint32 m_position = 0;     // номер в перестановке всей области 4^k
+    quint32 m_keys[Rounds] = {};
+};
+
+#endif // SHUFFLEBAG_H
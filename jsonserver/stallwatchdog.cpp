@@ -0,0 +1,124 @@
+#include "stallwatchdog.h"
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QHash>
+#include <QTextStream>
+#include <QMetaObject>
+#include <QDebug>
+
+StallWatchdog::StallWatchdog(QObject *target, const FlightRecorder &recorder, int thresholdMs,
+                             const QString &directory, QObject *parent) :
+    QThread(parent),
+    m_target(target),
+    m_recorder(recorder),
+    m_thresholdMs(thresholdMs),
+    m_directory(directory)
+{
+}
+
+StallWatchdog::~StallWatchdog()
+{
+    stop();
+}
+
+void StallWatchdog::stop()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_stopping = true;
+        m_wake.wakeAll();
+    }
+    wait();
+}
+
+void StallWatchdog::run()
+{
+    bool dumped = false;    // текущее зависание уже записано
+    QMutexLocker locker(&m_mutex);
+    while (!m_stopping) {
+        m_wake.wait(&m_mutex, CheckMs);
+        if (m_stopping) break;
+
+        const qint64 since = m_pendingSince.load(std::memory_order_acquire);
+        if (since < 0) {
+            dumped = false;
+            postHeartbeat();
+            continue;
+        }
+        const qint64 lagMs = (m_recorder.nowNs() - since) / 1000000;
+        if (lagMs >= m_thresholdMs && !dumped) {
+            dumped = true;
+            locker.unlock();
+            dump(lagMs);
+            locker.relock();
+        }
+    }
+}
+
+void StallWatchdog::postHeartbeat()
+{
+    m_pendingSince.store(m_recorder.nowNs(), std::memory_order_release);
+    QMetaObject::invokeMethod(m_target, [this]() {
+        m_pendingSince.store(-1, std::memory_order_release);
+    }, Qt::QueuedConnection);
+}
+
+void StallWatchdog::dump(qint64 lagMs)
+{
+    const QVector<FlightRecorder::Event> events = m_recorder.recent();
+    FlightRecorder::Event running;
+    const bool busy = m_recorder.current(running);
+    const qint64 now = m_recorder.nowNs();
+
+    QDir().mkpath(m_directory);
+    const QString path = QDir(m_directory).filePath(
+        "stall-" + QDateTime::currentDateTime().toString("yyyyMMdd-hhmmss-zzz") + ".txt");
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        qDebug() << "Stall watchdog: cannot write" << path;
+        return;
+    }
+
+    QTextStream out(&file);
+    out << "Event loop stalled for " << lagMs << " ms (threshold " << m_thresholdMs << " ms)\n";
+    if (busy) {
+        out << "Running now: " << running.handler << ' ' << running.type << " room " << running.room
+            << " for " << (now - running.startNs) / 1000000 << " ms\n";
+    } else {
+        out << "Running now: nothing recorded (outside instrumented handlers)\n";
+    }
+
+    // Сводка по обработчикам из того же кольца: сколько раз, сколько всего, самый долгий
+    struct Totals {
+        int count = 0;
+        qint64 totalNs = 0;
+        qint64 maxNs = 0;
+        qint64 bytes = 0;
+    };
+    QHash<QString, Totals> totals;
+    for (const FlightRecorder::Event &event : events) {
+        const QString key = event.type[0] ? QString("%1 %2").arg(event.handler, event.type)
+                                          : QString(event.handler);
+        Totals &t = totals[key];
+        ++t.count;
+        t.totalNs += event.durationNs;
+        t.maxNs = qMax(t.maxNs, event.durationNs);
+        t.bytes += event.bytesWritten;
+    }
+    out << "\nPer handler over the last " << events.size() << " events:\n";
+    for (auto it = totals.begin(); it != totals.end(); ++it) {
+        out << "  " << it.key() << ": count " << it->count
+            << ", total " << it->totalNs / 1000 << " us, max " << it->maxNs / 1000
+            << " us, " << it->bytes << " bytes\n";
+    }
+
+    out << "\nRecent events, oldest first (ms before the dump):\n";
+    for (const FlightRecorder::Event &event : events) {
+        out << "  -" << QString::number((now - event.startNs) / 1e6, 'f', 3)
+            << "  " << event.handler << ' ' << event.type << "  room " << event.room
+            << "  " << event.durationNs / 1000 << " us  " << event.bytesWritten << " bytes\n";
+    }
+    file.close();
+    qDebug() << "Event loop stalled for" << lagMs << "ms, flight recorder written to" << path;
+}
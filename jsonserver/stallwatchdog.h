@@ -0,0 +1,47 @@
+#ifndef STALLWATCHDOG_H
+#define STALLWATCHDOG_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QString>
+#include <atomic>
+#include "flightrecorder.h"
+
+// Сторожевой поток цикла событий. Каждые CheckMs он ставит в цикл событий
+// пустую задачу-пульс и ждет, когда та выполнится. Если пульс не выполнился
+// за thresholdMs, цикл стоит: в файл уходит бортовой самописец (последние
+// обработчики и тот, что выполняется сейчас) и сводка времени по обработчикам.
+// На одно зависание - один файл, пока цикл не оживет.
+class StallWatchdog : public QThread
+{
+    Q_OBJECT
+public:
+    static const int CheckMs = 50;
+
+    // target - объект в потоке цикла событий, которому ставится пульс
+    StallWatchdog(QObject *target, const FlightRecorder &recorder, int thresholdMs,
+                  const QString &directory, QObject *parent = nullptr);
+    ~StallWatchdog() override;
+
+    void stop();
+
+protected:
+    void run() override;
+
+private:
+    void postHeartbeat();
+    void dump(qint64 lagMs);
+
+    QObject *m_target;
+    const FlightRecorder &m_recorder;
+    const int m_thresholdMs;
+    const QString m_directory;
+
+    std::atomic<qint64> m_pendingSince{-1};   // когда поставлен невыполненный пульс, -1 - нет
+    QMutex m_mutex;
+    QWaitCondition m_wake;
+    bool m_stopping = false;
+};
+
+#endif // STALLWATCHDOG_H
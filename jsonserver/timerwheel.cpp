@@ -0,0 +1,181 @@
+#include "timerwheel.h"
+
+TimerWheel::TimerWheel(QObject *parent) : QObject(parent)
+{
+    m_heads.fill(-1, Levels * SlotsPerLevel);
+    m_clock.start();
+    m_tick.setInterval(TickMs);
+    connect(&m_tick, &QTimer::timeout, this, &TimerWheel::advance);
+}
+
+TimerWheel::Handle TimerWheel::start(int delayMs, Callback callback)
+{
+    if (m_active == 0) {
+        // Колесо пустое - догоняем часы без обхода пропущенных тиков
+        m_now = static_cast<quint64>(m_clock.elapsed() / TickMs);
+        m_tick.start();
+    }
+
+    int index;
+    if (!m_freeEntries.isEmpty()) {
+        index = m_freeEntries.takeLast();
+    } else {
+        index = m_entries.size();
+        m_entries.append(Entry());
+    }
+
+    Entry &entry = m_entries[index];
+    entry.callback = std::move(callback);
+    entry.expires = m_now + qMax(1, (delayMs + TickMs - 1) / TickMs);
+    ++entry.generation;
+    place(index);
+    ++m_active;
+    return (static_cast<Handle>(entry.generation) << 32) | static_cast<quint32>(index);
+}
+
+bool TimerWheel::cancel(Handle handle)
+{
+    const int index = entryIndex(handle);
+    if (index < 0) return false;
+
+    if (m_entries[index].slot >= 0) {
+        unlink(index);
+    }
+    release(index);
+    return true;
+}
+
+void TimerWheel::cancel(Handle *handle)
+{
+    cancel(*handle);
+    *handle = 0;
+}
+
+bool TimerWheel::isActive(Handle handle) const
+{
+    return entryIndex(handle) >= 0;
+}
+
+int TimerWheel::remaining(Handle handle) const
+{
+    const int index = entryIndex(handle);
+    if (index < 0) return -1;
+    const quint64 expires = m_entries[index].expires;
+    return expires > m_now ? static_cast<int>((expires - m_now) * TickMs) : 0;
+}
+
+int TimerWheel::entryIndex(Handle handle) const
+{
+    const int index = static_cast<int>(handle & 0xffffffffu);
+    const quint32 generation = static_cast<quint32>(handle >> 32);
+    if (handle == 0 || index >= m_entries.size()) return -1;
+
+    const Entry &entry = m_entries[index];
+    if (entry.generation != generation || entry.slot == FreeSlot) return -1;
+    return index;
+}
+
+void TimerWheel::place(int index)
+{
+    Entry &entry = m_entries[index];
+    const quint64 delta = entry.expires > m_now ? entry.expires - m_now : 0;
+
+    // Уровень - первый, чей охват вмещает задержку; дальше верхнего - на верхний,
+    // при его прокрутке таймер просто положат туда снова
+    int level = 0;
+    while (level < Levels - 1 && delta >= (quint64(1) << (SlotBits * (level + 1)))) {
+        ++level;
+    }
+    const quint64 tick = qMax(entry.expires, m_now);
+    const int slot = level * SlotsPerLevel
+            + static_cast<int>((tick >> (SlotBits * level)) & (SlotsPerLevel - 1));
+
+    entry.slot = slot;
+    entry.prev = -1;
+    entry.next = m_heads[slot];
+    if (entry.next >= 0) {
+        m_entries[entry.next].prev = index;
+    }
+    m_heads[slot] = index;
+}
+
+void TimerWheel::unlink(int index)
+{
+    Entry &entry = m_entries[index];
+    if (entry.prev >= 0) {
+        m_entries[entry.prev].next = entry.next;
+    } else {
+        m_heads[entry.slot] = entry.next;
+    }
+    if (entry.next >= 0) {
+        m_entries[entry.next].prev = entry.prev;
+    }
+    entry.prev = entry.next = -1;
+}
+
+void TimerWheel::release(int index)
+{
+    Entry &entry = m_entries[index];
+    entry.callback = Callback();
+    entry.slot = FreeSlot;
+    ++entry.generation;         // старые handle больше не совпадут
+    m_freeEntries.append(index);
+
+    if (--m_active == 0) {
+        m_tick.stop();
+    }
+}
+
+void TimerWheel::cascade(int level)
+{
+    const int slot = level * SlotsPerLevel
+            + static_cast<int>((m_now >> (SlotBits * level)) & (SlotsPerLevel - 1));
+    int index = m_heads[slot];
+    m_heads[slot] = -1;
+    while (index >= 0) {
+        const int next = m_entries[index].next;
+        place(index);
+        index = next;
+    }
+}
+
+void TimerWheel::advance()
+{
+    const quint64 target = static_cast<quint64>(m_clock.elapsed() / TickMs);
+
+    // Сначала собираем все, что истекло за пропущенные тики, потом вызываем:
+    // обработчик может запускать и отменять таймеры, не ломая обход ячеек
+    QVector<Handle> expired;
+    while (m_now < target && m_active > 0) {
+        ++m_now;
+        for (int level = 1; level < Levels; ++level) {
+            if (m_now & ((quint64(1) << (SlotBits * level)) - 1)) break;
+            cascade(level);
+        }
+
+        const int slot = static_cast<int>(m_now & (SlotsPerLevel - 1));
+        int index = m_heads[slot];
+        m_heads[slot] = -1;
+        while (index >= 0) {
+            Entry &entry = m_entries[index];
+            const int next = entry.next;
+            entry.slot = ExpiringSlot;
+            entry.prev = entry.next = -1;
+            expired.append((static_cast<Handle>(entry.generation) << 32) | static_cast<quint32>(index));
+            index = next;
+        }
+    }
+    if (m_active == 0) {
+        m_now = target;
+    }
+
+    for (Handle handle : expired) {
+        // Таймер мог отменить обработчик, сработавший раньше в этой же пачке
+        const int index = entryIndex(handle);
+        if (index < 0) continue;
+
+        Callback callback = std::move(m_entries[index].callback);
+        release(index);
+        callback();
+    }
+}
@@ -0,0 +1,74 @@
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include <QObject>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QVector>
+#include <functional>
+
+// Иерархическое колесо таймеров: все игровые таймеры потока (раунд, пауза
+// между раундами, ожидание resume) срабатывают от одного QTimer с шагом TickMs.
+// Запуск и отмена - O(1): таймер лежит в двусвязном списке своей ячейки.
+// Уровень 0 - ближайшие 64 тика, каждый следующий в 64 раза грубее; когда
+// время доходит до ячейки верхнего уровня, ее таймеры опускаются ниже.
+//
+// Handle содержит поколение записи: после срабатывания или отмены запись
+// получает новое поколение, и старый handle уже ничего не отменит и не запустит.
+class TimerWheel : public QObject
+{
+    Q_OBJECT
+public:
+    typedef quint64 Handle;     // 0 - нет таймера
+    typedef std::function<void()> Callback;
+
+    static const int TickMs = 50;
+
+    explicit TimerWheel(QObject *parent = nullptr);
+
+    Handle start(int delayMs, Callback callback);
+    // false - таймер уже сработал или отменен
+    bool cancel(Handle handle);
+    // Отменяет и обнуляет handle - удобно для полей-членов
+    void cancel(Handle *handle);
+    bool isActive(Handle handle) const;
+    // Сколько осталось до срабатывания (с точностью до тика), -1 - таймера нет
+    int remaining(Handle handle) const;
+
+    int activeCount() const { return m_active; }
+
+private:
+    static const int SlotBits = 6;
+    static const int SlotsPerLevel = 1 << SlotBits;
+    static const int Levels = 4;    // 64 тика, 3.2 с, 3.4 мин, 3.6 ч при TickMs = 50
+
+    static const int FreeSlot = -1;
+    static const int ExpiringSlot = -2; // сработал в текущей пачке, ждет вызова
+
+    struct Entry {
+        Callback callback;
+        quint64 expires = 0;    // номер тика
+        quint32 generation = 0;
+        int slot = FreeSlot;
+        int prev = -1;
+        int next = -1;
+    };
+
+    int entryIndex(Handle handle) const;
+    void place(int index);
+    void unlink(int index);
+    void release(int index);
+    void cascade(int level);
+    void advance();
+
+    QVector<Entry> m_entries;
+    QVector<int> m_freeEntries;
+    QVector<int> m_heads;       // первая запись ячейки, Levels * SlotsPerLevel
+    quint64 m_now = 0;          // текущий тик
+    int m_active = 0;
+
+    QElapsedTimer m_clock;
+    QTimer m_tick;              // работает, только пока есть таймеры
+};
+
+#endif // TIMERWHEEL_H
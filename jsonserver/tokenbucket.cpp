@@ -0,0 +1,36 @@
+#include "tokenbucket.h"
+
+TokenBucket::TokenBucket(double ratePerSecond, double burst) :
+    m_rate(ratePerSecond),
+    m_burst(burst),
+    m_tokens(burst)
+{
+}
+
+bool TokenBucket::tryTake(double cost, qint64 nowMs)
+{
+    refill(nowMs);
+    if (m_tokens < cost) return false;
+    m_tokens -= cost;
+    return true;
+}
+
+void TokenBucket::take(double cost, qint64 nowMs)
+{
+    refill(nowMs);
+    m_tokens -= cost;
+}
+
+double TokenBucket::available(qint64 nowMs)
+{
+    refill(nowMs);
+    return m_tokens;
+}
+
+void TokenBucket::refill(qint64 nowMs)
+{
+    if (m_updatedMs >= 0 && nowMs > m_updatedMs) {
+        m_tokens = qMin(m_burst, m_tokens + (nowMs - m_updatedMs) * m_rate / 1000.0);
+    }
+    m_updatedMs = nowMs;
+}
@@ -0,0 +1,29 @@
+#ifndef TOKENBUCKET_H
+#define TOKENBUCKET_H
+
+#include <QtGlobal>
+
+// Ведро жетонов: пополняется со скоростью rate в секунду до burst.
+// Время передается снаружи (мс от общего QElapsedTimer), чтобы все ведра
+// сервера жили по одним часам и не спрашивали их каждое отдельно
+class TokenBucket
+{
+public:
+    TokenBucket(double ratePerSecond = 0, double burst = 0);
+
+    // Берет cost, только если хватает; иначе ничего не меняет
+    bool tryTake(double cost, qint64 nowMs);
+    // Берет в долг: для команд, которые нельзя выбросить (конец начатого штриха)
+    void take(double cost, qint64 nowMs);
+    double available(qint64 nowMs);
+
+private:
+    void refill(qint64 nowMs);
+
+    double m_rate;
+    double m_burst;
+    double m_tokens;
+    qint64 m_updatedMs = -1;
+};
+
+#endif // TOKENBUCKET_H
@@ -0,0 +1,305 @@
+#include "worddictionary.h"
+#include <QSaveFile>
+#include <QHash>
+#include <QVector>
+#include <QTimer>
+#include <QFileInfo>
+#include <QtEndian>
+#include <QDebug>
+
+namespace {
+
+quint32 readU32(const uchar *data) { return qFromLittleEndian<quint32>(data); }
+quint16 readU16(const uchar *data) { return qFromLittleEndian<quint16>(data); }
+
+void appendU32(QByteArray &out, quint32 value)
+{
+    uchar bytes[4];
+    qToLittleEndian(value, bytes);
+    out.append(reinterpret_cast<const char *>(bytes), 4);
+}
+
+void appendU16(QByteArray &out, quint16 value)
+{
+    uchar bytes[2];
+    qToLittleEndian(value, bytes);
+    out.append(reinterpret_cast<const char *>(bytes), 2);
+}
+
+}
+
+WordDictionary::~WordDictionary()
+{
+    if (m_data) m_file.unmap(const_cast<uchar *>(m_data));
+}
+
+QSharedPointer<const WordDictionary> WordDictionary::open(const QString &path)
+{
+    QSharedPointer<WordDictionary> dictionary(new WordDictionary);
+    dictionary->m_file.setFileName(path);
+    if (!dictionary->m_file.open(QIODevice::ReadOnly)) {
+        qDebug() << "Dictionary: cannot open" << path;
+        return QSharedPointer<const WordDictionary>();
+    }
+    dictionary->m_size = dictionary->m_file.size();
+    if (dictionary->m_size < HeaderSize) {
+        qDebug() << "Dictionary: file is too short" << path;
+        return QSharedPointer<const WordDictionary>();
+    }
+    dictionary->m_data = dictionary->m_file.map(0, dictionary->m_size);
+    if (!dictionary->m_data || !dictionary->validate()) {
+        qDebug() << "Dictionary: broken file" << path;
+        return QSharedPointer<const WordDictionary>();
+    }
+    return dictionary;
+}
+
+bool WordDictionary::validate()
+{
+    const uchar *h = m_data;
+    if (readU32(h) != Magic || readU32(h + 4) != Version) return false;
+    m_wordCount = readU32(h + 8);
+    m_categoryCount = readU32(h + 12);
+    m_languageCount = readU32(h + 16);
+    const quint64 wordsOffset = readU32(h + 20);
+    const quint64 categoriesOffset = readU32(h + 24);
+    const quint64 languagesOffset = readU32(h + 28);
+    const quint64 stringsOffset = readU32(h + 32);
+    m_stringsSize = readU32(h + 36);
+
+    // Таблицы должны целиком лежать в файле; дальше к ним обращаемся без проверок
+    const quint64 size = static_cast<quint64>(m_size);
+    if (wordsOffset + quint64(m_wordCount) * WordEntrySize > size
+            || categoriesOffset + quint64(m_categoryCount) * CategoryEntrySize > size
+            || languagesOffset + quint64(m_languageCount) * LanguageEntrySize > size
+            || stringsOffset + m_stringsSize > size
+            || m_languageCount > 256) {
+        return false;
+    }
+    m_words = m_data + wordsOffset;
+    m_categories = m_data + categoriesOffset;
+    m_languages = m_data + languagesOffset;
+    m_strings = m_data + stringsOffset;
+
+    for (quint32 i = 0; i < m_wordCount; ++i) {
+        const uchar *entry = m_words + i * WordEntrySize;
+        if (quint64(readU32(entry)) + readU16(entry + 4) > m_stringsSize) return false;
+        if (readU16(entry + 4) == 0 || entry[7] >= m_languageCount) return false;
+    }
+    for (quint32 i = 0; i < m_categoryCount; ++i) {
+        const uchar *entry = m_categories + i * CategoryEntrySize;
+        if (quint64(readU32(entry)) + readU16(entry + 4) > m_stringsSize) return false;
+        if (quint64(readU32(entry + 8)) + readU32(entry + 12) > m_wordCount) return false;
+    }
+    for (quint32 i = 0; i < m_languageCount; ++i) {
+        const uchar *entry = m_languages + i * LanguageEntrySize;
+        if (quint64(readU32(entry)) + readU16(entry + 4) > m_stringsSize) return false;
+    }
+    return true;
+}
+
+QString WordDictionary::string(quint32 offset, quint32 length) const
+{
+    return QString::fromUtf8(reinterpret_cast<const char *>(m_strings + offset), static_cast<int>(length));
+}
+
+int WordDictionary::findCategory(const QString &name) const
+{
+    for (quint32 i = 0; i < m_categoryCount; ++i) {
+        const uchar *entry = m_categories + i * CategoryEntrySize;
+        if (string(readU32(entry), readU16(entry + 4)).compare(name, Qt::CaseInsensitive) == 0) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+void WordDictionary::categoryRange(int category, int &first, int &count) const
+{
+    const uchar *entry = m_categories + category * CategoryEntrySize;
+    first = static_cast<int>(readU32(entry + 8));
+    count = static_cast<int>(readU32(entry + 12));
+}
+
+int WordDictionary::findLanguage(const QString &name) const
+{
+    for (quint32 i = 0; i < m_languageCount; ++i) {
+        const uchar *entry = m_languages + i * LanguageEntrySize;
+        if (string(readU32(entry), readU16(entry + 4)).compare(name, Qt::CaseInsensitive) == 0) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+WordDictionary::Word WordDictionary::word(int index) const
+{
+    const uchar *entry = m_words + index * WordEntrySize;
+    QStringList parts = string(readU32(entry), readU16(entry + 4)).split('|');
+    Word word;
+    word.text = parts.takeFirst();
+    word.aliases = parts;
+    word.difficulty = entry[6];
+    word.language = entry[7];
+    return word;
+}
+
+bool WordDictionary::compile(const QString &sourcePath, const QString &targetPath, QString *error)
+{
+    QFile source(sourcePath);
+    if (!source.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        *error = "cannot open " + sourcePath;
+        return false;
+    }
+
+    struct Entry {
+        QByteArray text;
+        int difficulty;
+        int language;
+    };
+    // Категории в порядке первого появления, слова внутри - в порядке файла
+    QStringList categories;
+    QHash<QString, QVector<Entry>> byCategory;
+    QStringList languages;
+    int lineNumber = 0;
+    while (!source.atEnd()) {
+        const QString line = QString::fromUtf8(source.readLine()).trimmed();
+        ++lineNumber;
+        if (line.isEmpty() || line.startsWith('#')) continue;
+
+        const QStringList fields = line.split('\t');
+        bool ok = false;
+        const int difficulty = fields.size() == 4 ? fields[1].toInt(&ok) : 0;
+        if (!ok || difficulty < 0 || difficulty > 255 || fields[3].trimmed().isEmpty()) {
+            *error = QString("line %1: expected category<TAB>difficulty<TAB>language<TAB>word").arg(lineNumber);
+            return false;
+        }
+        const QByteArray text = fields[3].trimmed().toUtf8();
+        if (text.size() > 0xFFFF) {
+            *error = QString("line %1: word is too long").arg(lineNumber);
+            return false;
+        }
+        const QString category = fields[0].trimmed();
+        const QString language = fields[2].trimmed();
+        int languageIndex = languages.indexOf(language);
+        if (languageIndex < 0) {
+            if (languages.size() == 256) {
+                *error = QString("line %1: more than 256 languages").arg(lineNumber);
+                return false;
+            }
+            languageIndex = languages.size();
+            languages.append(language);
+        }
+        if (!byCategory.contains(category)) categories.append(category);
+        byCategory[category].append(Entry{text, difficulty, languageIndex});
+    }
+
+    QByteArray strings;
+    QByteArray words;
+    QByteArray categoryTable;
+    QByteArray languageTable;
+    quint32 wordCount = 0;
+    for (const QString &category : categories) {
+        const QByteArray name = category.toUtf8();
+        appendU32(categoryTable, strings.size());
+        appendU16(categoryTable, static_cast<quint16>(name.size()));
+        appendU16(categoryTable, 0);
+        strings += name;
+        appendU32(categoryTable, wordCount);
+        appendU32(categoryTable, byCategory[category].size());
+        for (const Entry &entry : byCategory[category]) {
+            appendU32(words, strings.size());
+            appendU16(words, static_cast<quint16>(entry.text.size()));
+            words.append(static_cast<char>(entry.difficulty));
+            words.append(static_cast<char>(entry.language));
+            strings += entry.text;
+            ++wordCount;
+        }
+    }
+    for (const QString &language : languages) {
+        const QByteArray name = language.toUtf8();
+        appendU32(languageTable, strings.size());
+        appendU16(languageTable, static_cast<quint16>(name.size()));
+        appendU16(languageTable, 0);
+        strings += name;
+    }
+
+    QByteArray out;
+    const quint32 wordsOffset = HeaderSize;
+    const quint32 categoriesOffset = wordsOffset + words.size();
+    const quint32 languagesOffset = categoriesOffset + categoryTable.size();
+    const quint32 stringsOffset = languagesOffset + languageTable.size();
+    appendU32(out, Magic);
+    appendU32(out, Version);
+    appendU32(out, wordCount);
+    appendU32(out, categories.size());
+    appendU32(out, languages.size());
+    appendU32(out, wordsOffset);
+    appendU32(out, categoriesOffset);
+    appendU32(out, languagesOffset);
+    appendU32(out, stringsOffset);
+    appendU32(out, strings.size());
+    out += words + categoryTable + languageTable + strings;
+
+    // Временный файл и переименование: работающий сервер увидит либо старый словарь, либо новый
+    QSaveFile target(targetPath);
+    if (!target.open(QIODevice::WriteOnly) || target.write(out) != out.size() || !target.commit()) {
+        *error = "cannot write " + targetPath;
+        return false;
+    }
+    qDebug() << "Dictionary" << targetPath << ":" << wordCount << "words," << categories.size()
+             << "categories," << languages.size() << "languages";
+    return true;
+}
+
+DictionaryStore::DictionaryStore(QObject *parent) : QObject(parent)
+{
+    connect(&m_watcher, &QFileSystemWatcher::fileChanged, this, &DictionaryStore::onFileChanged);
+    // Переименование поверх файла видно как изменение каталога
+    connect(&m_watcher, &QFileSystemWatcher::directoryChanged, this, &DictionaryStore::onFileChanged);
+}
+
+bool DictionaryStore::load(const QString &path)
+{
+    m_path = path;
+    m_current = WordDictionary::open(path);
+    const QFileInfo info(path);
+    m_loadedModified = info.lastModified();
+    m_loadedSize = info.size();
+    m_watcher.addPath(path);
+    m_watcher.addPath(QFileInfo(path).absolutePath());
+    if (m_current) {
+        qDebug() << "Dictionary loaded:" << m_current->size() << "words from" << path;
+    }
+    return !m_current.isNull();
+}
+
+void DictionaryStore::onFileChanged()
+{
+    // Изменения приходят пачкой: перечитываем один раз, когда запись утихла
+    if (m_reloadPending) return;
+    m_reloadPending = true;
+    QTimer::singleShot(ReloadDelayMs, this, &DictionaryStore::reload);
+}
+
+void DictionaryStore::reload()
+{
+    m_reloadPending = false;
+    // Старый файл после замены наблюдатель забывает
+    if (!m_watcher.files().contains(m_path)) m_watcher.addPath(m_path);
+
+    const QFileInfo info(m_path);
+    if (m_current && info.exists() && info.lastModified() == m_loadedModified && info.size() == m_loadedSize) {
+        return;
+    }
+    QSharedPointer<const WordDictionary> next = WordDictionary::open(m_path);
+    if (!next) {
+        qDebug() << "Dictionary reload failed, keeping the previous one";
+        return;
+    }
+    m_current = next;
+    m_loadedModified = info.lastModified();
+    m_loadedSize = info.size();
+    qDebug() << "Dictionary reloaded:" << m_current->size() << "words";
+    emit reloaded();
+}
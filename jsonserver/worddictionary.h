@@ -0,0 +1,109 @@
+#ifndef WORDDICTIONARY_H
+#define WORDDICTIONARY_H
+
+#include <QObject>
+#include <QFile>
+#include <QString>
+#include <QStringList>
+#include <QSharedPointer>
+#include <QFileSystemWatcher>
+#include <QDateTime>
+
+// Словарь слов в компактном бинарном файле. Файл отображается в память только
+// для чтения: комнаты и процессы сервера делят одни и те же страницы кэша ОС,
+// а слово декодируется из UTF-8 только когда выбрано.
+//
+// Формат (все числа little-endian):
+//   заголовок: magic, version, wordCount, categoryCount, languageCount,
+//              wordsOffset, categoriesOffset, languagesOffset, stringsOffset, stringsSize
+//   слово (8 байт): textOffset u32, textLength u16, difficulty u8, language u8
+//   категория (16 байт): nameOffset u32, nameLength u16, 0 u16, firstWord u32, wordCount u32
+//   язык (8 байт): nameOffset u32, nameLength u16, 0 u16
+//   строки: UTF-8, текст слова - "слово|вариант|вариант"
+// Слова отсортированы по категориям, так что категория - это диапазон номеров.
+class WordDictionary
+{
+public:
+    static const quint32 Magic = 0x44524357;   // "WCRD"
+    static const quint32 Version = 1;
+
+    struct Word {
+        QString text;
+        QStringList aliases;    // другие принятые ответы
+        int difficulty = 0;
+        int language = 0;
+    };
+
+    ~WordDictionary();
+
+    // nullptr, если файла нет или он поврежден
+    static QSharedPointer<const WordDictionary> open(const QString &path);
+    // Собирает словарь из текста: строки "категория<TAB>сложность<TAB>язык<TAB>слово|вариант",
+    // пустые строки и строки с '#' пропускаются. Файл заменяется атомарно
+    static bool compile(const QString &sourcePath, const QString &targetPath, QString *error);
+
+    int size() const { return static_cast<int>(m_wordCount); }
+    int findCategory(const QString &name) const;   // -1, если нет
+    void categoryRange(int category, int &first, int &count) const;
+    int findLanguage(const QString &name) const;   // -1, если нет
+
+    int difficulty(int index) const { return m_words[index * WordEntrySize + 6]; }
+    int language(int index) const { return m_words[index * WordEntrySize + 7]; }
+    Word word(int index) const;
+
+private:
+    static const int HeaderSize = 40;
+    static const int WordEntrySize = 8;
+    static const int CategoryEntrySize = 16;
+    static const int LanguageEntrySize = 8;
+
+    WordDictionary() = default;
+    bool validate();
+    QString string(quint32 offset, quint32 length) const;
+
+    QFile m_file;
+    const uchar *m_data = nullptr;
+    qint64 m_size = 0;
+    quint32 m_wordCount = 0;
+    quint32 m_categoryCount = 0;
+    quint32 m_languageCount = 0;
+    const uchar *m_words = nullptr;
+    const uchar *m_categories = nullptr;
+    const uchar *m_languages = nullptr;
+    const uchar *m_strings = nullptr;
+    quint32 m_stringsSize = 0;
+};
+
+// Текущий словарь процесса. При замене файла (compile делает ее атомарной)
+// новый словарь открывается и проверяется целиком, и только потом подменяет
+// старый. Комната, которая держит старый словарь, дорабатывает с ним: его
+// отображение живет, пока на него есть ссылка
+class DictionaryStore : public QObject
+{
+    Q_OBJECT
+public:
+    static const int ReloadDelayMs = 200;
+
+    explicit DictionaryStore(QObject *parent = nullptr);
+
+    bool load(const QString &path);
+    QSharedPointer<const WordDictionary> current() const { return m_current; }
+
+signals:
+    void reloaded();
+
+private slots:
+    void onFileChanged();
+
+private:
+    void reload();
+
+    QString m_path;
+    QFileSystemWatcher m_watcher;
+    QSharedPointer<const WordDictionary> m_current;
+    QDateTime m_loadedModified;     // по ним отличаем замену словаря от других файлов каталога
+    qint64 m_loadedSize = -1;
+    bool m_reloadPending = false;
+};
+
+#endif // WORDDICTIONARY_H
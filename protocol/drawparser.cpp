@@ -0,0 +1,320 @@
+#include "drawparser.h"
+#include <limits.h>
+#include <string.h>
+
+namespace Protocol {
+
+namespace {
+
+enum Field {
+    HasType = 1 << 0,
+    HasX = 1 << 1,
+    HasY = 1 << 2,
+    HasX1 = 1 << 3,
+    HasY1 = 1 << 4,
+    HasX2 = 1 << 5,
+    HasY2 = 1 << 6,
+    HasWidth = 1 << 7,
+    HasColor = 1 << 8
+};
+
+bool isSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+bool isKey(const char *key, int length, const char *name)
+{
+    return length == static_cast<int>(strlen(name)) && memcmp(key, name, length) == 0;
+}
+
+struct Reader {
+    const char *p;
+    const char *end;
+
+    void skipSpace()
+    {
+        while (p < end && isSpace(*p)) ++p;
+    }
+
+    bool consume(char c)
+    {
+        skipSpace();
+        if (p == end || *p != c) return false;
+        ++p;
+        return true;
+    }
+
+    // Строка без escape-последовательностей: с ними - обычный разбор
+    bool string(const char *&begin, int &length)
+    {
+        if (!consume('"')) return false;
+        const char *close = static_cast<const char *>(memchr(p, '"', end - p));
+        if (!close || memchr(p, '\\', close - p)) return false;
+        begin = p;
+        length = static_cast<int>(close - p);
+        p = close + 1;
+        return true;
+    }
+
+    bool integer(qint64 &value)
+    {
+        skipSpace();
+        const bool negative = p < end && *p == '-';
+        if (negative) ++p;
+        const char *start = p;
+        qint64 magnitude = 0;
+        while (p < end && *p >= '0' && *p <= '9') {
+            if (p - start == 18) return false;
+            magnitude = magnitude * 10 + (*p - '0');
+            ++p;
+        }
+        if (p == start || (*start == '0' && p - start > 1)) return false;
+        // Дробная часть и экспонента - не схема команды
+        if (p < end && (*p == '.' || *p == 'e' || *p == 'E')) return false;
+        value = negative ? -magnitude : magnitude;
+        return true;
+    }
+
+    bool integer(int &value)
+    {
+        qint64 wide;
+        if (!integer(wide) || wide < INT_MIN || wide > INT_MAX) return false;
+        value = static_cast<int>(wide);
+        return true;
+    }
+};
+
+bool parseColor(const char *s, int length, quint32 &color)
+{
+    if (length != 7 || s[0] != '#') return false;
+    quint32 rgb = 0;
+    for (int i = 1; i < 7; ++i) {
+        const char c = s[i];
+        int digit;
+        if (c >= '0' && c <= '9') digit = c - '0';
+        else if (c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') digit = c - 'A' + 10;
+        else return false;
+        rgb = (rgb << 4) | static_cast<quint32>(digit);
+    }
+    color = 0xFF000000 | rgb;
+    return true;
+}
+
+// trace - десятичное quint64 строкой; переполнение - не наш формат
+bool parseDecimal(const char *s, int length, quint64 &value)
+{
+    if (length == 0 || length > 20) return false;
+    quint64 result = 0;
+    for (int i = 0; i < length; ++i) {
+        if (s[i] < '0' || s[i] > '9') return false;
+        const quint64 digit = static_cast<quint64>(s[i] - '0');
+        if (result > (~quint64(0) - digit) / 10) return false;
+        result = result * 10 + digit;
+    }
+    value = result;
+    return true;
+}
+
+struct Writer {
+    char *p;
+    char *end;
+    bool overflow = false;
+
+    void raw(const char *text)
+    {
+        const size_t length = strlen(text);
+        if (overflow || static_cast<size_t>(end - p) < length) {
+            overflow = true;
+            return;
+        }
+        memcpy(p, text, length);
+        p += length;
+    }
+
+    void number(quint64 value, bool negative = false)
+    {
+        char digits[24];
+        int count = 0;
+        do {
+            digits[count++] = static_cast<char>('0' + value % 10);
+            value /= 10;
+        } while (value);
+        if (negative) digits[count++] = '-';
+        if (overflow || end - p < count) {
+            overflow = true;
+            return;
+        }
+        while (count) *p++ = digits[--count];
+    }
+
+    void number(qint64 value)
+    {
+        if (value < 0) number(0 - static_cast<quint64>(value), true);
+        else number(static_cast<quint64>(value), false);
+    }
+
+    void color(quint32 argb)
+    {
+        static const char Hex[] = "0123456789abcdef";
+        if (overflow || end - p < 7) {
+            overflow = true;
+            return;
+        }
+        *p++ = '#';
+        for (int shift = 20; shift >= 0; shift -= 4) *p++ = Hex[(argb >> shift) & 0xF];
+    }
+};
+
+}
+
+bool parseDraw(const char *data, int size, DrawCommand &command, qint64 &seq)
+{
+    Reader in{data, data + size};
+    if (!in.consume('{')) return false;
+
+    command = DrawCommand();
+    seq = -1;
+    unsigned fields = 0;
+    int x = 0;
+    int y = 0;
+    const char *text;
+    int length;
+
+    if (!in.consume('}')) {
+        do {
+            const char *key;
+            int keyLength;
+            if (!in.string(key, keyLength) || !in.consume(':')) return false;
+
+            switch (keyLength) {
+            case 1:
+                if (*key == 'x') { if (!in.integer(x)) return false; fields |= HasX; }
+                else if (*key == 'y') { if (!in.integer(y)) return false; fields |= HasY; }
+                else return false;
+                break;
+            case 2:
+                if (isKey(key, 2, "x1")) { if (!in.integer(command.x1)) return false; fields |= HasX1; }
+                else if (isKey(key, 2, "y1")) { if (!in.integer(command.y1)) return false; fields |= HasY1; }
+                else if (isKey(key, 2, "x2")) { if (!in.integer(command.x2)) return false; fields |= HasX2; }
+                else if (isKey(key, 2, "y2")) { if (!in.integer(command.y2)) return false; fields |= HasY2; }
+                else return false;
+                break;
+            case 3:
+                if (!isKey(key, 3, "seq") || !in.integer(seq) || seq < 0) return false;
+                break;
+            case 4:
+                if (!in.string(text, length)) return false;
+                if (isKey(key, 4, "type")) {
+                    if (messageType(text, length) != MessageType::Draw) return false;
+                    fields |= HasType;
+                } else if (isKey(key, 4, "tool")) {
+                    command.tool = tool(text, length);
+                    if (command.tool == Tool::Unknown) return false;
+                } else {
+                    return false;
+                }
+                break;
+            case 5:
+                if (isKey(key, 5, "width")) {
+                    if (!in.integer(command.width)) return false;
+                    fields |= HasWidth;
+                } else if (isKey(key, 5, "color")) {
+                    if (!in.string(text, length) || !parseColor(text, length, command.color)) return false;
+                    fields |= HasColor;
+                } else if (isKey(key, 5, "trace")) {
+                    if (!in.string(text, length) || !parseDecimal(text, length, command.trace)) return false;
+                } else {
+                    return false;
+                }
+                break;
+            case 6:
+                if (!isKey(key, 6, "action") || !in.string(text, length)) return false;
+                command.action = drawAction(text, length);
+                if (command.action == DrawAction::None) return false;
+                break;
+            default:
+                // В том числе "text": ему нужна QString - это работа обычного разбора
+                return false;
+            }
+        } while (in.consume(','));
+        if (!in.consume('}')) return false;
+    }
+    in.skipSpace();
+    if (in.p != in.end) return false;
+
+    // Те же требования к полям, что у Json::decode
+    if (!(fields & HasType) || command.tool == Tool::Unknown || command.tool == Tool::Text) return false;
+    if (command.tool == Tool::Clear) {
+        const quint64 trace = command.trace;
+        command = DrawCommand();
+        command.tool = Tool::Clear;
+        command.trace = trace;
+        return true;
+    }
+    if (command.action == DrawAction::None || !(fields & HasColor)) return false;
+    if (command.tool != Tool::Fill && !(fields & HasWidth)) return false;
+    if (command.isPoint()) {
+        if ((fields & (HasX | HasY)) != (HasX | HasY)) return false;
+        command.x1 = x;
+        command.y1 = y;
+        command.x2 = 0;
+        command.y2 = 0;
+    } else if ((fields & (HasX1 | HasY1 | HasX2 | HasY2)) != (HasX1 | HasY1 | HasX2 | HasY2)) {
+        return false;
+    }
+    if (command.tool == Tool::Fill) command.width = 0;
+    return true;
+}
+
+int writeDraw(const DrawCommand &command, qint64 seq, char *out, int capacity)
+{
+    if (command.tool == Tool::Unknown || command.tool == Tool::Text) return -1;
+    if (command.tool != Tool::Clear && command.action == DrawAction::None) return -1;
+
+    Writer w{out, out + capacity};
+    w.raw("{\"type\":\"draw\",\"tool\":\"");
+    w.raw(name(command.tool));
+    w.raw("\"");
+    if (command.tool != Tool::Clear) {
+        w.raw(",\"action\":\"");
+        w.raw(name(command.action));
+        w.raw("\"");
+        if (command.isPoint()) {
+            w.raw(",\"x\":");
+            w.number(qint64(command.x1));
+            w.raw(",\"y\":");
+            w.number(qint64(command.y1));
+        } else {
+            w.raw(",\"x1\":");
+            w.number(qint64(command.x1));
+            w.raw(",\"y1\":");
+            w.number(qint64(command.y1));
+            w.raw(",\"x2\":");
+            w.number(qint64(command.x2));
+            w.raw(",\"y2\":");
+            w.number(qint64(command.y2));
+        }
+        w.raw(",\"color\":\"");
+        w.color(command.color);
+        w.raw("\"");
+        if (command.tool != Tool::Fill) {
+            w.raw(",\"width\":");
+            w.number(qint64(command.width));
+        }
+        if (command.trace) {
+            w.raw(",\"trace\":\"");
+            w.number(command.trace, false);
+            w.raw("\"");
+        }
+    }
+    if (seq >= 0) {
+        w.raw(",\"seq\":");
+        w.number(seq);
+    }
+    w.raw("}");
+    return w.overflow ? -1 : static_cast<int>(w.p - out);
+}
+
+}
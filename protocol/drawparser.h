@@ -0,0 +1,27 @@
+#ifndef DRAWPARSER_H
+#define DRAWPARSER_H
+
+#include "messages.h"
+
+// Быстрый путь для команд рисования - это почти весь трафик комнаты.
+// Строка "draw" разбирается прямо из байтов кадра в DrawCommand, без
+// QJsonDocument, QJsonObject и строковых ключей, и так же пишется обратно.
+// Схема у команды плоская и известная заранее, поэтому разбор - один проход:
+// строки пробегаются memchr (в libc он векторный), числа - только целые.
+// Все, что не укладывается в схему (другой тип, лишние поля, escape в строке,
+// дробное число, текст), быстрый путь не берет: parseDraw вернет false, и строка
+// уходит обычному разбору QJsonDocument с тем же результатом для корректных команд.
+namespace Protocol {
+
+static const int MaxDrawLineBytes = 256;    // с запасом для самой длинной команды
+
+// seq - номер потока комнаты, если он есть в строке, иначе -1
+bool parseDraw(const char *data, int size, DrawCommand &command, qint64 &seq);
+
+// Пишет строку без '\n'; seq < 0 - без номера. -1, если команду так не записать
+// (текст) или не хватило capacity
+int writeDraw(const DrawCommand &command, qint64 seq, char *out, int capacity);
+
+}
+
+#endif // DRAWPARSER_H
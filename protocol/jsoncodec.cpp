@@ -0,0 +1,273 @@
+#include "jsoncodec.h"
+
+namespace Protocol {
+namespace Json {
+
+namespace {
+
+QJsonObject message(MessageType type)
+{
+    QJsonObject object;
+    object["type"] = QLatin1String(name(type));
+    return object;
+}
+
+bool readInt(const QJsonObject &message, const char *key, int &value)
+{
+    const QJsonValue field = message[QLatin1String(key)];
+    if (!field.isDouble()) return false;
+    value = field.toInt();
+    return true;
+}
+
+bool readString(const QJsonObject &message, const char *key, QString &value)
+{
+    const QJsonValue field = message[QLatin1String(key)];
+    if (!field.isString()) return false;
+    value = field.toString();
+    return true;
+}
+
+}
+
+MessageType type(const QJsonObject &message)
+{
+    return messageType(message["type"].toString());
+}
+
+QString colorName(quint32 color)
+{
+    return QString("#%1").arg(color & 0xFFFFFF, 6, 16, QLatin1Char('0'));
+}
+
+bool parseColor(const QString &name, quint32 &color)
+{
+    if (name.size() != 7 || name.at(0) != '#') return false;
+    quint32 rgb = 0;
+    for (int i = 1; i < 7; ++i) {
+        const ushort c = name.at(i).unicode();
+        int digit;
+        if (c >= '0' && c <= '9') digit = c - '0';
+        else if (c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') digit = c - 'A' + 10;
+        else return false;
+        rgb = (rgb << 4) | static_cast<quint32>(digit);
+    }
+    color = 0xFF000000 | rgb;
+    return true;
+}
+
+QJsonObject encode(const DrawCommand &command)
+{
+    QJsonObject object = message(MessageType::Draw);
+    object["tool"] = QLatin1String(name(command.tool));
+    if (command.tool == Tool::Clear) return object;
+
+    object["action"] = QLatin1String(name(command.action));
+    if (command.isPoint()) {
+        object["x"] = command.x1;
+        object["y"] = command.y1;
+    } else {
+        object["x1"] = command.x1;
+        object["y1"] = command.y1;
+        object["x2"] = command.x2;
+        object["y2"] = command.y2;
+    }
+    object["color"] = colorName(command.color);
+    if (command.tool != Tool::Fill) object["width"] = command.width;
+    if (command.tool == Tool::Text) object["text"] = command.text;
+    // Строкой: 64-битный id не помещается в число JSON без потерь
+    if (command.trace) object["trace"] = QString::number(command.trace);
+    return object;
+}
+
+bool decode(const QJsonObject &message, DrawCommand &command)
+{
+    command = DrawCommand();
+    command.tool = tool(message["tool"].toString());
+    if (command.tool == Tool::Unknown) return false;
+    // trace есть и у очистки - как в parseDraw
+    if (message.contains("trace")) command.trace = message["trace"].toString().toULongLong();
+    if (command.tool == Tool::Clear) return true;
+
+    command.action = drawAction(message["action"].toString());
+    if (command.action == DrawAction::None) return false;
+    if (command.isPoint()) {
+        if (!readInt(message, "x", command.x1) || !readInt(message, "y", command.y1)) return false;
+    } else if (!readInt(message, "x1", command.x1) || !readInt(message, "y1", command.y1)
+               || !readInt(message, "x2", command.x2) || !readInt(message, "y2", command.y2)) {
+        return false;
+    }
+    if (!parseColor(message["color"].toString(), command.color)) return false;
+    if (command.tool != Tool::Fill && !readInt(message, "width", command.width)) return false;
+    if (command.tool == Tool::Text && !readString(message, "text", command.text)) return false;
+    return true;
+}
+
+QJsonObject encode(const Guess &guess)
+{
+    QJsonObject object = message(MessageType::Guess);
+    object["text"] = guess.text;
+    return object;
+}
+
+bool decode(const QJsonObject &message, Guess &guess)
+{
+    return readString(message, "text", guess.text);
+}
+
+QJsonObject encode(const Chat &chat)
+{
+    QJsonObject object = message(MessageType::Chat);
+    object["player"] = chat.player;
+    object["text"] = chat.text;
+    return object;
+}
+
+bool decode(const QJsonObject &message, Chat &chat)
+{
+    return readInt(message, "player", chat.player) && readString(message, "text", chat.text);
+}
+
+QJsonObject encode(const CloseGuess &close)
+{
+    QJsonObject object = message(MessageType::Close);
+    object["text"] = close.text;
+    return object;
+}
+
+bool decode(const QJsonObject &message, CloseGuess &close)
+{
+    return readString(message, "text", close.text);
+}
+
+QJsonObject encode(const CorrectGuess &correct)
+{
+    QJsonObject object = message(MessageType::CorrectGuess);
+    object["guesser"] = correct.guesser;
+    object["word"] = correct.word;
+    object["drawer"] = correct.drawer;
+    return object;
+}
+
+bool decode(const QJsonObject &message, CorrectGuess &correct)
+{
+    return readInt(message, "guesser", correct.guesser) && readString(message, "word", correct.word)
+            && readInt(message, "drawer", correct.drawer);
+}
+
+QJsonObject encode(const PlayerJoined &joined)
+{
+    QJsonObject object = message(MessageType::PlayerJoined);
+    object["id"] = joined.id;
+    object["name"] = joined.name;
+    object["score"] = joined.score;
+    return object;
+}
+
+bool decode(const QJsonObject &message, PlayerJoined &joined)
+{
+    return readInt(message, "id", joined.id) && readString(message, "name", joined.name)
+            && readInt(message, "score", joined.score);
+}
+
+QJsonObject encode(const PlayerLeft &left)
+{
+    QJsonObject object = message(MessageType::PlayerLeft);
+    object["id"] = left.id;
+    return object;
+}
+
+bool decode(const QJsonObject &message, PlayerLeft &left)
+{
+    return readInt(message, "id", left.id);
+}
+
+QJsonObject encode(const RoundStart &start)
+{
+    QJsonObject object = message(MessageType::RoundStart);
+    object["drawer"] = start.drawer;
+    object["round"] = start.round;
+    return object;
+}
+
+bool decode(const QJsonObject &message, RoundStart &start)
+{
+    return readInt(message, "drawer", start.drawer) && readInt(message, "round", start.round);
+}
+
+QJsonObject encode(const YourTurn &turn)
+{
+    QJsonObject object = message(MessageType::YourTurn);
+    object["word"] = turn.word;
+    return object;
+}
+
+bool decode(const QJsonObject &message, YourTurn &turn)
+{
+    return readString(message, "word", turn.word);
+}
+
+QJsonObject encode(const RoundEnd &end)
+{
+    QJsonObject object = message(MessageType::RoundEnd);
+    object["scoreSeq"] = end.scoreSeq;
+    return object;
+}
+
+bool decode(const QJsonObject &message, RoundEnd &end)
+{
+    return readInt(message, "scoreSeq", end.scoreSeq);
+}
+
+QJsonObject encode(const GameOver &over)
+{
+    QJsonObject object = message(MessageType::GameOver);
+    object["scoreSeq"] = over.scoreSeq;
+    return object;
+}
+
+bool decode(const QJsonObject &message, GameOver &over)
+{
+    return readInt(message, "scoreSeq", over.scoreSeq);
+}
+
+QJsonObject encode(const Ping &ping)
+{
+    QJsonObject object = message(MessageType::Ping);
+    object["id"] = ping.id;
+    object["t"] = ping.time;
+    return object;
+}
+
+bool decode(const QJsonObject &message, Ping &ping)
+{
+    if (!message["id"].isDouble() || !message["t"].isDouble()) return false;
+    ping.id = static_cast<qint64>(message["id"].toDouble());
+    ping.time = static_cast<qint64>(message["t"].toDouble());
+    return true;
+}
+
+QJsonObject encode(const Pong &pong)
+{
+    QJsonObject object = message(MessageType::Pong);
+    object["id"] = pong.id;
+    object["t"] = pong.time;
+    return object;
+}
+
+bool decode(const QJsonObject &message, Pong &pong)
+{
+    if (!message["id"].isDouble() || !message["t"].isDouble()) return false;
+    pong.id = static_cast<qint64>(message["id"].toDouble());
+    pong.time = static_cast<qint64>(message["t"].toDouble());
+    return true;
+}
+
+QJsonObject encode(MessageType type)
+{
+    return message(type);
+}
+
+}
+}
@@ -0,0 +1,54 @@
+#ifndef JSONCODEC_H
+#define JSONCODEC_H
+
+#include <QJsonObject>
+#include "messages.h"
+
+// Кодек строкового формата: одно сообщение - один компактный JSON-объект
+// в строке. Сжатие deflate - слой ниже, оно получает уже готовые строки.
+// Сервер и клиент собирают и разбирают сообщения только здесь, поэтому
+// имена полей не могут разойтись между ними.
+namespace Protocol {
+namespace Json {
+
+MessageType type(const QJsonObject &message);
+
+QJsonObject encode(const DrawCommand &command);
+QJsonObject encode(const Guess &guess);
+QJsonObject encode(const Chat &chat);
+QJsonObject encode(const CloseGuess &close);
+QJsonObject encode(const CorrectGuess &correct);
+QJsonObject encode(const PlayerJoined &joined);
+QJsonObject encode(const PlayerLeft &left);
+QJsonObject encode(const RoundStart &start);
+QJsonObject encode(const YourTurn &turn);
+QJsonObject encode(const RoundEnd &end);
+QJsonObject encode(const GameOver &over);
+QJsonObject encode(const Ping &ping);
+QJsonObject encode(const Pong &pong);
+// Сообщение без полей, например ChatHidden или ScoresResync
+QJsonObject encode(MessageType type);
+
+// false, если обязательного поля нет или оно не того вида; тип не проверяется
+bool decode(const QJsonObject &message, DrawCommand &command);
+bool decode(const QJsonObject &message, Guess &guess);
+bool decode(const QJsonObject &message, Chat &chat);
+bool decode(const QJsonObject &message, CloseGuess &close);
+bool decode(const QJsonObject &message, CorrectGuess &correct);
+bool decode(const QJsonObject &message, PlayerJoined &joined);
+bool decode(const QJsonObject &message, PlayerLeft &left);
+bool decode(const QJsonObject &message, RoundStart &start);
+bool decode(const QJsonObject &message, YourTurn &turn);
+bool decode(const QJsonObject &message, RoundEnd &end);
+bool decode(const QJsonObject &message, GameOver &over);
+bool decode(const QJsonObject &message, Ping &ping);
+bool decode(const QJsonObject &message, Pong &pong);
+
+// "#rrggbb" <-> ARGB с непрозрачной альфой
+QString colorName(quint32 color);
+bool parseColor(const QString &name, quint32 &color);
+
+}
+}
+
+#endif // JSONCODEC_H
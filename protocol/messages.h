@@ -0,0 +1,90 @@
+#ifndef MESSAGES_H
+#define MESSAGES_H
+
+#include <QString>
+#include "protocol.h"
+
+// Сообщения протокола с полями. Остальные типы (register, resume, playerList,
+// scores и т. п.) пока ходят как QJsonObject, но ветвятся по тому же MessageType
+namespace Protocol {
+
+// Команда рисования. Начало штриха и заливка - одна точка (x1, y1),
+// на проводе это "x"/"y"; отрезки и фигуры - от (x1, y1) до (x2, y2)
+struct DrawCommand {
+    Tool tool = Tool::Unknown;
+    DrawAction action = DrawAction::None;
+    int x1 = 0;
+    int y1 = 0;
+    int x2 = 0;
+    int y2 = 0;
+    int width = 0;
+    quint32 color = 0xFF000000;     // ARGB, на проводе "#rrggbb"
+    quint64 trace = 0;              // id потока трассировки, 0 - нет
+    QString text;                   // только для Tool::Text
+
+    // Одна точка вместо отрезка
+    bool isPoint() const { return action == DrawAction::Start || tool == Tool::Fill; }
+};
+
+struct Guess {
+    QString text;
+};
+
+struct Chat {
+    int player = -1;
+    QString text;
+};
+
+// Почти угадал: видит только автор догадки
+struct CloseGuess {
+    QString text;
+};
+
+struct CorrectGuess {
+    int guesser = -1;
+    QString word;
+    int drawer = -1;
+};
+
+struct PlayerJoined {
+    int id = -1;
+    QString name;
+    int score = 0;
+};
+
+struct PlayerLeft {
+    int id = -1;
+};
+
+struct RoundStart {
+    int drawer = -1;
+    int round = 0;
+};
+
+// Слово уходит только художнику
+struct YourTurn {
+    QString word;
+};
+
+struct RoundEnd {
+    int scoreSeq = 0;
+};
+
+struct GameOver {
+    int scoreSeq = 0;
+};
+
+// Время - по часам клиента, сервер возвращает его в Pong как есть
+struct Ping {
+    qint64 id = 0;
+    qint64 time = 0;
+};
+
+struct Pong {
+    qint64 id = 0;
+    qint64 time = 0;
+};
+
+}
+
+#endif // MESSAGES_H
@@ -0,0 +1,147 @@
+#include "protocol.h"
+
+namespace Protocol {
+
+namespace {
+
+template <typename T>
+struct Entry {
+    const char *name;
+    T value;
+};
+
+// Строки сравниваются как байты: все имена протокола - ASCII
+constexpr int compare(const char *a, int aLength, const char *b)
+{
+    int i = 0;
+    for (; i < aLength && b[i] != '\0'; ++i) {
+        if (a[i] != b[i]) return static_cast<unsigned char>(a[i]) < static_cast<unsigned char>(b[i]) ? -1 : 1;
+    }
+    if (i < aLength) return 1;
+    return b[i] == '\0' ? 0 : -1;
+}
+
+constexpr int length(const char *s)
+{
+    int n = 0;
+    while (s[n] != '\0') ++n;
+    return n;
+}
+
+template <typename T, int N>
+constexpr bool isSorted(const Entry<T> (&table)[N])
+{
+    for (int i = 1; i < N; ++i) {
+        if (compare(table[i - 1].name, length(table[i - 1].name), table[i].name) >= 0) return false;
+    }
+    return true;
+}
+
+template <typename T, int N>
+T find(const Entry<T> (&table)[N], const char *name, int nameLength, T fallback)
+{
+    int low = 0;
+    int high = N;
+    while (low < high) {
+        const int middle = (low + high) / 2;
+        const int order = compare(name, nameLength, table[middle].name);
+        if (order == 0) return table[middle].value;
+        if (order < 0) high = middle;
+        else low = middle + 1;
+    }
+    return fallback;
+}
+
+template <typename T, int N>
+T find(const Entry<T> (&table)[N], const QString &name, T fallback)
+{
+    // Самое длинное имя протокола короче буфера; длиннее - точно не наше
+    char buffer[32];
+    const int size = name.size();
+    if (size > static_cast<int>(sizeof(buffer))) return fallback;
+    for (int i = 0; i < size; ++i) {
+        const ushort c = name.at(i).unicode();
+        if (c > 0x7F) return fallback;
+        buffer[i] = static_cast<char>(c);
+    }
+    return find(table, buffer, size, fallback);
+}
+
+template <typename T, int N>
+const char *nameOf(const Entry<T> (&table)[N], T value)
+{
+    for (const Entry<T> &entry : table) {
+        if (entry.value == value) return entry.name;
+    }
+    return "";
+}
+
+constexpr Entry<MessageType> MessageTypes[] = {
+    {"chat", MessageType::Chat},
+    {"chatHidden", MessageType::ChatHidden},
+    {"close", MessageType::Close},
+    {"compressStart", MessageType::CompressStart},
+    {"correctGuess", MessageType::CorrectGuess},
+    {"draw", MessageType::Draw},
+    {"gameOver", MessageType::GameOver},
+    {"guess", MessageType::Guess},
+    {"migrate", MessageType::Migrate},
+    {"ping", MessageType::Ping},
+    {"playerJoined", MessageType::PlayerJoined},
+    {"playerLeft", MessageType::PlayerLeft},
+    {"playerList", MessageType::PlayerList},
+    {"pong", MessageType::Pong},
+    {"register", MessageType::Register},
+    {"registered", MessageType::Registered},
+    {"resume", MessageType::Resume},
+    {"resumeFailed", MessageType::ResumeFailed},
+    {"resumed", MessageType::Resumed},
+    {"roundEnd", MessageType::RoundEnd},
+    {"roundStart", MessageType::RoundStart},
+    {"scores", MessageType::Scores},
+    {"scoresResync", MessageType::ScoresResync},
+    {"subscribe", MessageType::Subscribe},
+    {"subscribed", MessageType::Subscribed},
+    {"yourTurn", MessageType::YourTurn}
+};
+static_assert(isSorted(MessageTypes), "message types must be sorted by name");
+static_assert(sizeof(MessageTypes) / sizeof(MessageTypes[0]) == int(MessageType::Draw),
+              "every message type needs a name");
+
+constexpr Entry<Tool> Tools[] = {
+    {"clear", Tool::Clear},
+    {"ellipse", Tool::Ellipse},
+    {"fill", Tool::Fill},
+    {"line", Tool::Line},
+    {"pencil", Tool::Pencil},
+    {"rectangle", Tool::Rectangle},
+    {"rubber", Tool::Rubber},
+    {"text", Tool::Text}
+};
+static_assert(isSorted(Tools), "tools must be sorted by name");
+static_assert(sizeof(Tools) / sizeof(Tools[0]) == int(Tool::Clear), "every tool needs a name");
+
+constexpr Entry<DrawAction> DrawActions[] = {
+    {"draw", DrawAction::Draw},
+    {"move", DrawAction::Move},
+    {"release", DrawAction::Release},
+    {"start", DrawAction::Start}
+};
+static_assert(isSorted(DrawActions), "draw actions must be sorted by name");
+static_assert(sizeof(DrawActions) / sizeof(DrawActions[0]) == int(DrawAction::Draw),
+              "every draw action needs a name");
+
+}
+
+MessageType messageType(const QString &name) { return find(MessageTypes, name, MessageType::Unknown); }
+MessageType messageType(const char *name, int length) { return find(MessageTypes, name, length, MessageType::Unknown); }
+Tool tool(const QString &name) { return find(Tools, name, Tool::Unknown); }
+Tool tool(const char *name, int length) { return find(Tools, name, length, Tool::Unknown); }
+DrawAction drawAction(const QString &name) { return find(DrawActions, name, DrawAction::None); }
+DrawAction drawAction(const char *name, int length) { return find(DrawActions, name, length, DrawAction::None); }
+
+const char *name(MessageType type) { return nameOf(MessageTypes, type); }
+const char *name(Tool tool) { return nameOf(Tools, tool); }
+const char *name(DrawAction action) { return nameOf(DrawActions, action); }
+
+}
@@ -0,0 +1,81 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <QString>
+
+// Словарь протокола игры, общий для сервера и клиента. Тип сообщения и
+// инструмент приходят строкой только на проводе: на входе строка один раз
+// превращается в перечисление, и дальше все ветвится через switch.
+// Таблицы имен - отсортированные массивы, порядок проверяется при компиляции,
+// поиск - двоичный, без выделения памяти.
+namespace Protocol {
+
+enum class MessageType {
+    Unknown,
+    // клиент -> сервер
+    Register,
+    Resume,
+    Subscribe,
+    Guess,
+    Ping,
+    ScoresResync,
+    CompressStart,
+    // сервер -> клиент
+    Registered,
+    Resumed,
+    ResumeFailed,
+    Subscribed,
+    PlayerJoined,
+    PlayerLeft,
+    PlayerList,
+    Scores,
+    RoundStart,
+    YourTurn,
+    RoundEnd,
+    GameOver,
+    Chat,
+    Close,
+    ChatHidden,
+    CorrectGuess,
+    Pong,
+    Migrate,
+    // в обе стороны
+    Draw
+};
+
+enum class Tool {
+    Unknown,
+    Pencil,
+    Rubber,
+    Line,
+    Rectangle,
+    Ellipse,
+    Fill,
+    Text,
+    Clear
+};
+
+enum class DrawAction {
+    None,       // у "clear" действия нет
+    Start,
+    Move,
+    Release,
+    Draw        // фигура, заливка или текст целиком
+};
+
+// Unknown / None, если имя не из протокола
+MessageType messageType(const QString &name);
+MessageType messageType(const char *name, int length);
+Tool tool(const QString &name);
+Tool tool(const char *name, int length);
+DrawAction drawAction(const QString &name);
+DrawAction drawAction(const char *name, int length);
+
+// Имя на проводе; для Unknown / None - пустая строка
+const char *name(MessageType type);
+const char *name(Tool tool);
+const char *name(DrawAction action);
+
+}
+
+#endif // PROTOCOL_H
@@ -0,0 +1,18 @@
+QT += core
+QT -= gui
+
+CONFIG += c++17 staticlib
+
+TARGET = protocol
+TEMPLATE = lib
+
+SOURCES += \
+    protocol.cpp \
+    drawparser.cpp \
+    jsoncodec.cpp
+
+HEADERS += \
+    protocol.h \
+    messages.h \
+    drawparser.h \
+    jsoncodec.h
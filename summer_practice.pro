@@ -0,0 +1,12 @@
+# Сервер и клиент вместе с общей библиотекой протокола и автотестами
+TEMPLATE = subdirs
+
+SUBDIRS += \
+    protocol \
+    jsonserver \
+    jsonclient \
+    tests
+
+jsonserver.depends = protocol
+jsonclient.depends = protocol
+tests.depends = protocol
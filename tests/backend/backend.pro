@@ -0,0 +1,27 @@
+QT += core network testlib
+QT -= gui
+
+CONFIG += c++17 console testcase
+CONFIG -= app_bundle
+
+TARGET = tst_backend
+TEMPLATE = app
+
+# Библиотека протокола (../../protocol), собирается первой из summer_practice.pro
+win32:CONFIG(release, debug|release): LIBS += -L$$OUT_PWD/../../protocol/release/ -lprotocol
+else:win32:CONFIG(debug, debug|release): LIBS += -L$$OUT_PWD/../../protocol/debug/ -lprotocol
+else:unix: LIBS += -L$$OUT_PWD/../../protocol/ -lprotocol
+
+INCLUDEPATH += $$PWD/../../protocol
+DEPENDPATH += $$PWD/../../protocol
+
+win32-g++:CONFIG(release, debug|release): PRE_TARGETDEPS += $$OUT_PWD/../../protocol/release/libprotocol.a
+else:win32-g++:CONFIG(debug, debug|release): PRE_TARGETDEPS += $$OUT_PWD/../../protocol/debug/libprotocol.a
+else:win32:!win32-g++:CONFIG(release, debug|release): PRE_TARGETDEPS += $$OUT_PWD/../../protocol/release/protocol.lib
+else:win32:!win32-g++:CONFIG(debug, debug|release): PRE_TARGETDEPS += $$OUT_PWD/../../protocol/debug/protocol.lib
+else:unix: PRE_TARGETDEPS += $$OUT_PWD/../../protocol/libprotocol.a
+
+# Сервер целиком, кроме main.cpp
+include(../../jsonserver/jsonserver.pri)
+
+SOURCES += tst_backend.cpp
@@ -0,0 +1,320 @@
+#include <QtTest>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QJsonDocument>
+#include <QScopedPointer>
+#include "myserver.h"
+#include "connectionbackend.h"
+#include "jsoncodec.h"
+
+using namespace Protocol;
+
+namespace {
+
+const int TimeoutMs = 5000;
+
+// Порт, который только что был свободен. Слушает потом сам backend,
+// QTcpServer нужен только чтобы спросить порт у ядра
+quint16 freePort()
+{
+    QTcpServer probe;
+    if (!probe.listen(QHostAddress::LocalHost, 0)) return 0;
+    return probe.serverPort();
+}
+
+QByteArray line(const QJsonObject &message)
+{
+    return QJsonDocument(message).toJson(QJsonDocument::Compact) + "\n";
+}
+
+QJsonObject registerMessage(const QString &name)
+{
+    QJsonObject message = Json::encode(MessageType::Register);
+    message["name"] = name;
+    return message;
+}
+
+QJsonObject ping(qint64 id)
+{
+    Ping ping;
+    ping.id = id;
+    ping.time = 1000 * id;
+    return Json::encode(ping);
+}
+
+// Клиент в одном потоке с сервером: ждет только через цикл событий
+// (qWaitFor), блокирующие waitFor* остановили бы и сервер
+class Client
+{
+public:
+    bool connectTo(quint16 port)
+    {
+        m_socket.connectToHost(QHostAddress::LocalHost, port);
+        return QTest::qWaitFor([this]() { return m_socket.state() == QAbstractSocket::ConnectedState; },
+                               TimeoutMs);
+    }
+
+    void send(const QJsonObject &message) { sendRaw(line(message)); }
+
+    void sendRaw(const QByteArray &bytes)
+    {
+        m_socket.write(bytes);
+        m_socket.flush();
+    }
+
+    // По байту с проходом цикла событий после каждого: сервер получает строку кусками
+    void sendByBytes(const QByteArray &bytes)
+    {
+        for (char byte : bytes) {
+            sendRaw(QByteArray(1, byte));
+            QTest::qWait(1);
+        }
+    }
+
+    // Первое еще не взятое сообщение типа type; остальные ждут своей очереди
+    QJsonObject waitFor(MessageType type)
+    {
+        QJsonObject found;
+        QTest::qWaitFor([&]() { return take(type, found); }, TimeoutMs);
+        return found;
+    }
+
+    int registerAs(const QString &name)
+    {
+        send(registerMessage(name));
+        const QJsonObject registered = waitFor(MessageType::Registered);
+        return registered["success"].toBool() ? registered["id"].toInt() : -1;
+    }
+
+    QTcpSocket &socket() { return m_socket; }
+
+private:
+    bool take(MessageType type, QJsonObject &found)
+    {
+        m_buffer.append(m_socket.readAll());
+        int pos;
+        while ((pos = m_buffer.indexOf('\n')) >= 0) {
+            m_received.append(QJsonDocument::fromJson(m_buffer.left(pos)).object());
+            m_buffer.remove(0, pos + 1);
+        }
+        for (int i = 0; i < m_received.size(); ++i) {
+            if (Json::type(m_received[i]) == type) {
+                found = m_received.takeAt(i);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    QTcpSocket m_socket;
+    QByteArray m_buffer;
+    QList<QJsonObject> m_received;
+};
+
+}
+
+// Каждый тест идет на каждом backend, собранном для этой ОС: сервер
+// не должен замечать, через какой транспорт пришли байты
+class tst_Backend : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase_data();
+    void initTestCase();
+    void registerDrawGuess();
+    void partialReads();
+    void peerCloseWithUnreadData();
+    void writeBackpressure();
+};
+
+void tst_Backend::initTestCase_data()
+{
+    QTest::addColumn<QString>("backend");
+    for (const QString &name : ConnectionBackend::available()) {
+        QTest::newRow(qPrintable(name)) << name;
+    }
+}
+
+void tst_Backend::initTestCase()
+{
+    QVERIFY(ConnectionBackend::available().contains("qt"));
+#ifdef Q_OS_LINUX
+    QVERIFY(ConnectionBackend::available().contains("epoll"));
+#endif
+}
+
+void tst_Backend::registerDrawGuess()
+{
+    QFETCH_GLOBAL(QString, backend);
+    myserver server;
+    const quint16 port = freePort();
+    QVERIFY(server.startServer(port, backend));
+
+    Client first;
+    Client second;
+    QVERIFY(first.connectTo(port));
+    const int firstId = first.registerAs("First");
+    QVERIFY(firstId >= 0);
+    QVERIFY(second.connectTo(port));
+    const int secondId = second.registerAs("Second");
+    QVERIFY(secondId >= 0);
+    QVERIFY(firstId != secondId);
+
+    // Второй игрок запускает игру
+    RoundStart start;
+    QVERIFY(Json::decode(first.waitFor(MessageType::RoundStart), start));
+    QVERIFY(start.drawer == firstId || start.drawer == secondId);
+    QVERIFY(!second.waitFor(MessageType::RoundStart).isEmpty());
+    Client &drawer = start.drawer == firstId ? first : second;
+    Client &guesser = start.drawer == firstId ? second : first;
+    const int guesserId = start.drawer == firstId ? secondId : firstId;
+
+    YourTurn turn;
+    QVERIFY(Json::decode(drawer.waitFor(MessageType::YourTurn), turn));
+    QVERIFY(!turn.word.isEmpty());
+
+    DrawCommand stroke;
+    stroke.tool = Tool::Pencil;
+    stroke.action = DrawAction::Start;
+    stroke.x1 = 12;
+    stroke.y1 = 34;
+    stroke.width = 3;
+    stroke.color = 0xFF102030;
+    drawer.send(Json::encode(stroke));
+    DrawCommand received;
+    QVERIFY(Json::decode(guesser.waitFor(MessageType::Draw), received));
+    QCOMPARE(int(received.tool), int(stroke.tool));
+    QCOMPARE(int(received.action), int(stroke.action));
+    QCOMPARE(received.x1, stroke.x1);
+    QCOMPARE(received.y1, stroke.y1);
+    QCOMPARE(received.width, stroke.width);
+    QCOMPARE(received.color, stroke.color);
+
+    Guess guess;
+    guess.text = turn.word;
+    guesser.send(Json::encode(guess));
+    CorrectGuess correct;
+    QVERIFY(Json::decode(drawer.waitFor(MessageType::CorrectGuess), correct));
+    QCOMPARE(correct.guesser, guesserId);
+    QCOMPARE(correct.word, turn.word);
+    QVERIFY(!guesser.waitFor(MessageType::CorrectGuess).isEmpty());
+}
+
+void tst_Backend::partialReads()
+{
+    QFETCH_GLOBAL(QString, backend);
+    myserver server;
+    const quint16 port = freePort();
+    QVERIFY(server.startServer(port, backend));
+
+    Client client;
+    QVERIFY(client.connectTo(port));
+    client.sendByBytes(line(registerMessage("Slow")));
+    QVERIFY(!client.waitFor(MessageType::Registered).isEmpty());
+
+    // Две строки, граница записи - внутри второй: первая обрабатывается
+    // сразу, вторая ждет конца в буфере соединения
+    const QByteArray both = line(ping(1)) + line(ping(2));
+    const int cut = line(ping(1)).size() + 5;
+    client.sendRaw(both.left(cut));
+    Pong pong;
+    QVERIFY(Json::decode(client.waitFor(MessageType::Pong), pong));
+    QCOMPARE(pong.id, qint64(1));
+    client.sendByBytes(both.mid(cut));
+    QVERIFY(Json::decode(client.waitFor(MessageType::Pong), pong));
+    QCOMPARE(pong.id, qint64(2));
+    QCOMPARE(pong.time, qint64(2000));
+}
+
+void tst_Backend::peerCloseWithUnreadData()
+{
+    QFETCH_GLOBAL(QString, backend);
+    myserver server;
+    const quint16 port = freePort();
+    QVERIFY(server.startServer(port, backend));
+
+    Client watcher;
+    QVERIFY(watcher.connectTo(port));
+    QVERIFY(watcher.registerAs("Watcher") >= 0);
+
+    // Данные и FIN приходят серверу вместе: строки закрытого соединения
+    // все равно дочитываются, ответы уходят в закрытый сокет без падения
+    Client leaver;
+    QVERIFY(leaver.connectTo(port));
+    leaver.sendRaw(line(registerMessage("Leaver")) + line(ping(1)) + line(ping(2)));
+    leaver.socket().disconnectFromHost();
+
+    PlayerJoined joined;
+    QVERIFY(Json::decode(watcher.waitFor(MessageType::PlayerJoined), joined));
+    QCOMPARE(joined.name, QString("Leaver"));
+
+    // Сервер жив и обслуживает остальных
+    watcher.send(ping(3));
+    Pong pong;
+    QVERIFY(Json::decode(watcher.waitFor(MessageType::Pong), pong));
+    QCOMPARE(pong.id, qint64(3));
+}
+
+void tst_Backend::writeBackpressure()
+{
+    QFETCH_GLOBAL(QString, backend);
+    QScopedPointer<ConnectionBackend> server(ConnectionBackend::create(backend));
+    QVERIFY(!server.isNull());
+    const quint16 port = freePort();
+    QVERIFY(server->listen(port));
+
+    int connection = -1;
+    qint64 written = 0;
+    bool closed = false;
+    connect(server.data(), &ConnectionBackend::newConnection, [&](int id) { connection = id; });
+    connect(server.data(), &ConnectionBackend::bytesWritten, [&](int id, qint64 bytes) {
+        if (id == connection) written += bytes;
+    });
+    connect(server.data(), &ConnectionBackend::disconnected, [&](int id) {
+        if (id == connection) closed = true;
+    });
+
+    // Клиент пока не читает: его буфер, буферы ядра и очередь backend заполняются
+    QTcpSocket client;
+    client.setReadBufferSize(64 * 1024);
+    client.connectToHost(QHostAddress::LocalHost, port);
+    QTRY_VERIFY(connection >= 0);
+
+    // 32 МБ заведомо больше буферов ядра на loopback. Половина - через writeMany
+    const int chunkBytes = 1024 * 1024;
+    const int chunkCount = 32;
+    const qint64 total = qint64(chunkBytes) * chunkCount;
+    QByteArray chunk(chunkBytes, Qt::Uninitialized);
+    for (int i = 0; i < chunkBytes; ++i) chunk[i] = static_cast<char>(i % 251);
+    for (int i = 0; i < chunkCount; ++i) {
+        if (i % 2) server->writeMany({connection}, chunk);
+        else server->write(connection, chunk);
+    }
+
+    QTest::qWait(200);
+    QVERIFY2(written < total, qPrintable(QString("%1 of %2 bytes written to a peer that does not read")
+                                         .arg(written).arg(total)));
+    QVERIFY(!closed);
+
+    // Клиент читает все: байты целы и по порядку, очередь ушла до конца
+    client.setReadBufferSize(0);
+    qint64 received = 0;
+    qint64 firstBad = -1;
+    QTest::qWaitFor([&]() {
+        const QByteArray data = client.readAll();
+        for (char byte : data) {
+            if (firstBad < 0 && byte != static_cast<char>((received % chunkBytes) % 251)) firstBad = received;
+            ++received;
+        }
+        return received >= total;
+    }, 30000);
+    QCOMPARE(received, total);
+    QCOMPARE(firstBad, qint64(-1));
+    QTRY_COMPARE(written, total);
+    QVERIFY(!closed);
+}
+
+QTEST_GUILESS_MAIN(tst_Backend)
+
+#include "tst_backend.moc"
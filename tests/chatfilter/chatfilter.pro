@@ -0,0 +1,21 @@
+QT += core testlib
+QT -= gui
+
+CONFIG += c++17 console testcase
+CONFIG -= app_bundle
+
+TARGET = tst_chatfilter
+TEMPLATE = app
+
+# Фильтр чата сервера и свертка символов из GuessMatcher: без сети и протокола
+INCLUDEPATH += $$PWD/../../jsonserver
+DEPENDPATH += $$PWD/../../jsonserver
+
+SOURCES += \
+    $$PWD/../../jsonserver/chatfilter.cpp \
+    $$PWD/../../jsonserver/guessmatcher.cpp \
+    tst_chatfilter.cpp
+
+HEADERS += \
+    $$PWD/../../jsonserver/chatfilter.h \
+    $$PWD/../../jsonserver/guessmatcher.h
@@ -0,0 +1,133 @@
+#include <QtTest>
+#include "chatfilter.h"
+
+Q_DECLARE_METATYPE(ChatFilter::Verdict)
+
+class tst_ChatFilter : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void filter_data();
+    void filter();
+    void answerChanges();
+    void manySpans();
+};
+
+void tst_ChatFilter::filter_data()
+{
+    QTest::addColumn<QStringList>("blocklist");
+    QTest::addColumn<QString>("answer");
+    QTest::addColumn<QString>("text");
+    QTest::addColumn<ChatFilter::Verdict>("verdict");
+    QTest::addColumn<QString>("filtered");   // текст после фильтра
+
+    const QStringList blocklist = QStringList() << "дурак" << "болван" << "кот";
+
+    QTest::newRow("clean") << blocklist << "Яблоко"
+                           << "Это что-то круглое?" << ChatFilter::Clean << "Это что-то круглое?";
+    // Основа "яблок" ловит любое окончание и двойники букв
+    QTest::newRow("answer") << blocklist << "Яблоко"
+                            << "это яблоки" << ChatFilter::Withheld << "это яблоки";
+    QTest::newRow("answer with another ending") << blocklist << "Яблоко"
+                                                << "ЯБЛОКОМ!" << ChatFilter::Withheld << "ЯБЛОКОМ!";
+    QTest::newRow("answer with lookalikes") << blocklist << "Яблоко"
+                                            << "ябл0ки" << ChatFilter::Withheld << "ябл0ки";
+    QTest::newRow("answer inside a word") << blocklist << "Яблоко"
+                                          << "заяблоко" << ChatFilter::Clean << "заяблоко";
+    // Ответ важнее маски: сообщение не рассылается целиком
+    QTest::newRow("answer after a blocked word") << blocklist << "Яблоко"
+                                                 << "дурак, яблоко" << ChatFilter::Withheld << "дурак, яблоко";
+
+    QTest::newRow("blocked") << blocklist << ""
+                             << "ты дурак" << ChatFilter::Masked << "ты *****";
+    QTest::newRow("several blocked") << blocklist << ""
+                                     << "Дурак и болван, дурак!" << ChatFilter::Masked << "***** и ******, *****!";
+    QTest::newRow("blocked with lookalikes") << blocklist << ""
+                                             << "KOT" << ChatFilter::Masked << "***";
+    // С начала слова маскируется только сам образец
+    QTest::newRow("blocked word start") << blocklist << ""
+                                        << "котлета" << ChatFilter::Masked << "***лета";
+    QTest::newRow("blocked inside a word") << blocklist << ""
+                                           << "скоту, эдурак" << ChatFilter::Clean << "скоту, эдурак";
+    // Неудача на "с" не должна мешать образцу, который начинается со следующего слова
+    QTest::newRow("inside, then at start") << blocklist << ""
+                                           << "скот кот" << ChatFilter::Masked << "скот ***";
+
+    // Разделители схлопываются в пробел: образец из двух слов ловится через
+    // любой их набор, а сами знаки не маскируются
+    const QStringList phrase = QStringList() << "малыш йода";
+    QTest::newRow("across punctuation") << phrase << ""
+                                        << "Малыш...!!! Йода" << ChatFilter::Masked << "*****...!!! ****";
+    QTest::newRow("across punctuation and space") << phrase << ""
+                                                  << "малыш - - йода!" << ChatFilter::Masked << "***** - - ****!";
+    QTest::newRow("phrase split by a word") << phrase << ""
+                                            << "малыш и йода" << ChatFilter::Clean << "малыш и йода";
+
+    // Вложенные образцы дают один отрезок
+    QTest::newRow("overlapping patterns") << (QStringList() << "дура" << "дурак") << ""
+                                          << "дурак!" << ChatFilter::Masked << "*****!";
+
+    // Окно - 128 символов: совпадения далеко от начала и поперек его границы
+    const QString longPrefix = QString("ха ").repeated(80);
+    QTest::newRow("far from start") << blocklist << ""
+                                    << longPrefix + "дурак" << ChatFilter::Masked << longPrefix + "*****";
+    const QString wrapPrefix = QString(125, QChar(0x0445)) + "!!";
+    QTest::newRow("across window boundary") << blocklist << ""
+                                            << wrapPrefix + "дурак" << ChatFilter::Masked << wrapPrefix + "*****";
+    QTest::newRow("phrase across window boundary") << phrase << ""
+                                                   << wrapPrefix + "малыш, йода" << ChatFilter::Masked
+                                                   << wrapPrefix + "*****, ****";
+}
+
+void tst_ChatFilter::filter()
+{
+    QFETCH(QStringList, blocklist);
+    QFETCH(QString, answer);
+    QFETCH(QString, text);
+    QFETCH(ChatFilter::Verdict, verdict);
+    QFETCH(QString, filtered);
+
+    ChatFilter chatFilter;
+    chatFilter.setBlocklist(blocklist);
+    if (!answer.isEmpty()) chatFilter.setAnswer(answer, QStringList());
+    QCOMPARE(int(chatFilter.filter(text)), int(verdict));
+    QCOMPARE(text, filtered);
+}
+
+void tst_ChatFilter::answerChanges()
+{
+    ChatFilter chatFilter;
+    QString text = "яблоко";
+    QCOMPARE(int(chatFilter.filter(text)), int(ChatFilter::Clean));
+
+    // Варианты ответа тоже его выдают
+    chatFilter.setAnswer("Малыш Йода", QStringList() << "Йода");
+    text = "это йоды";
+    QCOMPARE(int(chatFilter.filter(text)), int(ChatFilter::Withheld));
+
+    chatFilter.setAnswer("Яблоко", QStringList());
+    text = "это йоды";
+    QCOMPARE(int(chatFilter.filter(text)), int(ChatFilter::Clean));
+    text = "яблоко";
+    QCOMPARE(int(chatFilter.filter(text)), int(ChatFilter::Withheld));
+
+    chatFilter.clearAnswer();
+    QCOMPARE(int(chatFilter.filter(text)), int(ChatFilter::Clean));
+    QCOMPARE(text, QString("яблоко"));
+}
+
+void tst_ChatFilter::manySpans()
+{
+    // Отрезков больше, чем мест под них: последний дотягивается до конца,
+    // ни одно совпадение не остается открытым
+    ChatFilter chatFilter;
+    chatFilter.setBlocklist(QStringList() << "дурак");
+    QString text = QString("дурак ").repeated(20);
+    QCOMPARE(int(chatFilter.filter(text)), int(ChatFilter::Masked));
+    QCOMPARE(text, QString("***** ").repeated(20));
+}
+
+QTEST_APPLESS_MAIN(tst_ChatFilter)
+
+#include "tst_chatfilter.moc"
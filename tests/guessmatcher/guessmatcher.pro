@@ -0,0 +1,19 @@
+QT += core testlib
+QT -= gui
+
+CONFIG += c++17 console testcase
+CONFIG -= app_bundle
+
+TARGET = tst_guessmatcher
+TEMPLATE = app
+
+# Проверка догадок сервера: ей не нужны ни сеть, ни протокол
+INCLUDEPATH += $$PWD/../../jsonserver
+DEPENDPATH += $$PWD/../../jsonserver
+
+SOURCES += \
+    $$PWD/../../jsonserver/guessmatcher.cpp \
+    tst_guessmatcher.cpp
+
+HEADERS += \
+    $$PWD/../../jsonserver/guessmatcher.h
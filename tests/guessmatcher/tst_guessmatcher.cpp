@@ -0,0 +1,159 @@
+#include <QtTest>
+#include <QRandomGenerator>
+#include "guessmatcher.h"
+
+Q_DECLARE_METATYPE(GuessMatcher::Result)
+
+namespace {
+
+// Обычное расстояние Левенштейна по всей матрице: эталон для битового Майерса
+int editDistance(const QString &a, const QString &b)
+{
+    QVector<int> row(b.size() + 1);
+    for (int j = 0; j <= b.size(); ++j) row[j] = j;
+    for (int i = 1; i <= a.size(); ++i) {
+        int diagonal = row[0];
+        row[0] = i;
+        for (int j = 1; j <= b.size(); ++j) {
+            const int above = row[j];
+            row[j] = qMin(qMin(row[j] + 1, row[j - 1] + 1), diagonal + (a[i - 1] == b[j - 1] ? 0 : 1));
+            diagonal = above;
+        }
+    }
+    return row[b.size()];
+}
+
+GuessMatcher::Result expected(const QString &word, const QString &guess)
+{
+    const int distance = editDistance(word, guess);
+    if (distance == 0) return GuessMatcher::Exact;
+    return distance <= GuessMatcher::closeDistance(word.size()) ? GuessMatcher::Close : GuessMatcher::Miss;
+}
+
+// Кириллица без двойников и без ё: нормализация ничего в этих словах не меняет
+const QString Alphabet = QString("абвгд");
+
+QString randomWord(QRandomGenerator &random, int length)
+{
+    QString word;
+    for (int i = 0; i < length; ++i) word += Alphabet[random.bounded(Alphabet.size())];
+    return word;
+}
+
+QString randomEdit(QRandomGenerator &random, QString word)
+{
+    const QChar c = Alphabet[random.bounded(Alphabet.size())];
+    switch (word.isEmpty() ? 0 : random.bounded(3)) {
+    case 0: word.insert(random.bounded(word.size() + 1), c); break;
+    case 1: word.remove(random.bounded(word.size()), 1); break;
+    default: word[random.bounded(word.size())] = c; break;
+    }
+    return word;
+}
+
+}
+
+class tst_GuessMatcher : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void match_data();
+    void match();
+    void aliases();
+    void longWord();
+    void againstEditDistance();
+};
+
+void tst_GuessMatcher::match_data()
+{
+    QTest::addColumn<QString>("word");
+    QTest::addColumn<QString>("guess");
+    QTest::addColumn<GuessMatcher::Result>("result");
+
+    QTest::newRow("exact") << "Яблоко" << "яблоко" << GuessMatcher::Exact;
+    QTest::newRow("case and punctuation") << "Малыш Йода" << "  МАЛЫШ,  йода!" << GuessMatcher::Exact;
+    QTest::newRow("one substitution") << "Яблоко" << "яблако" << GuessMatcher::Close;
+    QTest::newRow("one deletion") << "Яблоко" << "яблок" << GuessMatcher::Close;
+    // До семи букв - одна опечатка, дальше две
+    QTest::newRow("two edits, short word") << "Яблоко" << "ябако" << GuessMatcher::Miss;
+    QTest::newRow("two edits, long word") << "Программист" << "прогрмаист" << GuessMatcher::Close;
+    QTest::newRow("three edits, long word") << "Программист" << "прагрмаист" << GuessMatcher::Miss;
+    // Короткие слова - только точно: "кит" не подсказывает "кот"
+    QTest::newRow("short word cutoff") << "Кот" << "кит" << GuessMatcher::Miss;
+    QTest::newRow("length cutoff") << "Слон" << "слонопотам" << GuessMatcher::Miss;
+    QTest::newRow("digit lookalike") << "Яблоко" << "ябл0ко" << GuessMatcher::Exact;
+    QTest::newRow("latin lookalikes") << "Крокодил" << "KPOKOДИЛ" << GuessMatcher::Exact;
+    // В латинском слове 0 - не буква: это опечатка, а не двойник
+    QTest::newRow("digit in latin word") << "Robot" << "r0bot" << GuessMatcher::Close;
+    QTest::newRow("yo as ye") << "Ёжик" << "ежик" << GuessMatcher::Exact;
+    QTest::newRow("ye as yo") << "Ежик" << "ёжик" << GuessMatcher::Exact;
+    QTest::newRow("decomposed yo") << "Ёжик" << QString::fromUtf8("е\xcc\x88жик") << GuessMatcher::Exact;
+    QTest::newRow("stress mark") << "Яблоко" << QString::fromUtf8("я\xcc\x81блоко") << GuessMatcher::Exact;
+    QTest::newRow("empty guess") << "Яблоко" << "" << GuessMatcher::Miss;
+    QTest::newRow("only punctuation") << "Яблоко" << "?!" << GuessMatcher::Miss;
+}
+
+void tst_GuessMatcher::match()
+{
+    QFETCH(QString, word);
+    QFETCH(QString, guess);
+    QFETCH(GuessMatcher::Result, result);
+
+    GuessMatcher matcher;
+    matcher.setWord(word);
+    QCOMPARE(int(matcher.match(guess)), int(result));
+}
+
+void tst_GuessMatcher::aliases()
+{
+    GuessMatcher matcher;
+    matcher.setWord("Малыш Йода", QStringList() << "Йода");
+    QCOMPARE(int(matcher.match("йода")), int(GuessMatcher::Exact));
+    QCOMPARE(int(matcher.match("малыш йда")), int(GuessMatcher::Close));
+    QCOMPARE(int(matcher.match("люк")), int(GuessMatcher::Miss));
+
+    matcher.clear();
+    QVERIFY(matcher.isEmpty());
+    QCOMPARE(int(matcher.match("йода")), int(GuessMatcher::Miss));
+}
+
+void tst_GuessMatcher::longWord()
+{
+    // Слово в MaxLength символов - последний бит битового вектора
+    const QString longest = QString("аб").repeated(GuessMatcher::MaxLength / 2);
+    GuessMatcher matcher;
+    matcher.setWord(longest);
+    QCOMPARE(int(matcher.match(longest)), int(GuessMatcher::Exact));
+    QCOMPARE(int(matcher.match(longest + "вв")), int(GuessMatcher::Close));
+    QCOMPARE(int(matcher.match(longest + "ввв")), int(GuessMatcher::Miss));
+
+    // Длиннее MaxLength - пропускается целиком
+    matcher.setWord(longest + "в");
+    QVERIFY(matcher.isEmpty());
+    QCOMPARE(int(matcher.match(longest + "в")), int(GuessMatcher::Miss));
+}
+
+void tst_GuessMatcher::againstEditDistance()
+{
+    QRandomGenerator random(20240601);
+    GuessMatcher matcher;
+    for (int round = 0; round < 2000; ++round) {
+        const QString word = randomWord(random, 1 + random.bounded(GuessMatcher::MaxLength));
+        matcher.setWord(word);
+        // Мелкие правки проверяют порог, случайные слова - промахи
+        QString guess = word;
+        const int edits = random.bounded(5);
+        for (int i = 0; i < edits; ++i) guess = randomEdit(random, guess);
+        if (random.bounded(4) == 0) guess = randomWord(random, 1 + random.bounded(GuessMatcher::MaxLength));
+
+        const GuessMatcher::Result result = matcher.match(guess);
+        QVERIFY2(result == expected(word, guess),
+                 qPrintable(QString("%1 / %2: distance %3, match %4")
+                            .arg(word, guess).arg(editDistance(word, guess)).arg(int(result))));
+    }
+}
+
+QTEST_APPLESS_MAIN(tst_GuessMatcher)
+
+#include "tst_guessmatcher.moc"
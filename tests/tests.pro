@@ -0,0 +1,8 @@
+# Автотесты: make check из корня собирает и запускает все
+TEMPLATE = subdirs
+
+SUBDIRS += \
+    protocol \
+    backend \
+    guessmatcher \
+    chatfilter